@@ -4,6 +4,8 @@
 #include "hayMaker/AnariDeviceRenderer.h"
 #include "hayMaker/HayMaker.h"
 #include "hayStack/ColorMap.h"
+#include "hayStack/Tracing.h"
+#include <set>
 
 namespace hm {
   using namespace hs;
@@ -30,12 +32,17 @@ namespace hm {
 
     anari.device = 0;
 #if HS_MPI
-    if (hayMaker->world.size > 1) {
+    // (if hayMaker composites, or renders sort-first, every rank's
+    // device is on its own)
+    if (hayMaker->world.size > 1 &&
+        !hayMaker->ownCompositing && !hayMaker->sortFirst) {
       std::cout << "#hm: compiled with MPI support and running in MPI mode: trying to load anari mpi device" << std::endl;
       anari.device = anari::newDevice(hayMaker->library, "mpi");//"default");
       if (!anari.device) {
-        std::cout << "#hm: could not create ANARI 'mpi' device subtype... !?" << std::endl;
+        std::cout << "#hm: could not create ANARI 'mpi' device subtype... !?"
+                  << " - compositing on the hayStack side instead" << std::endl;
       }
+      distributed = anari.device != 0;
     }
 #endif
     if (!anari.device)
@@ -93,24 +100,30 @@ namespace hm {
     }
     anari::commitParameters(anari.device, anari.renderer);
 
-    anari.frame = anari::newObject<anari::Frame>(anari.device);
-    anari::setParameter(anari.device, anari.frame, "world",    anari.world);
-    anari::setParameter(anari.device, anari.frame, "renderer", anari.renderer);
-    anari::setParameter(anari.device, anari.frame, "denoise",  (bool)true);
-
     anari.camera = anari::newObject<anari::Camera>(anari.device, "perspective");
 
-    anari::setParameter(anari.device, anari.frame, "camera",   anari.camera);
-    anari::commitParameters(anari.device, anari.frame);
+    // with double buffering we use two frames that share world,
+    // renderer, and camera, and get rendered into alternately
+    anari.numFrames
+      = hayMaker->globalRenderSettings.doubleBufferedFrames ? 2 : 1;
+    for (int i=0;i<anari.numFrames;i++) {
+      anari::Frame frame = anari::newObject<anari::Frame>(anari.device);
+      anari::setParameter(anari.device, frame, "world",    anari.world);
+      anari::setParameter(anari.device, frame, "renderer", anari.renderer);
+      anari::setParameter(anari.device, frame, "denoise",  (bool)true);
+      anari::setParameter(anari.device, frame, "camera",   anari.camera);
+      anari::commitParameters(anari.device, frame);
+      anari.frames[i] = frame;
+    }
   }
   
-  void AnariDeviceRenderer::renderFrame()
+  void AnariDeviceRenderer::renderFrame(int whichFrame)
   {
     if (dirty) {
       applyTransferFunction(currentXF);
       dirty = false;
     }
-    anari::render(anari.device, anari.frame);
+    anari::render(anari.device, anari.frames[whichFrame]);
   }
 
   void AnariDeviceRenderer
@@ -285,6 +298,28 @@ namespace hm {
                         "direction", (const anari::math::float3&)camera_dir);
     anari::setParameter(anari.device, anari.camera,
                         "up",        (const anari::math::float3&)camera.vu);
+    anari::setParameter(anari.device, anari.camera,
+                        "imageRegion", ANARI_FLOAT32_BOX2, &imageRegion);
+    anari::commitParameters(anari.device, anari.camera);
+  }
+
+  void AnariDeviceRenderer::setTransparentBackground()
+  {
+    const vec4f transparent(0.f);
+    anari::setParameter(anari.device, anari.renderer, "background",
+                        (const anari::math::float4 &)transparent);
+    anari::commitParameters(anari.device, anari.renderer);
+  }
+
+  void AnariDeviceRenderer::setImageRegion(const vec2i &fullSize,
+                                           const box2f &region)
+  {
+    fbSize      = fullSize;
+    imageRegion = region;
+    anari::setParameter(anari.device, anari.camera,
+                        "aspect",    fbSize.x / (float)fbSize.y);
+    anari::setParameter(anari.device, anari.camera,
+                        "imageRegion", ANARI_FLOAT32_BOX2, &imageRegion);
     anari::commitParameters(anari.device, anari.camera);
   }
   
@@ -302,31 +337,40 @@ namespace hm {
     // stored in mini::Scene'
     // -----------------------------------------------------------------
     auto &myData = *myPartition;
-    for (auto miniScene : myData.minis)
+    for (auto miniScene : myData.minis) {
+      HS_TRACE_SCOPE("create","miniScene");
       renderMiniScene(miniScene);
+    }
     
     // ------------------------------------------------------------------
     // render all spheres
     // -----------------------------------------------------------------
-    for (auto content : myData.sphereSets)
+    for (auto content : myData.sphereSets) {
+      HS_TRACE_SCOPE("create","spheres");
       for (auto created : create(*content))
         rootGeoms.push_back(created);
+    }
     
-    for (auto content : myData.capsuleSets)
+    for (auto content : myData.capsuleSets) {
+      HS_TRACE_SCOPE("create","capsules");
       for (auto created : create(*content))
         rootGeoms.push_back(created);
+    }
     
     // ------------------------------------------------------------------
     // render all cylinders
     // -----------------------------------------------------------------
-    for (auto content : myData.cylinderSets)
+    for (auto content : myData.cylinderSets) {
+      HS_TRACE_SCOPE("create","cylinders");
       for (auto created : create(*content))
         rootGeoms.push_back(created);
+    }
     
     // ------------------------------------------------------------------
     // render all individual meshes
     // -----------------------------------------------------------------
     for (auto content : myData.triangleMeshes) {
+      HS_TRACE_SCOPE("create","triangles");
       auto created = create(*content);
       auto meshGroup = createGroup(created,{});
       rootInstances.groups.push_back(meshGroup);
@@ -338,23 +382,26 @@ namespace hm {
     // render all structured volumes
     // -----------------------------------------------------------------
     for (auto vol : myData.structuredVolumes) {
+      HS_TRACE_SCOPE("create","structuredVolume");
       anari::Volume createdVolume = create(*vol);
       if (createdVolume)
         rootVolumes.push_back(createdVolume);
     }
-#if HS_USE_MULTI_SCATTERING
     for (auto vol : myData.nanovdbVolumes) {
+      HS_TRACE_SCOPE("create","nanovdbVolume");
       anari::Volume createdVolume = create(*vol);
-      if (createdVolume) {
-        rootVolumes.push_back(createdVolume);
+      if (!createdVolume) continue;
+      rootVolumes.push_back(createdVolume);
+#if HS_USE_MULTI_SCATTERING
+      if (vol->densityVolume)
         principledScatterByVolume[createdVolume] = vol->scatter;
-      }
-    }
 #endif
+    }
     // ------------------------------------------------------------------
     // render all *UN*-structured volumes
     // -----------------------------------------------------------------
     for (auto vol : myData.unsts) {
+      HS_TRACE_SCOPE("create","umesh");
       anari::Volume createdVolume = create(vol);
       if (createdVolume)
         rootVolumes.push_back(createdVolume);
@@ -363,6 +410,7 @@ namespace hm {
     // render all *AMR* volumes
     // -----------------------------------------------------------------
     for (auto vol : myData.amr) {
+      HS_TRACE_SCOPE("create","amr");
       anari::Volume createdVolume = create(*vol);
       if (createdVolume)
         rootVolumes.push_back(createdVolume);
@@ -404,6 +452,40 @@ namespace hm {
     setInstances(rootInstances.groups,rootInstances.xfms);
   }
 
+  void AnariDeviceRenderer::rebuildWorld()
+  {
+    auto device = anari.device;
+    for (auto geom : rootGeoms)
+      anari::release(device,geom);
+    for (auto vol : rootVolumes)
+      anari::release(device,vol);
+    // instanced mini objects appear more than once
+    std::set<anari::Group> groups(rootInstances.groups.begin(),
+                                  rootInstances.groups.end());
+    for (auto group : groups)
+      anari::release(device,group);
+    for (auto light : lights)
+      anari::release(device,light);
+    for (auto &mrv : multiResVolumes) {
+      anari::release(device,mrv.fullRes);
+      anari::release(device,mrv.coarse);
+    }
+    if (!lights.empty())
+      anari::unsetParameter(device,anari.world,"light");
+    
+    rootGeoms.clear();
+    rootVolumes.clear();
+    rootInstances.groups.clear();
+    rootInstances.xfms.clear();
+    lights.clear();
+    multiResVolumes.clear();
+    principledScatterByVolume.clear();
+    rootGroup   = 0;
+    volumeGroup = 0;
+
+    renderInitialAnariWorld();
+  }
+
   void AnariDeviceRenderer
   ::setInstances(const std::vector<anari::Group> &groups,
                  const std::vector<affine3f> &xfms)
@@ -447,6 +529,7 @@ namespace hm {
        "instance",
        anari::newArray1D(anari.device,
                          instances.data(),instances.size()));
+    HS_TRACE_SCOPE("commit","world");
     anari::commitParameters(anari.device, anari.world);    
   }
 
@@ -688,7 +771,7 @@ namespace hm {
     lights.push_back(light);
   }
 
-  anari::Volume AnariDeviceRenderer::create(const StructuredVolume &vol)
+  anari::SpatialField AnariDeviceRenderer::createField(const StructuredVolume &vol)
   {
     anari::math::int3 volumeDims = (const anari::math::int3&)vol.dims;
       
@@ -700,17 +783,18 @@ namespace hm {
                         (const anari::math::float3&)vol.gridSpacing);
     if (vol.texelFormat == "float") {
       anari::setParameterArray3D
-        (anari.device, field, "data", (const float *)vol.rawData.data(),
+        (anari.device, field, "data", (const float *)vol.voxels(),
          volumeDims.x, volumeDims.y, volumeDims.z);
     } else if (vol.texelFormat == "uint8_t") {
       anari::setParameterArray3D
-        (anari.device, field, "data", (const uint8_t *)vol.rawData.data(),
+        (anari.device, field, "data", (const uint8_t *)vol.voxels(),
          volumeDims.x, volumeDims.y, volumeDims.z);
     } else if (vol.texelFormat == "uint16_t") {
       std::cout << "volume with uint16s, converting to float" << std::endl;
-      static std::vector<float> volumeAsFloats(vol.rawData.size()/2);
+      // setParameterArray3D() copies, so this can be temporary
+      std::vector<float> volumeAsFloats(vol.voxelBytes()/2);
       for (size_t i=0;i<volumeAsFloats.size();i++)
-        volumeAsFloats[i] = ((uint16_t*)vol.rawData.data())[i]
+        volumeAsFloats[i] = ((const uint16_t*)vol.voxels())[i]
           * (1.f/((1<<16)-1));
       anari::setParameterArray3D
         (anari.device, field, "data", (const float *)volumeAsFloats.data(),
@@ -721,16 +805,73 @@ namespace hm {
     }
         
     anari::commitParameters(anari.device, field);
-
+    return field;
+  }
+  
+  anari::Volume AnariDeviceRenderer::create(const StructuredVolume &vol)
+  {
+    auto field = createField(vol);
     auto volume = anari::newObject<anari::Volume>
       (anari.device, "transferFunction1D");
-    anari::setAndReleaseParameter(anari.device, volume,
-                                  "value", field);
+    if (vol.coarserLevels.empty()) {
+      anari::setAndReleaseParameter(anari.device, volume,
+                                    "value", field);
+    } else {
+      // keep both fields around, so setInteractive() can swap them
+      MultiResVolume mrv;
+      mrv.volume  = volume;
+      mrv.fullRes = field;
+      mrv.coarse  = createField(*vol.coarserLevels.back());
+      anari::setParameter(anari.device, volume, "value",
+                          interactive ? mrv.coarse : mrv.fullRes);
+      multiResVolumes.push_back(mrv);
+    }
     anari::commitParameters(anari.device, volume);
 
     return volume;
   }
 
+  void AnariDeviceRenderer::setInteractive(bool interactive)
+  {
+    if (interactive == this->interactive)
+      return;
+    this->interactive = interactive;
+    for (auto &mrv : multiResVolumes) {
+      anari::setParameter(anari.device, mrv.volume, "value",
+                          interactive ? mrv.coarse : mrv.fullRes);
+      anari::commitParameters(anari.device, mrv.volume);
+    }
+  }
+
+  anari::Volume AnariDeviceRenderer::create(const hs::NanoVDBVolume &vol)
+  {
+    auto field = anari::newObject<anari::SpatialField>
+      (anari.device, "nanovdb");
+    anari::setParameterArray1D
+      (anari.device, field, "data", (const uint8_t *)vol.data.data(),
+       vol.data.size());
+    anari::commitParameters(anari.device, field);
+
+#if HS_USE_MULTI_SCATTERING
+    if (vol.densityVolume) {
+      auto volume = anari::newObject<anari::Volume>
+        (anari.device, "principled_volume");
+      anari::setAndReleaseParameter(anari.device, volume, "value", field);
+      applyPrincipledScatterParams(volume, vol.scatter);
+      applyDefaultPrincipledTransferFunction(volume);
+      anari::commitParameters(anari.device, volume);
+      return volume;
+    }
+#endif
+    // plain scalar field; gets colored through the transfer function
+    // just like any structured volume
+    auto volume = anari::newObject<anari::Volume>
+      (anari.device, "transferFunction1D");
+    anari::setAndReleaseParameter(anari.device, volume, "value", field);
+    anari::commitParameters(anari.device, volume);
+    return volume;
+  }
+
   void AnariDeviceRenderer
   ::createDefaultColorMapper(const range1f &inputRange,
                                      const std::vector<vec4f> &colorMap)
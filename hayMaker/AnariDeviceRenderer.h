@@ -30,7 +30,13 @@ namespace hm {
                         HayMaker     *hayMaker,
                         OnePartition *myPartition);
     void renderInitialAnariWorld();    
-    void renderFrame();
+    /*! releases everything renderInitialAnariWorld() created, and
+        creates it again from the (changed) partition; eg, for the
+        next time step of in-situ data */
+    void rebuildWorld();
+    /*! launches rendering into the given one of our (one or two)
+        frames; this does not wait for the frame to complete */
+    void renderFrame(int whichFrame = 0);
 
     struct {
       std::vector<affine3f>     xfms;
@@ -50,6 +56,30 @@ namespace hm {
     OnePartition *const myPartition;
     
     void setCamera(const hs::Camera &camera);
+
+    /*! sets the size of the whole image (for the camera's aspect
+        ratio), and which part of it - in normalized coordinates -
+        this device's frame(s) show */
+    void setImageRegion(const vec2i &fullSize, const box2f &region);
+
+    /*! renders onto (0,0,0,0) instead of the background; for when
+        the background gets added after compositing */
+    void setTransparentBackground();
+
+    /*! switch all structured volumes that have a coarser level to
+        that level (interactive=true), or back to full resolution */
+    void setInteractive(bool interactive);
+    
+    /*! a structured volume that has a coarser (pre-filtered) level
+        in addition to its full-res data; its volume's 'value' is one
+        of the two fields, depending on 'interactive' */
+    struct MultiResVolume {
+      anari::Volume       volume;
+      anari::SpatialField fullRes;
+      anari::SpatialField coarse;
+    };
+    std::vector<MultiResVolume> multiResVolumes;
+    bool interactive = false;
     
     void setTransferFunction(const TransferFunction &xf);
       
@@ -87,6 +117,7 @@ namespace hm {
     
     anari::Group createGroup(const std::vector<anari::Surface> &geoms,
                              const std::vector<anari::Volume>  &volumes);
+    anari::SpatialField createField(const hs::StructuredVolume &vol);
     anari::Volume create(const hs::StructuredVolume &vol);
     anari::Volume create(const hs::NanoVDBVolume &vol);
     anari::Volume create(const hs::TAMRVolume &input);
@@ -144,13 +175,23 @@ namespace hm {
                    const std::vector<anari::Light> &lights);
 
     bool dirty = true;
+    /*! whether our device is barney's 'mpi' one, which composites
+        all ranks' data itself */
+    bool distributed = false;
+    /*! size of the whole image, which may be more than the frame's
+        if the frame is only a part of it (see imageRegion) */
     vec2i fbSize { -1,-1 };
+    box2f imageRegion { vec2f(0.f), vec2f(1.f) };
 
     struct {
       anari::Device device;
       anari::World  world;
       anari::Renderer renderer;
-      anari::Frame    frame;
+      /*! the frame(s) we render into - two if double buffered, else
+          one. all frames share the same world, renderer, and
+          camera */
+      anari::Frame    frames[2] = { 0, 0 };
+      int             numFrames = 1;
       anari::Camera   camera;
     } anari;
   };
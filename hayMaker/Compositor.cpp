@@ -0,0 +1,241 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayMaker/Compositor.h"
+#include "hayMaker/common.h"
+#include "hayStack/Tracing.h"
+#include <numeric>
+#include <iomanip>
+
+namespace hm {
+
+  namespace {
+    /*! premultiplied 'front over back' */
+    inline vec4f over(const vec4f &front, const vec4f &back)
+    {
+      const float t = 1.f-front.w;
+      return vec4f(front.x+t*back.x,
+                   front.y+t*back.y,
+                   front.z+t*back.z,
+                   front.w+t*back.w);
+    }
+  }
+
+  Compositor::Compositor(Comm &comm)
+    : comm(comm)
+  {}
+
+  void Compositor::blend(vec4f *myColor, float *myDepth,
+                         const vec4f *otherColor, const float *otherDepth,
+                         bool mineInFront, int numPixels)
+  {
+    for (int i=0;i<numPixels;i++) {
+      bool myFront = mineInFront;
+      if (myDepth) {
+        if (std::isfinite(myDepth[i]) && std::isfinite(otherDepth[i]))
+          myFront = myDepth[i] <= otherDepth[i];
+        myDepth[i] = std::min(myDepth[i],otherDepth[i]);
+      }
+      myColor[i]
+        = myFront
+        ? over(myColor[i],otherColor[i])
+        : over(otherColor[i],myColor[i]);
+    }
+  }
+
+  void Compositor::composite(const vec2i &fbSize,
+                             const vec4f *color,
+                             const float *depth,
+                             float        visibilityKey,
+                             const vec4f &bgBottom,
+                             const vec4f &bgTop,
+                             uint32_t    *finalRGBA)
+  {
+    HS_TRACE_SCOPE("composite");
+    const int  numPixels = fbSize.x*fbSize.y;
+    const bool haveDepth = depth != nullptr;
+    this->color.resize(numPixels);
+    for (int i=0;i<numPixels;i++) {
+      const vec4f c = color[i];
+      this->color[i]
+        = colorIsPremultiplied
+        ? c
+        : vec4f(c.w*c.x,c.w*c.y,c.w*c.z,c.w);
+    }
+    if (haveDepth)
+      this->depth.assign(depth,depth+numPixels);
+
+    // all ranks, front to back
+    std::vector<float> keys(comm.size);
+    comm.allGather(keys.data(),visibilityKey);
+    std::vector<int> order(comm.size);
+    std::iota(order.begin(),order.end(),0);
+    std::stable_sort(order.begin(),order.end(),
+                     [&](int a, int b) { return keys[a] < keys[b]; });
+    const int myPos
+      = int(std::find(order.begin(),order.end(),comm.rank)-order.begin());
+
+    // binary swap works on a power of two; the first 2*numFolded
+    // ranks (in order) pair up first, so the ones that are left
+    // are still contiguous in the order
+    int numParticipants = 1;
+    while (2*numParticipants <= comm.size)
+      numParticipants *= 2;
+    const int numFolded = comm.size-numParticipants;
+    auto rankOf = [&](int participant) {
+      return order[participant < numFolded
+                   ? 2*participant
+                   : participant+numFolded];
+    };
+    int numStages = 2;
+    for (int bit=1;bit<numParticipants;bit+=bit)
+      numStages++;
+    if ((int)stageTimes.size() != numStages) {
+      stageTimes.assign(numStages,0.);
+      stageBytes.assign(numStages,0);
+      numFramesSinceReport = 0;
+    }
+
+    // sends [sendBegin,+sendCount) of ours to 'partner', and
+    // receives its pixels of the range we keep
+    auto exchange = [&](int partner, int sendBegin, int sendCount,
+                        int recvCount, int stage) {
+      MPI_Request requests[4];
+      int numRequests = 0;
+      recvColor.resize(recvCount);
+      if (recvCount)
+        comm.recv(partner,0,recvColor.data(),recvCount,requests[numRequests++]);
+      if (sendCount)
+        comm.send(partner,0,this->color.data()+sendBegin,sendCount,
+                  requests[numRequests++]);
+      if (haveDepth) {
+        recvDepth.resize(recvCount);
+        if (recvCount)
+          comm.recv(partner,1,recvDepth.data(),recvCount,requests[numRequests++]);
+        if (sendCount)
+          comm.send(partner,1,this->depth.data()+sendBegin,sendCount,
+                    requests[numRequests++]);
+      }
+      for (int i=0;i<numRequests;i++)
+        comm.wait(requests[i]);
+      stageBytes[stage]
+        += size_t(sendCount)*(sizeof(vec4f)+(haveDepth ? sizeof(float) : 0));
+    };
+    auto endStage = [&](int stage, double t0) {
+      double t1 = getCurrentTime();
+      stageTimes[stage] += t1-t0;
+      hs::trace::record("compositeStage",std::to_string(stage),t0,t1);
+    };
+
+    int stage = 0;
+    double t0 = getCurrentTime();
+    int participant = -1;
+    int begin = 0, end = numPixels;
+    if (myPos < 2*numFolded) {
+      if (myPos & 1)
+        exchange(order[myPos-1],0,numPixels,0,stage);
+      else {
+        exchange(order[myPos+1],0,0,numPixels,stage);
+        blend(this->color.data(),haveDepth ? this->depth.data() : nullptr,
+              recvColor.data(),recvDepth.data(),true,numPixels);
+        participant = myPos/2;
+      }
+    } else
+      participant = myPos-numFolded;
+    endStage(stage++,t0);
+
+    for (int bit=1;bit<numParticipants;bit+=bit) {
+      t0 = getCurrentTime();
+      if (participant >= 0) {
+        // the lower half of the order is in front, and keeps the
+        // first half of the pixels
+        const bool lower = !(participant & bit);
+        const int  mid   = begin+(end-begin)/2;
+        const int  keepBegin = lower ? begin : mid;
+        const int  keepEnd   = lower ? mid   : end;
+        const int  sendBegin = lower ? mid   : begin;
+        const int  sendEnd   = lower ? end   : mid;
+        exchange(rankOf(participant ^ bit),sendBegin,sendEnd-sendBegin,
+                 keepEnd-keepBegin,stage);
+        blend(this->color.data()+keepBegin,
+              haveDepth ? this->depth.data()+keepBegin : nullptr,
+              recvColor.data(),recvDepth.data(),lower,keepEnd-keepBegin);
+        begin = keepBegin;
+        end   = keepEnd;
+      }
+      endStage(stage++,t0);
+    }
+
+    // every participant now has the final pixels of its range; get
+    // those to rank 0 (whose own range already is in place)
+    t0 = getCurrentTime();
+    int myRange[2] = { 0, 0 };
+    if (participant >= 0) {
+      myRange[0] = begin;
+      myRange[1] = end;
+    }
+    if (comm.rank == 0) {
+      std::vector<int> ranges(2*comm.size);
+      comm.masterGather(ranges.data(),myRange,2);
+      std::vector<MPI_Request> requests;
+      for (int r=1;r<comm.size;r++) {
+        int count = ranges[2*r+1]-ranges[2*r];
+        if (count == 0) continue;
+        requests.push_back(MPI_Request());
+        comm.recv(r,2,this->color.data()+ranges[2*r],count,requests.back());
+      }
+      for (auto &request : requests)
+        comm.wait(request);
+    } else {
+      comm.masterGather(myRange,2);
+      if (end > begin && participant >= 0) {
+        MPI_Request request;
+        comm.send(0,2,this->color.data()+begin,end-begin,request);
+        comm.wait(request);
+        stageBytes[stage] += size_t(end-begin)*sizeof(vec4f);
+      }
+    }
+    endStage(stage++,t0);
+
+    if (comm.rank == 0) {
+      for (int iy=0;iy<fbSize.y;iy++) {
+        const float t = (iy+.5f)/fbSize.y;
+        const vec4f bg((1.f-t)*bgBottom.x+t*bgTop.x,
+                       (1.f-t)*bgBottom.y+t*bgTop.y,
+                       (1.f-t)*bgBottom.z+t*bgTop.z,
+                       (1.f-t)*bgBottom.w+t*bgTop.w);
+        for (int ix=0;ix<fbSize.x;ix++) {
+          const int i = ix+fbSize.x*iy;
+          finalRGBA[i] = packSRGB8(over(this->color[i],bg));
+        }
+      }
+    }
+
+    if (reportInterval > 0 && ++numFramesSinceReport == reportInterval)
+      report();
+  }
+
+  void Compositor::report()
+  {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "#hs.comp: " << comm.size << " rank(s), avg per frame (max over ranks):";
+    const int numStages = (int)stageTimes.size();
+    for (int s=0;s<numStages;s++) {
+      float time  = comm.allReduceMax(float(stageTimes[s]/numFramesSinceReport));
+      float bytes = comm.allReduceMax(float(stageBytes[s])/numFramesSinceReport);
+      ss << " "
+         << (s == 0 ? std::string("fold")
+             : (s == numStages-1 ? std::string("gather")
+                : "swap#"+std::to_string(s)))
+         << " " << 1000.f*time << "ms/"
+         << prettyNumber(size_t(bytes)) << "B";
+    }
+    if (comm.rank == 0)
+      std::cout << ss.str() << std::endl;
+    stageTimes.assign(numStages,0.);
+    stageBytes.assign(numStages,0);
+    numFramesSinceReport = 0;
+  }
+
+}
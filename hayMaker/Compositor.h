@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/MPIWrappers.h"
+
+namespace hm {
+  using namespace hs;
+  using hs::mpi::Comm;
+
+  /*! sort-last compositing on the hayStack side, for anari devices
+      that only ever render their own rank's data (ie, anything but
+      barney's 'mpi' device). every rank of the comm has rendered a
+      different data group, with a transparent background, into
+      linear rgba (and optionally depth); this premultiplies those
+      by alpha (see colorIsPremultiplied), and blends them - with
+      binary swap, over the ranks in front-to-back order of their
+      data - and hands the final frame, over the background, to
+      rank 0.
+
+      the order comes from every rank's 'visibility key' (eg, how far
+      its data's bounds are from the camera); where depth is given,
+      and both of two fragments have hit something (ie, finite
+      depth), the closer one goes in front instead - which is what
+      makes opaque content from overlapping groups come out right */
+  struct Compositor {
+    Compositor(Comm &comm);
+
+    /*! composites given frame (of fbSize pixels) with those of all
+        other ranks; collective. depth may be null on all ranks. on
+        rank 0, writes the final sRGB rgba8 pixels to finalRGBA, with
+        the background going from bgBottom (in row 0) to bgTop */
+    void composite(const vec2i &fbSize,
+                   const vec4f *color,
+                   const float *depth,
+                   float        visibilityKey,
+                   const vec4f &bgBottom,
+                   const vec4f &bgTop,
+                   uint32_t    *finalRGBA);
+
+    /*! num frames whose per-stage times get averaged, and then
+        printed on rank 0; 0 to never print them */
+    int reportInterval = 64;
+    /*! whether the frames' color already is premultiplied by its
+        alpha. anari doesn't say either way for FLOAT32_VEC4 color,
+        so by default composite() premultiplies every frame itself;
+        only set this for a device known to premultiply, as doing it
+        twice darkens partially covered pixels */
+    bool colorIsPremultiplied = false;
+
+  private:
+    /*! blends numPixels of the other rank's fragments with mine,
+        into mine; mineInFront says whose are in front where depth
+        doesn't decide it */
+    void blend(vec4f *myColor, float *myDepth,
+               const vec4f *otherColor, const float *otherDepth,
+               bool mineInFront, int numPixels);
+    void report();
+
+    Comm comm;
+    std::vector<vec4f> color, recvColor;
+    std::vector<float> depth, recvDepth;
+
+    /*! summed times of every stage since the last report: the fold
+        of non-power-of-two ranks, every binary-swap stage, and the
+        final gather */
+    std::vector<double> stageTimes;
+    std::vector<size_t> stageBytes;
+    int numFramesSinceReport = 0;
+  };
+
+}
@@ -5,6 +5,9 @@
 #include "hayStack/TransferFunction.h"
 #include "hayMaker/HayMaker.h"
 #include "hayMaker/AnariDeviceRenderer.h"
+#include "hayStack/Tracing.h"
+#include "hayStack/loader/TimeSeries.h"
+#include "hayStack/loader/Rebalancer.h"
 
 namespace hm {
 
@@ -29,6 +32,13 @@ namespace hm {
     // Ignore INFO/DEBUG messages
   }
 
+  /*! whether the frames get a depth channel, too */
+  static bool haveDepthChannel()
+  {
+    static bool have_depth = getenv("HS_HAVE_DEPTH");
+    return have_depth;
+  }
+
   HayMaker::HayMaker(Comm &world,
                      Comm &workers,
                      GlobalRenderSettings &globalRenderSettings,
@@ -44,11 +54,46 @@ namespace hm {
     // create device(s)
     // ------------------------------------------------------------------
     char *envlib = getenv("ANARI_LIBRARY");
-    std::string libname = envlib ? "environment" : "barney";
+    std::string libname
+      = !globalRenderSettings.anariLibrary.empty()
+      ? globalRenderSettings.anariLibrary
+      : (envlib ? "environment" : "barney");
     library = anari::loadLibrary(libname.c_str(), anariStatusFunc);
     if (!library)
       throw std::runtime_error("could not create anari library '"+libname+"' - bailing out");
 
+    // the anari 'mpi' device can't composite groups that are on
+    // different numbers of ranks, so partial replication always
+    // composites on our side
+    ownCompositing
+      = globalRenderSettings.hsCompositing
+      || (localPartitions && !localPartitions->replicasOfGroup.empty());
+    sortFirst = globalRenderSettings.sortFirstTilesPerRank > 0;
+    if (sortFirst) {
+      if (ownCompositing)
+        throw std::runtime_error("sort-first rendering doesn't work with"
+                                 " --hs-compositing or --replicas");
+      if (world.size != workers.size)
+        throw std::runtime_error("sort-first rendering doesn't work with"
+                                 " a head node");
+      if (!localPartitions || localPartitions->numPartitionsTotal() != 1)
+        throw std::runtime_error("sort-first rendering needs every rank to"
+                                 " have all the data (-ndg 1)");
+      if (deviceConfigs.size() != 1)
+        throw std::runtime_error("sort-first rendering needs exactly one"
+                                 " device per rank");
+      if (globalRenderSettings.doubleBufferedFrames)
+        throw std::runtime_error("sort-first rendering doesn't do double"
+                                 " buffering");
+      tileScheduler
+        = new TileScheduler(workers,
+                            globalRenderSettings.sortFirstTilesPerRank
+                            *workers.size);
+      if (workers.rank == 0)
+        std::cout << "#hs: rendering sort-first, " << tileScheduler->numTiles
+                  << " tiles on " << workers.size << " rank(s)" << std::endl;
+    }
+    
     // ------------------------------------------------------------------
     // create anari *device(s)*
     // ------------------------------------------------------------------
@@ -72,6 +117,35 @@ namespace hm {
                                                   this,
                                                   partition));
     }
+
+    // any other device only renders this rank's data
+    if (world.size > 1 && !perDevice[0]->distributed && !sortFirst)
+      ownCompositing = true;
+    if (workers.allReduceMin(int(ownCompositing))
+        != workers.allReduceMax(int(ownCompositing)))
+      throw std::runtime_error("some ranks got a distributed anari device,"
+                               " and some didn't");
+    if (ownCompositing) {
+      if (world.size != workers.size)
+        throw std::runtime_error("compositing on the hayStack side doesn't"
+                                 " work with a head node");
+      if (localPartitions->numPartitionsOnThisRank() != 1)
+        throw std::runtime_error("compositing on the hayStack side needs"
+                                 " exactly one data group per rank");
+      replicaComm = workers.split(localPartitions->get(0)->partitionsRank);
+      leaderComm  = workers.split(replicaComm.rank == 0 ? 0 : 1);
+      if (replicaComm.rank == 0) {
+        compositor = new Compositor(leaderComm);
+        compositor->colorIsPremultiplied = getenv("HS_PREMULTIPLIED");
+      }
+      for (auto dev : perDevice)
+        dev->setTransparentBackground();
+      if (workers.rank == 0)
+        std::cout << "#hs: compositing " << leaderComm.size
+                  << " data group(s) on the hayStack side"
+                  << (haveDepthChannel() ? ", with depth" : "")
+                  << std::endl;
+    }
     
     
     // ------------------------------------------------------------------
@@ -91,104 +165,409 @@ namespace hm {
     }
   }
 
+  HayMaker::~HayMaker()
+  {
+    for (auto pd : perDevice)
+      delete pd;
+    delete compositor;
+    delete tileScheduler;
+  }
+
   void HayMaker::resize(const vec2i &fbSize, uint32_t *hostRGBA)
   {
+    releaseFrames();
     this->fbSize = fbSize;
     this->hostRGBA = hostRGBA;
+    // the frame(s) this rank renders, and which rows of the image
+    // they are
+    vec2i frameSize = fbSize;
+    box2f region { vec2f(0.f), vec2f(1.f) };
+    if (ownCompositing) {
+      mappedPixels = nullptr;
+      if (replicaComm.rank == 0 && leaderComm.rank == 0)
+        finalPixels.resize(size_t(fbSize.x)*fbSize.y);
+      if (fbSize.y < replicaComm.size)
+        throw std::runtime_error("frame has fewer rows than there are ranks"
+                                 " sharing a data group");
+      // bands differ by at most one row, and end exactly at the
+      // image's last row
+      const int begin = bandBegin(replicaComm.rank);
+      const int end   = bandBegin(replicaComm.rank+1);
+      bandHeight  = end-begin;
+      frameSize.y = bandHeight;
+      region.lower.y = begin/float(fbSize.y);
+      region.upper.y = end/float(fbSize.y);
+    }
+    if (sortFirst) {
+      // (renderTiles() sets every tile's region)
+      mappedPixels = nullptr;
+      if (workers.rank == 0)
+        finalPixels.resize(size_t(fbSize.x)*fbSize.y);
+      tileHeight  = (fbSize.y+tileScheduler->numTiles-1)/tileScheduler->numTiles;
+      frameSize.y = tileHeight;
+    }
     for (auto dev : perDevice) {
+      dev->setImageRegion(fbSize,region);
       auto device = dev->anari.device;
-      auto frame = dev->anari.frame;
-      anari::setParameter(device, frame,
-                          "size",
-                          (const anari::math::uint2&)fbSize);
-      anari::setParameter(device, frame,
-                          "channel.color",
-                          ANARI_UFIXED8_RGBA_SRGB);
-      static bool have_depth = getenv("HS_HAVE_DEPTH");
-      if (have_depth)
+      for (int i=0;i<dev->anari.numFrames;i++) {
+        auto frame = dev->anari.frames[i];
+        anari::setParameter(device, frame,
+                            "size",
+                            (const anari::math::uint2&)frameSize);
+        // (to composite, we need linear color, and alpha)
         anari::setParameter(device, frame,
-                            "channel.depth", ANARI_FLOAT32);
+                            "channel.color",
+                            ownCompositing
+                            ? ANARI_FLOAT32_VEC4
+                            : ANARI_UFIXED8_RGBA_SRGB);
+        if (haveDepthChannel())
+          anari::setParameter(device, frame,
+                              "channel.depth", ANARI_FLOAT32);
 #ifdef TEST_IDCHANNEL
-      anari::setParameter(device, frame,
-                          TEST_IDCHANNEL, ANARI_UINT32);
+        anari::setParameter(device, frame,
+                            TEST_IDCHANNEL, ANARI_UINT32);
 #endif
 
-      anari::commitParameters(device, frame);
+        anari::commitParameters(device, frame);
+      }
     }
   }
   
+  void HayMaker::unmapFrame()
+  {
+    if (mappedIdx < 0) return;
+    auto dev0 = perDevice[0];
+    anari::unmap(dev0->anari.device,dev0->anari.frames[mappedIdx],
+                 mappedChannel);
+    mappedIdx = -1;
+    mappedPixels = nullptr;
+  }
+  
+  void HayMaker::dropFrameInFlight()
+  {
+    if (!frameInFlight) return;
+    for (auto dev : perDevice)
+      anari::wait(dev->anari.device,dev->anari.frames[presentIdx]);
+    frameInFlight = false;
+  }
+  
+  void HayMaker::releaseFrames()
+  {
+    unmapFrame();
+    dropFrameInFlight();
+  }
+
+  void HayMaker::terminate()
+  {
+    releaseFrames();
+    // don't leave a prefetch running into MPI_Finalize
+    if (timeSeries)
+      timeSeries->dropPrefetch();
+  }
 
   void HayMaker::renderFrame()
   {
     assert(!perDevice.empty());
     if (perDevice[0]->anari.world == 0)
       renderInitialAnariWorld();
+
+    // done here rather than after the previous frame, which the app
+    // may still be using (see getMappedFrame())
+    if (rebalancer && rebalancer->addFrame(lastFrameTimings.render)) {
+      if (rebalancer->changedThisRank)
+        rebuildWorld();
+      else
+        resetAccumulation();
+    }
+    
+    if (sortFirst) {
+      renderTiles();
+      return;
+    }
     
     const char *channelName = "channel.color";
 #ifdef TEST_IDCHANNEL
     channelName = TEST_IDCHANNEL;
 #endif
-    
+    auto dev0 = perDevice[0];
+    const bool doubleBuffered = dev0->anari.numFrames > 1;
+
+    // whatever we handed to the app last time is no longer needed
+    unmapFrame();
+
+    double t0 = getCurrentTime();
+    if (!frameInFlight)
+      for (auto dev : perDevice)
+        dev->renderFrame(presentIdx);
     for (auto dev : perDevice)
-      dev->renderFrame();
+      anari::wait(dev->anari.device,dev->anari.frames[presentIdx]);
+    frameInFlight = false;
+    double t1 = getCurrentTime();
+    
+    if (doubleBuffered) {
+      // launch the next frame right away, so it renders while we're
+      // reading back (and the app is using) this one
+      for (auto dev : perDevice)
+        dev->renderFrame(1-presentIdx);
+      frameInFlight = true;
+    }
+    
+    double t2, tc;
+    if (ownCompositing) {
+      auto device = dev0->anari.device;
+      auto frame  = dev0->anari.frames[presentIdx];
+      auto color  = anari::map<vec4f>(device,frame,"channel.color");
+      anari::MappedFrameData<float> depth = {};
+      if (haveDepthChannel())
+        depth = anari::map<float>(device,frame,"channel.depth");
+      t2 = getCurrentTime();
+      // (all other ranks are waiting for this one's frame, so this
+      // can't just skip it)
+      if (color.width != fbSize.x || color.height != bandHeight
+          || color.pixelType != ANARI_FLOAT32_VEC4)
+        throw std::runtime_error("resized frame or unsupported channel type!?");
+      compositeFrame(color.data,depth.data);
+      anari::unmap(device,frame,"channel.color");
+      if (depth.data)
+        anari::unmap(device,frame,"channel.depth");
+      tc = getCurrentTime();
+      if (hostRGBA && mappedPixels)
+        memcpy(hostRGBA,mappedPixels,fbSize.x*fbSize.y*sizeof(uint32_t));
+    } else {
+      auto fb = anari::map<uint32_t>(dev0->anari.device,
+                                     dev0->anari.frames[presentIdx],
+                                     channelName);
+      mappedIdx = presentIdx;
+      mappedChannel = channelName;
+      t2 = tc = getCurrentTime();
 
-    auto dev0 = perDevice[0];
-    auto fb = anari::map<uint32_t>(dev0->anari.device,
-                                   dev0->anari.frame,
-                                   channelName);
-
-    if (fb.width != fbSize.x || fb.height != fbSize.y)
-      std::cout << "resized frame or unsupported channel type!?" << std::endl;
-    else {
-      if (hostRGBA) {
+      if (fb.width != fbSize.x || fb.height != fbSize.y)
+        std::cout << "resized frame or unsupported channel type!?" << std::endl;
+      else {
+#ifndef TEST_IDCHANNEL
+        mappedPixels = fb.data;
+#endif
+        if (hostRGBA) {
 #ifdef TEST_IDCHANNEL
-        const uint64_t FNV_basis = 0xcbf29ce484222325ULL;
-        const uint64_t FNV_prime = 0x100000001b3ULL;
-        for (int i=0;i<fb.width*fb.height;i++) {
-          uint32_t ID = fb.data[i];
-          uint64_t s = FNV_basis + FNV_prime * ID;
+          const uint64_t FNV_basis = 0xcbf29ce484222325ULL;
+          const uint64_t FNV_prime = 0x100000001b3ULL;
+          for (int i=0;i<fb.width*fb.height;i++) {
+            uint32_t ID = fb.data[i];
+            uint64_t s = FNV_basis + FNV_prime * ID;
           
-          s = s * FNV_prime ^ ID;
-          int r = s & 0xff;
-          s = s * FNV_prime ^ ID;
-          int g = s & 0xff;
-          s = s * FNV_prime ^ ID;
-          int b = s & 0xff;
-          uint32_t rgba = b<<0 | g<<8 | r<<16 | 0xff<<24;
-          hostRGBA[i] = rgba;
-        }
+            s = s * FNV_prime ^ ID;
+            int r = s & 0xff;
+            s = s * FNV_prime ^ ID;
+            int g = s & 0xff;
+            s = s * FNV_prime ^ ID;
+            int b = s & 0xff;
+            uint32_t rgba = b<<0 | g<<8 | r<<16 | 0xff<<24;
+            hostRGBA[i] = rgba;
+          }
 #else
-        memcpy(hostRGBA,fb.data,fbSize.x*fbSize.y*sizeof(uint32_t));
+          memcpy(hostRGBA,fb.data,fbSize.x*fbSize.y*sizeof(uint32_t));
 #endif
+        }
       }
     }
-    anari::unmap(dev0->anari.device,dev0->anari.frame,channelName);
+    double t3 = getCurrentTime();
+    // if the app didn't give us a framebuffer we leave the frame
+    // mapped (until the next renderFrame), so it can use
+    // getMappedFrame() instead of a copy
+    if (hostRGBA)
+      unmapFrame();
+    
+    lastFrameTimings.render    = t1-t0;
+    lastFrameTimings.map       = t2-t1;
+    lastFrameTimings.composite = tc-t2;
+    lastFrameTimings.copy      = t3-tc;
+    hs::trace::record("render","",t0,t1);
+    hs::trace::record("readback","",t1,t3);
+    
+    if (doubleBuffered)
+      presentIdx = 1-presentIdx;
+  }
+  
+  void HayMaker::compositeFrame(const vec4f *bandColor,
+                                const float *bandDepth)
+  {
+    HS_TRACE_SCOPE("compositeFrame");
+    const int bandSize = fbSize.x*bandHeight;
+    const vec4f *color = bandColor;
+    const float *depth = bandDepth;
+    if (splitsFrame()) {
+      if (replicaComm.rank != 0) {
+        replicaComm.masterGatherv(bandColor,bandSize);
+        if (bandDepth)
+          replicaComm.masterGatherv(bandDepth,bandSize);
+        return;
+      }
+      // bands are in rank order, so back to back they're the whole
+      // frame
+      std::vector<int> bandSizes(replicaComm.size);
+      for (int r=0;r<replicaComm.size;r++)
+        bandSizes[r] = fbSize.x*(bandBegin(r+1)-bandBegin(r));
+      mergedColor.resize(size_t(fbSize.x)*fbSize.y);
+      replicaComm.masterGatherv(mergedColor.data(),bandColor,bandSizes);
+      color = mergedColor.data();
+      if (bandDepth) {
+        mergedDepth.resize(size_t(fbSize.x)*fbSize.y);
+        replicaComm.masterGatherv(mergedDepth.data(),bandDepth,bandSizes);
+        depth = mergedDepth.data();
+      }
+    }
+
+    // groups go front to back by how close their data's bounds are
+    // to the camera; exact for disjoint boxes that the camera isn't
+    // in, an approximation otherwise
+    const vec3f toBounds
+      = max(vec3f(0.f),max(localBounds.lower-eye,eye-localBounds.upper));
+    const float visibilityKey
+      = localBounds.empty() ? INFINITY : length(toBounds);
+
+    // same as the renderer's default gradient
+    vec4f bgBottom(.9f,.9f,.9f,1.f), bgTop(.15f,.25f,.8f,1.f);
+    const vec4f &bgColor = globalRenderSettings.bgColor;
+    if (!isnan(bgColor.x) && bgColor.x >= 0.f)
+      bgBottom = bgTop = bgColor;
+    compositor->composite(fbSize,color,depth,visibilityKey,
+                          bgBottom,bgTop,finalPixels.data());
+    if (leaderComm.rank == 0)
+      mappedPixels = finalPixels.data();
+  }
+  
+  void HayMaker::renderTiles()
+  {
+    auto dev0   = perDevice[0];
+    auto device = dev0->anari.device;
+    auto frame  = dev0->anari.frames[0];
+    const int W = fbSize.x;
+    const int H = fbSize.y;
+    const size_t tileSize = size_t(W)*tileHeight;
+    // rows of given tile that are in the image (the last one(s) may
+    // reach past it)
+    auto rowsOf = [&](int tile)
+    { return std::max(0,std::min(tileHeight,H-tile*tileHeight)); };
+
+    const std::vector<int> &myTiles = tileScheduler->myTiles();
+    std::vector<float> tileTimes(tileScheduler->numTiles,0.f);
+    if (workers.rank != 0)
+      tilePixels.resize(myTiles.size()*tileSize);
+    double renderTime = 0., mapTime = 0.;
+    for (int i=0;i<(int)myTiles.size();i++) {
+      const int tile = myTiles[i];
+      const int rows = rowsOf(tile);
+      if (rows == 0) continue;
+      // a tile that reaches past the image instead renders the
+      // image's last tileHeight rows, of which we use the last 'rows'
+      const int firstRow = std::min(tile*tileHeight,H-tileHeight);
+      box2f region { vec2f(0.f,firstRow/float(H)),
+                     vec2f(1.f,(firstRow+tileHeight)/float(H)) };
+      dev0->setImageRegion(fbSize,region);
+      double t0 = getCurrentTime();
+      dev0->renderFrame(0);
+      anari::wait(device,frame);
+      double t1 = getCurrentTime();
+      auto fb = anari::map<uint32_t>(device,frame,"channel.color");
+      // (all ranks' tiles are needed for the frame, so this can't
+      // just skip it)
+      if (fb.width != W || fb.height != tileHeight)
+        throw std::runtime_error("resized frame or unsupported channel type!?");
+      uint32_t *dst
+        = workers.rank == 0
+        ? finalPixels.data()+tile*tileSize
+        : tilePixels.data()+i*tileSize;
+      memcpy(dst,fb.data+size_t(tile*tileHeight-firstRow)*W,
+             rows*W*sizeof(uint32_t));
+      anari::unmap(device,frame,"channel.color");
+      double t2 = getCurrentTime();
+      tileTimes[tile] = float(t1-t0);
+      renderTime += t1-t0;
+      mapTime    += t2-t1;
+      hs::trace::record("renderTile",std::to_string(tile),t0,t1);
+    }
+
+    // tiles are whole rows, so every one goes right into its place
+    // of the final frame
+    double t3 = getCurrentTime();
+    std::vector<MPI_Request> requests;
+    if (workers.rank == 0) {
+      for (int tile=0;tile<tileScheduler->numTiles;tile++) {
+        const int owner = tileScheduler->ownerOf[tile];
+        if (owner == 0 || rowsOf(tile) == 0) continue;
+        requests.push_back(MPI_Request());
+        workers.recv(owner,tile,finalPixels.data()+tile*tileSize,
+                     rowsOf(tile)*W,requests.back());
+      }
+    } else {
+      for (int i=0;i<(int)myTiles.size();i++) {
+        const int tile = myTiles[i];
+        if (rowsOf(tile) == 0) continue;
+        requests.push_back(MPI_Request());
+        workers.send(0,tile,tilePixels.data()+i*tileSize,
+                     rowsOf(tile)*W,requests.back());
+      }
+    }
+    for (auto &request : requests)
+      workers.wait(request);
+    tileScheduler->update(tileTimes);
+    double t4 = getCurrentTime();
+
+    if (workers.rank == 0) {
+      mappedPixels = finalPixels.data();
+      if (hostRGBA)
+        memcpy(hostRGBA,finalPixels.data(),W*H*sizeof(uint32_t));
+    }
+    double t5 = getCurrentTime();
+    
+    lastFrameTimings.render    = renderTime;
+    lastFrameTimings.map       = mapTime;
+    lastFrameTimings.composite = t4-t3;
+    lastFrameTimings.copy      = t5-t4;
+    hs::trace::record("gatherTiles","",t3,t4);
   }
   
   void HayMaker::resetAccumulation()
   {
+    HS_TRACE_SCOPE("commit","resetAccumulation");
+    releaseFrames();
     for (auto dev : perDevice)
-      anari::commitParameters(dev->anari.device, dev->anari.frame);
+      for (int i=0;i<dev->anari.numFrames;i++)
+        anari::commitParameters(dev->anari.device, dev->anari.frames[i]);
   }
 
   void HayMaker::setCamera(const Camera &camera) 
   {
+    dropFrameInFlight();
+    eye = camera.vp;
     for (auto dev : perDevice)
       dev->setCamera(camera); 
   }
+
+  void HayMaker::setInteractive(bool interactive) 
+  {
+    HS_TRACE_SCOPE("commit","setInteractive");
+    dropFrameInFlight();
+    for (auto dev : perDevice)
+      dev->setInteractive(interactive); 
+  }
   
   void HayMaker::finalizeRender()
   {
-    for (auto dev : perDevice) {
-      anari::setParameter(dev->anari.device, dev->anari.frame,
-                          "world", dev->anari.world);
-      anari::commitParameters(dev->anari.device, dev->anari.frame);
-    }
+    HS_TRACE_SCOPE("commit","frames");
+    dropFrameInFlight();
+    for (auto dev : perDevice)
+      for (int i=0;i<dev->anari.numFrames;i++) {
+        anari::setParameter(dev->anari.device, dev->anari.frames[i],
+                            "world", dev->anari.world);
+        anari::commitParameters(dev->anari.device, dev->anari.frames[i]);
+      }
   }
   
   
   BoundsData HayMaker::getWorldBounds() const
   {
+    HS_TRACE_SCOPE("worldBounds");
     BoundsData bb = localPartitions->getBounds();
     bb.spatial.lower = world.allReduceMin(bb.spatial.lower);
     bb.spatial.upper = world.allReduceMax(bb.spatial.upper);
@@ -206,10 +585,56 @@ namespace hm {
 
   void HayMaker::renderInitialAnariWorld()
   {
+    localBounds = localPartitions->getBounds().spatial;
     for (auto dev : perDevice)
       dev->renderInitialAnariWorld();
   }
 
+  void HayMaker::rebuildWorld()
+  {
+    HS_TRACE_SCOPE("rebuildWorld");
+    releaseFrames();
+    localBounds = localPartitions->getBounds().spatial;
+    for (auto dev : perDevice)
+      dev->rebuildWorld();
+    resetAccumulation();
+  }
+
+  void HayMaker::setTimeStep(int stepIndex)
+  {
+    if (!timeSeries || stepIndex == currentTimeStep)
+      return;
+    HS_TRACE_SCOPE("setTimeStep",std::to_string(stepIndex));
+    double t0 = getCurrentTime();
+    bool wasPrefetched = false;
+    hs::LocalPartitions *next = timeSeries->acquire(stepIndex,wasPrefetched);
+    double t1 = getCurrentTime();
+    if (next->numPartitionsOnThisRank() != localPartitions->numPartitionsOnThisRank()) {
+      delete next;
+      throw std::runtime_error("time step "+std::to_string(stepIndex)
+                               +" got loaded into a different number of"
+                               " data groups on this rank");
+    }
+    for (int i=0;i<localPartitions->numPartitionsOnThisRank();i++)
+      localPartitions->get(i)->swapContent(*next->get(i));
+    // 'next' now holds the previous step
+    delete next;
+    rebuildWorld();
+    currentTimeStep = stepIndex;
+    double t2 = getCurrentTime();
+
+    timeSeries->prefetch((stepIndex+1) % timeSeries->numSteps,
+                         hs::loader::TimeSeries::hostBytes(*localPartitions));
+    float waitTime  = workers.allReduceMax(float(t1-t0));
+    float totalTime = workers.allReduceMax(float(t2-t0));
+    if (workers.rank == 0)
+      std::cout << "#hs.ts: time step " << stepIndex << " ready after "
+                << prettyDouble(totalTime) << "s ("
+                << prettyDouble(waitTime) << "s "
+                << (wasPrefetched ? "waiting for prefetch" : "loading it")
+                << ", rest building the world)" << std::endl;
+  }
+  
   void HayMaker::setTransferFunction(const hs::TransferFunction &xf)
   {
     for (auto dev : perDevice)
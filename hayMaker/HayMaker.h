@@ -7,10 +7,19 @@
 // current rank's parition(s) of distributed: model
 #include "hayStack/LocalPartitions.h"
 #include "hayMaker/MPIRenderEngine.h"
+#include "hayMaker/Compositor.h"
+#include "hayMaker/TileScheduler.h"
 
 #include <anari/anari_cpp.hpp>
 #include <anari/anari_cpp/ext/linalg.h>
 
+namespace hs {
+  namespace loader {
+    struct TimeSeries;
+    struct Rebalancer;
+  }
+}
+
 namespace hm {
   /*! the actual anari renderer part for the a given gpu/device */
   struct AnariDeviceRenderer;
@@ -25,6 +34,25 @@ namespace hm {
     
     /*! default color map index to use */
     int defaultColorMapIndex = 0;
+
+    /*! whether to render into two frames alternately, such that the
+        next frame renders while the previous one gets read back and
+        handed to the app. this adds one frame of latency, and each
+        frame only accumulates every other sample */
+    bool doubleBufferedFrames = false;
+
+    /*! name of the anari library to load (e.g., 'helide' for a
+        cpu-only, headless device). empty means '$ANARI_LIBRARY if
+        set, else barney' */
+    std::string anariLibrary;
+
+    /*! composite the data groups' images on the hayStack side (see
+        Compositor) even if the anari device could do that itself */
+    bool hsCompositing = false;
+
+    /*! if > 0, and every rank has all the data: render sort-first,
+        with this many screen tiles per rank (see TileScheduler) */
+    int sortFirstTilesPerRank = 0;
   };
   
   struct DeviceConfig {
@@ -47,14 +75,27 @@ namespace hm {
              GlobalRenderSettings &globalRenderSettings,
              hs::LocalPartitions *localPartitions,
              const std::vector<DeviceConfig> &deviceConfigs);
+    /*! deletes what the constructor created; the time series and
+        rebalancer (if any) belong to whoever set them. call
+        terminate() first */
+    ~HayMaker();
 
     void resize(const vec2i &fbSize, uint32_t *hostRgba);
     void renderFrame();
     void resetAccumulation();
     void setCamera(const Camera &camera);
+    void setInteractive(bool interactive) override;
+    /*! swaps this rank's partitions' content for that of the given
+        time step (prefetched, if possible), rebuilds the world, and
+        starts prefetching the step after that. collective across
+        all workers */
+    void setTimeStep(int stepIndex) override;
     void finalizeRender();
     /*! clean up and shut down */
-    void terminate() {}
+    void terminate() override;
+
+    const uint32_t *getMappedFrame() const override { return mappedPixels; }
+    FrameTimings getLastFrameTimings() const override { return lastFrameTimings; }
 
     void setTransferFunction(const hs::TransferFunction &xf) override;
     void setVolumeScatterSettings(const hs::VolumeScatterSettings &settings) override;
@@ -64,12 +105,53 @@ namespace hm {
         anari::world; later renderFrame()'s can then simply use that
         frame with updated camera */
     void renderInitialAnariWorld();
+
+    /*! re-creates every device's anari world from the (changed)
+        content of its partition - eg, for the next time step of
+        in-situ data. collective across all ranks */
+    void rebuildWorld();
     
     inline int numDevices() const { return perDevice.size(); }
     BoundsData getWorldBounds() const;
 
+    /*! whether this rank renders only a band of the frame, which
+        gets merged with the other bands of its data group's ranks
+        (see replicaComm) */
+    bool splitsFrame() const { return replicaComm.size > 1; }
+    /*! with ownCompositing: sends this rank's band of the frame to
+        the first rank of its data group, which puts together the
+        group's whole frame, and composites that with the other
+        groups' */
+    void compositeFrame(const vec4f *bandColor, const float *bandDepth);
+    /*! with sortFirst: renders this rank's tiles, one after another,
+        and sends them to rank 0, which puts together the frame */
+    void renderTiles();
+
+    /*! unmap the frame we last presented, if any */
+    void unmapFrame();
+    /*! if there's still a frame rendering in the background (ie,
+        double buffering), wait for it to finish, and drop it: it got
+        launched with the parameters from before whatever change is
+        about to be committed, so the next renderFrame() has to
+        render that frame again */
+    void dropFrameInFlight();
+    /*! unmap the frame we last presented (if any), and drop the one
+        in flight (if any) */
+    void releaseFrames();
+    
     uint32_t     *hostRGBA   = 0;
     vec2i         fbSize;
+    /*! which of the per-device frames gets presented next */
+    int           presentIdx = 0;
+    /*! whether presentIdx has already been launched (ie, by the
+        previous renderFrame, when double buffering) */
+    bool          frameInFlight = false;
+    /*! which frame we currently have mapped on device 0 (or -1),
+        and its pixels */
+    int             mappedIdx    = -1;
+    const uint32_t *mappedPixels = nullptr;
+    const char     *mappedChannel = "channel.color";
+    FrameTimings    lastFrameTimings;
     /*! whether we have to re-commit the model next frame */
     bool          dirty = true;
 
@@ -83,6 +165,50 @@ namespace hm {
     hs::LocalPartitions *const localPartitions;
     GlobalRenderSettings globalRenderSettings;
     const std::vector<DeviceConfig> deviceConfigs;
+    /*! if non-null, the content is a time series, and the
+        partitions currently hold its step currentTimeStep */
+    hs::loader::TimeSeries *timeSeries = nullptr;
+    int currentTimeStep = 0;
+    /*! if non-null, gets every frame's render time, and may move
+        content between data groups based on those */
+    hs::loader::Rebalancer *rebalancer = nullptr;
+    /*! whether the anari device(s) only render this rank's data, and
+        we composite the ranks' images ourselves: with --hs-compositing,
+        partial replication, or any device other than barney's 'mpi'
+        one on more than one rank */
+    bool                  ownCompositing = false;
+    /*! with ownCompositing, the ranks that have the same data group
+        as this one: each renders one band of rows (see
+        bandBegin()), in rank order, and the first one merges them */
+    Comm                  replicaComm;
+    /*! the first ranks of all data groups (the others' is unused),
+        which composite the groups' frames */
+    Comm                  leaderComm;
+    Compositor           *compositor = nullptr;
+    /*! first row of given replica's band (and, for replicaComm.size,
+        the image's height) */
+    int bandBegin(int replica) const
+    { return int(int64_t(replica)*fbSize.y/replicaComm.size); }
+    /*! rows in this rank's band */
+    int                   bandHeight = 0;
+    /*! on the first rank of a group, the group's merged frame */
+    std::vector<vec4f>    mergedColor;
+    std::vector<float>    mergedDepth;
+    /*! on the first rank of all, the final frame (also with
+        sortFirst) */
+    std::vector<uint32_t> finalPixels;
+    /*! whether every rank renders only its (TileScheduler's) tiles
+        of the frame, with all the data; the tiles have all of the
+        frame's width, and tileHeight rows */
+    bool                  sortFirst = false;
+    TileScheduler        *tileScheduler = nullptr;
+    int                   tileHeight = 0;
+    /*! on ranks other than 0, their tiles' pixels, to be sent */
+    std::vector<uint32_t> tilePixels;
+    /*! bounds of this rank's data, and camera position, for which
+        group's frame goes in front of which */
+    box3f                 localBounds;
+    vec3f                 eye;
   };
 
 }
@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayMaker/InSituAdaptor.h"
+#include "hayStack/Tracing.h"
+
+namespace hm {
+
+  InSituAdaptor::InSituAdaptor(hs::mpi::Comm &simComm,
+                               const GlobalRenderSettings &renderSettings,
+                               int gpuID)
+    : comm(simComm),
+      renderSettings(renderSettings),
+      gpuID(gpuID)
+  {
+    localPartitions = new hs::LocalPartitions({comm.rank},comm.size);
+  }
+
+  InSituAdaptor::~InSituAdaptor()
+  {
+    if (hayMaker) {
+      hayMaker->terminate();
+      delete hayMaker;
+    }
+    // (also deletes the partition, and what update() put into it)
+    delete localPartitions;
+  }
+
+  void InSituAdaptor::add(hs::loader::LoadableContent *content)
+  {
+    this->content.emplace_back(content);
+  }
+
+  void InSituAdaptor::clearContent()
+  {
+    content.clear();
+  }
+
+  void InSituAdaptor::update()
+  {
+    HS_TRACE_SCOPE("inSituUpdate");
+    double t0 = getCurrentTime();
+    OnePartition *partition = localPartitions->get(0);
+    partition->clear();
+    for (auto &c : content)
+      c->executeLoad(*partition);
+    double t1 = getCurrentTime();
+
+    if (!hayMaker) {
+      GlobalRenderSettings settings = renderSettings;
+      DeviceConfig dc;
+      dc.gpuID = gpuID;
+      hayMaker = new HayMaker(comm,comm,settings,localPartitions,{dc});
+      if (fbSize.x > 0)
+        resize(fbSize);
+      if (pendingXF) {
+        hayMaker->setTransferFunction(*pendingXF);
+        pendingXF.reset();
+      }
+      hayMaker->renderInitialAnariWorld();
+    } else
+      hayMaker->rebuildWorld();
+    double t2 = getCurrentTime();
+
+    lastTimings.ingest = comm.allReduceMax(float(t1-t0));
+    lastTimings.build  = comm.allReduceMax(float(t2-t1));
+  }
+
+  void InSituAdaptor::resize(const vec2i &fbSize)
+  {
+    this->fbSize = fbSize;
+    if (!hayMaker) return;
+    if (comm.rank == 0)
+      pixels.resize(size_t(fbSize.x)*size_t(fbSize.y));
+    hayMaker->resize(fbSize,comm.rank == 0 ? pixels.data() : nullptr);
+  }
+
+  void InSituAdaptor::setTransferFunction(const hs::TransferFunction &xf)
+  {
+    if (hayMaker)
+      hayMaker->setTransferFunction(xf);
+    else
+      pendingXF.reset(new hs::TransferFunction(xf));
+  }
+
+  const uint32_t *InSituAdaptor::render(const hs::Camera &camera)
+  {
+    if (!hayMaker)
+      throw std::runtime_error("InSituAdaptor: render() before first update()");
+    if (fbSize.x <= 0 || fbSize.y <= 0)
+      throw std::runtime_error("InSituAdaptor: render() without a frame size");
+    HS_TRACE_SCOPE("inSituRender");
+    double t0 = getCurrentTime();
+    hayMaker->setCamera(camera);
+    hayMaker->resetAccumulation();
+    hayMaker->renderFrame();
+    lastTimings.render = comm.allReduceMax(float(getCurrentTime()-t0));
+    return comm.rank == 0 ? pixels.data() : nullptr;
+  }
+
+  BoundsData InSituAdaptor::getWorldBounds() const
+  {
+    if (hayMaker)
+      return hayMaker->getWorldBounds();
+    BoundsData bb = localPartitions->getBounds();
+    bb.spatial.lower = comm.allReduceMin(bb.spatial.lower);
+    bb.spatial.upper = comm.allReduceMax(bb.spatial.upper);
+    bb.scalars.lower = comm.allReduceMin(bb.scalars.lower);
+    bb.scalars.upper = comm.allReduceMax(bb.scalars.upper);
+    return bb;
+  }
+
+}
@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayMaker/HayMaker.h"
+#include "hayStack/loader/ExternalContent.h"
+
+namespace hm {
+
+  /*! lets a running simulation render its own in-memory data with
+      hayStack, without writing it to (and reading it back from)
+      files. every rank of the simulation's communicator is one data
+      group, and renders whatever content that rank registers - data
+      never moves between ranks. per time step:
+
+        insitu.clearContent();
+        insitu.add(new hs::loader::ExternalStructuredVolume(myField,...));
+        insitu.update();              // ingest, and (re-)build the world
+        insitu.render(camera);        // pixels on rank 0
+
+      update() and render() are collective across the communicator.
+      content registered with add() refers to the caller's arrays.
+      structured volumes get rendered straight from those, so their
+      voxels have to stay valid (and unchanged) until after the last
+      render() of that step; particles and unstructured meshes get
+      copied in update(), so theirs only until update() returns. */
+  struct InSituAdaptor {
+    InSituAdaptor(hs::mpi::Comm &simComm,
+                  const GlobalRenderSettings &renderSettings,
+                  int gpuID = 0);
+    ~InSituAdaptor();
+
+    /*! adds content for the next update(); the adaptor takes
+        ownership of the content object (not of the caller's arrays
+        it refers to) */
+    void add(hs::loader::LoadableContent *content);
+
+    /*! drops all content added so far */
+    void clearContent();
+
+    /*! replaces what gets rendered with the currently added content;
+        the first update() also creates the renderer */
+    void update();
+
+    void resize(const vec2i &fbSize);
+    void setTransferFunction(const hs::TransferFunction &xf);
+
+    /*! renders one frame; returns the frame's fbSize.x*fbSize.y RGBA
+        pixels on rank 0, and null on all other ranks */
+    const uint32_t *render(const hs::Camera &camera);
+
+    /*! bounds of the current step's content, across all ranks */
+    BoundsData getWorldBounds() const;
+
+    /*! where - in seconds, max across ranks - the last step went */
+    struct {
+      /*! update(): wrapping the caller's arrays in our partition */
+      double ingest = 0.;
+      /*! update(): creating the renderer's world from that */
+      double build  = 0.;
+      /*! render() */
+      double render = 0.;
+    } lastTimings;
+
+    hs::mpi::Comm                 comm;
+    const GlobalRenderSettings    renderSettings;
+    const int                     gpuID;
+    hs::LocalPartitions          *localPartitions = nullptr;
+    HayMaker                     *hayMaker = nullptr;
+    std::vector<std::unique_ptr<hs::loader::LoadableContent>> content;
+    vec2i                         fbSize { 0, 0 };
+    std::vector<uint32_t>         pixels;
+    /*! the transfer function, if set before the renderer exists */
+    std::unique_ptr<hs::TransferFunction> pendingXF;
+  };
+
+}
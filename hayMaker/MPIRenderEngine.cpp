@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "hayMaker/MPIRenderEngine.h"
+#include "hayStack/Tracing.h"
 
 // #define LOGGING 1
 #if LOGGING
@@ -25,6 +26,8 @@ namespace hm {
      TERMINATE,
      SET_XF,
      RESET_ACCUMULATION,
+     SET_INTERACTIVE,
+     SET_TIME_STEP,
 #if HS_USE_MULTI_SCATTERING
      SET_VOLUME_SCATTER,
 #endif
@@ -41,6 +44,8 @@ namespace hm {
      "TERMINATE",
      "SET_XF",
      "RESET_ACCUMULATION",
+     "SET_INTERACTIVE",
+     "SET_TIME_STEP",
 #if HS_USE_MULTI_SCATTERING
      "SET_VOLUME_SCATTER",
 #endif
@@ -56,6 +61,8 @@ namespace hm {
                            "terminate",
                            "set_xf",
                            "reset_accum",
+                           "set_interactive",
+                           "set_time_step",
 #if HS_USE_MULTI_SCATTERING
                            "set_volume_scatter",
 #endif
@@ -63,13 +70,27 @@ namespace hm {
                            
   
   MPIRenderEngine::MPIRenderEngine(Comm &comm,
-                           RenderEngineInterface *passThrough)
+                                   RenderEngineInterface *passThrough,
+                                   int queueDepth)
     : comm(comm),
+      cmdComm(comm.dup()),
       passThrough(passThrough)
   {
-    int handShake = 29031974;
+    if (queueDepth <= 0) {
+      const char *fromEnv = getenv("HS_CMD_QUEUE_DEPTH");
+      queueDepth = fromEnv ? std::max(1,atoi(fromEnv)) : 2;
+    }
+    // if we render ourselves we can't run ahead of the workers
+    // anyway, so only pipeline when we're a head node
+    pipelined = (passThrough == nullptr);
+    if (!pipelined) queueDepth = 1;
+    slots.resize(queueDepth);
+    slotRequests.resize(queueDepth);
+    slotInFlight.resize(queueDepth,false);
+    
+    int handShake[2] = { 29031974, pipelined };
     comm.barrier();
-    sendToWorkers(handShake);
+    comm.bc_send(handShake,sizeof(handShake));
   }
 
   struct WorkerLoop 
@@ -94,6 +115,8 @@ namespace hm {
     void cmd_resize();
     void cmd_resetAccumulation();
     void cmd_setCamera();
+    void cmd_setInteractive();
+    void cmd_setTimeStep();
     void cmd_setTransferFunction();
 #if HS_USE_MULTI_SCATTERING
     void cmd_setVolumeScatterSettings();
@@ -109,20 +132,56 @@ namespace hm {
     void fromMaster(std::vector<T> &t);
     template<typename T>
     void fromMaster(T &t);
+
+    /*! wait for the next command's slot to arrive (if it hasn't
+        already), and make its payload available to fromMaster() */
+    void receiveCommand();
+    /*! if pipelined, post the (non-blocking) receive for the next
+        command's slot, so it can get delivered while we're still
+        executing the current one. must only be called once all of
+        the current command's arguments have been received */
+    void postNextCommand();
     
     Comm &comm;
+    /*! dup of comm that carries the commands (see
+        MPIRenderEngine::cmdComm) */
+    Comm cmdComm;
     RenderEngineInterface *renderer;
 
   private:
     int eomIdentifierBase = 0x12345;
     void checkEndOfMessage();
     void sendEndOfMessage();
+
+    /*! slot the next command gets received into */
+    CommandSlot slot;
+    MPI_Request slotRequest;
+    bool        slotPosted = false;
+    /*! whether the master sends non-blocking (see CommandSlot) */
+    bool        pipelined  = false;
+    /*! full payload of the command currently being executed, and
+        how much of that fromMaster() has already consumed */
+    std::vector<uint8_t> payload;
+    size_t readPos = 0;
+    /*! frame the command currently being executed belongs to */
+    int frameID = -1;
+
+    struct {
+      int    numCommands = 0;
+      /*! num commands that had already arrived by the time we
+          needed them */
+      int    numReady    = 0;
+      double waitTime    = 0.;
+    } stats;
   };
   
   template<typename T>
   void WorkerLoop::fromMaster(T &t)
   {
-    comm.bc_recv(&t,sizeof(T));
+    if (readPos+sizeof(T) > payload.size())
+      throw std::runtime_error("reading past end of command payload!?");
+    memcpy((void *)&t,payload.data()+readPos,sizeof(T));
+    readPos += sizeof(T);
   }
   
   template<typename T>
@@ -131,7 +190,11 @@ namespace hm {
     size_t s;
     fromMaster(s);
     t.resize(s);
-    if (s) comm.bc_recv(t.data(),s*sizeof(T));
+    if (s == 0) return;
+    if (readPos+s*sizeof(T) > payload.size())
+      throw std::runtime_error("reading past end of command payload!?");
+    memcpy((void *)t.data(),payload.data()+readPos,s*sizeof(T));
+    readPos += s*sizeof(T);
   }
   
   template<typename T>
@@ -139,23 +202,136 @@ namespace hm {
   {
     size_t s = t.size();
     sendToWorkers(s);
-    if (s) comm.bc_send(t.data(),s*sizeof(T));
+    const uint8_t *begin = (const uint8_t *)t.data();
+    pending.insert(pending.end(),begin,begin+s*sizeof(T));
   }
   
   template<typename T>
   void MPIRenderEngine::sendToWorkers(const T &t)
   {
-    comm.bc_send(&t,sizeof(T));
+    const uint8_t *begin = (const uint8_t *)&t;
+    pending.insert(pending.end(),begin,begin+sizeof(T));
   }
     
+  void MPIRenderEngine::flushCommand()
+  {
+    // every command starts with its tag
+    int cmd = -1;
+    if (pending.size() >= sizeof(cmd))
+      memcpy(&cmd,pending.data(),sizeof(cmd));
+    HS_TRACE_SCOPE("sendCommand",
+                   (cmd >= 0 && cmd < MAX_VALID_COMMANDS)
+                   ? commandNames[cmd] : "");
+
+    int slotID = nextSlot;
+    nextSlot = (nextSlot+1) % slots.size();
+    if (slotInFlight[slotID]) {
+      // all slots in flight - wait for the oldest one to go out
+      // before we can re-use it; this is what bounds how far we can
+      // run ahead of the workers.
+      if (!cmdComm.test(slotRequests[slotID])) {
+        double t0 = getCurrentTime();
+        cmdComm.wait(slotRequests[slotID]);
+        stats.stallTime += getCurrentTime()-t0;
+        stats.numStalls++;
+      }
+      slotInFlight[slotID] = false;
+    }
+    // how many frames the oldest command that's still in flight is
+    // behind this one
+    for (int i=0;i<(int)slots.size();i++)
+      if (slotInFlight[i] && !cmdComm.test(slotRequests[i]))
+        stats.maxFramesAhead = std::max(stats.maxFramesAhead,
+                                        nextFrameID-slots[i].frameID);
+      else
+        slotInFlight[i] = false;
     
+    CommandSlot &slot = slots[slotID];
+    slot.frameID     = nextFrameID;
+    slot.payloadSize = (int)pending.size();
+    size_t numInline = std::min(pending.size(),(size_t)CommandSlot::inlineCapacity);
+    memcpy(slot.payload,pending.data(),numInline);
+    if (pipelined) {
+      cmdComm.ibc_send(&slot,sizeof(slot),slotRequests[slotID]);
+      slotInFlight[slotID] = true;
+    } else
+      cmdComm.bc_send(&slot,sizeof(slot));
+    if (pending.size() > numInline)
+      cmdComm.bc_send(pending.data()+numInline,pending.size()-numInline);
+    
+    pending.clear();
+    stats.numCommands++;
+  }
 
+  void MPIRenderEngine::drainCommands()
+  {
+    for (int i=0;i<(int)slots.size();i++)
+      if (slotInFlight[i]) {
+        cmdComm.wait(slotRequests[i]);
+        slotInFlight[i] = false;
+      }
+  }
+  
+  void MPIRenderEngine::printStats()
+  {
+    std::cout << "#hm.mpi: issued " << stats.numCommands << " commands";
+    if (pipelined)
+      std::cout << " (queue depth " << slots.size() << "), "
+                << stats.numStalls << " of which stalled on a full queue (total "
+                << prettyDouble(stats.stallTime*1000.) << "ms);"
+                << " ran up to " << stats.maxFramesAhead
+                << " frame(s) ahead of the workers";
+    std::cout << std::endl;
+  }
+  
   WorkerLoop::WorkerLoop(Comm &comm,
                          RenderEngineInterface *renderer)
     : comm(comm),
+      cmdComm(comm.dup()),
       renderer(renderer)
   {}
 
+  void WorkerLoop::postNextCommand()
+  {
+    if (!pipelined) return;
+    cmdComm.ibc_recv(&slot,sizeof(slot),slotRequest);
+    slotPosted = true;
+  }
+  
+  void WorkerLoop::receiveCommand()
+  {
+    const int prevFrameID = frameID;
+    if (!pipelined) {
+      double t0 = getCurrentTime();
+      cmdComm.bc_recv(&slot,sizeof(slot));
+      stats.waitTime += getCurrentTime()-t0;
+    } else {
+      if (!slotPosted)
+        postNextCommand();
+      if (cmdComm.test(slotRequest))
+        stats.numReady++;
+      else {
+        double t0 = getCurrentTime();
+        cmdComm.wait(slotRequest);
+        stats.waitTime += getCurrentTime()-t0;
+      }
+      slotPosted = false;
+    }
+    stats.numCommands++;
+    
+    payload.resize(slot.payloadSize);
+    size_t numInline = std::min(payload.size(),(size_t)CommandSlot::inlineCapacity);
+    memcpy(payload.data(),slot.payload,numInline);
+    if (payload.size() > numInline)
+      cmdComm.bc_recv(payload.data()+numInline,payload.size()-numInline);
+    readPos = 0;
+    frameID = slot.frameID;
+    if (frameID < prevFrameID)
+      throw std::runtime_error("command for frame "+std::to_string(frameID)
+                               +" arrived after one for frame "
+                               +std::to_string(prevFrameID)+"!?");
+  }
+
   void WorkerLoop::checkEndOfMessage()
   {
     int expected_eomIdentifier = eomIdentifierBase++;
@@ -170,6 +346,7 @@ namespace hm {
   {
     int eomIdentifier = eomIdentifierBase++;
     sendToWorkers(eomIdentifier);
+    flushCommand();
   }
   
   // ==================================================================
@@ -195,7 +372,7 @@ namespace hm {
     // get args....
     // ------------------------------------------------------------------
     checkEndOfMessage();
-    ;
+    postNextCommand();
     // ------------------------------------------------------------------
     // and execute
     // ------------------------------------------------------------------
@@ -226,7 +403,7 @@ namespace hm {
     // get args....
     // ------------------------------------------------------------------
     checkEndOfMessage();
-    ;
+    postNextCommand();
     // ------------------------------------------------------------------
     // and execute
     // ------------------------------------------------------------------
@@ -243,10 +420,25 @@ namespace hm {
     int cmd = TERMINATE;
     sendToWorkers(cmd);
     sendEndOfMessage();
+    drainCommands();
       
     // ------------------------------------------------------------------
     // and do our own....
     // ------------------------------------------------------------------
+    // gather how well the pipeline worked on the receiving end (we
+    // don't receive, so contribute neutral values)
+    float readyFraction = cmdComm.allReduceMin(1.f);
+    float maxWaitTime   = cmdComm.allReduceMax(0.f);
+    printStats();
+    if (pipelined)
+      std::cout << "#hm.mpi: workers had at least "
+                << int(100.f*readyFraction+.5f)
+                << "% of commands delivered before they were needed;";
+    else
+      std::cout << "#hm.mpi:";
+    std::cout << " max total time workers spent waiting for commands "
+              << prettyDouble(maxWaitTime*1000.) << "ms" << std::endl;
+    if (passThrough) passThrough->terminate();
     // MPI_Finalize();
     // hs::mpi::finalize();//comm.finalize();
     // exit(0);
@@ -258,10 +450,15 @@ namespace hm {
     // get args....
     // ------------------------------------------------------------------
     checkEndOfMessage();
-    ;
+    // no more commands to come, so don't post another receive
+
     // ------------------------------------------------------------------
     // and do our own....
     // ------------------------------------------------------------------
+    float readyFraction
+      = stats.numCommands ? stats.numReady/float(stats.numCommands) : 1.f;
+    cmdComm.allReduceMin(readyFraction);
+    cmdComm.allReduceMax(float(stats.waitTime));
     // MPI_Finalize();
     renderer->terminate();
     // comm.finalize();
@@ -280,6 +477,7 @@ namespace hm {
     int cmd = RENDER_FRAME;
     sendToWorkers(cmd);
     sendEndOfMessage();
+    ++nextFrameID;
       
     // ------------------------------------------------------------------
     // and do our own....
@@ -293,7 +491,7 @@ namespace hm {
     // get args....
     // ------------------------------------------------------------------
     checkEndOfMessage();
-    ;
+    postNextCommand();
     // ------------------------------------------------------------------
     // and execute
     // ------------------------------------------------------------------
@@ -319,6 +517,8 @@ namespace hm {
     // ------------------------------------------------------------------
     if (passThrough) passThrough->resize(newSize,appFB);
 
+    // no non-blocking sends may be outstanding across the barrier
+    drainCommands();
     comm.barrier();
   }
 
@@ -336,7 +536,10 @@ namespace hm {
     
     renderer->resize(newSize,nullptr);
 
+    // only post the next receive once we're past the barrier (see
+    // MPIRenderEngine::resize)
     comm.barrier();
+    postNextCommand();
   }
 
   // ==================================================================
@@ -364,6 +567,7 @@ namespace hm {
     Camera camera;
     fromMaster(camera);
     checkEndOfMessage();
+    postNextCommand();
 
     // ------------------------------------------------------------------
     // and execute
@@ -373,6 +577,46 @@ namespace hm {
 
   // ==================================================================
 
+  void MPIRenderEngine::setInteractive(bool interactive)
+  {
+    int cmd = SET_INTERACTIVE;
+    sendToWorkers(cmd);
+    sendToWorkers((int)interactive);
+    sendEndOfMessage();
+    if (passThrough) passThrough->setInteractive(interactive);
+  }
+
+  void WorkerLoop::cmd_setInteractive()
+  {
+    int interactive;
+    fromMaster(interactive);
+    checkEndOfMessage();
+    postNextCommand();
+    renderer->setInteractive(interactive);
+  }
+
+  // ==================================================================
+
+  void MPIRenderEngine::setTimeStep(int stepIndex)
+  {
+    int cmd = SET_TIME_STEP;
+    sendToWorkers(cmd);
+    sendToWorkers(stepIndex);
+    sendEndOfMessage();
+    if (passThrough) passThrough->setTimeStep(stepIndex);
+  }
+
+  void WorkerLoop::cmd_setTimeStep()
+  {
+    int stepIndex;
+    fromMaster(stepIndex);
+    checkEndOfMessage();
+    postNextCommand();
+    renderer->setTimeStep(stepIndex);
+  }
+
+  // ==================================================================
+
   void MPIRenderEngine::setTransferFunction(const TransferFunction &xf)
   {
     // ------------------------------------------------------------------
@@ -401,6 +645,7 @@ namespace hm {
     fromMaster(xf.baseDensity);
     fromMaster(xf.colorMap);
     checkEndOfMessage();
+    postNextCommand();
 
     // ------------------------------------------------------------------
     // and execute
@@ -426,6 +671,7 @@ namespace hm {
     VolumeScatterSettings settings;
     fromMaster(settings);
     checkEndOfMessage();
+    postNextCommand();
     renderer->setVolumeScatterSettings(settings);
   }
 #endif
@@ -512,6 +758,7 @@ namespace hm {
     fromMaster(dirLights);
     
     checkEndOfMessage();
+    postNextCommand();
     
     // ------------------------------------------------------------------
     // and execute
@@ -522,20 +769,29 @@ namespace hm {
   // ==================================================================
   void WorkerLoop::runWorker()
   {
-    int handShake = -1;
+    int handShake[2] = { -1, 0 };
     comm.barrier();
-    fromMaster(handShake);
-    if (handShake != 29031974)
+    comm.bc_recv(handShake,sizeof(handShake));
+    pipelined = handShake[1];
+    if (handShake[0] != 29031974)
       throw std::runtime_error("could not handshake with master");
     
     while (1) {
+      {
+        HS_TRACE_SCOPE("waitCommand");
+        receiveCommand();
+      }
       int cmd = -1;
       fromMaster(cmd);
-      LOG(printf("#mi(%i) worker got cmd tag %i (%s)\n",
-                 comm.workersRank,cmd,
+      HS_TRACE_SCOPE("command",
+                     (cmd >= 0 && cmd < MAX_VALID_COMMANDS)
+                     ? commandNames[cmd] : "<invalid>");
+      LOG(printf("#mi(%i) worker got cmd tag %i (%s) for frame %i\n",
+                 comm.rank,cmd,
                  ((cmd>=0 && cmd<MAX_VALID_COMMANDS)
                   ?commandNames[cmd]
-                  :"<not a valid tag>")));
+                  :"<not a valid tag>"),
+                 frameID));
       // PRINT(cmd); PRINT(cmdName[cmd]);
       switch(cmd) {
       case SET_CAMERA:
@@ -554,6 +810,12 @@ namespace hm {
       case RESET_ACCUMULATION:
         cmd_resetAccumulation();
         break;
+      case SET_INTERACTIVE:
+        cmd_setInteractive();
+        break;
+      case SET_TIME_STEP:
+        cmd_setTimeStep();
+        break;
       case SCREEN_SHOT:
         cmd_screenShot();
         break;
@@ -12,17 +12,52 @@ namespace hm {
   using namespace hs;
   
   using hs::mpi::Comm;
+
+  /*! fixed-size slot in which the master broadcasts each command to
+      the workers, in a single broadcast. Each slot carries the id of
+      the frame the command belongs to, plus an inline payload area
+      that holds the command's tag, all its arguments, and the
+      end-of-message tag, as long as those fit - which is the case
+      for all the per-frame commands (camera, render frame, accum
+      reset). Larger commands (lights, transfer functions) send
+      whatever does not fit in a second broadcast right after the
+      slot.
+
+      With a head node (ie, a master that doesn't render anything
+      itself) the slots go out as non-blocking broadcasts, and the
+      workers post the receive for the next command as soon as they
+      have the current one's arguments; so the commands for frame N+1
+      get delivered while the workers are still rendering frame
+      N. The master can have at most 'queueDepth' slots in flight,
+      and stalls when it is that many commands ahead. */
+  struct CommandSlot {
+    enum { inlineCapacity = 240 };
+    /*! number of RENDER_FRAME commands issued before this one */
+    int frameID;
+    /*! total payload size of this command, in bytes; if larger than
+        inlineCapacity the rest follows in a separate broadcast */
+    int payloadSize;
+    uint8_t payload[inlineCapacity];
+  };
   
   /*! base abstraction for any renderer - no matter whether its a
     single node or multiple workers on the back */
   struct MPIRenderEngine : public RenderEngineInterface {
+    /*! 'queueDepth' is the max number of commands the master can
+        have in flight to the workers when it runs as a head node; '0'
+        means 'use $HS_CMD_QUEUE_DEPTH, or 2'. if the master renders
+        itself (ie, has a passThrough renderer) it is in lock-step
+        with the workers anyway, and all commands get sent blocking */
     MPIRenderEngine(Comm &comm,
-                    RenderEngineInterface *passThrough = 0);
+                    RenderEngineInterface *passThrough = 0,
+                    int queueDepth = 0);
     
     void renderFrame() override;
     void resize(const vec2i &fbSize, uint32_t *hostRgba) override;
     void resetAccumulation() override;
     void setCamera(const Camera &camera) override;
+    void setInteractive(bool interactive) override;
+    void setTimeStep(int stepIndex) override;
     // void setXF(const range1f &domain,
     //            const std::vector<vec4f> &colors) override;
     void setTransferFunction(const TransferFunction &xf) override;
@@ -35,6 +70,13 @@ namespace hm {
                    const std::vector<hs::PointLight> &pointLights,
                    const std::vector<hs::DirLight> &dirLights) override;
 
+    /*! frame read-back is local to the master, so these simply
+        forward to the passthrough renderer */
+    const uint32_t *getMappedFrame() const override
+    { return passThrough ? passThrough->getMappedFrame() : nullptr; }
+    FrameTimings getLastFrameTimings() const override
+    { return passThrough ? passThrough->getLastFrameTimings() : FrameTimings(); }
+    
     static void runWorker(Comm &comm,
                           RenderEngineInterface *client);
 
@@ -47,13 +89,45 @@ namespace hm {
 
     void checkEndOfMessage();
     void sendEndOfMessage();
+
+    /*! broadcast the currently pending command (ie, everything sent
+        since the last end-of-message) */
+    void flushCommand();
+    /*! wait until all slots still in flight have been delivered;
+        must be called before any other collective on 'comm' */
+    void drainCommands();
+    void printStats();
     
     Comm &comm;
+    /*! dup of comm that carries only the commands, so they can't
+        get mixed up with any other collectives on 'comm' */
+    Comm cmdComm;
     
     /*! passthrough-renderer on master node */
     RenderEngineInterface *passThrough = 0;
 
     int eomIdentifierBase = 0x12345;
+
+    /*! ring of slots for non-blocking sends; a single entry (that
+        only ever gets sent blocking) if we're not pipelining */
+    std::vector<CommandSlot> slots;
+    std::vector<MPI_Request> slotRequests;
+    std::vector<bool>        slotInFlight;
+    int  nextSlot  = 0;
+    bool pipelined = false;
+    /*! payload of the command currently being assembled */
+    std::vector<uint8_t> pending;
+    int nextFrameID = 0;
+
+    struct {
+      int    numCommands = 0;
+      /*! num times we had to wait for the oldest slot to go out */
+      int    numStalls   = 0;
+      double stallTime   = 0.;
+      /*! max num frames the oldest command still in flight was
+          behind the newest one */
+      int    maxFramesAhead = 0;
+    } stats;
   };
 
 }
@@ -0,0 +1,687 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayMaker/NativeRenderer.h"
+#include "hayMaker/common.h"
+#include "hayStack/Tracing.h"
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <numeric>
+#include <iomanip>
+
+namespace hm {
+
+  namespace {
+    /*! color of a surface that doesn't have any per-vertex or
+        per-sphere colors */
+    vec3f colorOf(const mini::Material::SP &material)
+    {
+      if (auto disney = std::dynamic_pointer_cast<mini::DisneyMaterial>(material))
+        return disney->baseColor;
+      if (auto matte = std::dynamic_pointer_cast<mini::Matte>(material))
+        return matte->reflectance;
+      return vec3f(.8f);
+    }
+
+    inline vec3f xfmPoint(const affine3f &xfm, const vec3f &v)
+    { return xfm.l.vx*v.x + xfm.l.vy*v.y + xfm.l.vz*v.z + xfm.p; }
+
+    /*! slab test; returns whether ray overlaps box within
+        [0,tMax), and where it enters it */
+    inline bool boxHit(const box3f &box, const vec3f &org, const vec3f &rcpDir,
+                       float tMax, float &tEnter, float &tLeave)
+    {
+      const vec3f lo = (box.lower-org)*rcpDir;
+      const vec3f hi = (box.upper-org)*rcpDir;
+      tEnter = std::max(0.f,reduce_max(min(lo,hi)));
+      tLeave = std::min(tMax,reduce_min(max(lo,hi)));
+      return tEnter <= tLeave;
+    }
+
+    /*! a small hash-based random number generator; good enough for
+        pixel and ray-marching jitter */
+    struct Random {
+      Random(uint32_t a, uint32_t b, uint32_t c)
+        : state(hash(a ^ hash(b ^ hash(c))))
+      {}
+      static uint32_t hash(uint32_t x)
+      {
+        x ^= x >> 16; x *= 0x7feb352dU;
+        x ^= x >> 15; x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+      }
+      float operator()()
+      {
+        state = hash(state+0x9e3779b9U);
+        return (state >> 8)*(1.f/(1<<24));
+      }
+      uint32_t state;
+    };
+
+    template<typename T>
+    inline float voxel(const T *voxels, const vec3i &dims,
+                       int x, int y, int z, float scale)
+    { return scale*float(voxels[x+size_t(dims.x)*(y+size_t(dims.y)*z)]); }
+
+    template<typename T>
+    inline float trilinear(const T *voxels, const vec3i &dims,
+                           const vec3f &p, float scale)
+    {
+      const int ix = std::max(0,std::min(int(p.x),dims.x-2));
+      const int iy = std::max(0,std::min(int(p.y),dims.y-2));
+      const int iz = std::max(0,std::min(int(p.z),dims.z-2));
+      const float fx = std::max(0.f,std::min(1.f,p.x-ix));
+      const float fy = std::max(0.f,std::min(1.f,p.y-iy));
+      const float fz = std::max(0.f,std::min(1.f,p.z-iz));
+      const size_t dx = 1;
+      const size_t dy = size_t(dims.x);
+      const size_t dz = size_t(dims.x)*dims.y;
+      const T *v = voxels+ix+dy*iy+dz*iz;
+      const float v00 = (1.f-fx)*float(v[0])    + fx*float(v[dx]);
+      const float v10 = (1.f-fx)*float(v[dy])   + fx*float(v[dy+dx]);
+      const float v01 = (1.f-fx)*float(v[dz])   + fx*float(v[dz+dx]);
+      const float v11 = (1.f-fx)*float(v[dz+dy])+ fx*float(v[dz+dy+dx]);
+      return scale*((1.f-fz)*((1.f-fy)*v00+fy*v10)
+                    +    fz *((1.f-fy)*v01+fy*v11));
+    }
+
+    /*! range of the vertex values of cells [begin,end) */
+    template<typename T>
+    range1f rangeOf(const T *voxels, const vec3i &dims,
+                    const vec3i &begin, const vec3i &end, float scale)
+    {
+      range1f range;
+      for (int z=begin.z;z<=end.z;z++)
+        for (int y=begin.y;y<=end.y;y++)
+          for (int x=begin.x;x<=end.x;x++)
+            range.extend(voxel(voxels,dims,x,y,z,scale));
+      return range;
+    }
+  }
+
+  NativeRenderer::NativeRenderer(hs::LocalPartitions *localPartitions,
+                                 const GlobalRenderSettings &globalRenderSettings)
+    : localPartitions(localPartitions),
+      globalRenderSettings(globalRenderSettings)
+  {
+    numThreads = std::max(1,(int)std::thread::hardware_concurrency());
+    unitDistance = powf(1.05f,xf.baseDensity-100.f);
+  }
+
+  BoundsData NativeRenderer::getWorldBounds() const
+  {
+    BoundsData bounds = localPartitions->getBounds();
+    if (bounds.spatial.empty())
+      bounds.spatial = box3f(vec3f(-1.f),vec3f(+1.f));
+    return bounds;
+  }
+
+  void NativeRenderer::buildAccels()
+  {
+    HS_TRACE_SCOPE("nativeBuild");
+    triangles.clear();
+    spheres.clear();
+    volumes.clear();
+    auto addTriangle = [&](const vec3f &v0, const vec3f &v1, const vec3f &v2,
+                           const vec3f &color) {
+      triangles.push_back({ v0, v1-v0, v2-v0, color });
+    };
+    auto initLevel = [&](VolumeLevel &level, const hs::StructuredVolume *vol) {
+      level.vol = vol;
+      if (vol->texelFormat == "float")
+        level.format = VolumeLevel::FLOAT;
+      else if (vol->texelFormat == "uint8_t")
+        level.format = VolumeLevel::UINT8;
+      else if (vol->texelFormat == "uint16_t")
+        level.format = VolumeLevel::UINT16;
+      else
+        throw std::runtime_error("native renderer: un-supported texel format '"
+                                 +vol->texelFormat+"'");
+      level.rcpSpacing = rcp(vol->gridSpacing);
+      const vec3i numCells = vol->dims-1;
+      level.numBricks = vec3i((numCells.x+brickSize-1)/brickSize,
+                              (numCells.y+brickSize-1)/brickSize,
+                              (numCells.z+brickSize-1)/brickSize);
+      level.dt = .5f*reduce_min(vol->gridSpacing);
+      const int numBricks = level.numBricks.x*level.numBricks.y*level.numBricks.z;
+      level.brickRanges.resize(numBricks);
+      std::vector<std::thread> threads;
+      for (int tid=0;tid<numThreads;tid++)
+        threads.push_back(std::thread([&,tid]() {
+          for (int brickID=tid;brickID<numBricks;brickID+=numThreads) {
+            const vec3i brick(brickID % level.numBricks.x,
+                              (brickID / level.numBricks.x) % level.numBricks.y,
+                              brickID / (level.numBricks.x*level.numBricks.y));
+            const vec3i begin = brick*int(brickSize);
+            const vec3i end = min(begin+int(brickSize),numCells);
+            const uint8_t *voxels = vol->voxels();
+            switch (level.format) {
+            case VolumeLevel::FLOAT:
+              level.brickRanges[brickID]
+                = rangeOf((const float*)voxels,vol->dims,begin,end,1.f);
+              break;
+            case VolumeLevel::UINT8:
+              level.brickRanges[brickID]
+                = rangeOf(voxels,vol->dims,begin,end,1.f/255.f);
+              break;
+            case VolumeLevel::UINT16:
+              level.brickRanges[brickID]
+                = rangeOf((const uint16_t*)voxels,vol->dims,begin,end,1.f/65535.f);
+              break;
+            }
+          }
+        }));
+      for (auto &thread : threads)
+        thread.join();
+    };
+
+    int numIgnored = 0;
+    for (auto part : localPartitions->myPartitions) {
+      for (auto mesh : part->triangleMeshes) {
+        const vec3f color = colorOf(mesh->material);
+        for (auto idx : mesh->indices)
+          addTriangle(mesh->vertices[idx.x],
+                      mesh->vertices[idx.y],
+                      mesh->vertices[idx.z],
+                      mesh->colors.empty()
+                      ? color
+                      : (mesh->colors[idx.x]
+                         +mesh->colors[idx.y]
+                         +mesh->colors[idx.z])*(1.f/3.f));
+      }
+      for (auto mini : part->minis)
+        for (auto inst : mini->instances)
+          for (auto mesh : inst->object->meshes) {
+            const vec3f color = colorOf(mesh->material);
+            for (auto idx : mesh->indices)
+              addTriangle(xfmPoint(inst->xfm,mesh->vertices[idx.x]),
+                          xfmPoint(inst->xfm,mesh->vertices[idx.y]),
+                          xfmPoint(inst->xfm,mesh->vertices[idx.z]),
+                          color);
+          }
+      for (auto ss : part->sphereSets) {
+        const vec3f color = colorOf(ss->material);
+        for (size_t i=0;i<ss->origins.size();i++)
+          spheres.push_back({ ss->origins[i],
+                              ss->radii.empty() ? ss->radius : ss->radii[i],
+                              ss->colors.empty() ? color : ss->colors[i] });
+      }
+      for (auto vol : part->structuredVolumes) {
+        if (reduce_min(vol->dims) < 2) continue;
+        Volume volume;
+        volume.bounds = box3f(vol->gridOrigin,
+                              vol->gridOrigin+vec3f(vol->dims-1)*vol->gridSpacing);
+        volume.valueRange = vol->getValueRange();
+        initLevel(volume.levels[0],vol.get());
+        if (!vol->coarserLevels.empty()) {
+          initLevel(volume.levels[1],vol->coarserLevels.back().get());
+          volume.numLevels = 2;
+        }
+        volumes.push_back(std::move(volume));
+      }
+      numIgnored
+        += int(part->unsts.size()
+               +part->cylinderSets.size()
+               +part->capsuleSets.size()
+               +part->nanovdbVolumes.size()
+               +part->amr.size());
+    }
+
+    const int numPrims = int(triangles.size()+spheres.size());
+    primIDs.resize(numPrims);
+    std::iota(primIDs.begin(),primIDs.end(),0);
+    std::vector<box3f> primBounds(numPrims);
+    std::vector<vec3f> centers(numPrims);
+    for (int i=0;i<numPrims;i++) {
+      box3f &bounds = primBounds[i];
+      if (i < (int)triangles.size()) {
+        const Triangle &tri = triangles[i];
+        bounds.extend(tri.v0);
+        bounds.extend(tri.v0+tri.e1);
+        bounds.extend(tri.v0+tri.e2);
+      } else {
+        const Sphere &sphere = spheres[i-triangles.size()];
+        bounds.extend(sphere.center-sphere.radius);
+        bounds.extend(sphere.center+sphere.radius);
+      }
+      centers[i] = bounds.center();
+    }
+    bvh.clear();
+    if (numPrims > 0) {
+      bvh.push_back({});
+      buildBVH(0,0,numPrims,primBounds,centers);
+    }
+    computeBrickOpacities();
+    haveAccels = true;
+
+    std::cout << "#hs.native: " << prettyNumber(triangles.size())
+              << " triangles, " << prettyNumber(spheres.size())
+              << " spheres (" << prettyNumber(bvh.size()) << " bvh nodes), "
+              << volumes.size() << " structured volume(s)";
+    if (numIgnored)
+      std::cout << "; ignoring " << numIgnored
+                << " piece(s) of content the native renderer doesn't support";
+    std::cout << std::endl;
+  }
+
+  /*! median split along the largest axis of the prims' centers; no
+      sah, since this is for quick looks, and has to build fast */
+  void NativeRenderer::buildBVH(int nodeID, int begin, int end,
+                                std::vector<box3f> &primBounds,
+                                std::vector<vec3f> &centers)
+  {
+    const int maxLeafSize = 4;
+    box3f bounds, centerBounds;
+    for (int i=begin;i<end;i++) {
+      bounds.extend(primBounds[primIDs[i]]);
+      centerBounds.extend(centers[primIDs[i]]);
+    }
+    bvh[nodeID].bounds = bounds;
+    const vec3f extent = centerBounds.span();
+    if (end-begin <= maxLeafSize || reduce_max(extent) <= 0.f) {
+      bvh[nodeID].offset   = begin;
+      bvh[nodeID].numPrims = end-begin;
+      return;
+    }
+    const int dim
+      = (extent.x >= extent.y && extent.x >= extent.z)
+      ? 0
+      : (extent.y >= extent.z ? 1 : 2);
+    const int mid = (begin+end)/2;
+    std::nth_element(primIDs.begin()+begin,primIDs.begin()+mid,primIDs.begin()+end,
+                     [&](uint32_t a, uint32_t b)
+                     { return centers[a][dim] < centers[b][dim]; });
+    const int childID = (int)bvh.size();
+    bvh.push_back({});
+    bvh.push_back({});
+    bvh[nodeID].offset   = childID;
+    bvh[nodeID].numPrims = 0;
+    buildBVH(childID+0,begin,mid,primBounds,centers);
+    buildBVH(childID+1,mid,end,primBounds,centers);
+  }
+
+  void NativeRenderer::computeBrickOpacities()
+  {
+    const int numColors = (int)xf.colorMap.size();
+    for (auto &volume : volumes) {
+      volume.domain
+        = isUnsetTransferFunctionDomain(xf.domain)
+        ? volume.valueRange
+        : xf.domain;
+      const float span = volume.domain.upper-volume.domain.lower;
+      for (int l=0;l<volume.numLevels;l++) {
+        VolumeLevel &level = volume.levels[l];
+        level.brickOpacity.resize(level.brickRanges.size());
+        for (size_t b=0;b<level.brickRanges.size();b++) {
+          const range1f range = level.brickRanges[b];
+          float opacity = 0.f;
+          if (numColors > 0) {
+            // all color map entries that any value in the brick
+            // interpolates between
+            auto entryOf = [&](float value) {
+              float f = span > 0.f ? (value-volume.domain.lower)/span : 0.f;
+              return std::max(0.f,std::min(1.f,f))*(numColors-1);
+            };
+            const int begin = int(floorf(entryOf(range.lower)));
+            const int end   = std::min(numColors-1,int(ceilf(entryOf(range.upper))));
+            for (int i=begin;i<=end;i++)
+              opacity = std::max(opacity,xf.colorMap[i].w);
+          }
+          level.brickOpacity[b] = opacity;
+        }
+      }
+    }
+  }
+
+  void NativeRenderer::updateScreen()
+  {
+    const float fovy = camera.fovy > 0.f ? camera.fovy : 60.f;
+    const float aspect = fbSize.y > 0 ? fbSize.x/float(fbSize.y) : 1.f;
+    const float scale = tanf(.5f*fovy*float(M_PI)/180.f);
+    screen.org = camera.vp;
+    screen.dir = normalize(camera.vi-camera.vp);
+    screen.du  = normalize(cross(screen.dir,camera.vu))*(scale*aspect);
+    screen.dv  = normalize(cross(screen.du,screen.dir))*scale;
+  }
+
+  void NativeRenderer::resize(const vec2i &fbSize, uint32_t *hostRGBA)
+  {
+    this->fbSize   = fbSize;
+    this->hostRGBA = hostRGBA;
+    accum.resize(size_t(fbSize.x)*fbSize.y);
+    finalPixels.resize(size_t(fbSize.x)*fbSize.y);
+    updateScreen();
+    resetAccumulation();
+  }
+
+  void NativeRenderer::resetAccumulation()
+  {
+    accumID = 0;
+  }
+
+  void NativeRenderer::setCamera(const hs::Camera &camera)
+  {
+    this->camera = camera;
+    updateScreen();
+    resetAccumulation();
+  }
+
+  void NativeRenderer::setTransferFunction(const hs::TransferFunction &xf)
+  {
+    this->xf = xf;
+    unitDistance = powf(1.05f,xf.baseDensity-100.f);
+    computeBrickOpacities();
+    resetAccumulation();
+  }
+
+  void NativeRenderer::setInteractive(bool interactive)
+  {
+    if (interactive == this->interactive) return;
+    this->interactive = interactive;
+    resetAccumulation();
+  }
+
+  void NativeRenderer::intersectSurfaces(const Ray &ray, Hit &hit) const
+  {
+    if (bvh.empty()) return;
+    int stack[64];
+    int stackPtr = 0;
+    stack[stackPtr++] = 0;
+    while (stackPtr > 0) {
+      const BVHNode &node = bvh[stack[--stackPtr]];
+      float t0, t1;
+      if (!boxHit(node.bounds,ray.org,ray.rcpDir,hit.t,t0,t1))
+        continue;
+      if (node.numPrims == 0) {
+        float tNear[2], tFar;
+        const bool hit0 = boxHit(bvh[node.offset+0].bounds,ray.org,ray.rcpDir,
+                                 hit.t,tNear[0],tFar);
+        const bool hit1 = boxHit(bvh[node.offset+1].bounds,ray.org,ray.rcpDir,
+                                 hit.t,tNear[1],tFar);
+        // closer child goes on top
+        if (hit0 && hit1) {
+          const int first = tNear[1] < tNear[0];
+          stack[stackPtr++] = node.offset+1-first;
+          stack[stackPtr++] = node.offset+first;
+        } else if (hit0)
+          stack[stackPtr++] = node.offset;
+        else if (hit1)
+          stack[stackPtr++] = node.offset+1;
+        continue;
+      }
+      for (int i=node.offset;i<node.offset+node.numPrims;i++) {
+        const int primID = (int)primIDs[i];
+        if (primID < (int)triangles.size()) {
+          // moeller-trumbore
+          const Triangle &tri = triangles[primID];
+          const vec3f pvec = cross(ray.dir,tri.e2);
+          const float det = dot(tri.e1,pvec);
+          if (fabsf(det) < 1e-20f) continue;
+          const float rcpDet = 1.f/det;
+          const vec3f tvec = ray.org-tri.v0;
+          const float u = dot(tvec,pvec)*rcpDet;
+          if (u < 0.f || u > 1.f) continue;
+          const vec3f qvec = cross(tvec,tri.e1);
+          const float v = dot(ray.dir,qvec)*rcpDet;
+          if (v < 0.f || u+v > 1.f) continue;
+          const float t = dot(tri.e2,qvec)*rcpDet;
+          if (t <= 0.f || t >= hit.t) continue;
+          hit.t = t;
+          hit.primID = primID;
+        } else {
+          const Sphere &sphere = spheres[primID-triangles.size()];
+          const vec3f oc = ray.org-sphere.center;
+          const float b = dot(oc,ray.dir);
+          const float c = dot(oc,oc)-sphere.radius*sphere.radius;
+          const float disc = b*b-c;
+          if (disc < 0.f) continue;
+          const float root = sqrtf(disc);
+          float t = -b-root;
+          if (t <= 0.f) t = -b+root;
+          if (t <= 0.f || t >= hit.t) continue;
+          hit.t = t;
+          hit.primID = primID;
+        }
+      }
+    }
+  }
+
+  float NativeRenderer::sample(const VolumeLevel &level, const vec3f &P) const
+  {
+    const hs::StructuredVolume *vol = level.vol;
+    const vec3f p = (P-vol->gridOrigin)*level.rcpSpacing;
+    const uint8_t *voxels = vol->voxels();
+    switch (level.format) {
+    case VolumeLevel::UINT8:
+      return trilinear(voxels,vol->dims,p,1.f/255.f);
+    case VolumeLevel::UINT16:
+      return trilinear((const uint16_t*)voxels,vol->dims,p,1.f/65535.f);
+    default:
+      return trilinear((const float*)voxels,vol->dims,p,1.f);
+    }
+  }
+
+  vec4f NativeRenderer::classify(float value, const range1f &domain) const
+  {
+    const int numColors = (int)xf.colorMap.size();
+    if (numColors == 0) return vec4f(0.f);
+    if (numColors == 1) return xf.colorMap[0];
+    const float span = domain.upper-domain.lower;
+    float f = span > 0.f ? (value-domain.lower)/span : 0.f;
+    f = std::max(0.f,std::min(1.f,f))*(numColors-1);
+    const int   i = std::min(int(f),numColors-2);
+    const float w = f-i;
+    return (1.f-w)*xf.colorMap[i]+w*xf.colorMap[i+1];
+  }
+
+  /*! 3D-DDA over the level's bricks; bricks the transfer function
+      maps to fully transparent don't get any samples. samples are at
+      t0+(k+jitter)*dt, no matter which bricks got skipped */
+  size_t NativeRenderer::marchVolume(const Volume &volume, const Ray &ray,
+                                     float t0, float t1, float jitter,
+                                     vec4f &color) const
+  {
+    const VolumeLevel &level
+      = volume.levels[(interactive && volume.numLevels > 1) ? 1 : 0];
+    const vec3f brickExtent = level.vol->gridSpacing*float(brickSize);
+    const vec3f P0 = ray.org+t0*ray.dir;
+    const vec3f rel = (P0-volume.bounds.lower)*rcp(brickExtent);
+    vec3i cell, step;
+    vec3f tNext, tDelta;
+    for (int d=0;d<3;d++) {
+      cell[d] = std::max(0,std::min(level.numBricks[d]-1,int(floorf(rel[d]))));
+      if (ray.dir[d] == 0.f) {
+        step[d]   = 0;
+        tNext[d]  = INFINITY;
+        tDelta[d] = INFINITY;
+        continue;
+      }
+      step[d] = ray.dir[d] > 0.f ? 1 : -1;
+      const float boundary
+        = volume.bounds.lower[d]+(cell[d]+(step[d] > 0 ? 1 : 0))*brickExtent[d];
+      tNext[d]  = (boundary-ray.org[d])*ray.rcpDir[d];
+      tDelta[d] = brickExtent[d]*fabsf(ray.rcpDir[d]);
+    }
+
+    const float dt = level.dt;
+    const float alphaScale = dt/unitDistance;
+    size_t numSamples = 0;
+    float t = t0;
+    while (t < t1) {
+      const float tExit = std::min(t1,reduce_min(tNext));
+      const int brickID
+        = cell.x+level.numBricks.x*(cell.y+level.numBricks.y*cell.z);
+      if (level.brickOpacity[brickID] > 0.f) {
+        for (int k=std::max(0,int(ceilf((t-t0)/dt-jitter)));;k++) {
+          const float ts = t0+(k+jitter)*dt;
+          if (ts >= tExit) break;
+          const vec4f rgba
+            = classify(sample(level,ray.org+ts*ray.dir),volume.domain);
+          numSamples++;
+          const float alpha = (1.f-color.w)*(1.f-expf(-rgba.w*alphaScale));
+          color.x += alpha*rgba.x;
+          color.y += alpha*rgba.y;
+          color.z += alpha*rgba.z;
+          color.w += alpha;
+          if (color.w >= .99f) return numSamples;
+        }
+      }
+      t = tExit;
+      const int d
+        = (tNext.x <= tNext.y && tNext.x <= tNext.z)
+        ? 0
+        : (tNext.y <= tNext.z ? 1 : 2);
+      if (tNext[d] >= t1) break;
+      cell[d] += step[d];
+      if (cell[d] < 0 || cell[d] >= level.numBricks[d]) break;
+      tNext[d] += tDelta[d];
+    }
+    return numSamples;
+  }
+
+  vec4f NativeRenderer::traceSample(const vec2i &pixel, int sampleID,
+                                    size_t &numSamples) const
+  {
+    const int spp = std::max(1,globalRenderSettings.samplesPerPixel);
+    Random random(pixel.x+fbSize.x*pixel.y,accumID*spp+sampleID,0x1234567);
+    const float u = 2.f*(pixel.x+random())/fbSize.x-1.f;
+    const float v = 2.f*(pixel.y+random())/fbSize.y-1.f;
+    Ray ray;
+    ray.org = screen.org;
+    ray.dir = normalize(screen.dir+u*screen.du+v*screen.dv);
+    for (int d=0;d<3;d++)
+      ray.rcpDir[d]
+        = 1.f/(fabsf(ray.dir[d]) < 1e-20f ? copysignf(1e-20f,ray.dir[d]) : ray.dir[d]);
+
+    Hit hit;
+    intersectSurfaces(ray,hit);
+
+    vec4f color(0.f);
+    if (!volumes.empty()) {
+      // volumes get blended in the order the ray enters them
+      thread_local std::vector<std::pair<float,int>> entered;
+      entered.clear();
+      for (int i=0;i<(int)volumes.size();i++) {
+        float t0, t1;
+        if (boxHit(volumes[i].bounds,ray.org,ray.rcpDir,hit.t,t0,t1))
+          entered.push_back({ t0,i });
+      }
+      std::sort(entered.begin(),entered.end());
+      const float jitter = random();
+      for (auto &e : entered) {
+        float t0, t1;
+        boxHit(volumes[e.second].bounds,ray.org,ray.rcpDir,hit.t,t0,t1);
+        numSamples += marchVolume(volumes[e.second],ray,t0,t1,jitter,color);
+        if (color.w >= .99f) break;
+      }
+    }
+
+    if (hit.primID >= 0 && color.w < 1.f) {
+      vec3f N, surfaceColor;
+      if (hit.primID < (int)triangles.size()) {
+        const Triangle &tri = triangles[hit.primID];
+        N = normalize(cross(tri.e1,tri.e2));
+        surfaceColor = tri.color;
+      } else {
+        const Sphere &sphere = spheres[hit.primID-triangles.size()];
+        N = normalize(ray.org+hit.t*ray.dir-sphere.center);
+        surfaceColor = sphere.color;
+      }
+      const vec3f shaded
+        = surfaceColor*(.25f+.75f*fabsf(dot(N,ray.dir)));
+      const float w = 1.f-color.w;
+      color.x += w*shaded.x;
+      color.y += w*shaded.y;
+      color.z += w*shaded.z;
+      color.w = 1.f;
+    }
+
+    if (color.w < 1.f) {
+      vec4f bg;
+      const vec4f bgColor = globalRenderSettings.bgColor;
+      if (!std::isnan(bgColor.x) && bgColor.x >= 0.f)
+        bg = bgColor;
+      else {
+        const vec4f bgBottom(.9f,.9f,.9f,1.f);
+        const vec4f bgTop(.15f,.25f,.8f,1.f);
+        const float t = (pixel.y+.5f)/fbSize.y;
+        bg = (1.f-t)*bgBottom+t*bgTop;
+      }
+      color = color+(1.f-color.w)*bg;
+    }
+    return color;
+  }
+
+  void NativeRenderer::renderFrame()
+  {
+    if (!haveAccels)
+      buildAccels();
+    if (fbSize.x <= 0 || fbSize.y <= 0) return;
+
+    const double t0 = getCurrentTime();
+    const int spp = std::max(1,globalRenderSettings.samplesPerPixel);
+    const vec2i numTiles((fbSize.x+tileSize-1)/tileSize,
+                         (fbSize.y+tileSize-1)/tileSize);
+    const float scale = 1.f/((accumID+1)*spp);
+    std::atomic<int>    nextTile(0);
+    std::atomic<size_t> numSamples(0);
+    std::vector<std::thread> threads;
+    for (int tid=0;tid<numThreads;tid++)
+      threads.push_back(std::thread([&]() {
+        size_t mySamples = 0;
+        for (int tileID=nextTile++;tileID<numTiles.x*numTiles.y;tileID=nextTile++) {
+          const vec2i begin
+            = vec2i(tileID % numTiles.x,tileID / numTiles.x)*int(tileSize);
+          const vec2i end = min(begin+int(tileSize),fbSize);
+          for (int iy=begin.y;iy<end.y;iy++)
+            for (int ix=begin.x;ix<end.x;ix++) {
+              vec4f sum(0.f);
+              for (int s=0;s<spp;s++)
+                sum = sum+traceSample(vec2i(ix,iy),s,mySamples);
+              const size_t i = ix+size_t(fbSize.x)*iy;
+              accum[i] = accumID == 0 ? sum : accum[i]+sum;
+              finalPixels[i] = packSRGB8(scale*accum[i]);
+            }
+        }
+        numSamples += mySamples;
+      }));
+    for (auto &thread : threads)
+      thread.join();
+    accumID++;
+
+    const double t1 = getCurrentTime();
+    if (hostRGBA)
+      std::memcpy(hostRGBA,finalPixels.data(),finalPixels.size()*sizeof(uint32_t));
+    const double t2 = getCurrentTime();
+    hs::trace::record("render","native",t0,t1);
+
+    lastFrameTimings = FrameTimings();
+    lastFrameTimings.render = t1-t0;
+    lastFrameTimings.copy   = t2-t1;
+    stats.numRays    += size_t(fbSize.x)*fbSize.y*spp;
+    stats.numSamples += numSamples;
+    stats.renderTime += t1-t0;
+    if (reportInterval > 0 && ++numFramesSinceReport == reportInterval)
+      report();
+  }
+
+  void NativeRenderer::report()
+  {
+    const double time = stats.renderTime-statsAtReport.renderTime;
+    if (time > 0.) {
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(2);
+      ss << "#hs.native: " << numThreads << " thread(s), "
+         << prettyNumber(size_t((stats.numRays-statsAtReport.numRays)/time))
+         << " rays/s, "
+         << prettyNumber(size_t((stats.numSamples-statsAtReport.numSamples)/time))
+         << " samples/s, " << 1000.*time/numFramesSinceReport << "ms/frame";
+      std::cout << ss.str() << std::endl;
+    }
+    statsAtReport = stats;
+    numFramesSinceReport = 0;
+  }
+
+}
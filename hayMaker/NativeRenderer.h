@@ -0,0 +1,168 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/LocalPartitions.h"
+#include "hayMaker/HayMaker.h"
+
+namespace hm {
+
+  /*! a simple cpu renderer that doesn't need any anari library (nor
+      a gpu): for quick looks on login nodes, and for tracking
+      performance on machines without gpus. renders the structured
+      volumes, spheres, and triangle meshes (including those of mini
+      scenes) of a single rank's partition(s), with primary rays
+      only: volumes get ray-marched with the transfer function,
+      skipping bricks that the transfer function maps to fully
+      transparent, and surfaces come from a bvh over all spheres and
+      triangles. all other content gets ignored.
+
+      multi-threaded over tiles of the frame, and accumulates samples
+      across frames until the camera (or anything else) changes */
+  struct NativeRenderer : public RenderEngineInterface {
+    NativeRenderer(hs::LocalPartitions *localPartitions,
+                   const GlobalRenderSettings &globalRenderSettings);
+
+    BoundsData getWorldBounds() const;
+    /*! builds the bvh and the volumes' brick value ranges from the
+        current content of the partitions */
+    void buildAccels();
+
+    void resize(const vec2i &fbSize, uint32_t *hostRgba) override;
+    void renderFrame() override;
+    void resetAccumulation() override;
+    void setCamera(const hs::Camera &camera) override;
+    void setTransferFunction(const hs::TransferFunction &xf) override;
+    /*! renders volumes from their coarsest level (if they have
+        coarser levels at all) while interactive, same as
+        AnariDeviceRenderer */
+    void setInteractive(bool interactive) override;
+
+    const uint32_t *getMappedFrame() const override
+    { return finalPixels.empty() ? nullptr : finalPixels.data(); }
+    FrameTimings getLastFrameTimings() const override { return lastFrameTimings; }
+
+    /*! totals across all frames so far */
+    struct Stats {
+      /*! primary rays, one per pixel sample */
+      size_t numRays    = 0;
+      /*! volume samples taken (ie, transfer function lookups) */
+      size_t numSamples = 0;
+      double renderTime = 0.;
+    };
+    Stats stats;
+    /*! num frames over which rays/s and samples/s get printed; 0 to
+        never print them */
+    int   reportInterval = 64;
+    int   numThreads;
+
+  private:
+    struct Ray {
+      vec3f org, dir;
+      /*! 1/dir, for the slab tests */
+      vec3f rcpDir;
+    };
+    /*! a triangle the way the intersection test wants it */
+    struct Triangle {
+      vec3f v0, e1, e2;
+      vec3f color;
+    };
+    struct Sphere {
+      vec3f center;
+      float radius;
+      vec3f color;
+    };
+    /*! inner nodes have numPrims == 0, and their children at
+        offset and offset+1; leaves have their prims at
+        primIDs[offset..offset+numPrims) */
+    struct BVHNode {
+      box3f bounds;
+      int   offset;
+      int   numPrims;
+    };
+    /*! one level of a structured volume, in bricks of brickSize
+        cells each */
+    struct VolumeLevel {
+      const hs::StructuredVolume *vol = nullptr;
+      enum { FLOAT, UINT8, UINT16 } format;
+      vec3f rcpSpacing;
+      vec3i numBricks;
+      std::vector<range1f> brickRanges;
+      /*! per brick, the highest opacity the current transfer
+          function gives any of its values; 0 means it can be
+          skipped */
+      std::vector<float>   brickOpacity;
+      /*! ray-marching step */
+      float dt;
+    };
+    struct Volume {
+      box3f   bounds;
+      range1f valueRange;
+      /*! what the transfer function's color map spans: its domain,
+          or - if that isn't set - valueRange */
+      range1f domain;
+      /*! full-res and (if any) coarsest level */
+      VolumeLevel levels[2];
+      int     numLevels = 1;
+    };
+    struct Hit {
+      float t = INFINITY;
+      int   primID = -1;
+    };
+    enum { brickSize = 8, tileSize = 16 };
+
+    void  buildBVH(int nodeID, int begin, int end,
+                   std::vector<box3f> &primBounds,
+                   std::vector<vec3f> &centers);
+    void  computeBrickOpacities();
+    /*! the camera's screen, for the current camera and frame size */
+    void  updateScreen();
+    /*! (linear, premultiplied) rgba of given pixel sample */
+    vec4f traceSample(const vec2i &pixel, int sampleID,
+                      size_t &numSamples) const;
+    void  intersectSurfaces(const Ray &ray, Hit &hit) const;
+    /*! marches ray from t0 to t1 through volume, blending into
+        color (front to back); returns num samples taken */
+    size_t marchVolume(const Volume &volume, const Ray &ray,
+                       float t0, float t1, float jitter,
+                       vec4f &color) const;
+    float sample(const VolumeLevel &level, const vec3f &P) const;
+    vec4f classify(float value, const range1f &domain) const;
+    void  report();
+
+    hs::LocalPartitions *const localPartitions;
+    const GlobalRenderSettings globalRenderSettings;
+
+    std::vector<Triangle> triangles;
+    std::vector<Sphere>   spheres;
+    /*! prim IDs below triangles.size() are triangles, the others
+        spheres */
+    std::vector<uint32_t> primIDs;
+    std::vector<BVHNode>  bvh;
+    std::vector<Volume>   volumes;
+
+    bool       haveAccels = false;
+
+    hs::TransferFunction xf;
+    /*! distance over which a sample's opacity applies (same as for
+        the anari volumes) */
+    float      unitDistance;
+    hs::Camera camera;
+    struct {
+      vec3f org, dir, du, dv;
+    } screen;
+    bool       interactive = false;
+
+    vec2i      fbSize { 0,0 };
+    uint32_t  *hostRGBA = nullptr;
+    std::vector<vec4f>    accum;
+    std::vector<uint32_t> finalPixels;
+    int        accumID = 0;
+    FrameTimings lastFrameTimings;
+    /*! stats since last report */
+    Stats      statsAtReport;
+    int        numFramesSinceReport = 0;
+  };
+
+}
@@ -8,6 +8,25 @@
 
 /* parallel renderer abstraction */
 namespace hm {
+
+  /*! per-frame breakdown of where a renderFrame() spent its time, in
+      seconds */
+  struct FrameTimings {
+    /*! time spent waiting for the presented frame to finish
+        rendering; with double buffering this is only the part of
+        the render that did _not_ overlap with the previous frame's
+        readback */
+    double render = 0.;
+    /*! time spent mapping the frame's color channel */
+    double map    = 0.;
+    /*! time spent compositing the ranks' frames on the hayStack
+        side - or, sort-first, gathering their tiles - (0 if the
+        anari device does that) */
+    double composite = 0.;
+    /*! time spent copying the mapped pixels into the host
+        framebuffer (0 if app uses the mapped frame directly) */
+    double copy   = 0.;
+  };
   
   /*! base abstraction for any renderer - no matter whether it's a
       single node or multiple workers on the back */
@@ -21,6 +40,14 @@ namespace hm {
     virtual void resize(const vec2i &fbSize, uint32_t *hostRgba) {}
     virtual void resetAccumulation() {}
     virtual void setCamera(const hs::Camera &camera) {}
+    /*! tells the renderer whether the user is currently interacting
+        (eg, dragging the camera); while true, it may trade quality
+        for frame rate - eg, by rendering structured volumes from a
+        coarser level of their pyramid */
+    virtual void setInteractive(bool interactive) {}
+    /*! switches to the given step (0..numSteps-1) of a time series,
+        if the content is one */
+    virtual void setTimeStep(int stepIndex) {}
     // virtual void setXF(const range1f &domain,
     //                    const std::vector<vec4f> &colors) {}
     virtual void screenShot() {}
@@ -28,6 +55,16 @@ namespace hm {
     virtual void setLights(float ambient,
                            const std::vector<hs::PointLight> &pointLights,
                            const std::vector<hs::DirLight> &dirLights) {}
+
+    /*! returns the pixels of the most recently presented frame, if
+        the renderer can provide them without a copy (in which case
+        the app can pass a null host framebuffer to resize()). the
+        pointer is only valid until the next renderFrame(), resize(),
+        or resetAccumulation(); null if not available */
+    virtual const uint32_t *getMappedFrame() const { return nullptr; }
+    
+    /*! timing breakdown of the last renderFrame() */
+    virtual FrameTimings getLastFrameTimings() const { return {}; }
   };
 
 }
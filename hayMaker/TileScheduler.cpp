@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayMaker/TileScheduler.h"
+#include <numeric>
+#include <iomanip>
+
+namespace hm {
+
+  TileScheduler::TileScheduler(Comm &comm, int numTiles)
+    : numTiles(numTiles),
+      comm(comm)
+  {
+    if (numTiles < 1)
+      throw std::runtime_error("need at least one tile");
+    ownerOf.resize(numTiles);
+    for (int t=0;t<numTiles;t++)
+      ownerOf[t] = t % comm.size;
+    setMyTiles();
+  }
+
+  void TileScheduler::setMyTiles()
+  {
+    tilesOfThisRank.clear();
+    for (int t=0;t<numTiles;t++)
+      if (ownerOf[t] == comm.rank)
+        tilesOfThisRank.push_back(t);
+  }
+
+  void TileScheduler::update(const std::vector<float> &myTileTimes)
+  {
+    if (comm.rank != 0) {
+      comm.masterGather(myTileTimes.data(),numTiles);
+      comm.bc_recv(ownerOf.data(),numTiles*sizeof(int));
+      setMyTiles();
+      return;
+    }
+
+    allTimes.resize(size_t(numTiles)*comm.size);
+    comm.masterGather(allTimes.data(),myTileTimes.data(),numTiles);
+    // every tile got rendered by exactly one rank, all others have
+    // 0 for it
+    std::vector<float> tileTime(numTiles,0.f);
+    for (int r=0;r<comm.size;r++)
+      for (int t=0;t<numTiles;t++)
+        tileTime[t] += allTimes[size_t(r)*numTiles+t];
+
+    std::vector<double> rankTime(comm.size,0.);
+    double sumTime = 0.;
+    for (int t=0;t<numTiles;t++) {
+      rankTime[ownerOf[t]] += tileTime[t];
+      sumTime += tileTime[t];
+    }
+    const double currentMax
+      = *std::max_element(rankTime.begin(),rankTime.end());
+    if (sumTime > 0.)
+      sumImbalance += currentMax*comm.size/sumTime;
+
+    // longest processing time first
+    std::vector<int> order(numTiles);
+    std::iota(order.begin(),order.end(),0);
+    std::stable_sort(order.begin(),order.end(),
+                     [&](int a, int b) { return tileTime[a] > tileTime[b]; });
+    std::vector<int>    newOwnerOf(numTiles);
+    std::vector<double> newRankTime(comm.size,0.);
+    for (auto t : order) {
+      int r = int(std::min_element(newRankTime.begin(),newRankTime.end())
+                  -newRankTime.begin());
+      newOwnerOf[t]   = r;
+      newRankTime[r] += tileTime[t];
+    }
+    const double newMax
+      = *std::max_element(newRankTime.begin(),newRankTime.end());
+    if (newMax*minImprovement < currentMax) {
+      ownerOf = newOwnerOf;
+      numReassignments++;
+    }
+    comm.bc_send(ownerOf.data(),numTiles*sizeof(int));
+    setMyTiles();
+
+    if (reportInterval > 0 && ++numFramesSinceReport == reportInterval) {
+      std::stringstream ss;
+      ss << std::fixed << std::setprecision(2);
+      ss << "#hs.sf: " << numTiles << " tiles on " << comm.size
+         << " rank(s); average imbalance "
+         << sumImbalance/numFramesSinceReport
+         << "x (slowest rank over average), re-assigned "
+         << numReassignments << " time(s) in the last "
+         << numFramesSinceReport << " frames";
+      std::cout << ss.str() << std::endl;
+      numFramesSinceReport = 0;
+      numReassignments = 0;
+      sumImbalance = 0.;
+    }
+  }
+
+}
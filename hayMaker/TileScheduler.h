@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/MPIWrappers.h"
+
+namespace hm {
+  using namespace hs;
+  using hs::mpi::Comm;
+
+  /*! which rank renders which screen tile, for sort-first rendering
+      of data that every rank has all of. starts out interleaved
+      (tile t on rank t%N); after every frame, rank 0 gets the
+      tiles' render times, re-assigns them longest first to
+      whichever rank has the least so far (LPT), and - if that's
+      enough of an improvement over the current assignment - hands
+      the new one to everybody */
+  struct TileScheduler {
+    TileScheduler(Comm &comm, int numTiles);
+
+    /*! the tiles this rank renders, in increasing order */
+    const std::vector<int> &myTiles() const { return tilesOfThisRank; }
+
+    /*! collective; given how long this rank took for each of its
+        tiles (indexed by tile, with 0 for those of other ranks),
+        updates the assignment for the next frame */
+    void update(const std::vector<float> &myTileTimes);
+
+    const int numTiles;
+    /*! rank that renders every tile */
+    std::vector<int> ownerOf;
+    /*! a new assignment only gets used if its slowest rank is
+        predicted to be faster than the current one's by at least
+        this factor */
+    float minImprovement = 1.05f;
+    /*! num frames over which imbalance and re-assignments get
+        printed on rank 0; 0 to never print them */
+    int reportInterval = 64;
+
+  private:
+    void setMyTiles();
+
+    Comm comm;
+    std::vector<int>   tilesOfThisRank;
+    /*! on rank 0, all ranks' times of the last frame */
+    std::vector<float> allTimes;
+    /*! stats since last report */
+    int    numFramesSinceReport = 0;
+    int    numReassignments = 0;
+    double sumImbalance = 0.;
+  };
+
+}
@@ -14,5 +14,20 @@ namespace hm {
   using hs::range1f;
   using hs::DirLight;
   using hs::PointLight;
+
+  /*! linear rgba to what a ANARI_UFIXED8_RGBA_SRGB frame would
+      have: sRGB-encoded color, linear alpha, 8 bits each */
+  inline uint32_t packSRGB8(const vec4f &c)
+  {
+    auto encode = [](float f) {
+      f = std::min(1.f,std::max(0.f,f));
+      f = (f <= 0.0031308f) ? 12.92f*f : 1.055f*powf(f,1.f/2.4f)-.055f;
+      return uint32_t(f*255.f+.5f);
+    };
+    return (encode(c.x) <<  0)
+      |    (encode(c.y) <<  8)
+      |    (encode(c.z) << 16)
+      |    (uint32_t(std::min(1.f,std::max(0.f,c.w))*255.f+.5f) << 24);
+  }
   
 }
@@ -829,17 +829,17 @@ namespace hs {
                         (const anari::math::float3&)vol->gridSpacing);
     if (vol->texelFormat == "float") {
       anari::setParameterArray3D
-        (device, field, "data", (const float *)vol->rawData.data(),
+        (device, field, "data", (const float *)vol->voxels(),
          volumeDims.x, volumeDims.y, volumeDims.z);
     } else if (vol->texelFormat == "uint8_t") {
       anari::setParameterArray3D
-        (device, field, "data", (const uint8_t *)vol->rawData.data(),
+        (device, field, "data", (const uint8_t *)vol->voxels(),
          volumeDims.x, volumeDims.y, volumeDims.z);
     } else if (vol->texelFormat == "uint16_t") {
       std::cout << "volume with uint16s, converting to float" << std::endl;
-      static std::vector<float> volumeAsFloats(vol->rawData.size()/2);
+      static std::vector<float> volumeAsFloats(vol->voxelBytes()/2);
       for (size_t i=0;i<volumeAsFloats.size();i++)
-        volumeAsFloats[i] = ((uint16_t*)vol->rawData.data())[i]
+        volumeAsFloats[i] = ((const uint16_t*)vol->voxels())[i]
           * (1.f/((1<<16)-1));
       anari::setParameterArray3D
         (device, field, "data", (const float *)volumeAsFloats.data(),
@@ -8,6 +8,7 @@
     data at all */
 
 #include "hayStack/LocalPartitions.h"
+#include "hayStack/Tracing.h"
 
 namespace hs {
 
@@ -24,8 +25,15 @@ namespace hs {
     assert(!myPartitions.empty());
   }
 
+  LocalPartitions::~LocalPartitions()
+  {
+    for (auto p : myPartitions)
+      delete p;
+  }
+
   BoundsData LocalPartitions::getBounds() const
   {
+    HS_TRACE_SCOPE("bounds");
     BoundsData bounds;
     for (auto &dg : myPartitions)
       bounds.extend(dg->getBounds());
@@ -64,6 +72,7 @@ namespace hs {
     negative side effects on performance */
   void LocalPartitions::mergeUnstructuredMeshes()
   {
+    HS_TRACE_SCOPE("mergeUnstructuredMeshes");
     for (auto &part : myPartitions)
       part->mergeUnstructuredMeshes();
   }
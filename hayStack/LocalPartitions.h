@@ -19,6 +19,8 @@ namespace hs {
   struct LocalPartitions {
     LocalPartitions(const std::vector<int> &localDataRanks,
                     int numPartitionsGlobally);
+    /*! also deletes the partitions */
+    ~LocalPartitions();
     BoundsData getBounds() const;
 
     /*! returns whether this rank does *not* have any data; in this
@@ -42,6 +44,9 @@ namespace hs {
         more ranks with more data */
     std::vector<OnePartition *> myPartitions;
     int const numPartitionsGlobally;
+    /*! num ranks of every data group, if partially replicated (see
+        DataLoader::replicasOfGroup); empty otherwise */
+    std::vector<int> replicasOfGroup;
     // int colorMapIndex = 0;
   };
 
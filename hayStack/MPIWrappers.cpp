@@ -55,14 +55,49 @@ namespace hs {
       and matched by bc_recv on all workers */
     void Comm::bc_send(const void *data, size_t numBytes)
     {
-      HS_MPI_CALL(Bcast((void *)data,numBytes,MPI_BYTE,0,comm));
+      // MPI counts are int, so send anything larger in pieces
+      for (size_t begin=0;begin<numBytes;begin+=maxBytesPerMessage)
+        HS_MPI_CALL(Bcast((uint8_t *)data+begin,
+                          (int)std::min(maxBytesPerMessage,numBytes-begin),
+                          MPI_BYTE,0,comm));
     }
     
     /*! receive side of a broadcast - must be called on all ranks >
       0, and match a bc_send on rank 0 */
     void Comm::bc_recv(void *data, size_t numBytes)
     {
-      HS_MPI_CALL(Bcast(data,numBytes,MPI_BYTE,0,comm));
+      for (size_t begin=0;begin<numBytes;begin+=maxBytesPerMessage)
+        HS_MPI_CALL(Bcast((uint8_t *)data+begin,
+                          (int)std::min(maxBytesPerMessage,numBytes-begin),
+                          MPI_BYTE,0,comm));
+    }
+    
+    /*! non-blocking version of bc_send (ie, MPI_Ibcast); the buffer
+      must remain valid (and unmodified) until the request has
+      completed */
+    void Comm::ibc_send(const void *data, size_t numBytes, MPI_Request &req)
+    {
+      assert(numBytes <= maxBytesPerMessage);
+      HS_MPI_CALL(Ibcast((void *)data,(int)numBytes,MPI_BYTE,0,comm,&req));
+    }
+    
+    /*! non-blocking version of bc_recv; must match a ibc_send on rank
+      0, and the buffer is only valid once the request has
+      completed */
+    void Comm::ibc_recv(void *data, size_t numBytes, MPI_Request &req)
+    {
+      assert(numBytes <= maxBytesPerMessage);
+      HS_MPI_CALL(Ibcast(data,(int)numBytes,MPI_BYTE,0,comm,&req));
+    }
+
+    /*! checks if the given request has completed yet, without
+      blocking. returns true (and frees the request) if it has, false
+      if not */
+    bool Comm::test(MPI_Request &req)
+    {
+      int done = 1;
+      HS_MPI_CALL(Test(&req,&done,MPI_STATUS_IGNORE));
+      return done != 0;
     }
     
     void Comm::assertValid() const
@@ -90,6 +125,20 @@ namespace hs {
       return result;
     }
 
+    size_t Comm::allReduceAdd(size_t value) const
+    {
+      uint64_t mine = value, result = value;
+      HS_MPI_CALL(Allreduce(&mine,&result,1,MPI_UINT64_T,MPI_SUM,comm));
+      return (size_t)result;
+    }
+
+    size_t Comm::allReduceMax(size_t value) const
+    {
+      uint64_t mine = value, result = value;
+      HS_MPI_CALL(Allreduce(&mine,&result,1,MPI_UINT64_T,MPI_MAX,comm));
+      return (size_t)result;
+    }
+
     int Comm::allReduceMin(int value) const
     {
       int result = value;
@@ -138,6 +187,12 @@ namespace hs {
       HS_MPI_CALL(Allgather(myValues,numMyValues,MPI_INT,allValues,numMyValues,MPI_INT,comm));
     }
     
+    void Comm::allGather(float *allValues, float myValue)
+    {
+      allValues[rank] = myValue;
+      HS_MPI_CALL(Allgather(&myValue,1,MPI_FLOAT,allValues,1,MPI_FLOAT,comm));
+    }
+    
     /*! free/close this communicator */
     void Comm::free()
     {
@@ -161,6 +216,34 @@ namespace hs {
 #endif
     }
     
+    /*! equivalent of MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) -
+      splits this comm into one comm per shared-memory node */
+    Comm Comm::splitShared()
+    {
+#if HS_FAKE_MPI
+        return Comm();
+#else
+      MPI_Comm newComm;
+      HS_MPI_CALL(Comm_split_type(comm,MPI_COMM_TYPE_SHARED,rank,
+                                  MPI_INFO_NULL,&newComm));
+      return Comm(newComm);
+#endif
+    }
+    
+    /*! equivalent of MPI_Comm_dup - creates a new communicator with
+      the same ranks as this one, but whose collectives can never get
+      mixed up with those on this one */
+    Comm Comm::dup() const
+    {
+#if HS_FAKE_MPI
+      return Comm();
+#else
+      MPI_Comm newComm;
+      HS_MPI_CALL(Comm_dup(comm,&newComm));
+      return Comm(newComm);
+#endif
+    }
+    
     void Comm::barrier() const
     {
       HS_MPI_CALL(Barrier(comm));
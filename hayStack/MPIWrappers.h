@@ -68,6 +68,16 @@ namespace hs {
           itself, and all others get a communicator that contains all
           other former ranks */
       Comm split(int color);
+
+      /*! equivalent of MPI_Comm_split_type(MPI_COMM_TYPE_SHARED) -
+          splits this comm into one comm per shared-memory node, each
+          containing exactly those ranks that run on that node */
+      Comm splitShared();
+
+      /*! equivalent of MPI_Comm_dup - creates a new communicator
+          with the same ranks as this one, but whose collectives can
+          never get mixed up with those on this one */
+      Comm dup() const;
       
       inline operator MPI_Comm() { return comm; }
 
@@ -80,6 +90,9 @@ namespace hs {
       vec3f allReduceMin(vec3f value) const;
       int   allReduceAdd(int value) const;
       float allReduceAdd(float value) const;
+      /*! for counts and sizes that may not fit an int */
+      size_t allReduceMax(size_t value) const;
+      size_t allReduceAdd(size_t value) const;
       void barrier() const;
 
       /*! free/close this communicator */
@@ -87,6 +100,7 @@ namespace hs {
 
       void allGather(int *allValues, int myValue);
       void allGather(int *allValues, const int *myValues, int numMyValues);
+      void allGather(float *allValues, float myValue);
       
       /*! master-side of a gather where clietn gathers a fixed number
           of itmes from each rank */
@@ -100,6 +114,37 @@ namespace hs {
       template<typename T>
       void masterGather(// what we're sending (this rank's data only)
                         const T *sendBuffer, int numItemsSentOnEachRank);
+      /*! master-side of a gather where each rank sends a different
+          (but known to the master) number of items (ie,
+          MPI_Gatherv); ranks' items end up back to back, in rank
+          order */
+      template<typename T>
+      void masterGatherv(// where we'll receive into - for ALL ranks
+                         T *recvBuffer,
+                         // what we're sending (this rank's data only)
+                         const T *sendBuffer,
+                         const std::vector<int> &numItemsOfRank);
+      /*! client-side of masterGatherv() */
+      template<typename T>
+      void masterGatherv(const T *sendBuffer, int numItemsSentByThisRank);
+
+      /*! all-to-all exchange of a varying number of items between
+          all ranks (ie, MPI_Alltoallv): the first sendCounts[0]
+          items of sendBuffer go to rank 0, the next sendCounts[1]
+          to rank 1, etc. returns everything all ranks sent to this
+          one, in rank order, with the per-rank counts in
+          recvCounts */
+      template<typename T>
+      std::vector<T> allToAllv(const std::vector<T> &sendBuffer,
+                               const std::vector<int> &sendCounts,
+                               std::vector<int> &recvCounts);
+
+      /*! all-gather of a varying number of items per rank (ie,
+          MPI_Allgatherv); returns all ranks' items in rank order,
+          with the per-rank counts in recvCounts */
+      template<typename T>
+      std::vector<T> allGatherv(const std::vector<T> &myItems,
+                                std::vector<int> &recvCounts);
 
       template<typename T>
       void recv(int fromRank, int tag,
@@ -115,16 +160,37 @@ namespace hs {
       }
 
       /*! master's send side of broadcast - must be done on rank 0,
-          and matched by bc_recv on all workers */
+          and matched by bc_recv on all workers. anything larger than
+          maxBytesPerMessage gets sent as multiple broadcasts */
       void bc_send(const void *ptr, size_t numBytes);
       
       /*! receive side of a broadcast - must be called on all ranks >
           0, and match a bc_send on rank 0 */
       void bc_recv(void *ptr, size_t numBytes);
 
+      /*! non-blocking version of bc_send (ie, MPI_Ibcast), for
+          messages of at most maxBytesPerMessage; the buffer must
+          remain valid (and unmodified) until the request has
+          completed */
+      void ibc_send(const void *ptr, size_t numBytes, MPI_Request &req);
+      
+      /*! non-blocking version of bc_recv; must match a ibc_send on
+          rank 0, and the buffer is only valid once the request has
+          completed */
+      void ibc_recv(void *ptr, size_t numBytes, MPI_Request &req);
+
+      /*! checks if the given request has completed yet, without
+          blocking. returns true (and frees the request) if it has,
+          false if not */
+      bool test(MPI_Request &req);
+
       int rank = -1, size = -1;
 
       MPI_Comm comm = MPI_COMM_NULL;
+
+      /*! largest piece that bc_send/bc_recv send in one broadcast
+          (MPI counts are int) */
+      static constexpr size_t maxBytesPerMessage = size_t(1)<<30;
     };
     
     template<typename T>
@@ -165,6 +231,66 @@ namespace hs {
                           0,comm));
     }
     
+    template<typename T>
+    inline std::vector<T> Comm::allToAllv(const std::vector<T> &sendBuffer,
+                                          const std::vector<int> &sendCounts,
+                                          std::vector<int> &recvCounts)
+    {
+#if HS_FAKE_MPI
+      recvCounts = sendCounts;
+      return sendBuffer;
+#else
+      recvCounts.resize(size);
+      HS_MPI_CALL(Alltoall(sendCounts.data(),1,MPI_INT,
+                           recvCounts.data(),1,MPI_INT,comm));
+      std::vector<int> sendOffsets(size), recvOffsets(size);
+      int numSent = 0, numRecv = 0;
+      for (int r=0;r<size;r++) {
+        sendOffsets[r] = numSent; numSent += sendCounts[r];
+        recvOffsets[r] = numRecv; numRecv += recvCounts[r];
+      }
+      std::vector<T> result(numRecv);
+      // counts are in items, not bytes, so we can move more than
+      // 2GB per rank
+      MPI_Datatype itemType;
+      HS_MPI_CALL(Type_contiguous(sizeof(T),MPI_BYTE,&itemType));
+      HS_MPI_CALL(Type_commit(&itemType));
+      HS_MPI_CALL(Alltoallv(sendBuffer.data(),sendCounts.data(),sendOffsets.data(),itemType,
+                            result.data(),recvCounts.data(),recvOffsets.data(),itemType,
+                            comm));
+      HS_MPI_CALL(Type_free(&itemType));
+      return result;
+#endif
+    }
+
+    template<typename T>
+    inline std::vector<T> Comm::allGatherv(const std::vector<T> &myItems,
+                                           std::vector<int> &recvCounts)
+    {
+#if HS_FAKE_MPI
+      recvCounts = { (int)myItems.size() };
+      return myItems;
+#else
+      recvCounts.resize(size);
+      int myCount = (int)myItems.size();
+      HS_MPI_CALL(Allgather(&myCount,1,MPI_INT,recvCounts.data(),1,MPI_INT,comm));
+      std::vector<int> recvOffsets(size);
+      int numRecv = 0;
+      for (int r=0;r<size;r++) {
+        recvOffsets[r] = numRecv; numRecv += recvCounts[r];
+      }
+      std::vector<T> result(numRecv);
+      MPI_Datatype itemType;
+      HS_MPI_CALL(Type_contiguous(sizeof(T),MPI_BYTE,&itemType));
+      HS_MPI_CALL(Type_commit(&itemType));
+      HS_MPI_CALL(Allgatherv(myItems.data(),myCount,itemType,
+                             result.data(),recvCounts.data(),recvOffsets.data(),itemType,
+                             comm));
+      HS_MPI_CALL(Type_free(&itemType));
+      return result;
+#endif
+    }
+
     /*! client-side of a gather where each client send a fixed number
       of items to the master */
     template<typename T>
@@ -175,6 +301,43 @@ namespace hs {
                           nullptr,numItemsSentOnEachRank*sizeof(T),MPI_BYTE,
                           0,comm));
     }
+
+    template<typename T>
+    inline void Comm::masterGatherv(T *recvBuffer,
+                                    const T *sendBuffer,
+                                    const std::vector<int> &numItemsOfRank)
+    {
+#if HS_FAKE_MPI
+      std::copy(sendBuffer,sendBuffer+numItemsOfRank[0],recvBuffer);
+#else
+      std::vector<int> recvOffsets(size);
+      int numRecv = 0;
+      for (int r=0;r<size;r++) {
+        recvOffsets[r] = numRecv; numRecv += numItemsOfRank[r];
+      }
+      MPI_Datatype itemType;
+      HS_MPI_CALL(Type_contiguous(sizeof(T),MPI_BYTE,&itemType));
+      HS_MPI_CALL(Type_commit(&itemType));
+      HS_MPI_CALL(Gatherv(sendBuffer,numItemsOfRank[rank],itemType,
+                          recvBuffer,numItemsOfRank.data(),recvOffsets.data(),itemType,
+                          0,comm));
+      HS_MPI_CALL(Type_free(&itemType));
+#endif
+    }
+
+    template<typename T>
+    inline void Comm::masterGatherv(const T *sendBuffer, int numItemsSentByThisRank)
+    {
+#if !HS_FAKE_MPI
+      MPI_Datatype itemType;
+      HS_MPI_CALL(Type_contiguous(sizeof(T),MPI_BYTE,&itemType));
+      HS_MPI_CALL(Type_commit(&itemType));
+      HS_MPI_CALL(Gatherv(sendBuffer,numItemsSentByThisRank,itemType,
+                          nullptr,nullptr,nullptr,itemType,
+                          0,comm));
+      HS_MPI_CALL(Type_free(&itemType));
+#endif
+    }
     
 
   }
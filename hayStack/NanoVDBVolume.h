@@ -38,7 +38,9 @@ namespace hs {
   };
 
   /*! One rank's piece of a (possibly split) NanoVDB grid. @c data holds the
-      raw NanoVDB buffer passed to Barney/ANARI as a UINT8 array1D. */
+      raw NanoVDB buffer passed to Barney/ANARI as a UINT8 array1D. Grid
+      index space maps 1:1 to world space unless the grid itself
+      specifies a different transform. */
   struct NanoVDBVolume {
     typedef std::shared_ptr<NanoVDBVolume> SP;
 
@@ -50,6 +52,11 @@ namespace hs {
     box3f bounds;
     range1f valueRange{0.f, 1.f};
     VolumeScatterParams scatter;
+    /*! whether this is a density volume for the multi-scattering
+        path (rendered as principled volume, using 'scatter'), or a
+        plain scalar field that gets colored through the transfer
+        function, like the sparse version of a raw volume */
+    bool densityVolume = true;
 
     box3f getBounds() const { return bounds; }
     range1f getValueRange() const { return valueRange; }
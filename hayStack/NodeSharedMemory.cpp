@@ -0,0 +1,152 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/NodeSharedMemory.h"
+#include <fstream>
+
+namespace hs {
+  namespace {
+    struct {
+      bool      begun = false;
+      /*! all ranks on this node */
+      mpi::Comm node;
+      /*! ranks on this node that load the same data groups as we do */
+      mpi::Comm replicas;
+      /*! node-shared bytes we allocated (as leader), and mapped from
+          another rank */
+      size_t    bytesOwned  = 0;
+      size_t    bytesMapped = 0;
+    } state;
+
+    /*! this process' resident and proportional set size, in bytes (0
+        if /proc/self/smaps_rollup isn't available) */
+    void getMemoryUsage(size_t &rss, size_t &pss)
+    {
+      rss = pss = 0;
+      std::ifstream in("/proc/self/smaps_rollup");
+      std::string line;
+      while (std::getline(in,line)) {
+        size_t kB = 0;
+        if (sscanf(line.c_str(),"Rss: %zu kB",&kB) == 1)
+          rss = kB*1024;
+        else if (sscanf(line.c_str(),"Pss: %zu kB",&kB) == 1)
+          pss = kB*1024;
+      }
+    }
+  }
+
+  void NodeSharedMemory::begin(mpi::Comm &workers, int firstDataGroup)
+  {
+    state.node     = workers.splitShared();
+    state.replicas = state.node.split(firstDataGroup);
+    state.bytesOwned = state.bytesMapped = 0;
+    state.begun    = true;
+
+    int numNodes    = workers.allReduceAdd(state.node.rank == 0 ? 1 : 0);
+    int numFollowers
+      = workers.allReduceAdd(state.replicas.rank > 0 ? 1 : 0);
+    if (workers.rank == 0)
+      std::cout << "#hs.shm: " << workers.size << " workers on " << numNodes
+                << " node(s); " << numFollowers << " of them map their data"
+                << " group(s) from another rank on the same node" << std::endl;
+  }
+
+  void NodeSharedMemory::end()
+  {
+    state.begun = false;
+  }
+
+  bool NodeSharedMemory::active()
+  {
+    return state.begun && state.replicas.size > 1;
+  }
+
+  void NodeSharedMemory::reportUsage(mpi::Comm &workers)
+  {
+    mpi::Comm node = state.node.comm == MPI_COMM_NULL
+      ? workers.splitShared()
+      : state.node;
+    size_t rss, pss;
+    getMemoryUsage(rss,pss);
+    const float MB = 1024.f*1024.f;
+    float nodeRSS    = node.allReduceAdd(rss/MB);
+    float nodePSS    = node.allReduceAdd(pss/MB);
+    float nodeShared = node.allReduceAdd(state.bytesOwned/MB);
+    float nodeMapped = node.allReduceAdd(state.bytesMapped/MB);
+    if (node.rank == 0) {
+      std::stringstream ss;
+      ss << "#hs.shm: node of worker #" << workers.rank << " (" << node.size
+         << " ranks): RSS " << prettyNumber(size_t(nodeRSS*MB))
+         << "B, PSS " << prettyNumber(size_t(nodePSS*MB)) << "B";
+      if (nodeShared > 0.f)
+        ss << "; " << prettyNumber(size_t(nodeShared*MB)) << "B in node-shared"
+           << " memory, mapped " << prettyNumber(size_t(nodeMapped*MB))
+           << "B instead of loading it again";
+      std::cout << ss.str() << std::endl;
+    }
+    if (node.comm != state.node.comm)
+      node.free();
+  }
+
+  std::shared_ptr<const uint8_t>
+  NodeSharedMemory::load(size_t numBytes,
+                         const std::function<void(uint8_t *)> &fill)
+  {
+    if (!active()) {
+      std::shared_ptr<uint8_t> mem(new uint8_t[numBytes],
+                                   std::default_delete<uint8_t[]>());
+      fill(mem.get());
+      return mem;
+    }
+#if HS_FAKE_MPI
+    throw std::runtime_error("node-shared memory requires MPI");
+#else
+    mpi::Comm &replicas = state.replicas;
+    const bool isLeader = (replicas.rank == 0);
+
+    // all replicas have to ask for the same thing - check (on all of
+    // them, so they all throw together), via max(size) and max(~size)
+    uint64_t sizes[2] = { numBytes, ~uint64_t(numBytes) };
+    uint64_t maxSizes[2];
+    HS_MPI_CALL(Allreduce(sizes,maxSizes,2,MPI_UINT64_T,MPI_MAX,replicas.comm));
+    if (maxSizes[0] != numBytes || ~maxSizes[1] != numBytes)
+      throw std::runtime_error("#hs.shm: replicas on this node disagree on the"
+                               " size of node-shared data - do they really"
+                               " load the same content?");
+
+    uint8_t *base = nullptr;
+    MPI_Win win;
+    HS_MPI_CALL(Win_allocate_shared(isLeader ? numBytes : 0,1,MPI_INFO_NULL,
+                                    replicas.comm,&base,&win));
+    MPI_Aint size;
+    int      dispUnit;
+    HS_MPI_CALL(Win_shared_query(win,0,&size,&dispUnit,&base));
+
+    HS_MPI_CALL(Win_lock_all(MPI_MODE_NOCHECK,win));
+    std::string error;
+    if (isLeader) {
+      try {
+        fill(base);
+      } catch (const std::exception &e) {
+        error = e.what();
+      }
+      HS_MPI_CALL(Win_sync(win));
+    }
+    int failed = !error.empty();
+    HS_MPI_CALL(Bcast(&failed,1,MPI_INT,0,replicas.comm));
+    if (!isLeader)
+      HS_MPI_CALL(Win_sync(win));
+    HS_MPI_CALL(Win_unlock_all(win));
+
+    if (failed)
+      throw std::runtime_error(isLeader
+                               ? error
+                               : "#hs.shm: node-shared load failed on leader rank");
+    (isLeader ? state.bytesOwned : state.bytesMapped) += numBytes;
+    // the window deliberately never gets freed (MPI_Win_free is
+    // collective, and this memory may be in use until the end)
+    return std::shared_ptr<const uint8_t>(base,[](const uint8_t *){});
+#endif
+  }
+
+}
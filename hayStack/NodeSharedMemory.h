@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/MPIWrappers.h"
+#include <functional>
+
+namespace hs {
+
+  /*! node-shared, read-only host memory for data that multiple ranks
+      on the same node would otherwise each load - and hold - their
+      own copy of; eg, with '-ndg 1' and eight ranks per node, every
+      one of those ranks loads the very same data group.
+
+      during loading, the ranks on a node (MPI_COMM_TYPE_SHARED) that
+      load the same data groups form a group of 'replicas'. whenever
+      a loader has a large, read-only payload (such as a structured
+      volume's voxels) it asks for it through load(): exactly one
+      replica - the 'leader' - allocates it in an MPI-3 shared-memory
+      window and reads it from disk; all others wait for that, and
+      then map the leader's memory. this relies on replicas executing
+      the same sequence of load()s, which they do because they load
+      the same content in the same order.
+
+      content that doesn't use load() still gets loaded by every
+      replica on its own. shared windows live until MPI gets
+      finalized. */
+  struct NodeSharedMemory {
+    /*! starts node-sharing for the rank's data groups, given by the
+        first one of them (ranks with the same first group have the
+        same groups). collective across all workers */
+    static void begin(mpi::Comm &workers, int firstDataGroup);
+
+    /*! ends node-sharing; memory that was shared stays valid */
+    static void end();
+
+    /*! prints - per node - the ranks' summed resident memory (RSS,
+        where each rank counts shared pages in full) and proportional
+        memory (PSS, where shared pages are split across the ranks
+        that map them; ie, what the node really uses), and how much
+        got shared. collective across all workers; works with and
+        without node sharing, for comparing the two */
+    static void reportUsage(mpi::Comm &workers);
+
+    /*! whether this rank currently shares its loads with at least one
+        other rank on the same node */
+    static bool active();
+
+    /*! returns numBytes of memory that hold what fill() writes into
+        it; if active(), this is collective across the replicas, only
+        the leader calls fill(), and the returned memory is shared
+        (and must not be written to). if fill() throws on the
+        leader, all replicas throw. */
+    static std::shared_ptr<const uint8_t>
+    load(size_t numBytes, const std::function<void(uint8_t *)> &fill);
+  };
+
+}
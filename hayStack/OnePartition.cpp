@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "hayStack/OnePartition.h"
+#include <stdexcept>
 
 namespace hs {
 
@@ -33,6 +34,37 @@ namespace hs {
     this->unsts.push_back({merged,box3f()});
   }
       
+  void OnePartition::clear()
+  {
+    minis.clear();
+    unsts.clear();
+    triangleMeshes.clear();
+    sphereSets.clear();
+    cylinderSets.clear();
+    capsuleSets.clear();
+    structuredVolumes.clear();
+    nanovdbVolumes.clear();
+    amr.clear();
+  }
+
+  void OnePartition::swapContent(OnePartition &other)
+  {
+    if (other.partitionsRank != partitionsRank)
+      throw std::runtime_error
+        ("OnePartition::swapContent: can't swap content of data group #"
+         +std::to_string(other.partitionsRank)+" into data group #"
+         +std::to_string(partitionsRank));
+    minis.swap(other.minis);
+    unsts.swap(other.unsts);
+    triangleMeshes.swap(other.triangleMeshes);
+    sphereSets.swap(other.sphereSets);
+    cylinderSets.swap(other.cylinderSets);
+    capsuleSets.swap(other.capsuleSets);
+    structuredVolumes.swap(other.structuredVolumes);
+    nanovdbVolumes.swap(other.nanovdbVolumes);
+    amr.swap(other.amr);
+  }
+      
   BoundsData OnePartition::getBounds() const
   {
     BoundsData bounds;
@@ -70,12 +102,10 @@ namespace hs {
       bounds.spatial.extend(volume->getBounds());
       bounds.scalars.extend(volume->getValueRange());
     }
-#if HS_USE_MULTI_SCATTERING
     for (auto &volume : nanovdbVolumes) {
       bounds.spatial.extend(volume->getBounds());
       bounds.scalars.extend(volume->getValueRange());
     }
-#endif
     return bounds;
   }
 
@@ -60,6 +60,14 @@ namespace hs {
     OnePartition(int partitionsRank,
                  int partitionsCount);
     BoundsData getBounds() const;
+
+    /*! removes all content */
+    void clear();
+
+    /*! exchanges all content with another partition (of the same
+        data group; throws if it isn't); eg, to switch to the next
+        time step */
+    void swapContent(OnePartition &other);
     
     mini::Material::SP                defaultMaterial;
     std::vector<mini::Scene::SP>      minis;
@@ -70,9 +78,7 @@ namespace hs {
     std::vector<Cylinders::SP>        cylinderSets;
     std::vector<Capsules::SP>         capsuleSets;
     std::vector<StructuredVolume::SP> structuredVolumes;
-#if HS_USE_MULTI_SCATTERING
     std::vector<NanoVDBVolume::SP>    nanovdbVolumes;
-#endif
     std::vector<TAMRVolume::SP>       amr;
     
     const int partitionsRank;
@@ -0,0 +1,374 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/PartitionSerializer.h"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unistd.h>
+
+namespace hs {
+  namespace {
+
+    const uint64_t serializedPartitionMagic = 0x317472617073686full;
+
+    struct Writer {
+      template<typename T>
+      void write(const T &t)
+      { write(&t,sizeof(t)); }
+
+      template<typename T>
+      void write(const std::vector<T> &vec)
+      {
+        write((uint64_t)vec.size());
+        write(vec.data(),vec.size()*sizeof(T));
+      }
+
+      void write(const std::string &s)
+      {
+        write((uint64_t)s.size());
+        write(s.data(),s.size());
+      }
+
+      void write(const void *ptr, size_t numBytes)
+      {
+        bytes.insert(bytes.end(),(const uint8_t*)ptr,(const uint8_t*)ptr+numBytes);
+      }
+
+      std::vector<uint8_t> bytes;
+    };
+
+    struct Reader {
+      Reader(const std::vector<uint8_t> &bytes) : bytes(bytes) {}
+
+      template<typename T>
+      void read(T &t)
+      { read(&t,sizeof(t)); }
+
+      template<typename T>
+      void read(std::vector<T> &vec)
+      {
+        uint64_t size;
+        read(size);
+        vec.resize(size);
+        read(vec.data(),size*sizeof(T));
+      }
+
+      void read(std::string &s)
+      {
+        uint64_t size;
+        read(size);
+        s.resize(size);
+        read(&s[0],size);
+      }
+
+      void read(void *ptr, size_t numBytes)
+      {
+        if (pos+numBytes > bytes.size())
+          throw std::runtime_error("PartitionSerializer: truncated data");
+        memcpy(ptr,bytes.data()+pos,numBytes);
+        pos += numBytes;
+      }
+
+      template<typename T>
+      T get() { T t; read(t); return t; }
+
+      const std::vector<uint8_t> &bytes;
+      size_t pos = 0;
+    };
+
+    /*! a temp file that gets removed again when this goes out of
+        scope */
+    struct TempFile {
+      TempFile(const std::string &suffix)
+      {
+        const char *dir = getenv("TMPDIR");
+        std::string pattern
+          = std::string(dir ? dir : "/tmp")+"/hs_partition_XXXXXX";
+        std::vector<char> name(pattern.begin(),pattern.end());
+        name.push_back(0);
+        int fd = mkstemp(name.data());
+        if (fd < 0)
+          throw std::runtime_error("PartitionSerializer: could not create temp file");
+        close(fd);
+        unlink(name.data());
+        fileName = std::string(name.data())+suffix;
+      }
+      ~TempFile() { unlink(fileName.c_str()); }
+
+      std::vector<uint8_t> readAll() const
+      {
+        std::ifstream in(fileName.c_str(),std::ios::binary|std::ios::ate);
+        std::vector<uint8_t> bytes(in.tellg());
+        in.seekg(0);
+        in.read((char *)bytes.data(),bytes.size());
+        return bytes;
+      }
+
+      void writeAll(const std::vector<uint8_t> &bytes) const
+      {
+        std::ofstream out(fileName.c_str(),std::ios::binary);
+        out.write((const char *)bytes.data(),bytes.size());
+      }
+
+      std::string fileName;
+    };
+
+    std::vector<uint8_t> toBytes(mini::Scene::SP scene)
+    {
+      TempFile tmp(".mini");
+      scene->save(tmp.fileName);
+      return tmp.readAll();
+    }
+
+    mini::Scene::SP miniFromBytes(const std::vector<uint8_t> &bytes)
+    {
+      TempFile tmp(".mini");
+      tmp.writeAll(bytes);
+      return mini::Scene::load(tmp.fileName);
+    }
+
+    std::vector<uint8_t> toBytes(umesh::UMesh::SP mesh)
+    {
+      TempFile tmp(".umesh");
+      mesh->saveTo(tmp.fileName);
+      return tmp.readAll();
+    }
+
+    umesh::UMesh::SP umeshFromBytes(const std::vector<uint8_t> &bytes)
+    {
+      TempFile tmp(".umesh");
+      tmp.writeAll(bytes);
+      return umesh::UMesh::loadFrom(tmp.fileName);
+    }
+
+    /*! materials of all of hayStack's own geometry types; these get
+        stored as one mini scene with one (single-triangle) mesh per
+        material, which is the only way to get them through
+        miniScene's serialization */
+    struct MaterialTable {
+      int indexOf(mini::Material::SP material)
+      {
+        if (!material) return -1;
+        auto it = index.find(material);
+        if (it != index.end()) return it->second;
+        index[material] = (int)materials.size();
+        materials.push_back(material);
+        return index[material];
+      }
+
+      mini::Scene::SP toScene() const
+      {
+        std::vector<mini::Instance::SP> instances;
+        for (auto material : materials) {
+          mini::Mesh::SP mesh = mini::Mesh::create();
+          mesh->vertices = { vec3f(0.f), vec3f(0.f), vec3f(0.f) };
+          mesh->indices  = { vec3i(0,1,2) };
+          mesh->material = material;
+          instances.push_back(mini::Instance::create(mini::Object::create({mesh})));
+        }
+        return mini::Scene::create(instances);
+      }
+
+      void fromScene(mini::Scene::SP scene)
+      {
+        for (auto inst : scene->instances)
+          materials.push_back(inst->object->meshes[0]->material);
+      }
+
+      mini::Material::SP get(int idx) const
+      { return idx < 0 ? mini::Material::SP() : materials[idx]; }
+
+      std::map<mini::Material::SP,int> index;
+      std::vector<mini::Material::SP>  materials;
+    };
+  }
+
+  bool PartitionSerializer::canSerialize(const OnePartition &partition)
+  {
+    return partition.amr.empty();
+  }
+
+  std::vector<uint8_t> PartitionSerializer::serialize(const OnePartition &partition)
+  {
+    if (!canSerialize(partition))
+      throw std::runtime_error("PartitionSerializer: partition contains"
+                               " content that can't be serialized");
+    Writer out;
+    MaterialTable materials;
+
+    out.write(serializedPartitionMagic);
+    out.write((uint64_t)partition.sphereSets.size());
+    for (auto ss : partition.sphereSets) {
+      out.write(ss->origins);
+      out.write(ss->colors);
+      out.write(ss->radii);
+      out.write(ss->radius);
+      out.write(materials.indexOf(ss->material));
+    }
+    out.write((uint64_t)partition.cylinderSets.size());
+    for (auto cs : partition.cylinderSets) {
+      out.write(cs->vertices);
+      out.write(cs->colors);
+      out.write(cs->indices);
+      out.write(cs->radii);
+      out.write(cs->colorPerVertex);
+      out.write(cs->radiusPerVertex);
+      out.write(cs->roundedCap);
+      out.write(cs->radius);
+      out.write(materials.indexOf(cs->material));
+    }
+    out.write((uint64_t)partition.capsuleSets.size());
+    for (auto cs : partition.capsuleSets) {
+      out.write(cs->vertices);
+      out.write(cs->colors);
+      out.write(cs->indices);
+      out.write(materials.indexOf(cs->material));
+    }
+    out.write((uint64_t)partition.triangleMeshes.size());
+    for (auto mesh : partition.triangleMeshes) {
+      out.write(mesh->vertices);
+      out.write(mesh->normals);
+      out.write(mesh->colors);
+      out.write(mesh->indices);
+      out.write(mesh->scalars.perVertex);
+      out.write(materials.indexOf(mesh->material));
+    }
+    out.write((uint64_t)partition.structuredVolumes.size());
+    for (auto vol : partition.structuredVolumes) {
+      out.write(vol->dims);
+      out.write(vol->texelFormat);
+      out.write((uint64_t)vol->voxelBytes());
+      out.write(vol->voxels(),vol->voxelBytes());
+      out.write(vol->rawDataRGB);
+      out.write(vol->gridOrigin);
+      out.write(vol->gridSpacing);
+      out.write(vol->knownValueRange);
+    }
+    out.write((uint64_t)partition.nanovdbVolumes.size());
+    for (auto vol : partition.nanovdbVolumes) {
+      out.write(vol->data);
+      out.write(vol->fileName);
+      out.write(vol->partID);
+      out.write(vol->fullIndexDims);
+      out.write(vol->cellRange);
+      out.write(vol->bounds);
+      out.write(vol->valueRange);
+      out.write(vol->scatter);
+      out.write(vol->densityVolume);
+    }
+    out.write((uint64_t)partition.unsts.size());
+    for (auto unst : partition.unsts) {
+      out.write(toBytes(unst.first));
+      out.write(unst.second);
+    }
+    out.write((uint64_t)partition.minis.size());
+    for (auto mini : partition.minis)
+      out.write(toBytes(mini));
+    // has to come last, after all materials have been added
+    out.write(materials.materials.empty()
+              ? std::vector<uint8_t>()
+              : toBytes(materials.toScene()));
+    return std::move(out.bytes);
+  }
+
+  void PartitionSerializer::deserialize(const std::vector<uint8_t> &bytes,
+                                        OnePartition &partition)
+  {
+    Reader in(bytes);
+    if (in.get<uint64_t>() != serializedPartitionMagic)
+      throw std::runtime_error("PartitionSerializer: not a serialized partition");
+
+    // materials come last in the stream, so remember where they go
+    std::vector<std::pair<mini::Material::SP *,int>> materialRefs;
+
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      SphereSet::SP ss = SphereSet::create();
+      in.read(ss->origins);
+      in.read(ss->colors);
+      in.read(ss->radii);
+      in.read(ss->radius);
+      materialRefs.push_back({&ss->material,in.get<int>()});
+      partition.sphereSets.push_back(ss);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      Cylinders::SP cs = Cylinders::create();
+      in.read(cs->vertices);
+      in.read(cs->colors);
+      in.read(cs->indices);
+      in.read(cs->radii);
+      in.read(cs->colorPerVertex);
+      in.read(cs->radiusPerVertex);
+      in.read(cs->roundedCap);
+      in.read(cs->radius);
+      materialRefs.push_back({&cs->material,in.get<int>()});
+      partition.cylinderSets.push_back(cs);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      Capsules::SP cs = Capsules::create();
+      in.read(cs->vertices);
+      in.read(cs->colors);
+      in.read(cs->indices);
+      materialRefs.push_back({&cs->material,in.get<int>()});
+      partition.capsuleSets.push_back(cs);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      TriangleMesh::SP mesh = TriangleMesh::create();
+      in.read(mesh->vertices);
+      in.read(mesh->normals);
+      in.read(mesh->colors);
+      in.read(mesh->indices);
+      in.read(mesh->scalars.perVertex);
+      materialRefs.push_back({&mesh->material,in.get<int>()});
+      partition.triangleMeshes.push_back(mesh);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      vec3i dims = in.get<vec3i>();
+      std::string texelFormat;
+      in.read(texelFormat);
+      std::vector<uint8_t> rawData(in.get<uint64_t>());
+      in.read(rawData.data(),rawData.size());
+      std::vector<uint8_t> rawDataRGB;
+      in.read(rawDataRGB);
+      vec3f gridOrigin  = in.get<vec3f>();
+      vec3f gridSpacing = in.get<vec3f>();
+      StructuredVolume::SP vol
+        = std::make_shared<StructuredVolume>(dims,texelFormat,rawData,rawDataRGB,
+                                             gridOrigin,gridSpacing);
+      in.read(vol->knownValueRange);
+      partition.structuredVolumes.push_back(vol);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      NanoVDBVolume::SP vol = std::make_shared<NanoVDBVolume>();
+      in.read(vol->data);
+      in.read(vol->fileName);
+      in.read(vol->partID);
+      in.read(vol->fullIndexDims);
+      in.read(vol->cellRange);
+      in.read(vol->bounds);
+      in.read(vol->valueRange);
+      in.read(vol->scatter);
+      in.read(vol->densityVolume);
+      partition.nanovdbVolumes.push_back(vol);
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      std::vector<uint8_t> meshBytes;
+      in.read(meshBytes);
+      box3f domain = in.get<box3f>();
+      partition.unsts.push_back({umeshFromBytes(meshBytes),domain});
+    }
+    for (size_t n=in.get<uint64_t>(), i=0;i<n;i++) {
+      std::vector<uint8_t> miniBytes;
+      in.read(miniBytes);
+      partition.minis.push_back(miniFromBytes(miniBytes));
+    }
+    std::vector<uint8_t> materialBytes;
+    in.read(materialBytes);
+    MaterialTable materials;
+    if (!materialBytes.empty())
+      materials.fromScene(miniFromBytes(materialBytes));
+    for (auto ref : materialRefs)
+      *ref.first = materials.get(ref.second);
+  }
+
+}
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/OnePartition.h"
+
+namespace hs {
+
+  /*! turns a (loaded) OnePartition into one flat block of bytes, and
+      back; eg, to load a data group once and then send it to all
+      other ranks that need the same group.
+
+      hayStack's own types (spheres, cylinders, capsules, triangle
+      meshes, structured and nanovdb volumes) get written directly;
+      their materials, and mini scenes, go through miniScene's own
+      file format, and unstructured meshes through umesh's - both via
+      temporary files in $TMPDIR (or /tmp). AMR volumes can't be
+      serialized (see canSerialize()). */
+  struct PartitionSerializer {
+    /*! whether everything in this partition can be serialized */
+    static bool canSerialize(const OnePartition &partition);
+
+    static std::vector<uint8_t> serialize(const OnePartition &partition);
+
+    /*! adds everything in given bytes to the partition */
+    static void deserialize(const std::vector<uint8_t> &bytes,
+                            OnePartition &partition);
+  };
+
+}
@@ -0,0 +1,149 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/PartitionSnapshot.h"
+#include <cstdio>
+#include <iomanip>
+#include <sys/stat.h>
+
+namespace hs {
+  namespace {
+
+    const uint64_t snapshotMagic   = 0x746f6e7370616e73ull;
+    const uint32_t snapshotVersion = 1;
+    /*! payload starts at a page boundary, so it can get mmap'ed */
+    const uint64_t payloadAlignment = 4096;
+
+    /*! 64-bit FNV-1a */
+    struct Hash {
+      void add(const void *ptr, size_t numBytes)
+      {
+        for (size_t i=0;i<numBytes;i++) {
+          value ^= ((const uint8_t*)ptr)[i];
+          value *= 0x100000001b3ull;
+        }
+      }
+      template<typename T>
+      void add(const T &t) { add(&t,sizeof(t)); }
+      void add(const std::string &s) { add(s.size()); add(s.data(),s.size()); }
+
+      uint64_t value = 0xcbf29ce484222325ull;
+    };
+
+    /*! the file a content descriptor reads from - ie, 'where' in
+        'type://N@where:key=value' - or the whole descriptor if it
+        isn't a url */
+    std::string inputFileOf(const std::string &descriptor)
+    {
+      size_t pos = descriptor.find("://");
+      if (pos == descriptor.npos) return descriptor;
+      std::string where = descriptor.substr(pos+3);
+      where = where.substr(0,where.find(":"));
+      pos = where.find("@");
+      return pos == where.npos ? where : where.substr(pos+1);
+    }
+  }
+
+  uint64_t PartitionSnapshot::computeKey(const std::vector<std::string> &contentDescriptors,
+                                         int numDataGroups)
+  {
+    Hash hash;
+    hash.add(snapshotVersion);
+    hash.add(numDataGroups);
+    for (auto &descriptor : contentDescriptors) {
+      hash.add(descriptor);
+      // content without an input file (eg, generated test content)
+      // is keyed by its descriptor alone
+      struct stat st;
+      if (stat(inputFileOf(descriptor).c_str(),&st) == 0) {
+        hash.add(uint64_t(st.st_size));
+        hash.add(uint64_t(st.st_mtime));
+      }
+    }
+    return hash.value;
+  }
+
+  std::string PartitionSnapshot::fileName(const std::string &directory,
+                                          uint64_t key,
+                                          int dataGroupID,
+                                          int numDataGroups)
+  {
+    std::stringstream ss;
+    ss << directory << "/hs-" << std::hex << std::setw(16) << std::setfill('0')
+       << key << std::dec << "-" << dataGroupID << "of" << numDataGroups
+       << ".hss";
+    return ss.str();
+  }
+
+  bool PartitionSnapshot::readHeader(const std::string &fileName,
+                                     uint64_t key,
+                                     Header &header)
+  {
+    struct stat st;
+    if (stat(fileName.c_str(),&st) != 0) return false;
+    FILE *file = fopen(fileName.c_str(),"rb");
+    if (!file) return false;
+    bool ok = fread(&header,sizeof(header),1,file) == 1;
+    fclose(file);
+    return ok
+      && header.magic   == snapshotMagic
+      && header.version == snapshotVersion
+      && header.key     == key
+      && uint64_t(st.st_size) == header.payloadOffset+header.payloadSize;
+  }
+
+  void PartitionSnapshot::write(const std::string &fileName,
+                                uint64_t key,
+                                int numDataGroups,
+                                const OnePartition &partition)
+  {
+    std::vector<uint8_t> payload = PartitionSerializer::serialize(partition);
+
+    Header header = {};
+    header.magic         = snapshotMagic;
+    header.version       = snapshotVersion;
+    header.dataGroupID   = partition.partitionsRank;
+    header.numDataGroups = numDataGroups;
+    header.key           = key;
+    header.bounds        = partition.getBounds();
+    header.payloadOffset = payloadAlignment;
+    header.payloadSize   = payload.size();
+    std::vector<uint8_t> padding(header.payloadOffset-sizeof(header),0);
+
+    const std::string tmpFileName = fileName+".tmp";
+    FILE *file = fopen(tmpFileName.c_str(),"wb");
+    if (!file)
+      throw std::runtime_error("could not create snapshot file "+tmpFileName);
+    bool ok
+      =  fwrite(&header,sizeof(header),1,file) == 1
+      && fwrite(padding.data(),padding.size(),1,file) == 1
+      && fwrite(payload.data(),payload.size(),1,file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmpFileName.c_str(),fileName.c_str()) != 0) {
+      remove(tmpFileName.c_str());
+      throw std::runtime_error("could not write snapshot file "+fileName);
+    }
+  }
+
+  void PartitionSnapshot::read(const std::string &fileName,
+                               uint64_t key,
+                               OnePartition &partition)
+  {
+    Header header;
+    if (!readHeader(fileName,key,header))
+      throw std::runtime_error("'"+fileName+"' is not a valid snapshot");
+    if (header.dataGroupID != partition.partitionsRank)
+      throw std::runtime_error("snapshot '"+fileName+"' is for data group "
+                               +std::to_string(header.dataGroupID));
+    std::vector<uint8_t> payload(header.payloadSize);
+    FILE *file = fopen(fileName.c_str(),"rb");
+    bool ok = file
+      && fseek(file,header.payloadOffset,SEEK_SET) == 0
+      && fread(payload.data(),payload.size(),1,file) == 1;
+    if (file) fclose(file);
+    if (!ok)
+      throw std::runtime_error("could not read snapshot file "+fileName);
+    PartitionSerializer::deserialize(payload,partition);
+  }
+
+}
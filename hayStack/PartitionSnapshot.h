@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/PartitionSerializer.h"
+
+namespace hs {
+
+  /*! one data group's fully loaded content, stored in a single file,
+      so a later run with the same inputs - and the same number of
+      data groups - can skip discovery, assignment, and all format
+      parsing, welding, splitting, etc, and instead read each of its
+      groups with a single sequential read.
+
+      a snapshot file is a fixed-size header (which also has the
+      group's bounds, so tools can look at those without reading the
+      rest), followed by - at a page-aligned offset - the group's
+      content as written by PartitionSerializer. files are named by a
+      key that hashes the content descriptors, the size and
+      modification time of each input file, and the number of data
+      groups; so any change to those simply doesn't find a snapshot
+      any more. */
+  struct PartitionSnapshot {
+    struct Header {
+      uint64_t   magic;
+      uint32_t   version;
+      int32_t    dataGroupID;
+      int32_t    numDataGroups;
+      int32_t    reserved;
+      uint64_t   key;
+      BoundsData bounds;
+      /*! where - in bytes from the start of the file - the
+          serialized partition begins, and how many bytes it has */
+      uint64_t   payloadOffset;
+      uint64_t   payloadSize;
+    };
+
+    /*! hashes everything that determines what the data groups will
+        contain */
+    static uint64_t computeKey(const std::vector<std::string> &contentDescriptors,
+                               int numDataGroups);
+
+    static std::string fileName(const std::string &directory,
+                                uint64_t key,
+                                int dataGroupID,
+                                int numDataGroups);
+
+    /*! reads (only) the header of given file; returns false if there
+        is no such file, or it isn't a complete snapshot for given
+        key */
+    static bool readHeader(const std::string &fileName,
+                           uint64_t key,
+                           Header &header);
+
+    /*! writes given (loaded) partition; the file only appears once
+        it is complete, so a run that crashes halfway never leaves a
+        snapshot that looks valid */
+    static void write(const std::string &fileName,
+                      uint64_t key,
+                      int numDataGroups,
+                      const OnePartition &partition);
+
+    /*! adds everything in given snapshot to the partition; throws if
+        it isn't a valid snapshot for given key */
+    static void read(const std::string &fileName,
+                     uint64_t key,
+                     OnePartition &partition);
+  };
+
+}
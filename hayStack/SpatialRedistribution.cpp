@@ -0,0 +1,477 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/SpatialRedistribution.h"
+#include "hayStack/Tracing.h"
+#include <functional>
+#include <map>
+#include <set>
+
+namespace hs {
+  namespace {
+
+    /*! what gets sent for one primitive; 'group' is the data group
+        it is going to */
+    struct SphereRecord {
+      vec3f origin;
+      vec3f color;
+      float radius;
+      int   group;
+    };
+    struct CylinderRecord {
+      vec3f vertex[2];
+      vec3f color[2];
+      float radius[2];
+      int   group;
+    };
+    struct TriangleRecord {
+      vec3f vertex[3];
+      vec3f normal[3];
+      int   group;
+    };
+
+    /*! one (weighted) sample of a group's primitive centroids */
+    struct Sample {
+      vec3f position;
+      float weight;
+      int   group;
+    };
+
+    /*! per-group bounds before and after, for the overlap stats */
+    struct GroupBounds {
+      int   group;
+      box3f before, after;
+    };
+
+    /*! kd-tree over all ranks' samples, with one leaf per data
+        group; built identically on every rank */
+    struct KDTree {
+      struct Node {
+        int   dim = -1;
+        float pos;
+        int   child[2];
+        int   leafID;
+      };
+
+      KDTree(std::vector<Sample> samples, int numLeaves)
+      {
+        std::function<int(int,int,int,int)> build
+          = [&](int begin, int end, int firstLeaf, int numLeaves)
+        {
+          int nodeID = (int)nodes.size();
+          nodes.push_back(Node());
+          if (numLeaves == 1) {
+            nodes[nodeID].leafID = firstLeaf;
+            return nodeID;
+          }
+          const int numLeft = numLeaves/2;
+          box3f bounds;
+          double totalWeight = 0.;
+          for (int i=begin;i<end;i++) {
+            bounds.extend(samples[i].position);
+            totalWeight += samples[i].weight;
+          }
+          int   dim = 0;
+          float pos = 0.f;
+          int   mid = begin;
+          if (end > begin) {
+            dim = arg_max(bounds.size());
+            std::sort(samples.begin()+begin,samples.begin()+end,
+                      [&](const Sample &a, const Sample &b)
+                      { return a.position[dim] < b.position[dim]; });
+            // weighted median (well, weighted numLeft/numLeaves-ian)
+            const double targetWeight = totalWeight*numLeft/numLeaves;
+            double weight = 0.;
+            while (mid < end && weight + samples[mid].weight <= targetWeight)
+              weight += samples[mid++].weight;
+            if (mid == begin && end-begin > 1) mid++;
+            pos = mid < end
+              ? samples[mid].position[dim]
+              : samples[end-1].position[dim];
+            // everything with the split coordinate goes right
+            while (mid > begin && samples[mid-1].position[dim] >= pos)
+              mid--;
+          }
+          nodes[nodeID].dim = dim;
+          nodes[nodeID].pos = pos;
+          int l = build(begin,mid,firstLeaf,numLeft);
+          int r = build(mid,end,firstLeaf+numLeft,numLeaves-numLeft);
+          nodes[nodeID].child[0] = l;
+          nodes[nodeID].child[1] = r;
+          return nodeID;
+        };
+        build(0,(int)samples.size(),0,numLeaves);
+      }
+
+      int leafOf(const vec3f &p) const
+      {
+        int nodeID = 0;
+        while (nodes[nodeID].dim >= 0)
+          nodeID = nodes[nodeID].child[p[nodes[nodeID].dim] >= nodes[nodeID].pos];
+        return nodes[nodeID].leafID;
+      }
+
+      std::vector<Node> nodes;
+    };
+
+    /*! the one triangle-soup mesh in given partition; or null if it
+        has none, or anything other than that one (lights-only
+        scenes are fine) */
+    mini::Mesh::SP soupOf(OnePartition *partition)
+    {
+      mini::Mesh::SP soup;
+      const affine3f identity;
+      for (auto mini : partition->minis) {
+        if (!mini || mini->instances.empty())
+          continue;
+        if (soup || mini->instances.size() != 1)
+          return {};
+        auto inst = mini->instances[0];
+        if (!inst || !inst->object || inst->object->meshes.size() != 1
+            || memcmp(&inst->xfm,&identity,sizeof(identity)) != 0)
+          return {};
+        soup = inst->object->meshes[0];
+        if (!soup || !soup->texcoords.empty())
+          return {};
+      }
+      return soup;
+    }
+
+    /*! send every record to all ranks that hold its group, and
+        return what this rank received */
+    template<typename Record>
+    std::vector<Record> exchange(mpi::Comm &workers,
+                                 const std::vector<Record> &records,
+                                 const std::vector<std::vector<int>> &holdersOf,
+                                 double &bytesSent)
+    {
+      std::vector<std::vector<Record>> perRank(workers.size);
+      for (auto &record : records)
+        for (int rank : holdersOf[record.group])
+          perRank[rank].push_back(record);
+      std::vector<Record> sendBuffer;
+      std::vector<int>    sendCounts(workers.size);
+      for (int rank=0;rank<workers.size;rank++) {
+        sendCounts[rank] = (int)perRank[rank].size();
+        sendBuffer.insert(sendBuffer.end(),perRank[rank].begin(),perRank[rank].end());
+        if (rank != workers.rank)
+          bytesSent += double(perRank[rank].size())*sizeof(Record);
+        perRank[rank] = {};
+      }
+      std::vector<int> recvCounts;
+      return workers.allToAllv(sendBuffer,sendCounts,recvCounts);
+    }
+
+    /*! sum of the groups' bounds' volumes over the volume of their
+        union; ie, the avg number of groups overlapping any given
+        point in the scene (1 if they perfectly tile the scene) */
+    double overlapOf(const std::vector<box3f> &boxes)
+    {
+      box3f all;
+      double sum = 0.;
+      for (auto &box : boxes) {
+        if (box.empty()) continue;
+        all.extend(box);
+        vec3f size = box.size();
+        sum += double(size.x)*double(size.y)*double(size.z);
+      }
+      if (all.empty()) return 0.;
+      vec3f size = all.size();
+      double volume = double(size.x)*double(size.y)*double(size.z);
+      return volume > 0. ? sum/volume : 0.;
+    }
+
+  }
+
+  void redistributeSpatially(mpi::Comm &workers,
+                             LocalPartitions &partitions,
+                             int samplesPerGroup)
+  {
+    HS_TRACE_SCOPE("redistribute");
+    double t0 = getCurrentTime();
+    const int numGroups = partitions.numPartitionsGlobally;
+
+    // ------------------------------------------------------------------
+    // who holds which group; the lowest such rank 'owns' it, and is
+    // the only one that sends that group's primitives
+    // ------------------------------------------------------------------
+    std::vector<int> myGroups;
+    for (auto part : partitions.myPartitions)
+      myGroups.push_back(part->partitionsRank);
+    std::vector<int> counts;
+    std::vector<int> allGroups = workers.allGatherv(myGroups,counts);
+    std::vector<std::vector<int>> holdersOf(numGroups);
+    for (int rank=0, i=0;rank<workers.size;rank++)
+      for (int j=0;j<counts[rank];j++,i++) {
+        auto &holders = holdersOf[allGroups[i]];
+        if (holders.empty() || holders.back() != rank)
+          holders.push_back(rank);
+      }
+    std::vector<OnePartition *> owned;
+    std::set<int> ownedGroups;
+    for (auto part : partitions.myPartitions)
+      if (holdersOf[part->partitionsRank][0] == workers.rank
+          && ownedGroups.insert(part->partitionsRank).second)
+        owned.push_back(part);
+
+    // ------------------------------------------------------------------
+    // which prim types can we move?
+    // ------------------------------------------------------------------
+    int localSpheres = 1, localCylinders = 1, localSoups = 1;
+    int localSphereColors = 1, localCylinderColors = 1, localNormals = 1;
+    for (auto part : partitions.myPartitions) {
+      localSpheres   &= part->sphereSets.size() == 1 && part->sphereSets[0];
+      localCylinders &= part->cylinderSets.size() == 1 && part->cylinderSets[0];
+      mini::Mesh::SP soup = soupOf(part);
+      localSoups     &= soup != nullptr;
+      if (localSpheres)   localSphereColors   &= !part->sphereSets[0]->colors.empty();
+      if (localCylinders) localCylinderColors &= !part->cylinderSets[0]->colors.empty();
+      if (soup)           localNormals        &= !soup->normals.empty();
+    }
+    const bool doSpheres   = workers.allReduceMin(localSpheres)   != 0;
+    const bool doCylinders = workers.allReduceMin(localCylinders) != 0;
+    const bool doSoups     = workers.allReduceMin(localSoups)     != 0;
+    const bool sphereColors   = workers.allReduceMin(localSphereColors)   != 0;
+    const bool cylinderColors = workers.allReduceMin(localCylinderColors) != 0;
+    const bool soupNormals    = workers.allReduceMin(localNormals)        != 0;
+    if (!doSpheres && !doCylinders && !doSoups) {
+      if (workers.rank == 0)
+        std::cout << MINI_TERMINAL_YELLOW
+                  << "#hs.redist: nothing to redistribute (need exactly one set of"
+                  << " spheres, cylinders, or one triangle soup in every data group)"
+                  << MINI_TERMINAL_DEFAULT << std::endl;
+      return;
+    }
+
+    auto cylinderVertex = [](const Cylinders &cs, size_t cylID, int end) {
+      return cs.indices.empty() ? int(2*cylID+end) : cs.indices[cylID][end];
+    };
+    auto numCylinders = [](const Cylinders &cs) {
+      return cs.indices.empty() ? cs.vertices.size()/2 : cs.indices.size();
+    };
+    /*! calls lambda(centroid) for every movable prim in partition */
+    auto forEachCentroid = [&](OnePartition *part, const auto &lambda) {
+      if (doSpheres)
+        for (auto &origin : part->sphereSets[0]->origins)
+          lambda(origin);
+      if (doCylinders) {
+        const Cylinders &cs = *part->cylinderSets[0];
+        for (size_t i=0;i<numCylinders(cs);i++)
+          lambda(.5f*(cs.vertices[cylinderVertex(cs,i,0)]
+                      +cs.vertices[cylinderVertex(cs,i,1)]));
+      }
+      if (doSoups) {
+        mini::Mesh::SP soup = soupOf(part);
+        for (auto &idx : soup->indices)
+          lambda((soup->vertices[idx.x]+soup->vertices[idx.y]+soup->vertices[idx.z])
+                 *(1.f/3.f));
+      }
+    };
+
+    // ------------------------------------------------------------------
+    // sample, and build the same kd-tree everywhere
+    // ------------------------------------------------------------------
+    std::vector<Sample>      mySamples;
+    std::vector<GroupBounds> myBounds;
+    double numPrimsTotal = 0.;
+    for (auto part : owned) {
+      size_t numPrims = 0;
+      GroupBounds bounds;
+      bounds.group = part->partitionsRank;
+      forEachCentroid(part,[&](const vec3f &c) { numPrims++; bounds.before.extend(c); });
+      numPrimsTotal += numPrims;
+      myBounds.push_back(bounds);
+      if (numPrims == 0) continue;
+      const size_t stride = std::max((size_t)1,numPrims/std::max(samplesPerGroup,1));
+      size_t i = 0;
+      forEachCentroid(part,[&](const vec3f &c) {
+        if ((i++ % stride) == 0)
+          mySamples.push_back({c,float(stride),part->partitionsRank});
+      });
+    }
+    std::vector<Sample> samples = workers.allGatherv(mySamples,counts);
+    if (samples.empty()) {
+      if (workers.rank == 0)
+        std::cout << "#hs.redist: no primitives to redistribute" << std::endl;
+      return;
+    }
+    KDTree kdTree(samples,numGroups);
+
+    // assign leaves to groups greedily, by how much of each group's
+    // sampled weight already is in a given leaf - that way as little
+    // as possible has to move
+    std::map<std::pair<int,int>,double> overlap;
+    for (auto &sample : samples)
+      overlap[{kdTree.leafOf(sample.position),sample.group}] += sample.weight;
+    std::vector<std::pair<double,std::pair<int,int>>> candidates;
+    for (auto &it : overlap)
+      candidates.push_back({it.second,it.first});
+    std::stable_sort(candidates.begin(),candidates.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::vector<int> groupOfLeaf(numGroups,-1);
+    std::vector<bool> groupTaken(numGroups,false);
+    for (auto &cand : candidates) {
+      int leaf = cand.second.first, group = cand.second.second;
+      if (groupOfLeaf[leaf] >= 0 || groupTaken[group]) continue;
+      groupOfLeaf[leaf] = group;
+      groupTaken[group] = true;
+    }
+    for (int leaf=0, group=0;leaf<numGroups;leaf++) {
+      if (groupOfLeaf[leaf] >= 0) continue;
+      while (groupTaken[group]) group++;
+      groupOfLeaf[leaf] = group;
+      groupTaken[group] = true;
+    }
+    auto groupOf = [&](const vec3f &centroid) {
+      return groupOfLeaf[kdTree.leafOf(centroid)];
+    };
+
+    // ------------------------------------------------------------------
+    // pack, exchange, and unpack - one prim type at a time
+    // ------------------------------------------------------------------
+    double numPrimsMoved = 0., bytesSent = 0.;
+    auto countMove = [&](int from, int to) { if (from != to) numPrimsMoved++; };
+
+    if (doSpheres) {
+      std::vector<SphereRecord> records;
+      for (auto part : owned) {
+        SphereSet &ss = *part->sphereSets[0];
+        for (size_t i=0;i<ss.origins.size();i++) {
+          SphereRecord rec;
+          rec.origin = ss.origins[i];
+          rec.color  = sphereColors ? ss.colors[i] : vec3f(0.f);
+          rec.radius = ss.radii.empty() ? ss.radius : ss.radii[i];
+          rec.group  = groupOf(rec.origin);
+          countMove(part->partitionsRank,rec.group);
+          records.push_back(rec);
+        }
+      }
+      for (auto part : partitions.myPartitions) {
+        SphereSet &ss = *part->sphereSets[0];
+        ss.origins.clear(); ss.colors.clear(); ss.radii.clear();
+      }
+      records = exchange(workers,records,holdersOf,bytesSent);
+      for (auto part : partitions.myPartitions) {
+        SphereSet &ss = *part->sphereSets[0];
+        for (auto &rec : records) {
+          if (rec.group != part->partitionsRank) continue;
+          ss.origins.push_back(rec.origin);
+          if (sphereColors) ss.colors.push_back(rec.color);
+          ss.radii.push_back(rec.radius);
+        }
+      }
+    }
+
+    if (doCylinders) {
+      std::vector<CylinderRecord> records;
+      for (auto part : owned) {
+        Cylinders &cs = *part->cylinderSets[0];
+        for (size_t i=0;i<numCylinders(cs);i++) {
+          CylinderRecord rec;
+          for (int end=0;end<2;end++) {
+            int v = cylinderVertex(cs,i,end);
+            rec.vertex[end] = cs.vertices[v];
+            rec.color[end]
+              = !cylinderColors ? vec3f(0.f)
+              : cs.colors[cs.colorPerVertex ? size_t(v) : i];
+            rec.radius[end]
+              = cs.radii.empty() ? cs.radius
+              : cs.radii[cs.radiusPerVertex ? size_t(v) : i];
+          }
+          rec.group = groupOf(.5f*(rec.vertex[0]+rec.vertex[1]));
+          countMove(part->partitionsRank,rec.group);
+          records.push_back(rec);
+        }
+      }
+      for (auto part : partitions.myPartitions) {
+        Cylinders &cs = *part->cylinderSets[0];
+        cs.vertices.clear(); cs.indices.clear(); cs.colors.clear(); cs.radii.clear();
+        // from now on everything is per vertex, two vertices per
+        // cylinder
+        cs.colorPerVertex  = true;
+        cs.radiusPerVertex = true;
+      }
+      records = exchange(workers,records,holdersOf,bytesSent);
+      for (auto part : partitions.myPartitions) {
+        Cylinders &cs = *part->cylinderSets[0];
+        for (auto &rec : records) {
+          if (rec.group != part->partitionsRank) continue;
+          for (int end=0;end<2;end++) {
+            cs.vertices.push_back(rec.vertex[end]);
+            if (cylinderColors) cs.colors.push_back(rec.color[end]);
+            cs.radii.push_back(rec.radius[end]);
+          }
+        }
+      }
+    }
+
+    if (doSoups) {
+      std::vector<TriangleRecord> records;
+      for (auto part : owned) {
+        mini::Mesh::SP soup = soupOf(part);
+        for (auto &idx : soup->indices) {
+          TriangleRecord rec;
+          for (int j=0;j<3;j++) {
+            rec.vertex[j] = soup->vertices[idx[j]];
+            rec.normal[j] = soupNormals ? soup->normals[idx[j]] : vec3f(0.f);
+          }
+          rec.group = groupOf((rec.vertex[0]+rec.vertex[1]+rec.vertex[2])*(1.f/3.f));
+          countMove(part->partitionsRank,rec.group);
+          records.push_back(rec);
+        }
+      }
+      for (auto part : partitions.myPartitions) {
+        mini::Mesh::SP soup = soupOf(part);
+        soup->vertices.clear(); soup->normals.clear(); soup->indices.clear();
+      }
+      records = exchange(workers,records,holdersOf,bytesSent);
+      for (auto part : partitions.myPartitions) {
+        mini::Mesh::SP soup = soupOf(part);
+        for (auto &rec : records) {
+          if (rec.group != part->partitionsRank) continue;
+          int base = (int)soup->vertices.size();
+          for (int j=0;j<3;j++) {
+            soup->vertices.push_back(rec.vertex[j]);
+            if (soupNormals) soup->normals.push_back(rec.normal[j]);
+          }
+          soup->indices.push_back(vec3i(base,base+1,base+2));
+        }
+      }
+    }
+
+    // ------------------------------------------------------------------
+    // and tell the user what that bought us
+    // ------------------------------------------------------------------
+    for (size_t i=0;i<owned.size();i++)
+      forEachCentroid(owned[i],[&](const vec3f &c) { myBounds[i].after.extend(c); });
+    std::vector<GroupBounds> allBounds = workers.allGatherv(myBounds,counts);
+    double myStats[3] = { numPrimsTotal, numPrimsMoved, bytesSent };
+    std::vector<double> allStats
+      = workers.allGatherv(std::vector<double>(myStats,myStats+3),counts);
+    double t1 = getCurrentTime();
+    if (workers.rank != 0)
+      return;
+    double sumStats[3] = { 0.,0.,0. };
+    for (size_t i=0;i<allStats.size();i++)
+      sumStats[i%3] += allStats[i];
+    std::vector<box3f> before, after;
+    for (auto &gb : allBounds) {
+      before.push_back(gb.before);
+      after.push_back(gb.after);
+    }
+    std::cout << "#hs.redist: redistributed "
+              << (doSpheres ? "spheres " : "")
+              << (doCylinders ? "cylinders " : "")
+              << (doSoups ? "triangles " : "")
+              << "across " << numGroups << " data groups in "
+              << prettyDouble(t1-t0) << "s" << std::endl;
+    std::cout << "#hs.redist: moved " << prettyNumber((size_t)sumStats[1])
+              << " of " << prettyNumber((size_t)sumStats[0]) << " prims ("
+              << prettyDouble(100.*sumStats[1]/std::max(sumStats[0],1.)) << "%), "
+              << prettyNumber((size_t)sumStats[2]) << "B sent between ranks" << std::endl;
+    std::cout << "#hs.redist: bounds overlap (avg num groups per point) "
+              << prettyDouble(overlapOf(before)) << " -> "
+              << prettyDouble(overlapOf(after)) << std::endl;
+  }
+
+}
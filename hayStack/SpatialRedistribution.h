@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/LocalPartitions.h"
+#include "hayStack/MPIWrappers.h"
+
+namespace hs {
+
+  /*! post-load pass that moves primitives between data groups such
+      that each group ends up owning a compact region of space. this
+      is meant for content that got split by index range (eg,
+      spheres://N@..., cylinders, ts.tri), where every group's
+      primitives are scattered across the whole scene.
+
+      all ranks first contribute a (cost-weighted) sample of their
+      groups' primitive centroids; from those every rank builds the
+      same kd-tree with one leaf per data group, and assigns leaves
+      to groups such that as many primitives as possible stay where
+      they are. primitives then get routed to the group whose leaf
+      contains their centroid, in one MPI_Alltoallv per primitive
+      type.
+
+      handles sphere sets, cylinder sets, and 'triangle soup' mini
+      scenes (a single, un-transformed, un-textured mesh) - but only
+      for types where every data group has exactly one such set, so
+      the receiving side knows which material etc to use. other
+      content is left where it is.
+
+      collective across all workers; prints bounds overlap and
+      exchange cost on rank 0 */
+  void redistributeSpatially(mpi::Comm &workers,
+                             LocalPartitions &partitions,
+                             int samplesPerGroup = 4096);
+
+}
@@ -17,9 +17,140 @@
 /*! a hay-*stack* is a description of data-parallel data */
 
 #include "hayStack/StructuredVolume.h"
+#include <thread>
 
 namespace hs {
 
+  namespace {
+    /*! runs body(i) for all i in [0,n), spread across all of this
+        rank's cores */
+    template<typename Lambda>
+    void parallelFor(int n, const Lambda &body)
+    {
+      const int numThreads
+        = std::min(n,std::max(1,(int)std::thread::hardware_concurrency()));
+      std::vector<std::thread> threads;
+      for (int t=0;t<numThreads;t++)
+        threads.emplace_back([&,t]() {
+          for (int i=t;i<n;i+=numThreads)
+            body(i);
+        });
+      for (auto &thread : threads)
+        thread.join();
+    }
+
+    /*! the fine-level voxels (and their weights) that one coarse
+        voxel gets filtered from, along one axis */
+    struct Taps {
+      int begin = 0;
+      std::vector<float> weights;
+    };
+
+    /*! computes, for each voxel of an axis with coarseDim voxels, the
+        taps into the same axis with fineDim voxels. coarse voxel i
+        sits at i*s in the fine grid (with s=fineCells/coarseCells,
+        usually 2), and averages the fine voxels within one coarse
+        cell around it (ie, the 2 fine cells on either side, which
+        for s=2 is the [1 2 1]/4 filter). the first and last voxel
+        only use the fine level's first and last voxel, respectively,
+        so they stay identical to what a neighboring partition that
+        shares this voxel layer computes */
+    std::vector<Taps> computeTaps(int fineDim, int coarseDim)
+    {
+      const int fineCells   = fineDim-1;
+      const int coarseCells = coarseDim-1;
+      std::vector<Taps> taps(coarseDim);
+      for (int i=0;i<coarseDim;i++) {
+        Taps &t = taps[i];
+        if (i == 0 || i == coarseCells) {
+          t.begin   = (i == 0) ? 0 : fineCells;
+          t.weights = { 1.f };
+          continue;
+        }
+        const float s = fineCells/float(coarseCells);
+        const float p = i*s;
+        t.begin = std::max(0,(int)ceilf(p-s));
+        const int end = std::min(fineCells,(int)floorf(p+s));
+        float sum = 0.f;
+        for (int j=t.begin;j<=end;j++) {
+          const float w = std::max(0.f,1.f-fabsf(j-p)/s);
+          t.weights.push_back(w);
+          sum += w;
+        }
+        for (auto &w : t.weights)
+          w /= sum;
+      }
+      return taps;
+    }
+
+    inline void storeTexel(float &texel, float v)
+    { texel = v; }
+    inline void storeTexel(uint8_t &texel, float v)
+    { texel = (uint8_t)std::min(255.f,std::max(0.f,v+.5f)); }
+    inline void storeTexel(uint16_t &texel, float v)
+    { texel = (uint16_t)std::min(65535.f,std::max(0.f,v+.5f)); }
+
+    /*! separable downsampling of a fine grid of texels into a coarse
+        one, one axis at a time; each pass is parallel over z
+        slices */
+    template<typename T>
+    void downsampleTexels(const T *in, const vec3i fine,
+                          T *out, const vec3i coarse)
+    {
+      const std::vector<Taps> tx = computeTaps(fine.x,coarse.x);
+      const std::vector<Taps> ty = computeTaps(fine.y,coarse.y);
+      const std::vector<Taps> tz = computeTaps(fine.z,coarse.z);
+      
+      // x: fine.xyz -> coarse.x * fine.yz
+      std::vector<float> tmpX(size_t(coarse.x)*fine.y*fine.z);
+      parallelFor(fine.z,[&](int iz) {
+        for (int iy=0;iy<fine.y;iy++) {
+          const T *src = in + fine.x*(iy+size_t(fine.y)*iz);
+          float *dst = tmpX.data() + coarse.x*(iy+size_t(fine.y)*iz);
+          for (int ix=0;ix<coarse.x;ix++) {
+            float v = 0.f;
+            for (int k=0;k<tx[ix].weights.size();k++)
+              v += tx[ix].weights[k]*float(src[tx[ix].begin+k]);
+            dst[ix] = v;
+          }
+        }
+      });
+      // y: coarse.x * fine.yz -> coarse.xy * fine.z
+      std::vector<float> tmpY(size_t(coarse.x)*coarse.y*fine.z,0.f);
+      parallelFor(fine.z,[&](int iz) {
+        for (int iy=0;iy<coarse.y;iy++) {
+          float *dst = tmpY.data() + coarse.x*(iy+size_t(coarse.y)*iz);
+          for (int k=0;k<ty[iy].weights.size();k++) {
+            const float w = ty[iy].weights[k];
+            const float *src
+              = tmpX.data() + coarse.x*(ty[iy].begin+k+size_t(fine.y)*iz);
+            for (int ix=0;ix<coarse.x;ix++)
+              dst[ix] += w*src[ix];
+          }
+        }
+      });
+      tmpX.clear();
+      tmpX.shrink_to_fit();
+      // z: coarse.xy * fine.z -> coarse.xyz
+      parallelFor(coarse.z,[&](int iz) {
+        std::vector<float> sum(coarse.x);
+        for (int iy=0;iy<coarse.y;iy++) {
+          std::fill(sum.begin(),sum.end(),0.f);
+          for (int k=0;k<tz[iz].weights.size();k++) {
+            const float w = tz[iz].weights[k];
+            const float *src
+              = tmpY.data() + coarse.x*(iy+size_t(coarse.y)*(tz[iz].begin+k));
+            for (int ix=0;ix<coarse.x;ix++)
+              sum[ix] += w*src[ix];
+          }
+          T *dst = out + coarse.x*(iy+size_t(coarse.y)*iz);
+          for (int ix=0;ix<coarse.x;ix++)
+            storeTexel(dst[ix],sum[ix]);
+        }
+      });
+    }
+  }
+
   box3f StructuredVolume::getBounds() const
   {
     box3f bb;
@@ -30,23 +161,25 @@ namespace hs {
 
   range1f StructuredVolume::getValueRange() const
   {
+    if (!knownValueRange.empty())
+      return knownValueRange;
     size_t numScalars = dims.x*(size_t)dims.y*dims.z;
     range1f range;
     // switch (texelFormat) {
     // case BN_FLOAT:
     if (texelFormat == "float") {
       for (size_t i=0;i<numScalars;i++)
-        range.extend(((const float *)rawData.data())[i]);
+        range.extend(((const float *)voxels())[i]);
     } else if (texelFormat == "uint8_t") {
     //   break;
     // case BN_UFIXED8:
       for (size_t i=0;i<numScalars;i++)
-        range.extend(1.f/255.f*((const uint8_t *)rawData.data())[i]);
+        range.extend(1.f/255.f*((const uint8_t *)voxels())[i]);
     //   break;
     // case BN_UFIXED16:
     } else if (texelFormat == "uint16_t") {
       for (size_t i=0;i<numScalars;i++)
-        range.extend(1.f/((1<<16)-1)*((const uint16_t *)rawData.data())[i]);
+        range.extend(1.f/((1<<16)-1)*((const uint16_t *)voxels())[i]);
     } else {
     //   break;
     // default:
@@ -55,4 +188,59 @@ namespace hs {
     return range;
   }
   
+  size_t StructuredVolume::voxelBytes() const
+  {
+    return dims.x*size_t(dims.y)*dims.z*sizeOf(texelFormat);
+  }
+
+  StructuredVolume::SP StructuredVolume::downsample() const
+  {
+    const vec3i fineCells   = dims-1;
+    const vec3i coarseCells = (fineCells+1)/2;
+    const vec3i coarseDims  = coarseCells+1;
+    std::vector<uint8_t> coarse(size_t(coarseDims.x)*coarseDims.y*coarseDims.z
+                                *sizeOf(texelFormat));
+    if (texelFormat == "float")
+      downsampleTexels((const float *)voxels(),dims,
+                       (float *)coarse.data(),coarseDims);
+    else if (texelFormat == "uint8_t")
+      downsampleTexels((const uint8_t *)voxels(),dims,
+                       (uint8_t *)coarse.data(),coarseDims);
+    else if (texelFormat == "uint16_t")
+      downsampleTexels((const uint16_t *)voxels(),dims,
+                       (uint16_t *)coarse.data(),coarseDims);
+    else
+      HAYSTACK_NYI();
+
+    // same domain as this level, so spacing is fineCells/coarseCells
+    // times ours
+    vec3f spacing = gridSpacing;
+    for (int d=0;d<3;d++)
+      if (coarseCells[d] > 0)
+        spacing[d] *= fineCells[d]/float(coarseCells[d]);
+    std::vector<uint8_t> noRGB;
+    return std::make_shared<StructuredVolume>(coarseDims,texelFormat,
+                                              coarse,noRGB,
+                                              gridOrigin,spacing);
+  }
+
+  void StructuredVolume::buildPyramid(int numLevels)
+  {
+    coarserLevels.clear();
+    const StructuredVolume *level = this;
+    while ((int)coarserLevels.size() < numLevels
+           && reduce_min(level->dims) > 2) {
+      coarserLevels.push_back(level->downsample());
+      level = coarserLevels.back().get();
+    }
+  }
+
+  size_t StructuredVolume::pyramidBytes() const
+  {
+    size_t bytes = 0;
+    for (auto level : coarserLevels)
+      bytes += level->voxelBytes();
+    return bytes;
+  }
+  
 }
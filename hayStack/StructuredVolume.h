@@ -34,15 +34,51 @@ namespace hs {
     box3f getBounds() const;
     range1f getValueRange() const;
 
+    /*! returns the next-coarser version of this volume: half the
+        cells per dimension (rounded up), covering exactly the same
+        domain (so spacing may be slightly different from 2x), and
+        box-filtered. voxels on the boundary faces are taken from this
+        level's boundary voxels only, so two partitions that share a
+        voxel layer also share it on every coarser level, and their
+        coarse volumes still meet without seams */
+    StructuredVolume::SP downsample() const;
+
+    /*! (re-)builds coarserLevels[] with up to numLevels levels;
+        stops early once a level would have fewer than two cells in
+        any dimension */
+    void buildPyramid(int numLevels);
+
+    /*! bytes used by coarserLevels[] */
+    size_t pyramidBytes() const;
+
+    /*! the scalars - either rawData, or (if those live in node-shared
+        memory, see NodeSharedMemory) sharedVoxels */
+    const uint8_t *voxels() const
+    { return sharedVoxels ? sharedVoxels.get() : rawData.data(); }
+    /*! size of voxels(), in bytes */
+    size_t voxelBytes() const;
+
     /*! dimensions of grid of scalars in rawData */
     vec3i      dims;
     std::vector<uint8_t> rawData;
+    /*! if set, the (read-only) scalars are in here, and rawData is
+        empty */
+    std::shared_ptr<const uint8_t> sharedVoxels;
     /*! either empty, or 3xuint8_t (RGB) for each voxel */
     std::vector<uint8_t> rawDataRGB;
     // ScalarType scalarType;
     const std::string// BNDataType
     texelFormat;
     vec3f gridOrigin, gridSpacing;
+    /*! if not empty, the range of values in rawData is already known
+        (eg, from a file's per-brick min/max table), and
+        getValueRange() just returns that */
+    range1f knownValueRange;
+    /*! coarser versions of this volume, coarserLevels[0] having half
+        the cells per dimension, coarserLevels[1] a quarter, etc;
+        empty unless buildPyramid() has been called. renderers can
+        use these while the user is interacting */
+    std::vector<StructuredVolume::SP> coarserLevels;
   };
 
   inline size_t sizeOf(const std::string &type)
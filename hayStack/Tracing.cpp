@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/Tracing.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+namespace hs {
+  namespace trace {
+
+    /*! fixed-size event record, so all ranks' buffers can get
+        gathered with a single masterGather */
+    struct Event {
+      char   name[32];
+      char   detail[48];
+      /*! relative to epoch, in seconds */
+      double begin, end;
+      int    thread;
+      int    valid;
+    };
+
+    static struct {
+      /*! read by every record(), from whichever thread */
+      std::atomic<bool>  enabled { false };
+      std::string        fileName;
+      double             epoch   = 0.;
+      std::vector<Event> events;
+      /*! max num events we record per rank; anything beyond that
+          gets dropped (and counted) */
+      size_t             maxEvents = 100000;
+      size_t             numDropped = 0;
+      std::mutex         mutex;
+      std::map<std::thread::id,int> threadIDs;
+    } state;
+
+    bool enabled() { return state.enabled; }
+
+    void init(mpi::Comm &comm, const std::string &fileName)
+    {
+      int anyEnabled = comm.allReduceMax(int(!fileName.empty()));
+      state.enabled  = anyEnabled != 0;
+      if (!state.enabled) return;
+
+      state.fileName = fileName.empty() ? "hayStack.trace.json" : fileName;
+      if (const char *maxEvents = getenv("HS_TRACE_MAX_EVENTS"))
+        state.maxEvents = std::stol(maxEvents);
+      state.events.reserve(std::min(state.maxEvents,(size_t)10000));
+
+      // all ranks leave the barrier at (close to) the same time, so
+      // that's our common time base
+      comm.barrier();
+      state.epoch = getCurrentTime();
+      if (comm.rank == 0)
+        std::cout << "#hs: tracing enabled, trace will be written to "
+                  << state.fileName << std::endl;
+    }
+
+    void record(const char *name, const std::string &detail,
+                double t_begin, double t_end)
+    {
+      if (!state.enabled) return;
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (state.events.size() >= state.maxEvents) {
+        state.numDropped++;
+        return;
+      }
+      Event event;
+      memset(&event,0,sizeof(event));
+      strncpy(event.name,name,sizeof(event.name)-1);
+      strncpy(event.detail,detail.c_str(),sizeof(event.detail)-1);
+      event.begin = t_begin - state.epoch;
+      event.end   = t_end   - state.epoch;
+      auto tid = std::this_thread::get_id();
+      if (state.threadIDs.find(tid) == state.threadIDs.end()) {
+        int newID = (int)state.threadIDs.size();
+        state.threadIDs[tid] = newID;
+      }
+      event.thread = state.threadIDs[tid];
+      event.valid  = 1;
+      state.events.push_back(event);
+    }
+
+    static std::string jsonString(const char *s)
+    {
+      std::string result = "\"";
+      for (;*s;s++) {
+        if (*s == '"' || *s == '\\')
+          result += '\\';
+        if ((unsigned char)*s < 0x20)
+          result += ' ';
+        else
+          result += *s;
+      }
+      return result + "\"";
+    }
+
+    void finish(mpi::Comm &comm)
+    {
+      if (!state.enabled) return;
+      std::vector<Event> events;
+      {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        events = state.events;
+        state.enabled = false;
+      }
+
+      // pad every rank's buffer to the same size, so we can use a
+      // plain (fixed-size) gather
+      const size_t numEvents = events.size();
+      const size_t maxEvents
+        = std::max((size_t)1,comm.allReduceMax(numEvents));
+      const size_t numDropped = comm.allReduceAdd(state.numDropped);
+      Event empty;
+      memset(&empty,0,sizeof(empty));
+      events.resize(maxEvents,empty);
+
+      // mpi counts are ints (of bytes, for masterGather), so long
+      // traces go in several gathers; allEvents is rank-major
+      const size_t eventsPerGather = (size_t(1) << 30)/sizeof(Event);
+      std::vector<Event> allEvents;
+      std::vector<Event> gathered;
+      if (comm.rank == 0)
+        allEvents.resize(maxEvents*comm.size);
+      for (size_t begin=0;begin<maxEvents;begin+=eventsPerGather) {
+        const int count = (int)std::min(eventsPerGather,maxEvents-begin);
+        if (comm.rank != 0) {
+          comm.masterGather(events.data()+begin,count);
+          continue;
+        }
+        gathered.resize(size_t(count)*comm.size);
+        comm.masterGather(gathered.data(),events.data()+begin,count);
+        for (int rank=0;rank<comm.size;rank++)
+          std::copy(gathered.begin()+size_t(rank)*count,
+                    gathered.begin()+size_t(rank+1)*count,
+                    allEvents.begin()+rank*maxEvents+begin);
+      }
+      if (comm.rank != 0)
+        return;
+
+      std::ofstream out(state.fileName.c_str());
+      if (!out.good()) {
+        std::cout << MINI_TERMINAL_RED
+                  << "#hs: could not open trace file " << state.fileName
+                  << MINI_TERMINAL_DEFAULT << std::endl;
+        return;
+      }
+      out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+      // name (and order) the 'processes' by rank
+      for (int rank=0;rank<comm.size;rank++) {
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+            << ",\"args\":{\"name\":\"rank " << rank << "\"}}," << std::endl;
+        out << "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":" << rank
+            << ",\"args\":{\"sort_index\":" << rank << "}}"
+            << (rank+1 < comm.size ? "," : "");
+      }
+      size_t numWritten = 0;
+      for (size_t i=0;i<allEvents.size();i++) {
+        const Event &event = allEvents[i];
+        if (!event.valid) continue;
+        int rank = int(i / maxEvents);
+        char timing[128];
+        snprintf(timing,sizeof(timing),
+                 "\"ts\":%.3f,\"dur\":%.3f",
+                 event.begin*1e6,(event.end-event.begin)*1e6);
+        out << ",\n"
+            << "{\"name\":" << jsonString(event.name)
+            << ",\"cat\":\"hs\",\"ph\":\"X\","
+            << timing
+            << ",\"pid\":" << rank
+            << ",\"tid\":" << event.thread;
+        if (event.detail[0])
+          out << ",\"args\":{\"detail\":" << jsonString(event.detail) << "}";
+        out << "}";
+        numWritten++;
+      }
+      out << std::endl << "]}" << std::endl;
+      std::cout << "#hs: wrote " << numWritten << " trace events from "
+                << comm.size << " rank(s) to " << state.fileName;
+      if (numDropped)
+        std::cout << " (" << numDropped << " events dropped; "
+                  << "increase HS_TRACE_MAX_EVENTS to keep them)";
+      std::cout << std::endl;
+    }
+
+  }
+}
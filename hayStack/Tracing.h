@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/MPIWrappers.h"
+
+/*! phase-level tracing across all ranks: each rank records
+    (begin,end) events for named phases into a local buffer, using
+    timestamps relative to an epoch that all ranks agree on (through
+    a barrier); at the end these get gathered on rank 0, and written
+    out as a chrome://tracing / perfetto json file, with one 'process'
+    per rank */
+namespace hs {
+  namespace trace {
+
+    /*! set up tracing: enabled if fileName is non-empty on _any_
+        rank, in which case rank 0 will write the trace into its
+        fileName (or "hayStack.trace.json" if it got none itself).
+        collective across all ranks of comm; and since this defines
+        the time epoch, should be called as early as possible */
+    void init(mpi::Comm &comm, const std::string &fileName);
+
+    /*! gather all ranks' events to rank 0, and write the trace
+        file. collective across the same ranks as init(); a no-op if
+        tracing isn't enabled */
+    void finish(mpi::Comm &comm);
+
+    /*! whether tracing is enabled */
+    bool enabled();
+
+    /*! record one event that started and ended at the given
+        (getCurrentTime()) times */
+    void record(const char *name, const std::string &detail,
+                double t_begin, double t_end);
+
+    /*! RAII scope that records an event for its lifetime */
+    struct Scope {
+      Scope(const char *name, const std::string &detail = "")
+        : name(name)
+      {
+        if (!enabled()) return;
+        this->detail = detail;
+        t_begin = getCurrentTime();
+      }
+      ~Scope()
+      {
+        if (t_begin < 0.) return;
+        record(name,detail,t_begin,getCurrentTime());
+      }
+      const char *const name;
+      std::string detail;
+      double      t_begin = -1.;
+    };
+
+  }
+}
+
+#define HS_TRACE_CONCAT_(a,b) a##b
+#define HS_TRACE_CONCAT(a,b) HS_TRACE_CONCAT_(a,b)
+/*! trace the remainder of the current scope under given name (and
+    optional detail string) */
+#define HS_TRACE_SCOPE(...)                                             \
+  hs::trace::Scope HS_TRACE_CONCAT(__hs_trace_scope_,__LINE__)(__VA_ARGS__)
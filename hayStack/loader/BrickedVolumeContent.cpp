@@ -0,0 +1,238 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/BrickedVolumeContent.h"
+#include "hayStack/NodeSharedMemory.h"
+#include <algorithm>
+#include <cstring>
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+
+    /* in RAWVolumeContent.cpp */
+    void splitKDTree(std::vector<box3i> &regions,
+                     box3i cellRange,
+                     int numParts);
+
+    /*! "hsbvol01" */
+    const uint64_t BrickedVolumeFile::magic = 0x31306c6f76627368ull;
+
+    inline uint64_t spreadBits(uint64_t x)
+    {
+      x &= 0x1fffff;
+      x = (x | x << 32) & 0x1f00000000ffffull;
+      x = (x | x << 16) & 0x1f0000ff0000ffull;
+      x = (x | x << 8)  & 0x100f00f00f00f00full;
+      x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+      x = (x | x << 2)  & 0x1249249249249249ull;
+      return x;
+    }
+
+    std::vector<vec3i> BrickedVolumeFile::mortonOrder(vec3i numBricks)
+    {
+      std::vector<std::pair<uint64_t,vec3i>> codes;
+      for (int iz=0;iz<numBricks.z;iz++)
+        for (int iy=0;iy<numBricks.y;iy++)
+          for (int ix=0;ix<numBricks.x;ix++)
+            codes.push_back({spreadBits(ix)|(spreadBits(iy)<<1)|(spreadBits(iz)<<2),
+                             vec3i(ix,iy,iz)});
+      std::sort(codes.begin(),codes.end(),
+                [](const auto &a, const auto &b) { return a.first < b.first; });
+      std::vector<vec3i> order;
+      for (auto &code : codes)
+        order.push_back(code.second);
+      return order;
+    }
+
+    void BrickedVolumeFile::readHeader(const std::string &fileName,
+                                       Header &header,
+                                       std::vector<LevelInfo> &levels)
+    {
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      in.read((char *)&header,sizeof(header));
+      if (!in.good() || header.magic != magic)
+        throw std::runtime_error("'"+fileName+"' is not a hayStack bricked volume file");
+      levels.resize(header.numLevels);
+      in.read((char *)levels.data(),levels.size()*sizeof(LevelInfo));
+      if (!in.good())
+        throw std::runtime_error("could not read level table from '"+fileName+"'");
+    }
+
+    BrickedVolumeContent::BrickedVolumeContent(const std::string &fileName,
+                                               int thisPartID,
+                                               int level,
+                                               const box3i &brickRange)
+      : fileName(fileName),
+        thisPartID(thisPartID),
+        level(level),
+        brickRange(brickRange)
+    {
+      std::vector<BrickedVolumeFile::LevelInfo> levels;
+      BrickedVolumeFile::readHeader(fileName,header,levels);
+      levelInfo = levels[level];
+    }
+
+    void BrickedVolumeContent::create(DataLoader *loader,
+                                      const ResourceSpecifier &dataURL)
+    {
+      BrickedVolumeFile::Header header;
+      std::vector<BrickedVolumeFile::LevelInfo> levels;
+      BrickedVolumeFile::readHeader(dataURL.where,header,levels);
+      int level = dataURL.get_int("level",0);
+      if (level < 0 || level >= header.numLevels)
+        throw std::runtime_error("BrickedVolumeContent: level "+std::to_string(level)
+                                 +" out of range (file has "
+                                 +std::to_string(header.numLevels)+" levels)");
+
+      std::vector<box3i> regions;
+      splitKDTree(regions,box3i(vec3i(0),levels[level].numBricks),dataURL.numParts);
+      if (regions.size() < dataURL.numParts)
+        throw std::runtime_error("not enough bricks on level "+std::to_string(level)
+                                 +" to split into indicated number of parts");
+      if (loader->myRank() == 0) {
+        std::cout << "#hs.bricked: " << dataURL.where << ": level " << level
+                  << " of " << header.numLevels << ", " << levels[level].dims
+                  << " voxels in " << levels[level].numBricks << " bricks of "
+                  << header.brickSize << "^3 cells" << std::endl;
+        for (int i=0;i<regions.size();i++)
+          std::cout << " #" << i << " : bricks " << regions[i] << std::endl;
+      }
+      for (int i=0;i<dataURL.numParts;i++)
+        loader->addContent(new BrickedVolumeContent(dataURL.where,i,level,regions[i]));
+    }
+
+    size_t BrickedVolumeContent::projectedSize()
+    {
+      vec3i numVoxels
+        = min(brickRange.upper*header.brickSize,levelInfo.dims-1)
+        - brickRange.lower*header.brickSize + 1;
+      return numVoxels.x*size_t(numVoxels.y)*numVoxels.z*sizeOf(header.texelFormat);
+    }
+
+    size_t BrickedVolumeContent::projectedPrims()
+    {
+      vec3i numCells
+        = min(brickRange.upper*header.brickSize,levelInfo.dims-1)
+        - brickRange.lower*header.brickSize;
+      return numCells.x*size_t(numCells.y)*numCells.z;
+    }
+
+    box3f BrickedVolumeContent::projectedBounds()
+    {
+      const float scale = float(1<<level);
+      const vec3i lower = brickRange.lower*header.brickSize;
+      const vec3i upper = min(brickRange.upper*header.brickSize,levelInfo.dims-1);
+      return box3f(vec3f(lower)*scale,vec3f(upper)*scale);
+    }
+
+    void BrickedVolumeContent::executeLoad(OnePartition &dataGroup)
+    {
+      const double t0 = getCurrentTime();
+      const int    B  = header.brickSize;
+      const size_t texelSize  = sizeOf(header.texelFormat);
+      const size_t brickVoxels = size_t(B+1)*(B+1)*(B+1);
+      const size_t brickBytes = brickVoxels*texelSize;
+      const vec3i  lower = brickRange.lower*B;
+      const vec3i  upper = min(brickRange.upper*B,levelInfo.dims-1);
+      vec3i  numVoxels = upper-lower+1;
+      const size_t numBytes = numVoxels.x*size_t(numVoxels.y)*numVoxels.z*texelSize;
+
+      // which of the file's bricks (by position in the file) are ours
+      std::vector<vec3i> order = BrickedVolumeFile::mortonOrder(levelInfo.numBricks);
+      std::vector<size_t> ours;
+      for (size_t i=0;i<order.size();i++)
+        if (order[i].x >= brickRange.lower.x && order[i].x < brickRange.upper.x &&
+            order[i].y >= brickRange.lower.y && order[i].y < brickRange.upper.y &&
+            order[i].z >= brickRange.lower.z && order[i].z < brickRange.upper.z)
+          ours.push_back(i);
+
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      range1f valueRange;
+      {
+        std::vector<range1f> ranges(order.size());
+        in.seekg(levelInfo.rangesOffset);
+        in.read((char *)ranges.data(),ranges.size()*sizeof(range1f));
+        for (auto i : ours)
+          valueRange.extend(ranges[i]);
+      }
+
+      // read runs of consecutive bricks with one read each, in pieces
+      // of at most ~64MB
+      const size_t maxBricksPerRead = std::max((size_t)1,(size_t(64)<<20)/brickBytes);
+      int numReads = 0;
+      auto readBricks = [&](uint8_t *rawData) {
+        std::vector<uint8_t> buffer;
+        for (size_t begin=0;begin<ours.size();) {
+          size_t end = begin+1;
+          while (end < ours.size() && ours[end] == ours[end-1]+1
+                 && end-begin < maxBricksPerRead)
+            end++;
+          buffer.resize((end-begin)*brickBytes);
+          in.seekg(levelInfo.bricksOffset+ours[begin]*brickBytes);
+          in.read((char *)buffer.data(),buffer.size());
+          if (!in.good())
+            throw std::runtime_error("BrickedVolumeContent: error reading bricks from '"
+                                     +fileName+"'");
+          numReads++;
+          for (size_t i=begin;i<end;i++) {
+            const uint8_t *brick = buffer.data()+(i-begin)*brickBytes;
+            const vec3i brickLower = order[ours[i]]*B;
+            const vec3i from = max(brickLower,lower);
+            const vec3i to   = min(brickLower+B,upper);
+            const size_t rowBytes = (to.x-from.x+1)*texelSize;
+            for (int iz=from.z;iz<=to.z;iz++)
+              for (int iy=from.y;iy<=to.y;iy++) {
+                const size_t srcIdx
+                  = (from.x-brickLower.x)
+                  + (B+1)*((iy-brickLower.y)+size_t(B+1)*(iz-brickLower.z));
+                const size_t dstIdx
+                  = (from.x-lower.x)
+                  + numVoxels.x*((iy-lower.y)+size_t(numVoxels.y)*(iz-lower.z));
+                memcpy(rawData+dstIdx*texelSize,
+                       brick+srcIdx*texelSize,rowBytes);
+              }
+          }
+          begin = end;
+        }
+      };
+
+      const float scale = float(1<<level);
+      std::vector<uint8_t> rawData, noRGB;
+      if (!NodeSharedMemory::active()) {
+        rawData.resize(numBytes);
+        readBricks(rawData.data());
+      }
+      StructuredVolume::SP volume
+        = std::make_shared<StructuredVolume>(numVoxels,header.texelFormat,
+                                             rawData,noRGB,
+                                             vec3f(lower)*scale,vec3f(scale));
+      if (NodeSharedMemory::active())
+        // other ranks on this node load the same bricks - only one of
+        // us reads them, into node-shared memory
+        volume->sharedVoxels = NodeSharedMemory::load(numBytes,readBricks);
+      volume->knownValueRange = valueRange;
+      dataGroup.structuredVolumes.push_back(volume);
+
+      if (verbose) {
+        const double t = getCurrentTime()-t0;
+        std::cout << "#hs.bricked: part " << thisPartID << ": "
+                  << prettyNumber(ours.size()*brickBytes) << "B in "
+                  << ours.size() << " bricks, " << numReads << " reads, "
+                  << prettyDouble(t) << "s ("
+                  << prettyNumber(size_t(ours.size()*brickBytes/std::max(t,1e-6)))
+                  << "B/s)" << std::endl;
+      }
+    }
+
+    std::string BrickedVolumeContent::toString()
+    {
+      std::stringstream ss;
+      ss << "BrickedVolume{fileName=" << fileName << ", part " << thisPartID
+         << ", level " << level << ", bricks " << brickRange
+         << ", proj size " << prettyNumber(projectedSize()) << "B}";
+      return ss.str();
+    }
+
+  }
+}
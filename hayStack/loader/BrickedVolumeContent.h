@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+#include "hayStack/StructuredVolume.h"
+
+namespace hs {
+  namespace loader {
+
+    /*! hayStack's native bricked ('.hsbv') structured-volume
+        format. a volume is stored as a pyramid of levels (level 0
+        being the input, each next one half the cells per dimension,
+        box-filtered); each level is a grid of fixed-size bricks of
+        brickSize^3 cells (so (brickSize+1)^3 voxels, with the last
+        voxel layer duplicated from the next brick, and bricks on the
+        border padded with clamped values). bricks are stored
+        contiguously in Morton order, preceded by a table of each
+        brick's (normalized, same as StructuredVolume::getValueRange)
+        min/max value. layout is:
+
+          Header
+          LevelInfo[numLevels]
+          for each level:
+            range1f  ranges[numBricks]   (in Morton order)
+            texel    bricks[numBricks][brickSize+1]^3 (in Morton order)
+     */
+    struct BrickedVolumeFile {
+      struct Header {
+        uint64_t magic;
+        /*! voxels on level 0 */
+        vec3i    dims;
+        /*! cells per brick and dimension */
+        int      brickSize;
+        int      numLevels;
+        /*! "uint8_t", "uint16_t", or "float" */
+        char     texelFormat[16];
+      };
+      struct LevelInfo {
+        /*! voxels on this level */
+        vec3i    dims;
+        vec3i    numBricks;
+        uint64_t rangesOffset;
+        uint64_t bricksOffset;
+      };
+
+      static const uint64_t magic;
+
+      /*! brick coordinates of given grid of bricks, in the order they
+          are stored in the file */
+      static std::vector<vec3i> mortonOrder(vec3i numBricks);
+
+      /*! voxels on the level after one with given dims (ie, half the
+          cells, rounded up) */
+      static vec3i nextLevelDims(vec3i dims)
+      { return dims/2+1; }
+
+      static void readHeader(const std::string &fileName,
+                             Header &header,
+                             std::vector<LevelInfo> &levels);
+    };
+
+    /*! a box of bricks from one level of a '.hsbv' file. 'N@' splits
+        the chosen level's brick grid into N kd-regions of whole
+        bricks, each of which becomes a StructuredVolume; and
+        ':level=L' loads a coarser level of the pyramid instead of
+        the full-res data, for fast previews. */
+    struct BrickedVolumeContent : public LoadableContent {
+      BrickedVolumeContent(const std::string &fileName,
+                           int thisPartID,
+                           int level,
+                           /*! range of bricks (upper is exclusive) */
+                           const box3i &brickRange);
+
+      static void create(DataLoader *loader,
+                         const ResourceSpecifier &dataURL);
+      size_t projectedSize() override;
+      size_t projectedPrims() override;
+      box3f  projectedBounds() override;
+      void   executeLoad(OnePartition &dataGroup) override;
+
+      std::string toString() override;
+
+      const std::string fileName;
+      const int         thisPartID;
+      const int         level;
+      const box3i       brickRange;
+      BrickedVolumeFile::Header    header;
+      BrickedVolumeFile::LevelInfo levelInfo;
+    };
+
+  }
+}
@@ -0,0 +1,281 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/ConfigPlanner.h"
+#include "hayStack/Tracing.h"
+#include <set>
+#include <iomanip>
+
+namespace hs {
+  namespace loader {
+    namespace {
+
+      /*! where in given descriptor its 'N@' split factor is (or
+          would go), and what it is (1 if there's none) */
+      int splitFactorOf(const std::string &descriptor, size_t &begin, size_t &end)
+      {
+        size_t scheme = descriptor.find("://");
+        begin = (scheme == descriptor.npos) ? 0 : scheme+3;
+        end   = begin;
+        while (end < descriptor.size() && isdigit(descriptor[end])) ++end;
+        if (end > begin && end < descriptor.size() && descriptor[end] == '@')
+          return std::stoi(descriptor.substr(begin,end-begin));
+        end = begin;
+        return 1;
+      }
+
+      std::string withSplitFactor(const std::string &descriptor, int numParts)
+      {
+        size_t begin, end;
+        int current = splitFactorOf(descriptor,begin,end);
+        if (current > 1)
+          // replace the digits only, keep the '@'
+          return descriptor.substr(0,begin)+std::to_string(numParts)
+            +descriptor.substr(end);
+        return descriptor.substr(0,begin)+std::to_string(numParts)+"@"
+          +descriptor.substr(begin);
+      }
+
+      inline size_t divRoundUp(size_t a, size_t b)
+      { return (a+b-1)/b; }
+    }
+
+    ConfigPlanner::Topology
+    ConfigPlanner::Topology::detect(mpi::Comm &comm, bool withHeadNode)
+    {
+      Topology topology;
+      // every rank's node is identified by the lowest rank on it
+      mpi::Comm node = comm.splitShared();
+      int nodeLeader = node.allReduceMin(comm.rank);
+      node.free();
+      std::vector<int> leaderOf(comm.size);
+      leaderOf[comm.rank] = nodeLeader;
+      comm.allGather(leaderOf.data(),nodeLeader);
+
+      const int firstDataRank = withHeadNode ? 1 : 0;
+      std::map<int,int> nodeIndexOf;
+      for (int r=firstDataRank;r<comm.size;r++) {
+        if (!nodeIndexOf.count(leaderOf[r])) {
+          int newIndex = (int)nodeIndexOf.size();
+          nodeIndexOf[leaderOf[r]] = newIndex;
+        }
+        topology.nodeOf.push_back(nodeIndexOf[leaderOf[r]]);
+      }
+      topology.numRanks = (int)topology.nodeOf.size();
+      topology.numNodes = (int)nodeIndexOf.size();
+      std::vector<int> ranksOnNode(topology.numNodes,0);
+      for (auto n : topology.nodeOf)
+        ranksOnNode[n]++;
+      topology.minRanksPerNode
+        = *std::min_element(ranksOnNode.begin(),ranksOnNode.end());
+      topology.maxRanksPerNode
+        = *std::max_element(ranksOnNode.begin(),ranksOnNode.end());
+      return topology;
+    }
+
+    ConfigPlanner::ConfigPlanner(DynamicDataLoader &loader,
+                                 size_t budgetPerRank,
+                                 bool withHeadNode)
+      : budgetPerRank(budgetPerRank),
+        loader(loader)
+    {
+      if (!loader.snapshotDir.empty())
+        throw std::runtime_error("planning needs content discovery,"
+                                 " which snapshots skip");
+      topology = Topology::detect(loader.workers,withHeadNode);
+      loader.gatherCapacities();
+    }
+
+    int ConfigPlanner::defaultDPR(int ndg) const
+    {
+      return topology.numRanks < ndg ? ndg / topology.numRanks : 1;
+    }
+
+    ConfigPlanner::Plan ConfigPlanner::evaluate(int ndg, int dpr)
+    {
+      Plan plan;
+      plan.ndg    = ndg;
+      plan.dpr    = dpr ? dpr : defaultDPR(ndg);
+      plan.groups = loader.planGroups(ndg,loader.groupCapacities(ndg,plan.dpr));
+
+      std::vector<size_t> groupBytes(ndg,0);
+      for (int g=0;g<ndg;g++)
+        for (auto content : plan.groups[g])
+          groupBytes[g] += content->projectedSize();
+
+      // same group-to-rank mapping as DataLoader::loadData()
+      std::vector<std::set<int>> groupsOnNode(topology.numNodes);
+      std::vector<size_t> rankBytes(topology.numRanks,0);
+      for (int r=0;r<topology.numRanks;r++)
+        for (int i=0;i<plan.dpr;i++) {
+          int g = (r*plan.dpr+i) % ndg;
+          rankBytes[r] += groupBytes[g];
+          groupsOnNode[topology.nodeOf[r]].insert(g);
+        }
+      plan.maxRankBytes
+        = *std::max_element(rankBytes.begin(),rankBytes.end());
+      std::vector<int> ranksOnNode(topology.numNodes,0);
+      for (auto n : topology.nodeOf)
+        ranksOnNode[n]++;
+      bool nodesFit = true;
+      for (int n=0;n<topology.numNodes;n++) {
+        size_t nodeBytes = 0;
+        for (auto g : groupsOnNode[n])
+          nodeBytes += groupBytes[g];
+        plan.maxNodeBytes = std::max(plan.maxNodeBytes,nodeBytes);
+        nodesFit = nodesFit && nodeBytes <= ranksOnNode[n]*budgetPerRank;
+      }
+      // with node-shared memory the replicas of a group on the same
+      // node share one copy, so it's the node's sum that matters
+      plan.fits
+        = loader.shareNodeMemory
+        ? nodesFit
+        : plan.maxRankBytes <= budgetPerRank;
+      return plan;
+    }
+
+    void ConfigPlanner::discover()
+    {
+      HS_TRACE_SCOPE("planDiscover");
+      for (auto &content : loader.allContent)
+        delete std::get<2>(content);
+      loader.allContent.clear();
+      descriptorOf.clear();
+      for (int i=0;i<(int)loader.contentDescriptors.size();i++) {
+        size_t begin = loader.allContent.size();
+        loader.discoverContent(loader.contentDescriptors[i]);
+        for (size_t j=begin;j<loader.allContent.size();j++)
+          descriptorOf[std::get<2>(loader.allContent[j])] = i;
+      }
+    }
+
+    ConfigPlanner::Plan ConfigPlanner::plan()
+    {
+      HS_TRACE_SCOPE("plan");
+      const int numRanks = topology.numRanks;
+      size_t totalBytes = 0;
+      for (auto &content : loader.allContent)
+        totalBytes += std::get<2>(content)->projectedSize();
+
+      // not even a single copy of everything fits across all ranks;
+      // no splitting can help with that
+      if (totalBytes > numRanks*budgetPerRank) {
+        Plan plan = evaluate(numRanks,1);
+        plan.fits = false;
+        return plan;
+      }
+
+      // (only the config: discover() below deletes the content that
+      // a plan's groups point to, so plans don't survive it)
+      std::pair<int,int> lastTried { numRanks, 1 };
+      // (every round evaluates all configs against the content as it
+      // is after the previous round's split, so the last split also
+      // gets evaluated)
+      const int maxSplitRounds = 4;
+      for (int round=0;;round++) {
+        // fewest groups first: every divisor of the num ranks (so
+        // that all groups have the same num copies), then more
+        // than one group per rank
+        std::vector<std::pair<int,int>> candidates;
+        for (int ndg=1;ndg<=numRanks;ndg++)
+          if (numRanks % ndg == 0)
+            candidates.push_back({ndg,1});
+        const int numPieces = (int)loader.allContent.size();
+        for (int dpr=2;numRanks*dpr<=numPieces;dpr++)
+          candidates.push_back({numRanks*dpr,dpr});
+        for (auto c : candidates) {
+          Plan plan = evaluate(c.first,c.second);
+          if (plan.fits) return plan;
+          lastTried = c;
+        }
+        if (round == maxSplitRounds) break;
+
+        // no config fits; split whatever pieces are too large to
+        // leave the packing some room
+        const size_t maxPieceBytes = std::max(budgetPerRank/2,size_t(1));
+        if (descriptorOf.empty())
+          discover();
+        std::map<int,size_t> largestPieceOf;
+        for (auto &content : loader.allContent) {
+          LoadableContent *piece = std::get<2>(content);
+          int d = descriptorOf[piece];
+          largestPieceOf[d] = std::max(largestPieceOf[d],piece->projectedSize());
+        }
+        bool anyChanged = false;
+        for (auto it : largestPieceOf) {
+          if (it.second <= maxPieceBytes) continue;
+          std::string &descriptor = loader.contentDescriptors[it.first];
+          size_t begin, end;
+          int numParts = splitFactorOf(descriptor,begin,end);
+          int newNumParts = int(numParts*divRoundUp(it.second,maxPieceBytes));
+          std::string newDescriptor = withSplitFactor(descriptor,newNumParts);
+          changedDescriptors.push_back({descriptor,newDescriptor});
+          descriptor = newDescriptor;
+          anyChanged = true;
+        }
+        if (!anyChanged) break;
+        size_t numPiecesBefore = loader.allContent.size();
+        discover();
+        if (loader.allContent.size() <= numPiecesBefore)
+          // none of the changed descriptors' types can split
+          break;
+      }
+      // nothing fits; report the last config tried, against the
+      // content as it is now
+      Plan plan = evaluate(lastTried.first,lastTried.second);
+      plan.fits = false;
+      return plan;
+    }
+
+    void ConfigPlanner::report(const Plan &plan)
+    {
+      if (loader.workers.rank != 0) return;
+      std::cout << "#hs.plan: " << topology.numRanks << " data rank(s) on "
+                << topology.numNodes << " node(s) ("
+                << topology.minRanksPerNode;
+      if (topology.maxRanksPerNode != topology.minRanksPerNode)
+        std::cout << "-" << topology.maxRanksPerNode;
+      std::cout << " per node); budget " << prettyNumber(budgetPerRank)
+                << "B per rank" << std::endl;
+      for (auto &changed : changedDescriptors)
+        std::cout << "#hs.plan: split '" << changed.first << "' as '"
+                  << changed.second << "'" << std::endl;
+      std::cout << "#hs.plan: -ndg " << plan.ndg << " -dpr " << plan.dpr;
+      if (plan.ndg < topology.numRanks)
+        std::cout << " (every group on " << topology.numRanks/plan.ndg
+                  << " ranks)";
+      std::cout << ": up to " << prettyNumber(plan.maxRankBytes) << "B per rank";
+      if (loader.shareNodeMemory)
+        std::cout << ", " << prettyNumber(plan.maxNodeBytes)
+                  << "B per node w/ node-shared memory";
+      std::cout << " - " << (plan.fits ? "fits" : "DOES NOT FIT") << std::endl;
+
+      std::cout << "#hs.plan:  group  pieces      bytes      prims  bounds" << std::endl;
+      for (int g=0;g<(int)plan.groups.size();g++) {
+        size_t bytes = 0, prims = 0;
+        bool   primsKnown = true, boundsKnown = true;
+        box3f  bounds;
+        for (auto content : plan.groups[g]) {
+          bytes += content->projectedSize();
+          size_t p = content->projectedPrims();
+          primsKnown = primsKnown && p > 0;
+          prims += p;
+          box3f b = content->projectedBounds();
+          boundsKnown = boundsKnown && !b.empty();
+          bounds.extend(b);
+        }
+        std::stringstream ss;
+        ss << "#hs.plan: " << std::setw(6) << g
+           << std::setw(8) << plan.groups[g].size()
+           << std::setw(10) << prettyNumber(bytes) << "B"
+           << std::setw(11) << (primsKnown ? prettyNumber(prims) : "?");
+        if (boundsKnown && !plan.groups[g].empty())
+          ss << "  " << bounds;
+        else
+          ss << "  ?";
+        std::cout << ss.str() << std::endl;
+      }
+    }
+
+  }
+}
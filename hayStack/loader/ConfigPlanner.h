@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+
+namespace hs {
+  namespace loader {
+
+    /*! picks the number of data groups (-ndg), data groups per rank
+        (-dpr), and - if some piece of content is too large for any
+        rank on its own - the 'N@' split factors of the content
+        descriptors, such that every rank's data fits a given memory
+        budget. goes only by what content discovery and
+        projectedSize() etc say, so it never loads any payload.
+
+        prefers as few data groups as possible (ie, as much
+        replication as the budget allows); with node-shared memory,
+        replicated groups count only once per node. */
+    struct ConfigPlanner {
+      /*! which ranks share a node, as per MPI_Comm_split_type */
+      struct Topology {
+        /*! collective across all ranks in given comm; with a head
+            node, that one (rank 0) gets left out of the topology */
+        static Topology detect(mpi::Comm &comm, bool withHeadNode);
+
+        /*! num ranks that load data */
+        int numRanks = 1;
+        int numNodes = 1;
+        int minRanksPerNode = 1;
+        int maxRanksPerNode = 1;
+        /*! node index of every rank */
+        std::vector<int> nodeOf;
+      };
+
+      struct Plan {
+        int ndg = 1;
+        int dpr = 1;
+        /*! content per group, as assignGroups() will assign it */
+        std::vector<std::vector<LoadableContent *>> groups;
+        /*! (projected) bytes of the rank that needs the most */
+        size_t maxRankBytes = 0;
+        /*! same for nodes, if sharing node memory */
+        size_t maxNodeBytes = 0;
+        bool   fits = false;
+      };
+
+      /*! has to get constructed (and used) on all ranks that share
+          the loader, as content discovery can be collective across
+          those; withHeadNode says whether the first of them won't
+          load any data */
+      ConfigPlanner(DynamicDataLoader &loader,
+                    size_t budgetPerRank,
+                    bool withHeadNode);
+
+      /*! finds the config with fewest data groups that fits the
+          budget; if there isn't one with the current split factors,
+          increases those (re-discovering the content with the new
+          descriptors) where that can help. the returned plan has
+          fits == false if nothing does. collective. the plan's groups
+          point into the loader's current content, so they're only
+          valid as long as that is */
+      Plan plan();
+
+      /*! what given ndg/dpr would need, with the current content */
+      Plan evaluate(int ndg, int dpr);
+
+      /*! prints topology, chosen config, and per-group bytes,
+          primitives, and bounds (on rank 0) */
+      void report(const Plan &plan);
+
+      const size_t budgetPerRank;
+      Topology     topology;
+
+    private:
+      /*! re-discovers all content from the loader's descriptors,
+          remembering which pieces came from which descriptor */
+      void discover();
+      /*! the dpr the loader would use for given ndg (if dpr is 0) */
+      int  defaultDPR(int ndg) const;
+
+      DynamicDataLoader &loader;
+      /*! index (into loader.contentDescriptors) of the descriptor
+          every piece of content came from */
+      std::map<LoadableContent *,int> descriptorOf;
+      /*! descriptors whose split factor got changed, and what they
+          were before */
+      std::vector<std::pair<std::string,std::string>> changedDescriptors;
+    };
+
+  }
+}
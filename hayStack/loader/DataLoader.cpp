@@ -2,13 +2,21 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "hayStack/loader/DataLoader.h"
+#include "hayStack/Tracing.h"
+#include "hayStack/NodeSharedMemory.h"
+#include "hayStack/PartitionSerializer.h"
+#include "hayStack/PartitionSnapshot.h"
+#include <limits>
+#include <iomanip>
 #include "hayStack/loader/TSTris.h"
 #include "hayStack/loader/TriangleMesh.h"
 #include "hayStack/loader/RAWVolumeContent.h"
+#include "hayStack/loader/BrickedVolumeContent.h"
 #include "hayStack/loader/GESTS.h"
 #include "hayStack/loader/TAMRContent.h"
 #include "hayStack/loader/CylindersFromFile.h"
 #include "hayStack/loader/SpheresFromFile.h"
+#include "hayStack/loader/ParticlesContent.h"
 #include "hayStack/loader/MaterialsTest.h"
 #include "hayStack/loader/BoxesFromFile.h"
 #include "hayStack/loader/MiniContent.h"
@@ -64,7 +72,7 @@ namespace hs {
           }
         }
         for (auto arg : betweenColons) {
-          std::string key=args, value="";
+          std::string key=arg, value="";
           int equals = arg.find("=");
           if (equals != key.npos) {
             key   = arg.substr(0,equals);
@@ -208,6 +216,18 @@ namespace hs {
       return size;
     }
 
+    size_t availableHostMemory()
+    {
+      std::ifstream in("/proc/meminfo");
+      std::string line;
+      while (std::getline(in,line)) {
+        size_t kB = 0;
+        if (sscanf(line.c_str(),"MemAvailable: %zu kB",&kB) == 1)
+          return kB*1024;
+      }
+      return 0;
+    }
+
 #if HS_USD
     mini::Scene::SP loadUSD(const std::string &fileName);
 #endif
@@ -252,40 +272,136 @@ namespace hs {
                   << " to ensure equal num data groups for each rank" << std::endl;
       }
   
-      assignGroups(numDataRanks);
-      std::vector<int> localDataRanks;
+      gatherCapacities();
+      groupCapacity = groupCapacities(numDataRanks,dataPerRank);
 
-      for (int i=0;i<dataPerRank;i++) {
-        int dataGroupID = (workers.rank*dataPerRank+i) % numDataRanks;
-        if (verbose) {
-          std::stringstream ss;
-          ss << "#hv: worker #" << workers.rank
-             << " loading global data group ID " << dataGroupID
-             << " into slot " << workers.rank << "." << i << ":";
-          std::cout << ss.str()
-                    << std::endl << std::flush;
+      std::vector<int> localDataRanks;
+      const bool partialReplication
+        = replicateHeavyGroups || !replicasOfGroup.empty();
+      if (partialReplication) {
+        // which group a rank gets depends on how many ranks the
+        // groups before it get - which depends on what content the
+        // groups have, so this has to assign the content first
+        if (dataPerRank != 1 || numDataRanks > workers.size)
+          throw std::runtime_error("partial replication needs one data group per rank");
+        if (!snapshotDir.empty() || !groupCapacity.empty())
+          throw std::runtime_error("partial replication does not work with"
+                                   " snapshots, or different rank capacities");
+        assignGroups(numDataRanks);
+        if (replicasOfGroup.empty())
+          replicasOfGroup = planReplicas(numDataRanks,workers.size);
+        int numRanks = 0;
+        for (auto n : replicasOfGroup) numRanks += n;
+        if ((int)replicasOfGroup.size() != numDataRanks || numRanks != workers.size)
+          throw std::runtime_error("partial replication: need "
+                                   +std::to_string(numDataRanks)
+                                   +" replica counts, summing up to "
+                                   +std::to_string(workers.size)
+                                   +" ranks");
+        int firstRank = 0;
+        for (int g=0;g<numDataRanks;g++) {
+          if (workers.rank >= firstRank &&
+              workers.rank < firstRank+replicasOfGroup[g])
+            localDataRanks.push_back(g);
+          firstRank += replicasOfGroup[g];
+        }
+        if (workers.rank == 0) {
+          std::cout << "#hs: partial replication - ranks per data group:";
+          for (auto n : replicasOfGroup)
+            std::cout << " " << n;
+          std::cout << std::endl;
+        }
+      } else
+        for (int i=0;i<dataPerRank;i++) {
+          int dataGroupID = (workers.rank*dataPerRank+i) % numDataRanks;
+          if (verbose) {
+            std::stringstream ss;
+            ss << "#hv: worker #" << workers.rank
+               << " loading global data group ID " << dataGroupID
+               << " into slot " << workers.rank << "." << i << ":";
+            std::cout << ss.str()
+                      << std::endl << std::flush;
+          }
+          localDataRanks.push_back(dataGroupID);
         }
-        localDataRanks.push_back(dataGroupID);
-      }
       assert(!localDataRanks.empty());
       LocalPartitions *localPartitions
         = new LocalPartitions(localDataRanks,numDataRanks);
+      localPartitions->replicasOfGroup = replicasOfGroup;
 
-      for (auto mp : localPartitions->myPartitions)
-        loadPartition(mp);
-        
-      if (!sharedLights.directional.empty() || sharedLights.envMap != "")
-        for (auto mp : localPartitions->myPartitions) {
-        // for (int i=0;i<localPartitions->numPartitionsOnThisRank();i++) {
-          mini::Scene::SP lights
-            = loadEnvMap(sharedLights.envMap);
-          // = (sharedLights.envMap == "")
-          // ? mini::Scene::create()
-          // : mini::Scene::load(sharedLights.envMap);
-          
-          lights->dirLights = sharedLights.directional;
-          mp->minis.push_back(lights);
+      const double t_begin = getCurrentTime();
+      // only use snapshots if *all* workers have all of theirs;
+      // discovery and assignment are collective
+      bool fromSnapshots = false;
+      uint64_t snapshotKey = 0;
+      if (!snapshotDir.empty()) {
+        // the default radius ends up in the loaded spheres, too
+        std::vector<std::string> inputs = contentDescriptors;
+        inputs.push_back("default-radius="+std::to_string(defaultRadius));
+        // (other capacities make for other groups)
+        for (auto c : groupCapacity)
+          inputs.push_back("capacity="+std::to_string(c));
+        snapshotKey = PartitionSnapshot::computeKey(inputs,numDataRanks);
+        bool haveAll = true;
+        for (auto dataGroupID : localDataRanks) {
+          PartitionSnapshot::Header header;
+          haveAll = haveAll && PartitionSnapshot::readHeader
+            (PartitionSnapshot::fileName(snapshotDir,snapshotKey,
+                                         dataGroupID,numDataRanks),
+             snapshotKey,header);
         }
+        fromSnapshots = workers.allReduceMin(haveAll ? 1 : 0);
+        if (workers.rank == 0)
+          std::cout << "#hs: " << (fromSnapshots ? "loading" : "no complete set of")
+                    << " snapshots for these inputs in '" << snapshotDir << "'"
+                    << std::endl;
+        if (!fromSnapshots)
+          for (auto &descriptor : contentDescriptors)
+            discoverContent(descriptor);
+      }
+      if (!fromSnapshots && !partialReplication)
+        assignGroups(numDataRanks);
+      
+      const bool broadcast
+        = loadOnceAndBroadcast && !shareNodeMemory && !fromSnapshots;
+      if (loadOnceAndBroadcast && shareNodeMemory && workers.rank == 0)
+        std::cout << "#hs: node-shared memory and load-once-and-broadcast"
+                  << " don't mix; only sharing node memory" << std::endl;
+      if (!fromSnapshots)
+        distributeContent(localDataRanks,broadcast);
+      if (shareNodeMemory)
+        NodeSharedMemory::begin(workers,localDataRanks[0]);
+      if (fromSnapshots) {
+        HS_TRACE_SCOPE("readSnapshots");
+        for (auto mp : localPartitions->myPartitions)
+          PartitionSnapshot::read(PartitionSnapshot::fileName
+                                  (snapshotDir,snapshotKey,
+                                   mp->partitionsRank,numDataRanks),
+                                  snapshotKey,*mp);
+      } else if (broadcast)
+        loadAndBroadcast(localPartitions,localDataRanks[0]);
+      else
+        for (auto mp : localPartitions->myPartitions)
+          loadPartition(mp);
+      if (shareNodeMemory)
+        NodeSharedMemory::end();
+      float timeToLoaded = workers.allReduceMax(float(getCurrentTime()-t_begin));
+      if (workers.rank == 0)
+        std::cout << "#hs: all workers loaded their data groups in "
+                  << prettyDouble(timeToLoaded) << "s ("
+                  << (fromSnapshots
+                      ? "from snapshots"
+                      : (broadcast
+                         ? "loaded once per group, and broadcast"
+                         : "every rank loads its own groups"))
+                  << ")" << std::endl;
+      if (!snapshotDir.empty() && !fromSnapshots)
+        writeSnapshots(localPartitions,snapshotKey,dataPerRank);
+      if (shareNodeMemory || reportNodeMemory)
+        NodeSharedMemory::reportUsage(workers);
+        
+      for (auto mp : localPartitions->myPartitions)
+        addSharedLights(mp);
 
       if (verbose) {
         workers.barrier();
@@ -299,6 +415,167 @@ namespace hs {
       return localPartitions;
     }
 
+    void DataLoader::gatherCapacities()
+    {
+      if (!(capacity > 0.f))
+        throw std::runtime_error("rank capacity has to be > 0 (is "
+                                 +std::to_string(capacity)+")");
+      rankCapacity.resize(workers.size);
+      workers.allGather(rankCapacity.data(),capacity);
+    }
+
+    std::vector<float> DataLoader::groupCapacities(int numDataRanks,
+                                                   int dataPerRank) const
+    {
+      std::vector<float> result(numDataRanks,0.f);
+      for (int r=0;r<(int)rankCapacity.size();r++)
+        for (int i=0;i<dataPerRank;i++) {
+          // same group-to-rank mapping as loadData()
+          int g = (r*dataPerRank+i) % numDataRanks;
+          float share = rankCapacity[r]/dataPerRank;
+          result[g] = result[g] == 0.f ? share : std::min(result[g],share);
+        }
+      // (groups that no rank has - more groups than slots - don't
+      // matter, but shouldn't get everything either)
+      float smallest = 0.f;
+      for (auto c : result)
+        if (c > 0.f && (smallest == 0.f || c < smallest)) smallest = c;
+      for (auto &c : result)
+        if (c == 0.f) c = smallest > 0.f ? smallest : 1.f;
+      for (auto c : result)
+        if (c != result[0]) return result;
+      return {};
+    }
+
+    std::vector<int> DataLoader::planReplicas(int numDataRanks,
+                                              int numRanks) const
+    {
+      std::vector<int> replicas(numDataRanks,1);
+      std::vector<double> size(numDataRanks);
+      for (int g=0;g<numDataRanks;g++)
+        size[g] = projectedSizeOf(g);
+      for (int r=numDataRanks;r<numRanks;r++) {
+        int heaviest = 0;
+        for (int g=1;g<numDataRanks;g++)
+          if (size[g]/replicas[g] > size[heaviest]/replicas[heaviest])
+            heaviest = g;
+        replicas[heaviest]++;
+      }
+      return replicas;
+    }
+
+    void DataLoader::addSharedLights(OnePartition *partition)
+    {
+      if (sharedLights.directional.empty() && sharedLights.envMap == "")
+        return;
+      mini::Scene::SP lights
+        = loadEnvMap(sharedLights.envMap);
+      // = (sharedLights.envMap == "")
+      // ? mini::Scene::create()
+      // : mini::Scene::load(sharedLights.envMap);
+      
+      lights->dirLights = sharedLights.directional;
+      partition->minis.push_back(lights);
+    }
+
+    void DataLoader::writeSnapshots(LocalPartitions *localPartitions,
+                                    uint64_t snapshotKey,
+                                    int dataPerRank)
+    {
+      HS_TRACE_SCOPE("writeSnapshots");
+      const int numDataRanks = localPartitions->numPartitionsTotal();
+      int numWritten = 0;
+      for (int i=0;i<localPartitions->numPartitionsOnThisRank();i++) {
+        // every group gets written by the first worker that has it
+        if (workers.rank*dataPerRank+i >= numDataRanks) break;
+        OnePartition *mp = localPartitions->myPartitions[i];
+        if (!PartitionSerializer::canSerialize(*mp)) {
+          std::cout << MINI_TERMINAL_RED
+                    << "#hs: WARNING: data group " << mp->partitionsRank
+                    << " has content that can't be snapshotted"
+                    << MINI_TERMINAL_DEFAULT << std::endl;
+          continue;
+        }
+        PartitionSnapshot::write(PartitionSnapshot::fileName
+                                 (snapshotDir,snapshotKey,
+                                  mp->partitionsRank,numDataRanks),
+                                 snapshotKey,numDataRanks,*mp);
+        ++numWritten;
+      }
+      numWritten = workers.allReduceAdd(numWritten);
+      if (workers.rank == 0)
+        std::cout << "#hs: wrote " << numWritten << " of " << numDataRanks
+                  << " data group snapshots to '" << snapshotDir << "'"
+                  << std::endl;
+    }
+
+    void DataLoader::loadAndBroadcast(LocalPartitions *localPartitions,
+                                      int firstDataGroup)
+    {
+      HS_TRACE_SCOPE("loadAndBroadcast");
+      hs::mpi::Comm group = workers.split(firstDataGroup);
+      size_t bytesSent = 0;
+      for (auto mp : localPartitions->myPartitions) {
+        if (group.size == 1) {
+          loadPartition(mp);
+          continue;
+        }
+        // a size of 0 means 'can't be serialized, load it yourselves'
+        uint64_t numBytes = 0;
+        std::vector<uint8_t> bytes;
+        if (group.rank == 0) {
+          loadPartition(mp);
+          if (PartitionSerializer::canSerialize(*mp)) {
+            bytes = PartitionSerializer::serialize(*mp);
+            numBytes = bytes.size();
+          }
+          group.bc_send(&numBytes,sizeof(numBytes));
+          group.bc_send(bytes.data(),numBytes);
+          bytesSent += numBytes;
+        } else {
+          group.bc_recv(&numBytes,sizeof(numBytes));
+          if (numBytes == 0) {
+            loadPartition(mp);
+            continue;
+          }
+          bytes.resize(numBytes);
+          group.bc_recv(bytes.data(),numBytes);
+          PartitionSerializer::deserialize(bytes,*mp);
+        }
+      }
+      if (verbose && group.rank == 0 && group.size > 1)
+        std::cout << "#hs: worker #" << workers.rank << " broadcast "
+                  << prettyNumber(bytesSent) << "B of data group "
+                  << firstDataGroup << " to " << (group.size-1)
+                  << " other rank(s)" << std::endl;
+      group.free();
+    }
+
+    void DataLoader::distributeContent(const std::vector<int> &localDataRanks,
+                                       bool broadcast)
+    {
+      HS_TRACE_SCOPE("distributeContent");
+      // with load-once-and-broadcast only the first rank of those
+      // with the same data groups executes the loads
+      bool loadsItsGroups = true;
+      if (broadcast) {
+        std::vector<int> firstGroupOf(workers.size);
+        workers.allGather(firstGroupOf.data(),localDataRanks[0]);
+        for (int r=0;r<workers.rank;r++)
+          if (firstGroupOf[r] == localDataRanks[0])
+            loadsItsGroups = false;
+      }
+      for (auto &c : allContent) {
+        LoadableContent *content = std::get<2>(c);
+        bool loadedHere = false;
+        if (loadsItsGroups)
+          for (auto dataGroupID : localDataRanks)
+            for (auto other : contentOf(dataGroupID))
+              loadedHere = loadedHere || (other == content);
+        content->distribute(workers,loadedHere);
+      }
+    }
+
     void DataLoader::addContent(LoadableContent *content) 
     {
       allContent.push_back(
@@ -317,6 +594,14 @@ namespace hs {
   
     void DataLoader::addContent(const std::string &contentDescriptor)
     {
+      contentDescriptors.push_back(contentDescriptor);
+      if (snapshotDir.empty())
+        discoverContent(contentDescriptor);
+    }
+
+    void DataLoader::discoverContent(const std::string &contentDescriptor)
+    {
+      HS_TRACE_SCOPE("discover",contentDescriptor);
       // if (startsWith(contentDescriptor,"spheres://")) {
       //   SpheresFromFile::create(this,contentDescriptor);
       // } else if (startsWith(contentDescriptor,"cylinders://")) {
@@ -326,7 +611,7 @@ namespace hs {
       // first, parse all the files we recognise from file name
       // extension:
       if (endsWith(contentDescriptor,".umesh")) {
-        UMeshContent::create(this,contentDescriptor);
+        UMeshContent::create(this,addIfRequired("umesh://",contentDescriptor));
 #if HS_VTK
       } else if (endsWith(contentDescriptor,".vtu") ||
                  endsWith(contentDescriptor,".vtp")) {
@@ -353,6 +638,8 @@ namespace hs {
         loader::VMDCyls::create(this,addIfRequired("vmdcyls://",contentDescriptor));
       } else if (endsWith(contentDescriptor,".vmdspheres")) {
         loader::VMDSpheres::create(this,addIfRequired("vmdspheres://",contentDescriptor));
+      } else if (endsWith(contentDescriptor,".hsp")) {
+        ParticlesContent::create(this,addIfRequired("particles://",contentDescriptor));
       } else if (endsWith(contentDescriptor,".vmdmesh")) {
         loader::VMDMesh::create(this,addIfRequired("vmdmesh://",contentDescriptor));
       } else if (endsWith(contentDescriptor,".rgbtris")) {
@@ -363,6 +650,8 @@ namespace hs {
         loader::HSMesh::create(this,addIfRequired("hsmesh://",contentDescriptor));
       } else if (endsWith(contentDescriptor,".raw")) {
         RAWVolumeContent::create(this,addIfRequired("raw://",contentDescriptor));
+      } else if (endsWith(contentDescriptor,".hsbv")) {
+        BrickedVolumeContent::create(this,addIfRequired("bricked://",contentDescriptor));
 #if HS_USE_MULTI_SCATTERING
       } else if (endsWith(contentDescriptor,".nvdb")) {
         NVDBVolumeContent::create(this,addIfRequired("nvdb://",contentDescriptor));
@@ -373,6 +662,8 @@ namespace hs {
         ResourceSpecifier url(contentDescriptor);
         if (url.type == "spheres")
           loader::SpheresFromFile::create(this,url);
+        else if (url.type == "particles")
+          ParticlesContent::create(this,url);
         else if (url.type == "ts.tri") 
           TSTriContent::create(this,contentDescriptor);
         else if (url.type == "iso-dump") 
@@ -387,6 +678,8 @@ namespace hs {
         //   ENDumpContent::create(this,contentDescriptor);
         else if (url.type == "raw") 
           RAWVolumeContent::create(this,url);
+        else if (url.type == "bricked")
+          BrickedVolumeContent::create(this,url);
 #if HS_USE_MULTI_SCATTERING
         else if (url.type == "nvdb")
           NVDBVolumeContent::create(this,url);
@@ -399,6 +692,8 @@ namespace hs {
           BoxesFromFile::create(this,url/*contentDescriptor*/);
         else if (url.type == "cylinders") 
           loader::CylindersFromFile::create(this,url);
+        else if (url.type == "umesh")
+          UMeshContent::create(this,url);
         else if (url.type == "spumesh")
           // spatially partitioned umeshes
           SpatiallyPartitionedUMeshContent::create(this,url);
@@ -410,28 +705,36 @@ namespace hs {
     
     void DynamicDataLoader::assignGroups(int numDifferentDataRanks)
     {
+      HS_TRACE_SCOPE("assignGroups");
       assert(numDifferentDataRanks > 0);
-      contentOfGroup.resize(numDifferentDataRanks);
-
-      std::priority_queue<std::pair<double,int>> loadedGroups;
-      for (int i=0;i<numDifferentDataRanks;i++)
-        loadedGroups.push({0,i});
-
       std::sort(allContent.begin(),allContent.end());
-      for (auto addtl : allContent) {
-        double addtlWeight = std::get<0>(addtl);
-        LoadableContent *addtlContent = std::get<2>(addtl);
-        auto currentlyLeastLoaded = loadedGroups.top(); loadedGroups.pop();
-        double currentWeight = currentlyLeastLoaded.first;
-        int groupID = currentlyLeastLoaded.second;
-        contentOfGroup[groupID].push_back(addtlContent);
-        loadedGroups.push({currentWeight+addtlWeight,groupID});
-      }
+      contentOfGroup = planGroups(numDifferentDataRanks,groupCapacity);
       workers.barrier();
       if (workers.rank == 0) {
         std::cout << "content assignment: created " << contentOfGroup.size() << " data groups" << std::endl;
+        // fill fraction: a group's share of all content, over its
+        // share of all capacity (1 is exactly proportional)
+        std::vector<double> groupSize(contentOfGroup.size(),0.);
+        double totalSize = 0., totalCapacity = 0.;
         for (int i=0;i<contentOfGroup.size();i++) {
-          std::cout << "= data group " << i << std::endl;
+          for (auto content : contentOfGroup[i])
+            groupSize[i] += content->projectedSize();
+          totalSize += groupSize[i];
+          if (!groupCapacity.empty())
+            totalCapacity += groupCapacity[i];
+        }
+        for (int i=0;i<contentOfGroup.size();i++) {
+          std::cout << "= data group " << i;
+          if (!groupCapacity.empty()) {
+            const double capacityShare = groupCapacity[i]/totalCapacity;
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(2)
+               << " (capacity " << 100.*capacityShare << "%, fill "
+               << (totalSize > 0. ? groupSize[i]/totalSize/capacityShare : 0.)
+               << ")";
+            std::cout << ss.str();
+          }
+          std::cout << std::endl;
           for (auto content : contentOfGroup[i])
             std::cout << "  - " << content->toString() << std::endl;
         }
@@ -439,6 +742,58 @@ namespace hs {
       workers.barrier();
     }
     
+    std::vector<std::vector<LoadableContent *>>
+    DynamicDataLoader::planGroups(int numDifferentDataRanks,
+                                  const std::vector<float> &groupCapacity)
+    {
+      std::vector<std::vector<LoadableContent *>> contentOfGroup(numDifferentDataRanks);
+      std::vector<double> groupSize(numDifferentDataRanks,0.);
+
+      // (weights are negative, so this is largest first)
+      auto sorted = allContent;
+      std::sort(sorted.begin(),sorted.end());
+      for (auto addtl : sorted) {
+        double addtlSize = -std::get<0>(addtl);
+        LoadableContent *addtlContent = std::get<2>(addtl);
+        // least full after adding this; on ties the last such group
+        int groupID = 0;
+        double bestFill = std::numeric_limits<double>::infinity();
+        for (int g=0;g<numDifferentDataRanks;g++) {
+          double fill
+            = (groupSize[g]+addtlSize)
+            / (groupCapacity.empty() ? 1.f : groupCapacity[g]);
+          if (fill <= bestFill) {
+            bestFill = fill;
+            groupID  = g;
+          }
+        }
+        contentOfGroup[groupID].push_back(addtlContent);
+        groupSize[groupID] += addtlSize;
+      }
+      return contentOfGroup;
+    }
+    
+    double DynamicDataLoader::projectedSizeOf(int dataGroupID) const
+    {
+      double size = 0.;
+      for (auto content : contentOfGroup[dataGroupID])
+        size += content->projectedSize();
+      return size;
+    }
+
+    void DynamicDataLoader::moveContent(LoadableContent *content,
+                                        int fromGroup,
+                                        int toGroup)
+    {
+      auto &from = contentOfGroup[fromGroup];
+      auto it = std::find(from.begin(),from.end(),content);
+      if (it == from.end())
+        throw std::runtime_error("moveContent: content is not in data group "
+                                 +std::to_string(fromGroup));
+      from.erase(it);
+      contentOfGroup[toGroup].push_back(content);
+    }
+    
     void DynamicDataLoader::loadPartition(OnePartition *partition)
     {
       int dataGroupID = partition->partitionsRank;
@@ -451,6 +806,8 @@ namespace hs {
         if (verbose)
           std::cout << " - #" << workers.rank << " loading content "
                     << content->toString() << std::endl << std::flush;
+        HS_TRACE_SCOPE("executeLoad",
+                       hs::trace::enabled() ? content->toString() : "");
         content->executeLoad(*partition);
       }
       if (verbose)
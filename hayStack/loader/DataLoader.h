@@ -41,6 +41,10 @@ namespace hs {
     /*! helper function that returns the size (in bytes) of a given file
       (or throws an exception if this file cannot be opened */
     size_t getFileSize(const std::string &fileName);
+
+    /*! what /proc/meminfo says the system still has available, in
+        bytes; 0 if unknown */
+    size_t availableHostMemory();
   
     /*! abstraction for some piece of renderable content, such as a
       triangle mesh, a mini scene (or part thereof), a umesh, a
@@ -60,13 +64,33 @@ namespace hs {
 
       /*! returns rank of process loading the data */
       int myRank() const { return workers.rank; }
+
+      /*! adds the content that given descriptor (a file name or
+          url) describes; with a snapshotDir this only gets recorded,
+          and discovered in loadData() if there are no snapshots */
       void addContent(const std::string &contentDescriptor);
+
+      /*! creates the loadable content for given descriptor */
+      void discoverContent(const std::string &contentDescriptor);
     
       /*! interface for any type of loadablecontent to add one or more
         different pieces of content */
       void addContent(LoadableContent *);
     
       virtual void assignGroups(int numDataRanks) = 0;
+
+      /*! projected size of all content assignGroups() put into
+          given data group */
+      virtual double projectedSizeOf(int dataGroupID) const = 0;
+
+      /*! the content assigned to given data group */
+      virtual const std::vector<LoadableContent *> &contentOf(int dataGroupID) const = 0;
+
+      /*! how many ranks each of the (assigned) data groups should
+          get for partial replication: one each, and every rank left
+          over after that goes to whatever group has the largest
+          projected size per copy */
+      std::vector<int> planReplicas(int numDataRanks, int numRanks) const;
     
       /*! interface for the app to load one particular rank's data
         group(s) */
@@ -77,6 +101,40 @@ namespace hs {
         collaboratively - but only on active workers */
       LocalPartitions *loadData(int numDataRanks,
                                 int dataPerRank);
+
+      /*! the loadOnceAndBroadcast variant of loading this rank's
+          partitions: the ranks that have the same data groups load
+          them on the first of those ranks, and broadcast them to
+          the others */
+      void loadAndBroadcast(LocalPartitions *localPartitions,
+                            int firstDataGroup);
+
+      /*! calls LoadableContent::distribute() for all content;
+          collective across all workers */
+      void distributeContent(const std::vector<int> &localDataRanks,
+                             bool broadcast);
+
+      /*! gathers every worker's capacity into rankCapacity;
+          collective across all workers */
+      void gatherCapacities();
+
+      /*! the capacity of each of given num data groups, given the
+          gathered rankCapacity: a rank's capacity gets split evenly
+          among its dataPerRank groups, and a group that's on
+          several ranks gets the smallest of those shares. empty if
+          all groups' are the same */
+      std::vector<float> groupCapacities(int numDataRanks,
+                                         int dataPerRank) const;
+
+      /*! adds the lights given on the command line (if any) to given
+          partition */
+      void addSharedLights(OnePartition *partition);
+
+      /*! writes the snapshot files for (the first copy of) every data
+          group after loading; collective across all workers */
+      void writeSnapshots(LocalPartitions *localPartitions,
+                          uint64_t snapshotKey,
+                          int dataPerRank);
     
       /*! list of all (abstract) pieces of content in the scene. */
       std::vector<std::tuple<double /*projected size*/,
@@ -89,6 +147,44 @@ namespace hs {
       } sharedLights;
       /*! default radius to use for spheres that do not have a radius specified */
       static float defaultRadius;
+      /*! whether ranks on the same node that load the same data
+          groups share (the large parts of) that data in node-shared
+          memory, see NodeSharedMemory */
+      bool shareNodeMemory  = false;
+      /*! whether to print per-node memory usage after loading */
+      bool reportNodeMemory = false;
+      /*! whether, for data groups that get loaded by more than one
+          rank, only one of those ranks reads the group's content,
+          and sends it to the others (see PartitionSerializer) */
+      bool loadOnceAndBroadcast = false;
+      /*! if non-empty, loadData() reads the data groups from
+          PartitionSnapshot files in this directory if all of them
+          are there for the current inputs; and otherwise loads them
+          the usual way, and then writes those files. has to be set
+          before adding content */
+      std::string snapshotDir;
+      /*! if non-empty, the number of ranks (ie, copies) of every
+          data group, for partial replication: rather than every
+          group being on the same number of ranks, each group's
+          ranks are consecutive, and can be more for groups that are
+          more expensive. those ranks then split the frame among
+          them (see HayMaker::replicaComm). loadData() fills this in if replicateHeavyGroups is
+          set; only with one data group per rank */
+      std::vector<int> replicasOfGroup;
+      /*! whether loadData() should compute replicasOfGroup from the
+          assigned groups' projected sizes, see planReplicas() */
+      bool replicateHeavyGroups = false;
+      /*! this rank's capacity, relative to the other workers': with
+          twice the capacity of another rank, a rank's data groups
+          get about twice as much of the content. has to be > 0 */
+      float capacity = 1.f;
+      /*! every worker's capacity, after gatherCapacities() */
+      std::vector<float> rankCapacity;
+      /*! what assignGroups() fills the groups in proportion to; set
+          by loadData(), and empty if all groups are the same */
+      std::vector<float> groupCapacity;
+      /*! all descriptors passed to addContent(), in order */
+      std::vector<std::string> contentDescriptors;
       hs::mpi::Comm workers;
     };
 
@@ -100,6 +196,7 @@ namespace hs {
       loading only after different pieces of content have already been
       assinged to different ranks/data groups. */
     struct LoadableContent {
+      virtual ~LoadableContent() = default;
     
       virtual std::string toString() = 0;
     
@@ -109,9 +206,25 @@ namespace hs {
         weight */
       virtual size_t projectedSize() = 0;
 
+      /*! estimate of the num primitives (cells, particles, ...) this
+          content will have, without loading it; 0 if unknown */
+      virtual size_t projectedPrims() { return 0; }
+
+      /*! the bounds this content will have, if known without loading
+          it; empty box otherwise */
+      virtual box3f  projectedBounds() { return box3f(); }
+
       /*! make this content execute the actual load, and add the
         actually loaded content to the specific data group */
       virtual void   executeLoad(OnePartition &dataGroup) = 0;
+
+      /*! gets called on all workers, for all content in the same
+          order, after content got assigned to data groups but before
+          any executeLoad(); loadedHere is whether this rank is going
+          to executeLoad() this content. content that is cheaper to
+          load once and then hand out (see UMeshPartContent) can do
+          that here */
+      virtual void   distribute(hs::mpi::Comm &workers, bool loadedHere) {}
     };
 
     /*! a data loader that assigns objects dynamically to data groups
@@ -121,8 +234,28 @@ namespace hs {
         : DataLoader(workers)
       {}
       void assignGroups(int numDataRanks) override;
+      double projectedSizeOf(int dataGroupID) const override;
+
+      /*! which content assignGroups() would put into which of given
+          num data groups - without changing any assignment. every
+          piece (largest first) goes into whatever group is least
+          full with it, relative to that group's capacity (all the
+          same if groupCapacity is empty) */
+      std::vector<std::vector<LoadableContent *>>
+      planGroups(int numDataRanks,
+                 const std::vector<float> &groupCapacity = {});
 
       virtual void loadPartition(OnePartition *dg) override;
+
+      /*! the content assigned to given data group */
+      const std::vector<LoadableContent *> &contentOf(int dataGroupID) const override
+      { return contentOfGroup[dataGroupID]; }
+      
+      /*! re-assigns one piece of content to another data group; only
+          changes the assignment, the caller has to re-load the
+          affected partitions. has to happen the same way on all
+          workers */
+      void moveContent(LoadableContent *content, int fromGroup, int toGroup);
     private:
       /*! loadable content per data group, after assigning it */
       std::vector<std::vector<LoadableContent *>> contentOfGroup;
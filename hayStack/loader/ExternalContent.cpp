@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/ExternalContent.h"
+#include "hayStack/StructuredVolume.h"
+#include <cstring>
+
+namespace hs {
+  namespace loader {
+
+    // ==================================================================
+    // ExternalStructuredVolume
+    // ==================================================================
+
+    ExternalStructuredVolume::ExternalStructuredVolume(const void *voxels,
+                                                       vec3i dims,
+                                                       const std::string &texelFormat,
+                                                       vec3f gridOrigin,
+                                                       vec3f gridSpacing,
+                                                       range1f valueRange)
+      : voxels(voxels),
+        dims(dims),
+        texelFormat(texelFormat),
+        gridOrigin(gridOrigin),
+        gridSpacing(gridSpacing),
+        valueRange(valueRange)
+    {
+      // throws for unknown formats
+      sizeOf(texelFormat);
+    }
+
+    size_t ExternalStructuredVolume::projectedSize()
+    {
+      return size_t(dims.x)*size_t(dims.y)*size_t(dims.z)*sizeOf(texelFormat);
+    }
+
+    void ExternalStructuredVolume::executeLoad(OnePartition &dataGroup)
+    {
+      std::vector<uint8_t> noData, noRGB;
+      StructuredVolume::SP volume
+        = std::make_shared<StructuredVolume>(dims,texelFormat,noData,noRGB,
+                                             gridOrigin,gridSpacing);
+      // the caller owns (and frees) the voxels
+      volume->sharedVoxels
+        = std::shared_ptr<const uint8_t>((const uint8_t *)voxels,
+                                         [](const uint8_t *){});
+      volume->knownValueRange = valueRange;
+      dataGroup.structuredVolumes.push_back(volume);
+    }
+
+    std::string ExternalStructuredVolume::toString()
+    {
+      std::stringstream ss;
+      ss << "ExternalStructuredVolume{dims=" << dims << ",format=" << texelFormat
+         << ",proj size " << prettyNumber(projectedSize()) << "B}";
+      return ss.str();
+    }
+
+    // ==================================================================
+    // ExternalParticles
+    // ==================================================================
+
+    ExternalParticles::ExternalParticles(const vec3f *positions,
+                                         size_t numParticles,
+                                         float radius,
+                                         const float *radii,
+                                         const vec3f *colors)
+      : positions(positions),
+        numParticles(numParticles),
+        radius(radius),
+        radii(radii),
+        colors(colors)
+    {}
+
+    size_t ExternalParticles::projectedSize()
+    {
+      return numParticles*(sizeof(vec3f)
+                           +(radii ? sizeof(float) : 0)
+                           +(colors ? sizeof(vec3f) : 0));
+    }
+
+    void ExternalParticles::executeLoad(OnePartition &dataGroup)
+    {
+      SphereSet::SP spheres = SphereSet::create();
+      mini::Matte::SP mat = std::make_shared<mini::Matte>();
+      mat->reflectance = .5f;
+      spheres->material = mat;
+      spheres->radius = radius;
+      spheres->origins.assign(positions,positions+numParticles);
+      if (radii)
+        spheres->radii.assign(radii,radii+numParticles);
+      if (colors)
+        spheres->colors.assign(colors,colors+numParticles);
+      dataGroup.sphereSets.push_back(spheres);
+    }
+
+    std::string ExternalParticles::toString()
+    {
+      return "ExternalParticles{"+prettyNumber(numParticles)+" particles}";
+    }
+
+    // ==================================================================
+    // ExternalUnstructuredMesh
+    // ==================================================================
+
+    ExternalUnstructuredMesh::ExternalUnstructuredMesh(const vec3f *vertices,
+                                                       const float *scalars,
+                                                       size_t numVertices,
+                                                       const int *tetIndices,
+                                                       size_t numTets,
+                                                       const int *hexIndices,
+                                                       size_t numHexes)
+      : vertices(vertices),
+        scalars(scalars),
+        numVertices(numVertices),
+        tetIndices(tetIndices),
+        numTets(numTets),
+        hexIndices(hexIndices),
+        numHexes(numHexes)
+    {}
+
+    size_t ExternalUnstructuredMesh::projectedSize()
+    {
+      return numVertices*(sizeof(vec3f)+sizeof(float))
+        + numTets*4*sizeof(int) + numHexes*8*sizeof(int);
+    }
+
+    void ExternalUnstructuredMesh::executeLoad(OnePartition &dataGroup)
+    {
+      static_assert(sizeof(umesh::Tet) == 4*sizeof(int),
+                    "unexpected umesh tet layout");
+      static_assert(sizeof(umesh::Hex) == 8*sizeof(int),
+                    "unexpected umesh hex layout");
+      umesh::UMesh::SP mesh = std::make_shared<umesh::UMesh>();
+      mesh->vertices.resize(numVertices);
+      memcpy(mesh->vertices.data(),vertices,numVertices*sizeof(vec3f));
+      mesh->perVertex = std::make_shared<umesh::Attribute>();
+      mesh->perVertex->values.assign(scalars,scalars+numVertices);
+      mesh->tets.resize(numTets);
+      if (numTets)
+        memcpy(mesh->tets.data(),tetIndices,numTets*sizeof(umesh::Tet));
+      mesh->hexes.resize(numHexes);
+      if (numHexes)
+        memcpy(mesh->hexes.data(),hexIndices,numHexes*sizeof(umesh::Hex));
+      mesh->finalize();
+      dataGroup.unsts.push_back({mesh,box3f()});
+    }
+
+    std::string ExternalUnstructuredMesh::toString()
+    {
+      return "ExternalUnstructuredMesh{"+prettyNumber(numTets)+" tets, "
+        +prettyNumber(numHexes)+" hexes}";
+    }
+
+  }
+}
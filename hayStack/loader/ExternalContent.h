@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+
+namespace hs {
+  namespace loader {
+
+    /*! content that doesn't come from a file, but from arrays the
+        caller owns - typically a simulation that hands its current
+        time step to hayStack in situ (see hm::InSituAdaptor). none of
+        these copy anything when they get created. structured volumes
+        stay zero-copy after that, too, so the caller has to keep
+        their voxels alive - and unchanged - until they have been
+        rendered, and the next step's content replaces them. particles
+        and unstructured meshes do get copied in executeLoad(), since
+        the SphereSet and umesh::UMesh the renderers consume keep
+        their arrays in std::vectors of their own. */
+
+    /*! one brick of a structured volume, in the caller's memory. this
+        is zero-copy: the partition's StructuredVolume refers to the
+        caller's voxels (through StructuredVolume::sharedVoxels). as
+        with files, neighboring bricks have to share one layer of
+        voxels to render without seams */
+    struct ExternalStructuredVolume : public LoadableContent {
+      /*! texelFormat is one of "float", "uint8_t", or "uint16_t"; if
+          valueRange isn't empty it's taken as the voxels' range,
+          saving a pass over them */
+      ExternalStructuredVolume(const void *voxels,
+                               vec3i dims,
+                               const std::string &texelFormat,
+                               vec3f gridOrigin,
+                               vec3f gridSpacing,
+                               range1f valueRange = range1f());
+      size_t projectedSize() override;
+      void   executeLoad(OnePartition &dataGroup) override;
+      std::string toString() override;
+
+      const void *const voxels;
+      const vec3i       dims;
+      const std::string texelFormat;
+      const vec3f       gridOrigin;
+      const vec3f       gridSpacing;
+      const range1f     valueRange;
+    };
+
+    /*! particles (rendered as spheres) in the caller's memory. radii
+        and colors are optional (null). SphereSet stores its
+        attributes in its own vectors, so these get copied - once, in
+        executeLoad() - rather than referenced */
+    struct ExternalParticles : public LoadableContent {
+      ExternalParticles(const vec3f *positions,
+                        size_t numParticles,
+                        float radius,
+                        const float *radii = nullptr,
+                        const vec3f *colors = nullptr);
+      size_t projectedSize() override;
+      void   executeLoad(OnePartition &dataGroup) override;
+      std::string toString() override;
+
+      const vec3f *const positions;
+      const size_t       numParticles;
+      const float        radius;
+      const float *const radii;
+      const vec3f *const colors;
+    };
+
+    /*! unstructured tet and/or hex cells, with one scalar per vertex,
+        in the caller's memory; indices are four (tet) or eight (hex;
+        four base, then four top vertices, in umesh order) ints per
+        cell. like particles these get copied into a umesh in
+        executeLoad() */
+    struct ExternalUnstructuredMesh : public LoadableContent {
+      ExternalUnstructuredMesh(const vec3f *vertices,
+                               const float *scalars,
+                               size_t numVertices,
+                               const int *tetIndices,
+                               size_t numTets,
+                               const int *hexIndices = nullptr,
+                               size_t numHexes = 0);
+      size_t projectedSize() override;
+      void   executeLoad(OnePartition &dataGroup) override;
+      std::string toString() override;
+
+      const vec3f *const vertices;
+      const float *const scalars;
+      const size_t       numVertices;
+      const int   *const tetIndices;
+      const size_t       numTets;
+      const int   *const hexIndices;
+      const size_t       numHexes;
+    };
+
+  }
+}
@@ -10,6 +10,8 @@
 
 #include <nanovdb/GridHandle.h>
 #include <nanovdb/io/IO.h>
+#include <nanovdb/tools/GridBuilder.h>
+#include <nanovdb/tools/CreateNanoGrid.h>
 
 #include <cstring>
 #include <iostream>
@@ -17,7 +19,16 @@
 #include <stdexcept>
 
 namespace hs {
+  namespace loader {
 
+    extern bool verbose;
+
+  /*! a nanovdb grid, split into numParts kd-tree bricks of its index
+      domain. each part only keeps the voxels (and active tiles) of
+      its own brick, plus a one-voxel apron for interpolation across
+      part boundaries, rebuilt into its own compact nanovdb grid; so
+      per-part memory scales with the brick's share of the (active)
+      grid, not with the whole grid. */
   struct NVDBVolumeContent : public LoadableContent {
     NVDBVolumeContent(const std::string &fileName,
                       int thisPartID,
@@ -44,6 +55,9 @@ namespace hs {
         throw std::runtime_error
           ("NVDBVolumeContent: no grids in '" + dataURL.where + "'");
 
+      if (!isSupportedGridType(meta[0].gridType))
+        throw std::runtime_error(unsupportedGridType(dataURL.where,meta[0].gridType));
+      
       box3i initRegion = indexBBoxFromMeta(meta[0].indexBBox);
 
       std::string extractString = dataURL.get("extract");
@@ -95,7 +109,7 @@ namespace hs {
       return fileSize * partCellCount / fullCells;
     }
 
-    void executeLoad(DataRank &dataGroup, bool verbose) override
+    void executeLoad(OnePartition &dataGroup) override
     {
       nanovdb::GridHandle<> gridHandle;
       try {
@@ -111,8 +125,30 @@ namespace hs {
       vol->partID = thisPartID;
       vol->cellRange = cellRange;
       vol->fullIndexDims = fullIndexDims;
-      vol->data.resize(gridHandle.size());
-      std::memcpy(vol->data.data(), gridHandle.data(), gridHandle.size());
+
+      box3i withApron = cellRange;
+      withApron.lower = withApron.lower - vec3i(1);
+      withApron.upper = withApron.upper + vec3i(1);
+      nanovdb::GridHandle<> partHandle;
+      switch (gridHandle.gridType()) {
+      case nanovdb::GridType::Float:
+        partHandle = extractSubGrid(*gridHandle.grid<float>(), withApron);
+        break;
+      case nanovdb::GridType::Fp4:
+        partHandle = extractSubGrid(*gridHandle.grid<nanovdb::Fp4>(), withApron);
+        break;
+      case nanovdb::GridType::Fp8:
+        partHandle = extractSubGrid(*gridHandle.grid<nanovdb::Fp8>(), withApron);
+        break;
+      case nanovdb::GridType::Fp16:
+        partHandle = extractSubGrid(*gridHandle.grid<nanovdb::Fp16>(), withApron);
+        break;
+      default:
+        // checked in create() already, but the file may have changed
+        throw std::runtime_error(unsupportedGridType(fileName,gridHandle.gridType()));
+      }
+      vol->data.resize(partHandle.size());
+      std::memcpy(vol->data.data(), partHandle.data(), partHandle.size());
 
       vol->bounds = worldBoundsForCellRange(gridHandle, cellRange);
       if (vol->bounds.empty()) {
@@ -129,8 +165,130 @@ namespace hs {
 
       if (verbose)
         std::cout << "#hs.nvdb: loaded part " << thisPartID << " of "
-                  << fileName << " (" << vol->data.size() << " bytes), bounds "
-                  << vol->bounds << std::endl;
+                  << fileName << " (" << prettyNumber(vol->data.size())
+                  << "B of " << prettyNumber(gridHandle.size())
+                  << "B full grid), bounds " << vol->bounds << std::endl;
+    }
+
+    /*! builds a new, standalone grid that contains only those active
+        voxels and active tiles of 'grid' that lie within 'range'
+        (which is in index space). this only visits the source
+        tree's leaves and tiles that overlap the range, so the cost
+        is that of the active data in the range, not of the range's
+        volume: active voxels of overlapping leaves get copied one by
+        one, tiles that lie fully inside the range stay tiles, and
+        tiles that straddle its boundary get split into smaller tiles
+        (and, at the boundary itself, voxels) */
+    template<typename BuildT>
+    static nanovdb::GridHandle<> extractSubGrid(const nanovdb::NanoGrid<BuildT> &grid,
+                                                const box3i &range)
+    {
+      using ValueT = typename nanovdb::NanoGrid<BuildT>::ValueType;
+      nanovdb::tools::build::Grid<BuildT> part(grid.tree().background(),
+                                               grid.gridName(),
+                                               grid.gridClass());
+      part.mMap = grid.map();
+
+      nanovdb::CoordBBox clip(nanovdb::Coord(range.lower.x,range.lower.y,range.lower.z),
+                              nanovdb::Coord(range.upper.x,range.upper.y,range.upper.z));
+      clip.intersect(grid.indexBBox());
+      if (clip.empty())
+        return nanovdb::tools::createNanoGrid(part);
+
+      const auto &tree = grid.tree();
+      // active tiles of the root and the two internal levels (the
+      // value masks of internal nodes also have the bits of active
+      // children set, so skip those)
+      for (auto it = tree.root().cbeginValueOn(); it; ++it)
+        addClippedTile<3>(part,clip,it.getOrigin(),ValueT(*it));
+      auto *upper = tree.getFirstUpper();
+      for (uint32_t i=0;i<tree.nodeCount(2);i++)
+        if (clip.hasOverlap(upper[i].bbox()))
+          for (auto it = upper[i].cbeginValueOn(); it; ++it)
+            if (!upper[i].data()->isChild(it.pos()))
+              addClippedTile<2>(part,clip,it.getOrigin(),ValueT(*it));
+      auto *lower = tree.getFirstLower();
+      for (uint32_t i=0;i<tree.nodeCount(1);i++)
+        if (clip.hasOverlap(lower[i].bbox()))
+          for (auto it = lower[i].cbeginValueOn(); it; ++it)
+            if (!lower[i].data()->isChild(it.pos()))
+              addClippedTile<1>(part,clip,it.getOrigin(),ValueT(*it));
+
+      auto acc = part.getAccessor();
+      auto *leaf = tree.getFirstLeaf();
+      for (uint32_t i=0;i<tree.nodeCount(0);i++) {
+        const nanovdb::CoordBBox leafBox
+          = nanovdb::CoordBBox::createCube(leaf[i].origin(),leaf[i].dim());
+        if (!clip.hasOverlap(leafBox))
+          continue;
+        const bool fullyInside = clip.isInside(leafBox);
+        for (auto it = leaf[i].cbeginValueOn(); it; ++it)
+          if (fullyInside || clip.isInside(it.getCoord()))
+            acc.setValue(it.getCoord(),ValueT(*it));
+      }
+      return nanovdb::tools::createNanoGrid(part);
+    }
+
+    /*! adds the part of an active tile at given tree level (1: a
+        tile in place of a leaf, 2: of a lower node, 3: of an upper
+        node) that lies within 'clip' to 'part' - as a tile if it is
+        fully inside, else recursively as smaller tiles, down to
+        individual voxels */
+    template<int level, typename BuildT, typename ValueT>
+    static void addClippedTile(nanovdb::tools::build::Grid<BuildT> &part,
+                               const nanovdb::CoordBBox &clip,
+                               const nanovdb::Coord &origin,
+                               const ValueT &value)
+    {
+      // edge length of a tile at this level
+      const int dim = level == 1 ? 8 : (level == 2 ? 128 : 4096);
+      const nanovdb::CoordBBox tileBox = nanovdb::CoordBBox::createCube(origin,dim);
+      if (!clip.hasOverlap(tileBox))
+        return;
+      if (clip.isInside(tileBox)) {
+        if constexpr (level == 1) {
+          // the builder fills newly created lower nodes with the
+          // tile's value - so make sure ours exists, and is empty
+          // (same as in RAWVolumeContent's sparse path)
+          auto *rootTile = part.mRoot.probeTile(origin);
+          if (!(rootTile && rootTile->child
+                && rootTile->child->mChildMask.isOn
+                (nanovdb::tools::build::BuildUpper<BuildT>::CoordToOffset(origin))))
+            part.mRoot.template addTile<1>(origin,part.mRoot.mBackground,false);
+        }
+        part.mRoot.template addTile<level>(origin,value,true);
+        return;
+      }
+      if constexpr (level == 1) {
+        nanovdb::CoordBBox inside = tileBox;
+        inside.intersect(clip);
+        for (auto ijk = inside.begin(); ijk; ++ijk)
+          part.tree().setValue(*ijk,value);
+      } else {
+        const int childDim = level == 3 ? 128 : 8;
+        for (int iz=0;iz<dim;iz+=childDim)
+          for (int iy=0;iy<dim;iy+=childDim)
+            for (int ix=0;ix<dim;ix+=childDim)
+              addClippedTile<level-1>(part,clip,origin.offsetBy(ix,iy,iz),value);
+      }
+    }
+
+    /*! the grid types extractSubGrid() can rebuild */
+    static bool isSupportedGridType(nanovdb::GridType type)
+    {
+      return type == nanovdb::GridType::Float
+        || type == nanovdb::GridType::Fp4
+        || type == nanovdb::GridType::Fp8
+        || type == nanovdb::GridType::Fp16;
+    }
+
+    static std::string unsupportedGridType(const std::string &fileName,
+                                           nanovdb::GridType type)
+    {
+      char typeName[nanovdb::strlen<nanovdb::GridType>()];
+      return "NVDBVolumeContent: grid in '"+fileName+"' is of type '"
+        +std::string(nanovdb::toStr(typeName,type))
+        +"'; can only split float, fp4, fp8, and fp16 grids";
     }
 
     std::string toString() override
@@ -147,7 +305,6 @@ namespace hs {
     const vec3i fullIndexDims;
     const box3i cellRange;
 
-  private:
     static int argMaxDim(vec3i size)
     {
       if (size.y > size.x && size.y >= size.z) return 1;
@@ -182,6 +339,7 @@ namespace hs {
       splitKDTree(regions, rBox, nRight);
     }
 
+  private:
     static box3i indexBBoxFromMeta(const nanovdb::CoordBBox &ib)
     {
       return {vec3i(ib[0][0], ib[0][1], ib[0][2]),
@@ -206,6 +364,7 @@ namespace hs {
     }
   };
 
+  }
 }
 
 #endif
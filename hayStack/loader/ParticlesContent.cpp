@@ -0,0 +1,251 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/ParticlesContent.h"
+#include <algorithm>
+#include <numeric>
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+
+    /*! "hsprt001" */
+    const uint64_t ParticleFile::magic = 0x3130307472707368ull;
+
+    // ==================================================================
+    // writing
+    // ==================================================================
+
+    void ParticleFile::write(const std::string &fileName,
+                             SphereSet::SP spheres,
+                             size_t maxChunkSize)
+    {
+      const size_t numParticles = spheres->origins.size();
+      const bool hasColors = !spheres->colors.empty();
+      const bool hasRadii  = !spheres->radii.empty();
+      maxChunkSize = std::max(maxChunkSize,(size_t)1);
+
+      // kd-split the particles (by origin) until each leaf has at
+      // most maxChunkSize particles; leaves in kd-order become the
+      // chunks
+      std::vector<size_t> order(numParticles);
+      std::iota(order.begin(),order.end(),0);
+      std::vector<ChunkInfo> chunks;
+      std::vector<std::pair<size_t,size_t>> stack = {{0,numParticles}};
+      while (!stack.empty()) {
+        auto range = stack.back(); stack.pop_back();
+        const size_t begin = range.first, end = range.second;
+        box3f bounds;
+        for (size_t i=begin;i<end;i++)
+          bounds.extend(spheres->origins[order[i]]);
+        if (end-begin <= maxChunkSize || bounds.size() == vec3f(0.f)) {
+          ChunkInfo chunk;
+          chunk.bounds = bounds;
+          chunk.begin  = begin;
+          chunk.count  = end-begin;
+          for (size_t i=begin;i<end;i++)
+            chunk.radiusRange.extend(hasRadii
+                                     ? spheres->radii[order[i]]
+                                     : spheres->radius);
+          chunks.push_back(chunk);
+          continue;
+        }
+        const int dim = arg_max(bounds.size());
+        const size_t mid = (begin+end)/2;
+        std::nth_element(order.begin()+begin,order.begin()+mid,order.begin()+end,
+                         [&](size_t a, size_t b)
+                         { return spheres->origins[a][dim] < spheres->origins[b][dim]; });
+        // push right first, so left gets emitted first
+        stack.push_back({mid,end});
+        stack.push_back({begin,mid});
+      }
+
+      Header header;
+      header.magic        = magic;
+      header.numParticles = numParticles;
+      header.numChunks    = chunks.size();
+      header.flags        = (hasColors ? HAS_COLORS : 0) | (hasRadii ? HAS_RADII : 0);
+      header.radius       = spheres->radius;
+
+      std::ofstream out(fileName.c_str(),std::ios::binary);
+      if (!out.good())
+        throw std::runtime_error("could not open '"+fileName+"' for writing");
+      out.write((const char *)&header,sizeof(header));
+      out.write((const char *)chunks.data(),chunks.size()*sizeof(ChunkInfo));
+      // one write per array per chunk
+      auto writeArray = [&](const auto &array) {
+        typedef typename std::decay<decltype(array[0])>::type T;
+        std::vector<T> chunkData;
+        for (auto &chunk : chunks) {
+          chunkData.resize(chunk.count);
+          for (size_t i=0;i<chunk.count;i++)
+            chunkData[i] = array[order[chunk.begin+i]];
+          out.write((const char *)chunkData.data(),chunk.count*sizeof(T));
+        }
+      };
+      writeArray(spheres->origins);
+      if (hasColors) writeArray(spheres->colors);
+      if (hasRadii)  writeArray(spheres->radii);
+      if (!out.good())
+        throw std::runtime_error("error writing '"+fileName+"'");
+    }
+
+    // ==================================================================
+    // reading
+    // ==================================================================
+
+    void ParticleFile::readHeader(const std::string &fileName,
+                                  Header &header,
+                                  std::vector<ChunkInfo> &chunks)
+    {
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      in.read((char *)&header,sizeof(header));
+      if (!in.good() || header.magic != magic)
+        throw std::runtime_error("'"+fileName+"' is not a hayStack particle file");
+      chunks.resize(header.numChunks);
+      in.read((char *)chunks.data(),chunks.size()*sizeof(ChunkInfo));
+      if (!in.good())
+        throw std::runtime_error("could not read chunk table from '"+fileName+"'");
+    }
+
+    SphereSet::SP ParticleFile::readChunks(const std::string &fileName,
+                                           const Header &header,
+                                           const std::vector<ChunkInfo> &chunks)
+    {
+      SphereSet::SP spheres = SphereSet::create();
+      spheres->radius = header.radius;
+      if (chunks.empty())
+        return spheres;
+      const size_t begin = chunks.front().begin;
+      const size_t count = chunks.back().begin+chunks.back().count-begin;
+
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      size_t arrayBase
+        = sizeof(Header)
+        + header.numChunks*sizeof(ChunkInfo);
+      auto readArray = [&](auto &array) {
+        typedef typename std::decay<decltype(array[0])>::type T;
+        array.resize(count);
+        in.seekg(arrayBase+begin*sizeof(T));
+        in.read((char *)array.data(),count*sizeof(T));
+        arrayBase += header.numParticles*sizeof(T);
+      };
+      readArray(spheres->origins);
+      if (header.flags & HAS_COLORS) readArray(spheres->colors);
+      if (header.flags & HAS_RADII)  readArray(spheres->radii);
+      if (!in.good())
+        throw std::runtime_error("error reading particles from '"+fileName+"'");
+      return spheres;
+    }
+
+    // ==================================================================
+    // the content
+    // ==================================================================
+
+    ParticlesContent::ParticlesContent(const ResourceSpecifier &data,
+                                       int thisPartID,
+                                       const ParticleFile::Header &header,
+                                       const std::vector<ParticleFile::ChunkInfo> &chunks)
+      : data(data),
+        thisPartID(thisPartID),
+        header(header),
+        chunks(chunks)
+    {
+      const bool hasRadii = header.flags & ParticleFile::HAS_RADII;
+      for (auto &chunk : chunks) {
+        numParticles += chunk.count;
+        const float maxRadius = hasRadii ? chunk.radiusRange.upper : radius();
+        bounds.extend(box3f(chunk.bounds.lower-maxRadius,
+                            chunk.bounds.upper+maxRadius));
+      }
+    }
+
+    void ParticlesContent::create(DataLoader *loader,
+                                  const ResourceSpecifier &dataURL)
+    {
+      ParticleFile::Header header;
+      std::vector<ParticleFile::ChunkInfo> chunks;
+      ParticleFile::readHeader(dataURL.where,header,chunks);
+
+      // cut the (kd-ordered) chunk list into numParts runs of about
+      // the same particle count
+      size_t chunkBegin = 0;
+      size_t numParticlesSoFar = 0;
+      for (int partID=0;partID<dataURL.numParts;partID++) {
+        const size_t target
+          = (header.numParticles*(partID+1))/dataURL.numParts;
+        size_t chunkEnd = chunkBegin;
+        while (chunkEnd < chunks.size()
+               && (numParticlesSoFar+chunks[chunkEnd].count <= target
+                   || chunkEnd == chunkBegin
+                   || partID == dataURL.numParts-1)) {
+          numParticlesSoFar += chunks[chunkEnd].count;
+          chunkEnd++;
+        }
+        if (chunkEnd == chunkBegin) {
+          std::cout << MINI_TERMINAL_YELLOW
+                    << "#hs.particles: warning - not enough chunks in "
+                    << dataURL.where << " for part " << partID
+                    << " (" << chunks.size() << " chunks for "
+                    << dataURL.numParts << " parts)"
+                    << MINI_TERMINAL_DEFAULT << std::endl;
+          continue;
+        }
+        loader->addContent
+          (new ParticlesContent(dataURL,partID,header,
+                                {chunks.begin()+chunkBegin,chunks.begin()+chunkEnd}));
+        chunkBegin = chunkEnd;
+      }
+    }
+
+    float ParticlesContent::radius() const
+    { return data.get_float("radius",header.radius); }
+
+    size_t ParticlesContent::projectedSize()
+    {
+      size_t bytesPerParticle = sizeof(vec3f);
+      if (header.flags & ParticleFile::HAS_COLORS) bytesPerParticle += sizeof(vec3f);
+      if (header.flags & ParticleFile::HAS_RADII)  bytesPerParticle += sizeof(float);
+      // (about) the same ratio of BVH etc to raw size as SpheresFromFile
+      const double projectedOverRawSize = 100./12.;
+      return size_t(projectedOverRawSize * numParticles * bytesPerParticle);
+    }
+
+    size_t ParticlesContent::projectedPrims()
+    { return numParticles; }
+
+    box3f ParticlesContent::projectedBounds()
+    { return bounds; }
+
+    void ParticlesContent::executeLoad(OnePartition &dataGroup)
+    {
+      SphereSet::SP spheres
+        = ParticleFile::readChunks(data.where,header,chunks);
+      if (spheres->radii.empty())
+        spheres->radius = radius();
+      mini::Matte::SP mat = std::make_shared<mini::Matte>();
+      mat->reflectance = .5f;
+      spheres->material = mat;
+      if (verbose)
+        std::cout << "   ... done loading " << prettyNumber(spheres->origins.size())
+                  << " particles (" << chunks.size() << " chunks) from "
+                  << data.where << std::endl << std::flush;
+      dataGroup.sphereSets.push_back(spheres);
+    }
+
+    std::string ParticlesContent::toString()
+    {
+      std::stringstream ss;
+      ss << bounds;
+      return "Particles{fileName="+data.where
+        +", part "+std::to_string(thisPartID)+" of "
+        + std::to_string(data.numParts)+", "
+        +prettyNumber(numParticles)+" particles in "
+        +std::to_string(chunks.size())+" chunks, bounds "
+        +ss.str()
+        +", proj size "
+        +prettyNumber(projectedSize())+"B}";
+    }
+
+  }
+}
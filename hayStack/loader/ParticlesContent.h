@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+
+namespace hs {
+  namespace loader {
+
+    /*! hayStack's native particle ('.hsp') file format. particles
+        are stored in spatially coherent chunks (the leaves of a
+        kd-tree, in kd-order), with a header table of each chunk's
+        bounds, count, and radius range - so a loader can pick whole
+        runs of chunks, and know their bounds, without ever reading
+        the payload. layout is:
+
+          Header
+          ChunkInfo[numChunks]
+          vec3f     origins[numParticles]
+          vec3f     colors [numParticles]  (only if HAS_COLORS)
+          float     radii  [numParticles]  (only if HAS_RADII)
+
+        with each chunk's particles stored contiguously in each of the
+        arrays. */
+    struct ParticleFile {
+      typedef enum { HAS_COLORS = 1, HAS_RADII = 2 } Flags;
+
+      struct Header {
+        uint64_t magic;
+        uint64_t numParticles;
+        uint64_t numChunks;
+        uint32_t flags;
+        /*! radius to use if there's no HAS_RADII */
+        float    radius;
+      };
+      struct ChunkInfo {
+        /*! bounds of the chunk's sphere *origins* */
+        box3f    bounds;
+        range1f  radiusRange;
+        uint64_t begin;
+        uint64_t count;
+      };
+
+      static const uint64_t magic;
+
+      /*! sort given spheres into chunks of at most maxChunkSize
+          particles each, and write them to given file */
+      static void write(const std::string &fileName,
+                        SphereSet::SP spheres,
+                        size_t maxChunkSize = 1<<16);
+
+      /*! read (only) header and chunk table */
+      static void readHeader(const std::string &fileName,
+                             Header &header,
+                             std::vector<ChunkInfo> &chunks);
+
+      /*! read all particles of the given chunks, which have to be
+          a contiguous run of the file's chunk table */
+      static SphereSet::SP readChunks(const std::string &fileName,
+                                      const Header &header,
+                                      const std::vector<ChunkInfo> &chunks);
+    };
+
+    /*! a (run of chunks from a) '.hsp' particle file. with
+        'N@file.hsp' the chunks get split into N contiguous runs of
+        roughly equal particle count; since chunks are stored in
+        kd-order each such run is spatially coherent. */
+    struct ParticlesContent : public LoadableContent {
+      ParticlesContent(const ResourceSpecifier &data,
+                       int thisPartID,
+                       const ParticleFile::Header &header,
+                       const std::vector<ParticleFile::ChunkInfo> &chunks);
+      static void create(DataLoader *loader,
+                         const ResourceSpecifier &dataURL);
+      size_t projectedSize() override;
+      size_t projectedPrims() override;
+      box3f  projectedBounds() override;
+      void   executeLoad(OnePartition &dataGroup) override;
+
+      std::string toString() override;
+
+      /*! radius of the spheres if the file doesn't have per-particle
+          radii: the 'radius=' argument if given, else the header's */
+      float radius() const;
+
+      const ResourceSpecifier data;
+      const int thisPartID;
+      const ParticleFile::Header header;
+      /*! the (contiguous run of) chunks this part loads */
+      const std::vector<ParticleFile::ChunkInfo> chunks;
+      size_t numParticles = 0;
+      /*! bounds of this part's spheres (including their radii), from
+          the chunk table alone */
+      box3f  bounds;
+    };
+
+  }
+}
@@ -2,10 +2,13 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "hayStack/loader/RAWVolumeContent.h"
+#include "hayStack/NodeSharedMemory.h"
 #include <fstream>
 #include <umesh/UMesh.h>
 #include <umesh/extractIsoSurface.h>
 #include <miniScene/Scene.h>
+#include <nanovdb/tools/GridBuilder.h>
+#include <nanovdb/tools/CreateNanoGrid.h>
 
 namespace umesh {
   UMesh::SP tetrahedralize(UMesh::SP in,
@@ -24,14 +27,18 @@ namespace hs {
                                        vec3i fullVolumeDims,
                                        const std::string &texelFormat,
                                        int numChannels,
-                                       float isoValue)
+                                       float isoValue,
+                                       float sparseTolerance,
+                                       float sparseBackground)
       : fileName(fileName),
         thisPartID(thisPartID),
         cellRange(cellRange),
         fullVolumeDims(fullVolumeDims),
         texelFormat(texelFormat),
         numChannels(numChannels),
-        isoValue(isoValue)
+        isoValue(isoValue),
+        sparseTolerance(sparseTolerance),
+        sparseBackground(sparseBackground)
     {}
 
     void splitKDTree(std::vector<box3i> &regions,
@@ -158,13 +165,25 @@ namespace hs {
       std::string isoString = dataURL.get("iso",dataURL.get("isoValue"));
       if (!isoString.empty())
         isoValue = std::stof(isoString);
+
+      // 'sparse' (or 'sparse=<tolerance>') converts to a sparse
+      // volume on load; values are in the same normalized [0,1]
+      // range as the transfer function for uint8/uint16 data
+      float sparseTolerance = NAN;
+      if (dataURL.has("sparse")) {
+        std::string tolString = dataURL.get("sparse");
+        sparseTolerance = tolString.empty() ? 0.f : std::stof(tolString);
+      }
+      float sparseBackground = dataURL.get_float("background",0.f);
     
       for (int i=0;i<dataURL.numParts;i++) {
         loader->addContent(new RAWVolumeContent(dataURL.where,i,
                                                 regions[i],
                                                 dims,texelFormat,//scalarType,
                                                 numChannels,
-                                                isoValue));
+                                                isoValue,
+                                                sparseTolerance,
+                                                sparseBackground));
       }
     }
   
@@ -174,11 +193,46 @@ namespace hs {
       return numVoxels.x*size_t(numVoxels.y)*numVoxels.z*numChannels*sizeOf(texelFormat);
     }
   
+    size_t RAWVolumeContent::projectedPrims()
+    {
+      vec3i numCells = cellRange.size();
+      return numCells.x*size_t(numCells.y)*numCells.z;
+    }
+
+    box3f RAWVolumeContent::projectedBounds()
+    {
+      return box3f(gridOrigin(),
+                   gridOrigin()+vec3f(cellRange.size())*gridSpacing());
+    }
+  
     void RAWVolumeContent::executeLoad(OnePartition &dataGroup)
     {
+      if (!isnan(sparseTolerance)) {
+        if (isnan(isoValue) && numChannels == 1) {
+          if (executeSparseLoad(dataGroup))
+            return;
+        } else
+          std::cout << MINI_TERMINAL_YELLOW
+                    << "#hs.raw: WARNING: sparse conversion is only supported for"
+                    << " single-channel volumes without iso-extraction; loading dense"
+                    << MINI_TERMINAL_DEFAULT << std::endl;
+      }
       vec3i numVoxels = (cellRange.size()+1);
       size_t numScalars = //numChannels*
         size_t(numVoxels.x)*size_t(numVoxels.y)*size_t(numVoxels.z);
+      if (numChannels == 1 && isnan(isoValue) && NodeSharedMemory::active()) {
+        // plain scalars that other ranks on this node load, too -
+        // only one of us reads them, into node-shared memory
+        std::vector<uint8_t> noData, noRGB;
+        StructuredVolume::SP volume
+          = std::make_shared<StructuredVolume>(numVoxels,texelFormat,noData,noRGB,
+                                               gridOrigin(),vec3f(gridSpacing()));
+        volume->sharedVoxels
+          = NodeSharedMemory::load(numScalars*sizeOf(texelFormat),
+                                   [&](uint8_t *dst) { readScalars(dst); });
+        dataGroup.structuredVolumes.push_back(volume);
+        return;
+      }
       std::vector<uint8_t> rawData(numScalars*sizeOf(texelFormat));
       char *dataPtr = (char *)rawData.data();
       std::ifstream in(fileName.c_str(),std::ios::binary);
@@ -232,8 +286,8 @@ namespace hs {
             }
           }
         }
-      vec3f gridOrigin(cellRange.lower);
-      vec3f gridSpacing(1.f);
+      vec3f gridOrigin = this->gridOrigin();
+      vec3f gridSpacing(this->gridSpacing());
     
       bool doIso = !isnan(isoValue);
       if (doIso) {
@@ -316,6 +370,176 @@ namespace hs {
       }
     }
   
+    void RAWVolumeContent::readScalars(uint8_t *dst)
+    {
+      const vec3i numVoxels = cellRange.size()+1;
+      const size_t texelSize = sizeOf(texelFormat);
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      if (!in.good())
+        throw std::runtime_error
+          ("hs::RAWVolumeContent: could not open '"+fileName+"'");
+      for (int iz=cellRange.lower.z;iz<=cellRange.upper.z;iz++)
+        for (int iy=cellRange.lower.y;iy<=cellRange.upper.y;iy++) {
+          size_t ofsInScalars
+            = cellRange.lower.x
+            + iy*size_t(fullVolumeDims.x)
+            + iz*size_t(fullVolumeDims.x)*size_t(fullVolumeDims.y);
+          in.seekg(ofsInScalars*texelSize);
+          in.read((char *)dst,numVoxels.x*texelSize);
+          if (!in.good())
+            throw std::runtime_error("read partial data...");
+          dst += numVoxels.x*texelSize;
+        }
+    }
+  
+    bool RAWVolumeContent::executeSparseLoad(OnePartition &dataGroup)
+    {
+      using BuildGrid  = nanovdb::tools::build::Grid<float>;
+      using BuildUpper = BuildGrid::Node2;
+      // we look at (and store) the data in blocks of one nanovdb leaf
+      // each, aligned to the global index space so they line up with
+      // the grid's leaves
+      const int B = BuildGrid::Node0::DIM;
+      const vec3i numVoxels = cellRange.size()+1;
+      const size_t texelSize = sizeOf(texelFormat);
+
+      std::ifstream in(fileName.c_str(),std::ios::binary);
+      if (!in.good())
+        throw std::runtime_error
+          ("hs::RAWVolumeContent: could not open '"+fileName+"'");
+
+      BuildGrid grid(sparseBackground);
+      // the grid's voxels live at their global index coordinates, so
+      // map those to the same world positions the dense path uses
+      const vec3f translation = gridOrigin()-vec3f(cellRange.lower)*gridSpacing();
+      grid.setTransform(gridSpacing(),
+                        nanovdb::Vec3d(translation.x,translation.y,translation.z));
+      auto acc = grid.getAccessor();
+      auto lowerExists = [&](const nanovdb::Coord &ijk) {
+        auto *rootTile = grid.mRoot.probeTile(ijk);
+        return rootTile && rootTile->child
+          && rootTile->child->mChildMask.isOn(BuildUpper::CoordToOffset(ijk));
+      };
+
+      size_t numBlocks = 0, numDenseBlocks = 0, numTiles = 0, numDropped = 0;
+      range1f valueRange;
+      std::vector<uint8_t> line(numVoxels.x*texelSize);
+      std::vector<float>   slab;
+      auto blockBegin = [&](int i) { return (i/B)*B; };
+      for (int bz=blockBegin(cellRange.lower.z);bz<=cellRange.upper.z;bz+=B) {
+        // read (and normalize) the next slab of up to B z-planes
+        const int z0 = std::max(bz,cellRange.lower.z);
+        const int z1 = std::min(bz+B-1,cellRange.upper.z);
+        slab.resize(size_t(z1-z0+1)*numVoxels.y*numVoxels.x);
+        float *out = slab.data();
+        for (int iz=z0;iz<=z1;iz++)
+          for (int iy=cellRange.lower.y;iy<=cellRange.upper.y;iy++) {
+            size_t ofsInScalars
+              = cellRange.lower.x
+              + iy*size_t(fullVolumeDims.x)
+              + iz*size_t(fullVolumeDims.x)*size_t(fullVolumeDims.y);
+            in.seekg(ofsInScalars*texelSize);
+            in.read((char *)line.data(),line.size());
+            if (!in.good())
+              throw std::runtime_error("read partial data...");
+            for (int ix=0;ix<numVoxels.x;ix++)
+              if (texelFormat == "float")
+                *out++ = ((const float *)line.data())[ix];
+              else if (texelFormat == "uint16_t")
+                *out++ = ((const uint16_t *)line.data())[ix]*(1.f/((1<<16)-1));
+              else
+                *out++ = ((const uint8_t *)line.data())[ix]*(1.f/((1<<8)-1));
+          }
+        auto voxel = [&](int ix, int iy, int iz) {
+          return slab[(ix-cellRange.lower.x)
+                      +numVoxels.x*((iy-cellRange.lower.y)
+                                    +size_t(numVoxels.y)*(iz-z0))];
+        };
+
+        // now classify each of this slab's blocks
+        for (int by=blockBegin(cellRange.lower.y);by<=cellRange.upper.y;by+=B)
+          for (int bx=blockBegin(cellRange.lower.x);bx<=cellRange.upper.x;bx+=B) {
+            const vec3i lo(std::max(bx,cellRange.lower.x),
+                           std::max(by,cellRange.lower.y),
+                           z0);
+            const vec3i hi(std::min(bx+B-1,cellRange.upper.x),
+                           std::min(by+B-1,cellRange.upper.y),
+                           z1);
+            range1f blockRange;
+            for (int iz=lo.z;iz<=hi.z;iz++)
+              for (int iy=lo.y;iy<=hi.y;iy++)
+                for (int ix=lo.x;ix<=hi.x;ix++)
+                  blockRange.extend(voxel(ix,iy,iz));
+            valueRange.extend(blockRange);
+            numBlocks++;
+
+            if (blockRange.upper-blockRange.lower > sparseTolerance) {
+              numDenseBlocks++;
+              for (int iz=lo.z;iz<=hi.z;iz++)
+                for (int iy=lo.y;iy<=hi.y;iy++)
+                  for (int ix=lo.x;ix<=hi.x;ix++)
+                    acc.setValue(nanovdb::Coord(ix,iy,iz),voxel(ix,iy,iz));
+              continue;
+            }
+            
+            const float value = .5f*(blockRange.lower+blockRange.upper);
+            if (fabsf(value-sparseBackground) <= sparseTolerance) {
+              numDropped++;
+              continue;
+            }
+            numTiles++;
+            if (lo == vec3i(bx,by,bz) && hi == vec3i(bx,by,bz)+vec3i(B-1)) {
+              const nanovdb::Coord ijk(bx,by,bz);
+              // the builder fills newly created lower nodes with the
+              // tile's value - so make sure ours exists, and is empty
+              if (!lowerExists(ijk))
+                grid.mRoot.template addTile<1>(ijk,sparseBackground,false);
+              grid.mRoot.template addTile<1>(ijk,value,true);
+            } else {
+              // block cut off by the brick boundary - can't be a tile
+              for (int iz=lo.z;iz<=hi.z;iz++)
+                for (int iy=lo.y;iy<=hi.y;iy++)
+                  for (int ix=lo.x;ix<=hi.x;ix++)
+                    acc.setValue(nanovdb::Coord(ix,iy,iz),value);
+            }
+          }
+      }
+
+      auto handle = nanovdb::tools::createNanoGrid(grid);
+      const size_t denseSize
+        = size_t(numVoxels.x)*size_t(numVoxels.y)*size_t(numVoxels.z)*texelSize;
+      std::cout << "#hs.raw: part #" << thisPartID << ": "
+                << numDenseBlocks << " of " << numBlocks << " blocks occupied ("
+                << prettyDouble(100.*numDenseBlocks/std::max(numBlocks,(size_t)1)) << "%), "
+                << numTiles << " uniform, " << numDropped << " dropped as background; "
+                << prettyNumber(handle.size()) << "B sparse vs "
+                << prettyNumber(denseSize) << "B dense ("
+                << prettyDouble(100.*handle.size()/std::max(denseSize,(size_t)1))
+                << "%)" << std::endl;
+      if (handle.size() >= denseSize) {
+        // (mostly) full bricks, or small ones where the tree's
+        // fixed overhead dominates - dense is the better deal
+        std::cout << "#hs.raw: part #" << thisPartID
+                  << ": sparse wouldn't save anything, loading dense" << std::endl;
+        return false;
+      }
+
+      auto vol = std::make_shared<NanoVDBVolume>();
+      vol->fileName      = fileName;
+      vol->partID        = thisPartID;
+      vol->cellRange     = cellRange;
+      vol->fullIndexDims = fullVolumeDims;
+      vol->bounds        = projectedBounds();
+      if (numDropped)
+        valueRange.extend(sparseBackground);
+      vol->valueRange    = valueRange;
+      vol->densityVolume = false;
+      vol->data.resize(handle.size());
+      memcpy(vol->data.data(),handle.data(),handle.size());
+      dataGroup.nanovdbVolumes.push_back(vol);
+      return true;
+    }
+
     std::string RAWVolumeContent::toString() 
     {
       std::stringstream ss;
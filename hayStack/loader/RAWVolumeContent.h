@@ -22,12 +22,34 @@ namespace hs {
                        /*! if not NaN, we'll actually not store the
                          volume, but run iso-value extraction and use
                          the resulting surface(s) */
-                       const float isoValue);
+                       const float isoValue,
+                       /*! if not NaN, convert to a sparse (nanovdb)
+                         volume while loading, with blocks that are
+                         uniform within this tolerance becoming single
+                         tiles (or getting dropped, if they're
+                         uniformly 'sparseBackground') */
+                       const float sparseTolerance = NAN,
+                       const float sparseBackground = 0.f);
     
       static void create(DataLoader *loader,
                          const ResourceSpecifier &dataURL);
       size_t projectedSize() override;
+      size_t projectedPrims() override;
+      box3f  projectedBounds() override;
       void   executeLoad(OnePartition &dataGroup) override;
+      /*! the sparse variant of executeLoad(), which streams the brick
+          in slabs of one nanovdb leaf each, and never holds the
+          dense brick in memory. returns false (and adds nothing) if
+          the sparse grid would not have been any smaller than the
+          dense brick */
+      bool   executeSparseLoad(OnePartition &dataGroup);
+      /*! reads (only) our region's scalars into dst */
+      void   readScalars(uint8_t *dst);
+      /*! world-space position of our first voxel, and distance
+          between voxels; the dense, iso, and sparse paths all place
+          their voxels with these */
+      vec3f  gridOrigin() const { return vec3f(cellRange.lower); }
+      float  gridSpacing() const { return 1.f; }
 
       std::string toString() override;
 
@@ -38,6 +60,8 @@ namespace hs {
       const int           numChannels;
       const std::string   texelFormat;
       const float         isoValue;
+      const float         sparseTolerance;
+      const float         sparseBackground;
     };
   
   }
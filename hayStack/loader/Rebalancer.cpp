@@ -0,0 +1,249 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/Rebalancer.h"
+#include "hayStack/StructuredVolume.h"
+#include "hayStack/Tracing.h"
+#include <set>
+
+namespace hs {
+  namespace loader {
+
+    Rebalancer::Rebalancer(mpi::Comm &workers,
+                           DynamicDataLoader &loader,
+                           LocalPartitions *localPartitions)
+      : workers(workers),
+        loader(loader),
+        localPartitions(localPartitions),
+        numGroupsPerRank(localPartitions->numPartitionsOnThisRank()),
+        numDataGroups(localPartitions->numPartitionsTotal())
+    {
+      if (loader.allContent.empty())
+        throw std::runtime_error("rebalancing needs the loader's content"
+                                 " (which snapshots don't have)");
+      // (allContent has them negated, for sorting largest first)
+      for (auto &content : loader.allContent)
+        weightOf[std::get<2>(content)] = -std::get<0>(content);
+
+      std::vector<int> myGroups;
+      for (auto mp : localPartitions->myPartitions)
+        myGroups.push_back(mp->partitionsRank);
+      if (workers.allReduceMin(numGroupsPerRank) != numGroupsPerRank ||
+          workers.allReduceMax(numGroupsPerRank) != numGroupsPerRank)
+        throw std::runtime_error("rebalancing needs the same number of"
+                                 " data groups on every rank");
+      groupsOfRank.resize(workers.size*numGroupsPerRank);
+      std::copy(myGroups.begin(),myGroups.end(),
+                groupsOfRank.begin()+workers.rank*numGroupsPerRank);
+      workers.allGather(groupsOfRank.data(),myGroups.data(),numGroupsPerRank);
+    }
+
+    bool Rebalancer::addFrame(double renderTime)
+    {
+      changedThisRank = false;
+      sumTime += renderTime;
+      if (++numFrames < windowFrames)
+        return false;
+
+      std::vector<float> rankTimes(workers.size);
+      workers.allGather(rankTimes.data(),float(sumTime/numFrames));
+      sumTime   = 0.;
+      numFrames = 0;
+      if (settling) {
+        settling = false;
+        return false;
+      }
+
+      float maxTime = 0.f, sumTimes = 0.f;
+      int   slowest = 0;
+      for (int r=0;r<workers.size;r++) {
+        sumTimes += rankTimes[r];
+        if (rankTimes[r] > maxTime) {
+          maxTime = rankTimes[r];
+          slowest = r;
+        }
+      }
+      const float avgTime   = sumTimes/workers.size;
+      const float imbalance = avgTime > 0.f ? maxTime/avgTime : 1.f;
+
+      if (imbalanceBefore >= 0.f) {
+        if (workers.rank == 0)
+          std::cout << "#hs.lb: imbalance after rebalancing is "
+                    << prettyDouble(imbalance) << "x (was "
+                    << prettyDouble(imbalanceBefore) << "x); slowest rank "
+                    << slowest << " at " << prettyDouble(1000.f*maxTime)
+                    << "ms, average " << prettyDouble(1000.f*avgTime)
+                    << "ms" << std::endl;
+        imbalanceBefore = -1.f;
+      }
+
+      if (imbalance <= threshold) {
+        numImbalancedWindows = 0;
+        return false;
+      }
+      if (++numImbalancedWindows < persistence)
+        return false;
+      numImbalancedWindows = 0;
+
+      std::vector<Move> moves = planMoves(rankTimes);
+      if (workers.rank == 0) {
+        std::cout << "#hs.lb: imbalance " << prettyDouble(imbalance)
+                  << "x for " << persistence << " windows of " << windowFrames
+                  << " frames (slowest rank " << slowest << " at "
+                  << prettyDouble(1000.f*maxTime) << "ms, average "
+                  << prettyDouble(1000.f*avgTime) << "ms); ";
+        if (moves.empty())
+          std::cout << "no content move would help" << std::endl;
+        else {
+          std::cout << "moving " << moves.size() << " piece(s) of content:" << std::endl;
+          for (auto &move : moves)
+            std::cout << "  - " << move.content->toString() << " : data group "
+                      << move.fromGroup << " -> " << move.toGroup << std::endl;
+        }
+      }
+      if (moves.empty())
+        return false;
+
+      double t0 = getCurrentTime();
+      applyMoves(moves);
+      float reloadTime = workers.allReduceMax(float(getCurrentTime()-t0));
+      int numChanged = workers.allReduceAdd(changedThisRank ? 1 : 0);
+      if (workers.rank == 0)
+        std::cout << "#hs.lb: " << numChanged << " of " << workers.size
+                  << " rank(s) re-loaded content, in "
+                  << prettyDouble(reloadTime) << "s" << std::endl;
+      imbalanceBefore = imbalance;
+      settling = true;
+      return true;
+    }
+
+    std::vector<Rebalancer::Move>
+    Rebalancer::planMoves(const std::vector<float> &rankTimes)
+    {
+      const int numRanks = workers.size;
+      auto hasGroup = [&](int rank, int groupID) {
+        for (int i=0;i<numGroupsPerRank;i++)
+          if (groupsOfRank[rank*numGroupsPerRank+i] == groupID) return true;
+        return false;
+      };
+
+      // what each group's content is, and what it weighs
+      std::vector<std::vector<LoadableContent *>> content(numDataGroups);
+      std::vector<double> groupWeight(numDataGroups,0.);
+      for (int g=0;g<numDataGroups;g++) {
+        content[g] = loader.contentOf(g);
+        for (auto c : content[g])
+          groupWeight[g] += weightOf[c];
+      }
+
+      // each group's time: what its rank(s) took, split by weight
+      // among the groups of a rank, and averaged over the ranks
+      // that have it
+      std::vector<double> groupTime(numDataGroups,0.);
+      std::vector<int>    numCopies(numDataGroups,0);
+      for (int r=0;r<numRanks;r++) {
+        double rankWeight = 0.;
+        for (int i=0;i<numGroupsPerRank;i++)
+          rankWeight += groupWeight[groupsOfRank[r*numGroupsPerRank+i]];
+        for (int i=0;i<numGroupsPerRank;i++) {
+          int g = groupsOfRank[r*numGroupsPerRank+i];
+          groupTime[g] += rankTimes[r] * (rankWeight > 0.
+                                          ? groupWeight[g]/rankWeight
+                                          : 1./numGroupsPerRank);
+          numCopies[g]++;
+        }
+      }
+      // ... and each piece of content's, by its share of its group
+      std::vector<std::vector<double>> cost(numDataGroups);
+      for (int g=0;g<numDataGroups;g++) {
+        if (numCopies[g]) groupTime[g] /= numCopies[g];
+        for (auto c : content[g])
+          cost[g].push_back(groupWeight[g] > 0.
+                            ? groupTime[g]*weightOf[c]/groupWeight[g]
+                            : groupTime[g]/content[g].size());
+      }
+
+      std::vector<Move> moves;
+      std::vector<double> T(numRanks);
+      for (int m=0;m<maxMoves;m++) {
+        // predicted time of every rank, with the moves so far
+        int slowest = 0;
+        for (int r=0;r<numRanks;r++) {
+          T[r] = 0.;
+          for (int i=0;i<numGroupsPerRank;i++) {
+            int g = groupsOfRank[r*numGroupsPerRank+i];
+            for (auto c : cost[g]) T[r] += c;
+          }
+          if (T[r] > T[slowest]) slowest = r;
+        }
+        // only take moves that make a noticeable difference
+        double bestMax = .98*T[slowest];
+        int bestFrom = -1, bestItem = -1, bestTo = -1;
+        for (int i=0;i<numGroupsPerRank;i++) {
+          int from = groupsOfRank[slowest*numGroupsPerRank+i];
+          // never leave a group empty
+          if (content[from].size() < 2) continue;
+          for (int item=0;item<(int)content[from].size();item++) {
+            const double c = cost[from][item];
+            for (int to=0;to<numDataGroups;to++) {
+              if (to == from) continue;
+              double newMax = 0.;
+              for (int r=0;r<numRanks && newMax < bestMax;r++)
+                newMax = std::max(newMax,
+                                  T[r]
+                                  - (hasGroup(r,from) ? c : 0.)
+                                  + (hasGroup(r,to)   ? c : 0.));
+              if (newMax < bestMax) {
+                bestMax  = newMax;
+                bestFrom = from;
+                bestItem = item;
+                bestTo   = to;
+              }
+            }
+          }
+        }
+        if (bestFrom < 0) break;
+        moves.push_back({ content[bestFrom][bestItem], bestFrom, bestTo });
+        content[bestTo].push_back(content[bestFrom][bestItem]);
+        cost[bestTo].push_back(cost[bestFrom][bestItem]);
+        content[bestFrom].erase(content[bestFrom].begin()+bestItem);
+        cost[bestFrom].erase(cost[bestFrom].begin()+bestItem);
+      }
+      return moves;
+    }
+
+    void Rebalancer::applyMoves(const std::vector<Move> &moves)
+    {
+      HS_TRACE_SCOPE("rebalance");
+      std::set<int> lostContent;
+      std::map<int,std::vector<LoadableContent *>> gainedContent;
+      for (auto &move : moves) {
+        loader.moveContent(move.content,move.fromGroup,move.toGroup);
+        lostContent.insert(move.fromGroup);
+        gainedContent[move.toGroup].push_back(move.content);
+      }
+      for (auto mp : localPartitions->myPartitions) {
+        const int g = mp->partitionsRank;
+        if (lostContent.count(g)) {
+          mp->clear();
+          loader.loadPartition(mp);
+          loader.addSharedLights(mp);
+        } else if (gainedContent.count(g)) {
+          // (anything that moved on from here would have put this
+          // group into lostContent)
+          for (auto content : gainedContent[g])
+            content->executeLoad(*mp);
+        } else
+          continue;
+        if (mergeUnstructuredMeshes)
+          mp->mergeUnstructuredMeshes();
+        if (pyramidLevels > 0)
+          for (auto vol : mp->structuredVolumes)
+            if (vol->coarserLevels.empty())
+              vol->buildPyramid(pyramidLevels);
+        changedThisRank = true;
+      }
+    }
+
+  }
+}
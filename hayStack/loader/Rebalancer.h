@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+
+namespace hs {
+  namespace loader {
+
+    /*! moves content between data groups based on how long each
+        rank actually takes to render its groups, rather than on the
+        content's projected size (which is all assignGroups() can go
+        by). every worker reports its render time for every frame;
+        every 'windowFrames' frames those get compared across ranks,
+        and if the slowest rank is more than 'threshold' times slower
+        than the average for 'persistence' windows in a row, whole
+        pieces of content get re-assigned from the slowest rank's
+        most expensive group to wherever they lower the (predicted)
+        slowest rank's time the most.
+
+        a group's render time gets estimated from the times of the
+        rank(s) that have it (split by projected size if a rank has
+        several groups), and a piece of content's from its share of
+        its group's projected size. only ranks that have a group
+        that lost or gained content re-load anything: groups that
+        only gained content load just that, others clear and re-load
+        all of theirs.
+
+        this needs a renderer in which every rank's render time
+        reflects its own data - eg, a cpu device where each rank
+        renders its groups independently. with a device whose ranks
+        wait for each other in the compositing stage, all ranks
+        report about the same time, and nothing ever moves. */
+    struct Rebalancer {
+      Rebalancer(mpi::Comm &workers,
+                 DynamicDataLoader &loader,
+                 LocalPartitions *localPartitions);
+
+      /*! to get called by every worker after every frame, with the
+          time this rank took to render it. returns true (on all
+          workers) if content got moved; changedThisRank then tells
+          whether this rank's partitions did change (in which case
+          its world needs to get rebuilt). collective across all
+          workers */
+      bool addFrame(double renderTime);
+
+      /*! num frames whose times get averaged before comparing ranks */
+      int   windowFrames = 8;
+      /*! max/average rank time above which ranks count as imbalanced */
+      float threshold    = 1.2f;
+      /*! num consecutive imbalanced windows before moving content */
+      int   persistence  = 3;
+      /*! max num pieces of content to move per rebalancing round */
+      int   maxMoves     = 4;
+      /*! post-processing that the initial load did, and that
+          re-loaded partitions therefore need, too */
+      bool  mergeUnstructuredMeshes = false;
+      int   pyramidLevels = 0;
+
+      bool  changedThisRank = false;
+
+    private:
+      struct Move {
+        LoadableContent *content;
+        int fromGroup;
+        int toGroup;
+      };
+      /*! decides which content to move, given each rank's average
+          render time; computes the same result on every worker */
+      std::vector<Move> planMoves(const std::vector<float> &rankTimes);
+      /*! applies the moves to the loader's assignment, and re-loads
+          those of this rank's partitions that they affect */
+      void applyMoves(const std::vector<Move> &moves);
+
+      mpi::Comm          workers;
+      DynamicDataLoader &loader;
+      LocalPartitions   *localPartitions;
+      /*! data groups of each rank, numGroupsPerRank at a time */
+      std::vector<int>   groupsOfRank;
+      int                numGroupsPerRank;
+      int                numDataGroups;
+      /*! projected size of every piece of content */
+      std::map<LoadableContent *,double> weightOf;
+
+      double sumTime    = 0.;
+      int    numFrames  = 0;
+      int    numImbalancedWindows = 0;
+      /*! skip the first window, and the one right after moving
+          content, as their first frame(s) also (re-)build the world
+          on the device */
+      bool   settling   = true;
+      /*! imbalance that triggered the last rebalancing; -1 if that
+          one's result has been reported already */
+      float  imbalanceBefore = -1.f;
+    };
+
+  }
+}
@@ -3,55 +3,313 @@
 
 #include "TAMRContent.h"
 #include <fstream>
+#include <functional>
 #include <tinyAMR/Model.h>
 
 namespace hs {
   namespace loader {
-  
+
     TAMRContent::TAMRContent(const std::string &fileName,
                              int thisPartID,
                              bool showBlockDebug,
-                             float isoValue)
+                             float isoValue,
+                             const std::vector<BlockRef> &blocks,
+                             size_t numBytes)
       : fileName(fileName),
         thisPartID(thisPartID),
         showBlockDebug(showBlockDebug),
-        isoValue(isoValue)
+        isoValue(isoValue),
+        blocks(blocks),
+        numBytes(numBytes)
     {}
 
+    void TAMRContent::splitBlocks(std::vector<std::vector<BlockRef>> &parts,
+                                  const tamr::Model &model,
+                                  int numParts)
+    {
+      parts.clear();
+      if (model.grids.empty()) {
+        parts.resize(numParts);
+        return;
+      }
+
+      // we split in the index space of the finest level; and only
+      // along planes that are multiples of the coarsest level's
+      // cells, so a plane never cuts through a cell of any level
+      int minLevel = model.grids[0].level, maxLevel = model.grids[0].level;
+      for (auto &grid : model.grids) {
+        minLevel = std::min(minLevel,grid.level);
+        maxLevel = std::max(maxLevel,grid.level);
+      }
+      const int quantum = 1<<(maxLevel-minLevel);
+      auto floorDiv = [](int a, int b) {
+        return a >= 0 ? a/b : -((-a+b-1)/b);
+      };
+      auto scaleOf = [&](const BlockRef &ref) {
+        return 1<<(maxLevel-model.grids[ref.gridID].level);
+      };
+      auto originOf = [&](const BlockRef &ref) {
+        return (const vec3i &)model.grids[ref.gridID].origin;
+      };
+      auto numCells = [](const BlockRef &ref) {
+        vec3i size = ref.end-ref.begin;
+        return size_t(size.x)*size_t(size.y)*size_t(size.z);
+      };
+      /*! where (in that block's own cells) given plane cuts the block */
+      auto cutOf = [&](const BlockRef &ref, int dim, int plane) {
+        int cut = plane/scaleOf(ref) - originOf(ref)[dim];
+        return std::max(ref.begin[dim],std::min(ref.end[dim],cut));
+      };
+
+      std::vector<BlockRef> all;
+      for (int gridID=0;gridID<(int)model.grids.size();gridID++) {
+        const vec3i dims = (const vec3i &)model.grids[gridID].dims;
+        if (reduce_min(dims) > 0)
+          all.push_back({gridID,vec3i(0),dims});
+      }
+
+      std::function<void(const std::vector<BlockRef> &,int)> split
+        = [&](const std::vector<BlockRef> &refs, int numParts)
+      {
+        if (numParts == 1) {
+          parts.push_back(refs);
+          return;
+        }
+        box3i domain;
+        size_t totalCost = 0;
+        for (auto &ref : refs) {
+          const int scale = scaleOf(ref);
+          domain.extend((originOf(ref)+ref.begin)*scale);
+          domain.extend((originOf(ref)+ref.end)*scale);
+          totalCost += numCells(ref);
+        }
+        const int numLeft = numParts/2;
+        const size_t targetCost = totalCost*numLeft/numParts;
+        auto costLeftOf = [&](int dim, int plane) {
+          size_t cost = 0;
+          for (auto &ref : refs) {
+            BlockRef left = ref;
+            left.end[dim] = cutOf(ref,dim,plane);
+            if (left.end[dim] > left.begin[dim])
+              cost += numCells(left);
+          }
+          return cost;
+        };
+
+        // try the domain's dimensions from widest to narrowest, until
+        // we find one that can actually separate the cells
+        vec3i extent = domain.size();
+        int dims[3] = { 0,1,2 };
+        std::sort(dims,dims+3,[&](int a, int b){ return extent[a] > extent[b]; });
+        int bestDim = -1, bestPlane = 0;
+        for (int dim : dims) {
+          int lo = -floorDiv(-domain.lower[dim],quantum);
+          int hi = floorDiv(domain.upper[dim],quantum);
+          if (hi-lo < 2) continue;
+          // smallest plane (in quanta) that has at least the target
+          // cost on its left; then check if the one before is closer
+          int begin = lo+1, end = hi-1;
+          while (begin < end) {
+            int mid = begin+(end-begin)/2;
+            if (costLeftOf(dim,mid*quantum) >= targetCost)
+              end = mid;
+            else
+              begin = mid+1;
+          }
+          int plane = begin;
+          if (plane > lo+1) {
+            size_t above = costLeftOf(dim,plane*quantum)-targetCost;
+            size_t below = targetCost-costLeftOf(dim,(plane-1)*quantum);
+            if (below < above) plane--;
+          }
+          size_t costLeft = costLeftOf(dim,plane*quantum);
+          if (costLeft == 0 || costLeft == totalCost)
+            continue;
+          bestDim = dim;
+          bestPlane = plane*quantum;
+          break;
+        }
+
+        if (bestDim < 0) {
+          // can't split this any further; give everything to the
+          // first part, and leave the others empty
+          parts.push_back(refs);
+          for (int i=1;i<numParts;i++)
+            parts.push_back({});
+          return;
+        }
+
+        std::vector<BlockRef> left, right;
+        for (auto &ref : refs) {
+          int cut = cutOf(ref,bestDim,bestPlane);
+          if (cut > ref.begin[bestDim]) {
+            BlockRef l = ref;
+            l.end[bestDim] = cut;
+            left.push_back(l);
+          }
+          if (cut < ref.end[bestDim]) {
+            BlockRef r = ref;
+            r.begin[bestDim] = cut;
+            right.push_back(r);
+          }
+        }
+        split(left,numLeft);
+        split(right,numParts-numLeft);
+      };
+      split(all,numParts);
+    }
+
+    /*! exact num bytes a part made up of given block refs will take */
+    static size_t sizeOf(const std::vector<TAMRContent::BlockRef> &refs)
+    {
+      size_t numBytes = refs.size()*sizeof(tamr::Grid);
+      for (auto &ref : refs) {
+        vec3i size = ref.end-ref.begin;
+        numBytes += size_t(size.x)*size_t(size.y)*size_t(size.z)*sizeof(float);
+      }
+      return numBytes;
+    }
+
     void TAMRContent::create(DataLoader *loader,
                              const ResourceSpecifier &dataURL)
     {
-      if (dataURL.numParts > 1)
-        throw std::runtime_error("on-demand splitting of TAMR files not yet supported");
       // std::string type = dataURL.get("type",dataURL.get("format",""));
-    
+
       const bool showBlockDebug = dataURL.has("dbg");
       float isoValue = NAN;
       const std::string isoString = dataURL.get("iso", dataURL.get("isoValue", ""));
       if (!isoString.empty())
         isoValue = std::stof(isoString);
+      if (dataURL.numParts == 1) {
+        loader->addContent(new TAMRContent(dataURL.where, 0, showBlockDebug, isoValue));
+        return;
+      }
+
+      // only rank 0 looks at the model, and tells everybody else
+      // which part gets which blocks (all ranks need the same split)
+      hs::mpi::Comm &comm = loader->workers;
+      std::vector<BlockRef> allRefs;
+      std::vector<int>      partBegin(dataURL.numParts+1,0);
+      int numRefs = 0;
+      if (comm.rank == 0) {
+        try {
+          tamr::Model::SP model = tamr::Model::load(dataURL.where);
+          std::vector<std::vector<BlockRef>> parts;
+          splitBlocks(parts,*model,dataURL.numParts);
+          for (int i=0;i<dataURL.numParts;i++) {
+            partBegin[i] = (int)allRefs.size();
+            for (auto &ref : parts[i]) allRefs.push_back(ref);
+          }
+          partBegin[dataURL.numParts] = (int)allRefs.size();
+          numRefs = (int)allRefs.size();
+        } catch (const std::exception &e) {
+          std::cerr << MINI_TERMINAL_RED << "#hs.tamr: could not split '"
+                    << dataURL.where << "': " << e.what()
+                    << MINI_TERMINAL_DEFAULT << std::endl;
+          numRefs = -1;
+        }
+      }
+      if (comm.size > 1) {
+        if (comm.rank == 0) comm.bc_send(&numRefs,sizeof(numRefs));
+        else                comm.bc_recv(&numRefs,sizeof(numRefs));
+      }
+      if (numRefs < 0)
+        throw std::runtime_error("could not split tamr model '"+dataURL.where+"'");
+      if (comm.size > 1) {
+        allRefs.resize(numRefs);
+        if (comm.rank == 0) {
+          comm.bc_send(partBegin.data(),partBegin.size()*sizeof(int));
+          comm.bc_send(allRefs.data(),allRefs.size()*sizeof(BlockRef));
+        } else {
+          comm.bc_recv(partBegin.data(),partBegin.size()*sizeof(int));
+          comm.bc_recv(allRefs.data(),allRefs.size()*sizeof(BlockRef));
+        }
+      }
+
       for (int i=0;i<dataURL.numParts;i++) {
-        loader->addContent(new TAMRContent(dataURL.where, i, showBlockDebug, isoValue));
+        std::vector<BlockRef> refs(allRefs.begin()+partBegin[i],
+                                   allRefs.begin()+partBegin[i+1]);
+        size_t numBytes = sizeOf(refs);
+        if (refs.empty()) {
+          if (comm.rank == 0)
+            std::cout << MINI_TERMINAL_YELLOW
+                      << "#hs.tamr: WARNING: part #" << i << " is empty - model "
+                      << "can't be split into " << dataURL.numParts << " parts"
+                      << MINI_TERMINAL_DEFAULT << std::endl;
+          continue;
+        }
+        if (comm.rank == 0)
+          std::cout << "#hs.tamr: part #" << i << ": " << refs.size()
+                    << " blocks, " << prettyNumber(numBytes) << "B" << std::endl;
+        loader->addContent(new TAMRContent(dataURL.where, i, showBlockDebug, isoValue,
+                                           refs, numBytes));
       }
     }
-  
+
     size_t TAMRContent::projectedSize()
     {
+      if (numBytes) return numBytes;
       return getFileSize(fileName) * 10;
     }
-  
-    void TAMRContent::executeLoad(OnePartition &dataGroup) 
+
+    void TAMRContent::executeLoad(OnePartition &dataGroup)
     {
+      // tinyAMR can only read a model as a whole, so this still
+      // takes the full model's memory while loading; we only get to
+      // drop the other parts' blocks before we build the volume
       tamr::Model::SP model = tamr::Model::load(fileName);
+      if (numBytes) {
+        // keep only our own blocks (or parts thereof), and their cells
+        std::vector<size_t> gridOffset(model->grids.size()+1,0);
+        for (size_t i=0;i<model->grids.size();i++) {
+          vec3i dims = (const vec3i &)model->grids[i].dims;
+          gridOffset[i+1] = gridOffset[i]+size_t(dims.x)*size_t(dims.y)*size_t(dims.z);
+        }
+        tamr::Model::SP part = std::make_shared<tamr::Model>();
+        // reserve up front, so growing the part's cells doesn't add
+        // another copy of them on top of the full model
+        size_t numPartCells = 0;
+        for (auto &ref : blocks) {
+          const vec3i size = ref.end-ref.begin;
+          numPartCells += size_t(size.x)*size_t(size.y)*size_t(size.z);
+        }
+        part->scalars.reserve(numPartCells);
+        part->grids.reserve(blocks.size());
+        for (auto &ref : blocks) {
+          const tamr::Grid &grid = model->grids[ref.gridID];
+          const vec3i dims = (const vec3i &)grid.dims;
+          tamr::Grid clipped = grid;
+          (vec3i &)clipped.origin = (const vec3i &)grid.origin + ref.begin;
+          (vec3i &)clipped.dims   = ref.end - ref.begin;
+          part->grids.push_back(clipped);
+          for (int iz=ref.begin.z;iz<ref.end.z;iz++)
+            for (int iy=ref.begin.y;iy<ref.end.y;iy++) {
+              const float *line
+                = model->scalars.data() + gridOffset[ref.gridID]
+                + ref.begin.x + dims.x*(iy + size_t(dims.y)*iz);
+              part->scalars.insert(part->scalars.end(),
+                                   line,line+(ref.end.x-ref.begin.x));
+            }
+        }
+        part->numCellsAcrossAllGrids = part->scalars.size();
+        std::cout << "#hs.tamr: part #" << thisPartID << " loaded "
+                  << part->grids.size() << " of " << model->grids.size()
+                  << " blocks, " << prettyNumber(part->scalars.size()) << " of "
+                  << prettyNumber(model->scalars.size()) << " cells" << std::endl;
+        model = part;
+      }
       dataGroup.amr.push_back(std::make_shared<TAMRVolume>(model, vec3f(0.f), vec3f(1.f), isoValue));
       if (showBlockDebug)
         dataGroup.cylinderSets.push_back(TAMRVolume::createBlockDebugCylinders(model));
     }
-  
-    std::string TAMRContent::toString() 
+
+    std::string TAMRContent::toString()
     {
       std::stringstream ss;
-      ss << "TinyAMR{#" << thisPartID << ",fileName="<<fileName<<"}";
+      ss << "TinyAMR{#" << thisPartID << ",fileName="<<fileName;
+      if (numBytes)
+        ss << ",numBlocks=" << blocks.size() << ",size=" << prettyNumber(numBytes) << "B";
+      ss << "}";
       return ss.str();
     }
 
@@ -7,15 +7,29 @@
 
 namespace hs {
   namespace loader {
-  
-    /*! a file of 'TinyAMR' (tamr) AMR files */
+
+    /*! a file of 'TinyAMR' (tamr) AMR files. with 'N@file.tamr' the
+        model's blocks get distributed across N parts by a
+        cost-balanced (ie, by num cells) kd-split of the model's
+        domain; blocks straddling a split plane get clipped, so every
+        cell ends up in exactly one part, and each part only keeps
+        its own blocks' cells. */
     struct TAMRContent : public LoadableContent {
-    
+
+      /*! (the sub-range of) one of the model's blocks that belongs to
+          a given part; begin/end are in that block's own cells */
+      struct BlockRef {
+        int   gridID;
+        vec3i begin, end;
+      };
+
       TAMRContent(const std::string &fileName,
                   int thisPartID,
                   bool showBlockDebug = false,
-                  float isoValue = NAN);
-      
+                  float isoValue = NAN,
+                  const std::vector<BlockRef> &blocks = {},
+                  size_t numBytes = 0);
+
       static void create(DataLoader *loader,
                          const ResourceSpecifier &dataURL);
       size_t projectedSize() override;
@@ -23,10 +37,21 @@ namespace hs {
 
       std::string toString() override;
 
+      /*! compute a cost-balanced kd-split of the given model's
+          blocks into numParts parts (some of which may end up empty
+          if the model is too small to split that often) */
+      static void splitBlocks(std::vector<std::vector<BlockRef>> &parts,
+                              const tamr::Model &model,
+                              int numParts);
+
       const std::string   fileName;
       const int           thisPartID;
       const bool          showBlockDebug;
       const float         isoValue;
+      /*! the blocks this part will load; empty means 'whole model' */
+      const std::vector<BlockRef> blocks;
+      /*! exact num bytes of this part's blocks and cells, if split */
+      const size_t        numBytes;
     };
 
   }
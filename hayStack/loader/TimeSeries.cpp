@@ -0,0 +1,210 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "hayStack/loader/TimeSeries.h"
+#include "hayStack/StructuredVolume.h"
+#include "hayStack/Tracing.h"
+#include <sys/stat.h>
+
+namespace hs {
+  namespace loader {
+    namespace {
+
+      /*! position and length of the '%[0-9]*d' in given string;
+          length 0 if there's none */
+      std::pair<size_t,size_t> findPattern(const std::string &s)
+      {
+        for (size_t pos=s.find('%');pos!=s.npos;pos=s.find('%',pos+1)) {
+          size_t end = pos+1;
+          while (end < s.size() && isdigit(s[end])) ++end;
+          if (end < s.size() && s[end] == 'd')
+            return { pos, end+1-pos };
+        }
+        return { s.npos, 0 };
+      }
+
+      /*! the file a descriptor reads from */
+      std::string fileOf(const std::string &descriptor)
+      {
+        return descriptor.find("://") == descriptor.npos
+          ? descriptor
+          : ResourceSpecifier(descriptor).where;
+      }
+
+      bool fileExists(const std::string &fileName)
+      {
+        struct stat st;
+        return stat(fileName.c_str(),&st) == 0;
+      }
+
+      template<typename T>
+      size_t bytesOf(const std::vector<T> &vec)
+      { return vec.size()*sizeof(T); }
+    }
+
+    TimeSeries::TimeSeries(mpi::Comm &workers,
+                           const std::vector<std::string> &descriptors,
+                           int firstStep,
+                           int numSteps,
+                           int numDataGroups,
+                           int dataPerRank)
+      : firstStep(firstStep),
+        numSteps(numSteps),
+        descriptors(descriptors),
+        numDataGroups(numDataGroups),
+        dataPerRank(dataPerRank),
+        workers(workers),
+        loaderComm(workers.dup())
+    {}
+
+    TimeSeries::~TimeSeries()
+    {
+      dropPrefetch();
+      loaderComm.free();
+    }
+
+    bool TimeSeries::isPattern(const std::string &descriptor)
+    {
+      return findPattern(descriptor).second > 0;
+    }
+
+    std::string TimeSeries::expand(const std::string &descriptor, int step)
+    {
+      auto pattern = findPattern(descriptor);
+      if (pattern.second == 0) return descriptor;
+      char number[64];
+      snprintf(number,sizeof(number),
+               descriptor.substr(pattern.first,pattern.second).c_str(),step);
+      return descriptor.substr(0,pattern.first)+number
+        +descriptor.substr(pattern.first+pattern.second);
+    }
+
+    void TimeSeries::findSteps(const std::string &pattern,
+                               int &firstStep,
+                               int &numSteps)
+    {
+      firstStep = fileExists(fileOf(expand(pattern,0))) ? 0 : 1;
+      numSteps = 0;
+      while (fileExists(fileOf(expand(pattern,firstStep+numSteps))))
+        ++numSteps;
+      if (numSteps == 0)
+        throw std::runtime_error("no time steps found for '"+pattern+"'");
+    }
+
+    size_t TimeSeries::hostBytes(const LocalPartitions &partitions)
+    {
+      size_t bytes = 0;
+      for (auto part : partitions.myPartitions) {
+        for (auto &vol : part->structuredVolumes)
+          bytes += vol->voxelBytes() + bytesOf(vol->rawDataRGB);
+        for (auto &vol : part->nanovdbVolumes)
+          bytes += bytesOf(vol->data);
+        for (auto &ss : part->sphereSets)
+          bytes += bytesOf(ss->origins)+bytesOf(ss->colors)+bytesOf(ss->radii);
+        for (auto &cs : part->cylinderSets)
+          bytes += bytesOf(cs->vertices)+bytesOf(cs->colors)
+            +bytesOf(cs->indices)+bytesOf(cs->radii);
+        for (auto &cs : part->capsuleSets)
+          bytes += bytesOf(cs->vertices)+bytesOf(cs->colors)+bytesOf(cs->indices);
+        for (auto &mesh : part->triangleMeshes)
+          bytes += bytesOf(mesh->vertices)+bytesOf(mesh->normals)
+            +bytesOf(mesh->colors)+bytesOf(mesh->indices);
+        for (auto &unst : part->unsts) {
+          auto &mesh = unst.first;
+          bytes += bytesOf(mesh->vertices)+bytesOf(mesh->tets)
+            +bytesOf(mesh->pyrs)+bytesOf(mesh->wedges)+bytesOf(mesh->hexes);
+          if (mesh->perVertex)
+            bytes += bytesOf(mesh->perVertex->values);
+        }
+        for (auto &mini : part->minis)
+          for (auto &inst : mini->instances)
+            for (auto &mesh : inst->object->meshes)
+              bytes += bytesOf(mesh->vertices)+bytesOf(mesh->indices);
+      }
+      return bytes;
+    }
+
+    LocalPartitions *TimeSeries::loadStep(int stepIndex)
+    {
+      HS_TRACE_SCOPE("loadTimeStep",std::to_string(stepIndex));
+      DynamicDataLoader loader(loaderComm);
+      loader.capacity = capacity;
+      loader.loadOnceAndBroadcast = loadOnceAndBroadcast;
+      loader.replicasOfGroup = replicasOfGroup;
+      for (auto &descriptor : descriptors)
+        loader.addContent(expand(descriptor,firstStep+stepIndex));
+      LocalPartitions *partitions = loader.loadData(numDataGroups,dataPerRank);
+      for (auto &content : loader.allContent)
+        delete std::get<2>(content);
+      if (mergeUnstructuredMeshes)
+        partitions->mergeUnstructuredMeshes();
+      if (pyramidLevels > 0)
+        for (auto part : partitions->myPartitions)
+          for (auto vol : part->structuredVolumes)
+            vol->buildPyramid(pyramidLevels);
+      return partitions;
+    }
+
+    LocalPartitions *TimeSeries::acquire(int stepIndex, bool &wasPrefetched)
+    {
+      if (prefetched.thread.joinable())
+        prefetched.thread.join();
+      // the prefetch may have failed on only some of the workers; so
+      // all have to agree on that before anyone throws, or the others
+      // would wait for it in their next collective
+      const bool failedHere = !prefetched.error.empty();
+      if (workers.allReduceMax(failedHere ? 1 : 0)) {
+        const std::string error
+          = failedHere ? prefetched.error : std::string("failed on another rank");
+        dropPrefetch();
+        throw std::runtime_error("prefetching time step failed: "+error);
+      }
+      wasPrefetched
+        = prefetched.partitions && prefetched.stepIndex == stepIndex;
+      if (wasPrefetched) {
+        LocalPartitions *partitions = prefetched.partitions;
+        prefetched.partitions = nullptr;
+        return partitions;
+      }
+      dropPrefetch();
+      return loadStep(stepIndex);
+    }
+
+    void TimeSeries::prefetch(int stepIndex, size_t bytesPerStep)
+    {
+      dropPrefetch();
+      // assume the next step is about as large as this one, and keep
+      // some headroom to what the system has left
+      bool fits = memoryCap == 0 || 2*bytesPerStep <= memoryCap;
+      size_t available = availableHostMemory();
+      if (available && bytesPerStep+bytesPerStep/4 > available)
+        fits = false;
+      // all workers load together, so either all prefetch, or none
+      if (!workers.allReduceMin(fits ? 1 : 0)) {
+        if (workers.rank == 0)
+          std::cout << "#hs.ts: not prefetching time step " << stepIndex
+                    << " - not enough memory on some rank(s)" << std::endl;
+        return;
+      }
+      prefetched.stepIndex = stepIndex;
+      prefetched.thread = std::thread([this,stepIndex]() {
+        try {
+          prefetched.partitions = loadStep(stepIndex);
+        } catch (const std::exception &e) {
+          prefetched.error = e.what();
+        }
+      });
+    }
+
+    void TimeSeries::dropPrefetch()
+    {
+      if (prefetched.thread.joinable())
+        prefetched.thread.join();
+      delete prefetched.partitions;
+      prefetched.partitions = nullptr;
+      prefetched.stepIndex = -1;
+      prefetched.error = "";
+    }
+
+  }
+}
@@ -0,0 +1,104 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayStack/loader/DataLoader.h"
+#include <thread>
+
+namespace hs {
+  namespace loader {
+
+    /*! a sequence of time steps, given by content descriptors of
+        which some contain a printf-style '%d' (or '%04d', etc)
+        pattern for the step number; eg,
+
+          raw://4@/data/dns_%04d.raw:format=float:dims=1024,1024,1024
+
+        every step gets loaded like a regular data set (into the same
+        data groups, with the same number of groups per rank), and
+        while one step renders, the next one can get loaded in the
+        background (see prefetch()), on a separate communicator. */
+    struct TimeSeries {
+      TimeSeries(mpi::Comm &workers,
+                 const std::vector<std::string> &descriptors,
+                 int firstStep,
+                 int numSteps,
+                 int numDataGroups,
+                 int dataPerRank);
+      ~TimeSeries();
+
+      /*! whether given descriptor has a time step pattern */
+      static bool isPattern(const std::string &descriptor);
+      /*! given descriptor, with its pattern (if any) replaced by
+          given step number */
+      static std::string expand(const std::string &descriptor, int step);
+      /*! looks for the first step (0 or 1) whose file exists, and
+          how many consecutive steps follow from there; throws if
+          there are none */
+      static void findSteps(const std::string &pattern,
+                            int &firstStep,
+                            int &numSteps);
+      /*! (approximate) host memory used by given partitions' content */
+      static size_t hostBytes(const LocalPartitions &partitions);
+
+      /*! returns the partitions of the step with given index
+          (0..numSteps-1): the prefetched ones if that step got
+          prefetched (waiting for the prefetch to complete, if
+          required), else it gets loaded right away. any prefetch of
+          another step gets dropped. if the prefetch failed on any
+          worker, this throws on all of them. collective across all
+          workers */
+      LocalPartitions *acquire(int stepIndex, bool &wasPrefetched);
+
+      /*! starts loading the step with given index in the background -
+          unless this would exceed memoryCap, or the memory the system
+          still has available, on any worker; bytesPerStep is what the
+          current step uses. that's only checked here, when the
+          prefetch starts - a step that turns out larger than the
+          current one still gets handed out by acquire(). collective
+          across all workers */
+      void prefetch(int stepIndex, size_t bytesPerStep);
+
+      /*! waits for - and frees - any prefetched step */
+      void dropPrefetch();
+
+      /*! max bytes that the current and the prefetched step may use
+          together, per rank; 0 means 'only limited by the system's
+          available memory' */
+      size_t    memoryCap = 0;
+      /*! post-processing that the initially loaded step got, and
+          that every other step therefore needs, too */
+      bool      mergeUnstructuredMeshes = false;
+      int       pyramidLevels = 0;
+      /*! loader settings that the first step got loaded with (see
+          DataLoader), for loading every other step the same way */
+      float     capacity = 1.f;
+      bool      loadOnceAndBroadcast = false;
+      /*! the first step's group-to-ranks mapping, if partially
+          replicated (after loading, so also if that got planned);
+          every step has to end up on the same ranks */
+      std::vector<int> replicasOfGroup;
+      const int firstStep;
+      const int numSteps;
+
+    private:
+      LocalPartitions *loadStep(int stepIndex);
+
+      const std::vector<std::string> descriptors;
+      const int numDataGroups;
+      const int dataPerRank;
+      mpi::Comm workers;
+      /*! all loading happens on this one, so it can never mix with
+          the collectives the renderer does meanwhile */
+      mpi::Comm loaderComm;
+      struct {
+        std::thread      thread;
+        int              stepIndex = -1;
+        LocalPartitions *partitions = nullptr;
+        std::string      error;
+      } prefetched;
+    };
+
+  }
+}
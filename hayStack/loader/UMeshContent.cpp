@@ -3,6 +3,9 @@
 
 #include "UMeshContent.h"
 #include "umesh/extractSurfaceMesh.h"
+#include "hayStack/PartitionSerializer.h"
+#include <functional>
+#include <sys/stat.h>
 
 namespace hs {
   namespace loader {
@@ -12,10 +15,103 @@ namespace hs {
         fileSize(getFileSize(fileName))
     {}
 
+    /*! size and modification time of the umesh a split was made
+        from; UMeshPartContent::save() appends this to the domains
+        file */
+    struct SourceStamp {
+      uint64_t size  = 0;
+      int64_t  mtime = 0;
+    };
+
+    static SourceStamp stampOf(const std::string &fileName)
+    {
+      SourceStamp stamp;
+      struct stat st;
+      if (stat(fileName.c_str(),&st) == 0) {
+        stamp.size  = uint64_t(st.st_size);
+        stamp.mtime = int64_t(st.st_mtime);
+      }
+      return stamp;
+    }
+
+    /*! whether given domains file holds a split into numParts that
+        got made from the current version of given source umesh */
+    static bool isUpToDateSplit(const std::string &domainsFileName,
+                                int numParts,
+                                const std::string &sourceFileName)
+    {
+      std::ifstream in(domainsFileName.c_str(),std::ios::binary);
+      if (!in.good()) return false;
+      size_t numDomains = 0, numRanges = 0;
+      in.read((char*)&numDomains,sizeof(numDomains));
+      if (!in.good() || numDomains != size_t(numParts)) return false;
+      in.seekg(numDomains*sizeof(box3f),std::ios::cur);
+      in.read((char*)&numRanges,sizeof(numRanges));
+      if (!in.good() || numRanges != numDomains) return false;
+      in.seekg(numRanges*sizeof(range1f),std::ios::cur);
+      SourceStamp stamp;
+      in.read((char*)&stamp,sizeof(stamp));
+      const SourceStamp current = stampOf(sourceFileName);
+      return in.good()
+        && stamp.size  == current.size
+        && stamp.mtime == current.mtime;
+    }
+
     void UMeshContent::create(DataLoader *loader,
-                              const std::string &dataURL)
+                              const ResourceSpecifier &dataURL)
     {
-      loader->addContent(new UMeshContent(/* this is a plain filename for umesh:*/dataURL));
+      const int numParts = dataURL.numParts;
+      if (numParts == 1) {
+        loader->addContent(new UMeshContent(dataURL.where));
+        return;
+      }
+      if (!dataURL.has("cache")) {
+        auto source = std::make_shared<UMeshPartContent::Source>();
+        for (int i=0;i<numParts;i++)
+          loader->addContent(new UMeshPartContent(dataURL.where,i,numParts,source));
+        return;
+      }
+
+      std::string base = dataURL.get("cache");
+      if (base.empty()) {
+        base = dataURL.where;
+        if (endsWith(base,".umesh"))
+          base = base.substr(0,base.size()-strlen(".umesh"));
+        base += "-n"+std::to_string(numParts);
+      }
+      // rank 0 splits (if there's no usable split from a previous
+      // run yet), everybody else waits for it, then all load the
+      // parts like any other spatially partitioned umesh
+      hs::mpi::Comm &comm = loader->workers;
+      int ok = 1;
+      if (comm.rank == 0) {
+        try {
+          const std::string domainsFileName = base+".domains";
+          if (isUpToDateSplit(domainsFileName,numParts,dataURL.where)) {
+            std::cout << "#hs.umesh: re-using split from " << domainsFileName << std::endl;
+          } else {
+            std::cout << "#hs.umesh: splitting " << dataURL.where << " into "
+                      << numParts << " parts, and saving those as "
+                      << base << "_*.umesh" << std::endl;
+            umesh::UMesh::SP mesh = umesh::UMesh::loadFrom(dataURL.where);
+            UMeshPartContent::save(UMeshPartContent::split(mesh,numParts),base,
+                                   dataURL.where);
+          }
+        } catch (const std::exception &e) {
+          std::cerr << MINI_TERMINAL_RED << "#hs.umesh: could not split '"
+                    << dataURL.where << "': " << e.what()
+                    << MINI_TERMINAL_DEFAULT << std::endl;
+          ok = 0;
+        }
+      }
+      if (comm.size > 1) {
+        if (comm.rank == 0) comm.bc_send(&ok,sizeof(ok));
+        else                comm.bc_recv(&ok,sizeof(ok));
+      }
+      if (!ok)
+        throw std::runtime_error("could not split umesh '"+dataURL.where+"'");
+      SpatiallyPartitionedUMeshContent::create(loader,ResourceSpecifier("spumesh://"+base),
+                                               /*withSurfaceMesh*/true);
     }
     
     std::string UMeshContent::toString() 
@@ -37,7 +133,12 @@ namespace hs {
       mesh->wedges.clear();
 #endif
       dataRank.unsts.push_back({mesh,box3f()});
+      addSurfaceMesh(dataRank,mesh);
+    }
 
+    void UMeshContent::addSurfaceMesh(OnePartition &dataRank,
+                                      umesh::UMesh::SP mesh)
+    {
       if (1 && (mesh->triangles.size() || mesh->quads.size())) {
         std::cout << "#hs: umesh seems to have surface triangles - extracting those." << std::endl;
         umesh::UMesh::SP extracted = umesh::extractSurfaceMesh(mesh);
@@ -66,27 +167,349 @@ namespace hs {
   
 
   
+    UMeshPartContent::UMeshPartContent(const std::string &fileName,
+                                       int thisPartID,
+                                       int numParts,
+                                       std::shared_ptr<Source> source)
+      : fileName(fileName),
+        fileSize(getFileSize(fileName)),
+        thisPartID(thisPartID),
+        numParts(numParts),
+        source(source)
+    {}
+
+    std::string UMeshPartContent::toString()
+    {
+      return "UMeshPart{fileName="+fileName+", part "+std::to_string(thisPartID)
+        +" of "+std::to_string(numParts)+", proj size "
+        +prettyNumber(projectedSize())+"B}";
+    }
+
+    size_t UMeshPartContent::projectedSize()
+    { return 2 * fileSize / numParts; }
+
+    void UMeshPartContent::distribute(hs::mpi::Comm &workers, bool loadedHere)
+    {
+      // (the first of this file's parts to get here does the split)
+      if (!source->isSplit) {
+        source->isSplit = true;
+        int ok = 1;
+        if (workers.rank == 0) {
+          try {
+            std::cout << "#hs.umesh: splitting " << fileName << " into "
+                      << numParts << " parts" << std::endl;
+            source->parts = split(umesh::UMesh::loadFrom(fileName),numParts);
+          } catch (const std::exception &e) {
+            std::cerr << MINI_TERMINAL_RED << "#hs.umesh: could not split '"
+                      << fileName << "': " << e.what()
+                      << MINI_TERMINAL_DEFAULT << std::endl;
+            ok = 0;
+          }
+        }
+        if (!workers.allReduceMin(ok))
+          throw std::runtime_error("could not split umesh '"+fileName+"'");
+      }
+      // rank 0 sends to everybody else that loads this part
+      hs::mpi::Comm group = workers.split((workers.rank == 0 || loadedHere) ? 0 : 1);
+      if (workers.rank == 0) {
+        auto &part = source->parts[thisPartID];
+        if (group.size > 1) {
+          OnePartition onlyThisPart(thisPartID,numParts);
+          onlyThisPart.unsts.push_back(part);
+          std::vector<uint8_t> bytes = PartitionSerializer::serialize(onlyThisPart);
+          uint64_t numBytes = bytes.size();
+          group.bc_send(&numBytes,sizeof(numBytes));
+          group.bc_send(bytes.data(),numBytes);
+        }
+        if (loadedHere)
+          received = part;
+        part = {};
+      } else if (loadedHere) {
+        uint64_t numBytes = 0;
+        group.bc_recv(&numBytes,sizeof(numBytes));
+        std::vector<uint8_t> bytes(numBytes);
+        group.bc_recv(bytes.data(),numBytes);
+        OnePartition onlyThisPart(thisPartID,numParts);
+        PartitionSerializer::deserialize(bytes,onlyThisPart);
+        received = onlyThisPart.unsts[0];
+      }
+      group.free();
+    }
+    
+    void UMeshPartContent::executeLoad(OnePartition &dataRank)
+    {
+      std::pair<umesh::UMesh::SP,box3f> part = received;
+      received = {};
+      if (!part.first)
+        // not distribute()d to this rank - split it here
+        part = split(umesh::UMesh::loadFrom(fileName),numParts,thisPartID)[thisPartID];
+      std::cout << "#hs.umesh: part #" << thisPartID << " of " << fileName
+                << ": " << part.first->toString() << std::endl;
+      dataRank.unsts.push_back(part);
+      UMeshContent::addSurfaceMesh(dataRank,part.first);
+    }
+
+    std::vector<std::pair<umesh::UMesh::SP,box3f>>
+    UMeshPartContent::split(umesh::UMesh::SP mesh, int numParts, int onlyPart)
+    {
+      const vec3f *vertices = (const vec3f *)mesh->vertices.data();
+
+      // bounds of all volumetric cells, in order tets, pyrs, wedges,
+      // hexes, polyhedra
+      std::vector<box3f> cellBounds;
+      auto addCells = [&](const auto &prims) {
+        for (auto &prim : prims) {
+          box3f bb;
+          for (int i=0;i<prim.numVertices;i++)
+            bb.extend(vertices[prim[i]]);
+          cellBounds.push_back(bb);
+        }
+      };
+      /*! calls lambda(pos) for every vertex index in given polyhedron's
+          face stream (which is numFaces, then numVerts,verts... for
+          each face) */
+      auto forEachPolyVertex = [&](int polyID, const auto &lambda) {
+        int pos = mesh->polyOffsets[polyID];
+        int numFaces = mesh->polyFaceStream[pos++];
+        for (int f=0;f<numFaces;f++) {
+          int numVerts = mesh->polyFaceStream[pos++];
+          for (int v=0;v<numVerts;v++)
+            lambda(pos++);
+        }
+      };
+      const int beginPyrs   = (int)mesh->tets.size();
+      const int beginWedges = beginPyrs   + (int)mesh->pyrs.size();
+      const int beginHexes  = beginWedges + (int)mesh->wedges.size();
+      const int beginPolys  = beginHexes  + (int)mesh->hexes.size();
+      addCells(mesh->tets);
+      addCells(mesh->pyrs);
+      addCells(mesh->wedges);
+      addCells(mesh->hexes);
+      for (int i=0;i<(int)mesh->polyOffsets.size();i++) {
+        box3f bb;
+        forEachPolyVertex(i,[&](int pos)
+                          { bb.extend(vertices[mesh->polyFaceStream[pos]]); });
+        cellBounds.push_back(bb);
+      }
+      const int numCells = (int)cellBounds.size();
+
+      // kd-tree over the cell centroids, with numParts leaves
+      struct Node {
+        int   dim = -1;
+        float pos;
+        int   child[2];
+        int   partID;
+      };
+      std::vector<Node>  nodes;
+      std::vector<box3f> domains(numParts);
+      std::vector<vec3f> centroids(numCells);
+      std::vector<int>   order(numCells);
+      box3f meshBounds;
+      for (int i=0;i<numCells;i++) {
+        centroids[i] = cellBounds[i].center();
+        order[i] = i;
+        meshBounds.extend(cellBounds[i]);
+      }
+      std::function<int(int,int,int,int,box3f)> build
+        = [&](int begin, int end, int firstPart, int numParts, box3f region)
+      {
+        int nodeID = (int)nodes.size();
+        nodes.push_back(Node());
+        if (numParts == 1) {
+          nodes[nodeID].partID = firstPart;
+          domains[firstPart] = region;
+          return nodeID;
+        }
+        const int numLeft = numParts/2;
+        const int mid = begin + int((end-begin)*size_t(numLeft)/numParts);
+        box3f centroidBounds;
+        for (int i=begin;i<end;i++)
+          centroidBounds.extend(centroids[order[i]]);
+        int dim;
+        float pos;
+        if (end-begin >= 2 && reduce_max(centroidBounds.size()) > 0.f) {
+          dim = arg_max(centroidBounds.size());
+          std::nth_element(order.begin()+begin,order.begin()+mid,order.begin()+end,
+                           [&](int a, int b)
+                           { return centroids[a][dim] < centroids[b][dim]; });
+          pos = centroids[order[mid]][dim];
+        } else {
+          // too few cells left to split - split the region in the
+          // middle, so every part still gets a (possibly empty) domain
+          dim = arg_max(region.size());
+          pos = region.center()[dim];
+        }
+        box3f lRegion = region, rRegion = region;
+        lRegion.upper[dim] = pos;
+        rRegion.lower[dim] = pos;
+        nodes[nodeID].dim = dim;
+        nodes[nodeID].pos = pos;
+        int l = build(begin,mid,firstPart,numLeft,lRegion);
+        int r = build(mid,end,firstPart+numLeft,numParts-numLeft,rRegion);
+        nodes[nodeID].child[0] = l;
+        nodes[nodeID].child[1] = r;
+        return nodeID;
+      };
+      build(0,numCells,0,numParts,meshBounds);
+
+      // every cell goes to every part whose domain it overlaps
+      std::vector<std::vector<int>> cellsOf(numParts);
+      std::function<void(int,int)> assign = [&](int nodeID, int cellID)
+      {
+        const Node &node = nodes[nodeID];
+        if (node.dim < 0) {
+          if (onlyPart < 0 || onlyPart == node.partID)
+            cellsOf[node.partID].push_back(cellID);
+          return;
+        }
+        // (cells that only touch a split plane don't overlap the
+        // other side; flat ones lying right in it go right)
+        const box3f &bb = cellBounds[cellID];
+        if (bb.lower[node.dim] < node.pos)
+          assign(node.child[0],cellID);
+        if (bb.upper[node.dim] > node.pos || bb.lower[node.dim] == node.pos)
+          assign(node.child[1],cellID);
+      };
+      for (int i=0;i<numCells;i++)
+        assign(0,i);
+      // ... while surface elements just go where their centroid is
+      auto partOf = [&](const vec3f &p) {
+        int nodeID = 0;
+        while (nodes[nodeID].dim >= 0)
+          nodeID = nodes[nodeID].child[p[nodes[nodeID].dim] >= nodes[nodeID].pos];
+        return nodes[nodeID].partID;
+      };
+
+      std::vector<std::pair<umesh::UMesh::SP,box3f>> parts(numParts);
+      std::vector<int> vertexID(mesh->vertices.size());
+      for (int partID=0;partID<numParts;partID++) {
+        parts[partID].second = domains[partID];
+        if (onlyPart >= 0 && partID != onlyPart)
+          continue;
+        umesh::UMesh::SP part = std::make_shared<umesh::UMesh>();
+        if (mesh->perVertex)
+          part->perVertex = std::make_shared<umesh::Attribute>();
+        std::fill(vertexID.begin(),vertexID.end(),-1);
+        auto remap = [&](int v) {
+          int &id = vertexID[v];
+          if (id < 0) {
+            id = (int)part->vertices.size();
+            part->vertices.push_back(mesh->vertices[v]);
+            if (mesh->perVertex)
+              part->perVertex->values.push_back(mesh->perVertex->values[v]);
+          }
+          return id;
+        };
+        auto copyCell = [&](auto prim, auto &into) {
+          for (int i=0;i<prim.numVertices;i++)
+            prim[i] = remap(prim[i]);
+          into.push_back(prim);
+        };
+        for (int cellID : cellsOf[partID]) {
+          if (cellID < beginPyrs)
+            copyCell(mesh->tets[cellID],part->tets);
+          else if (cellID < beginWedges)
+            copyCell(mesh->pyrs[cellID-beginPyrs],part->pyrs);
+          else if (cellID < beginHexes)
+            copyCell(mesh->wedges[cellID-beginWedges],part->wedges);
+          else if (cellID < beginPolys)
+            copyCell(mesh->hexes[cellID-beginHexes],part->hexes);
+          else {
+            const int polyID = cellID-beginPolys;
+            const int streamBegin = (int)part->polyFaceStream.size();
+            part->polyOffsets.push_back(streamBegin);
+            int end = polyID+1 < (int)mesh->polyOffsets.size()
+              ? mesh->polyOffsets[polyID+1]
+              : (int)mesh->polyFaceStream.size();
+            part->polyFaceStream.insert(part->polyFaceStream.end(),
+                                        mesh->polyFaceStream.begin()+mesh->polyOffsets[polyID],
+                                        mesh->polyFaceStream.begin()+end);
+            forEachPolyVertex(polyID,[&](int pos) {
+              int ofs = streamBegin + (pos-mesh->polyOffsets[polyID]);
+              part->polyFaceStream[ofs] = remap(mesh->polyFaceStream[pos]);
+            });
+          }
+        }
+        for (auto tri : mesh->triangles) {
+          vec3f c = (vertices[tri.x]+vertices[tri.y]+vertices[tri.z])*(1.f/3.f);
+          if (partOf(c) != partID) continue;
+          tri.x = remap(tri.x); tri.y = remap(tri.y); tri.z = remap(tri.z);
+          part->triangles.push_back(tri);
+        }
+        for (auto quad : mesh->quads) {
+          vec3f c = (vertices[quad.x]+vertices[quad.y]
+                     +vertices[quad.z]+vertices[quad.w])*.25f;
+          if (partOf(c) != partID) continue;
+          quad.x = remap(quad.x); quad.y = remap(quad.y);
+          quad.z = remap(quad.z); quad.w = remap(quad.w);
+          part->quads.push_back(quad);
+        }
+        part->finalize();
+        parts[partID].first = part;
+      }
+      return parts;
+    }
+
+    void UMeshPartContent::save(const std::vector<std::pair<umesh::UMesh::SP,box3f>> &parts,
+                                const std::string &base,
+                                const std::string &sourceFileName)
+    {
+      std::vector<box3f>   domains;
+      std::vector<range1f> valueRanges;
+      for (int i=0;i<(int)parts.size();i++) {
+        char suffix[100];
+        snprintf(suffix,sizeof(suffix),"_%05i",i);
+        std::string partFileName = base+suffix+".umesh";
+        std::cout << "#hs.umesh: saving part #" << i << " ("
+                  << parts[i].first->toString() << ") to "
+                  << partFileName << std::endl;
+        parts[i].first->saveTo(partFileName);
+        domains.push_back(parts[i].second);
+        umesh::range1f valueRange = parts[i].first->getValueRange();
+        valueRanges.push_back((const range1f &)valueRange);
+      }
+      // same layout SpatiallyPartitionedUMeshContent::create() reads,
+      // plus the source's stamp at the end
+      const std::string domainsFileName = base+".domains";
+      std::ofstream out(domainsFileName.c_str(),std::ios::binary);
+      size_t numDomains = domains.size();
+      out.write((const char*)&numDomains,sizeof(numDomains));
+      out.write((const char*)domains.data(),domains.size()*sizeof(domains[0]));
+      out.write((const char*)&numDomains,sizeof(numDomains));
+      out.write((const char*)valueRanges.data(),valueRanges.size()*sizeof(valueRanges[0]));
+      const SourceStamp stamp = stampOf(sourceFileName);
+      out.write((const char*)&stamp,sizeof(stamp));
+      if (!out.good())
+        throw std::runtime_error("could not write '"+domainsFileName+"'");
+    }
+
     SpatiallyPartitionedUMeshContent
     ::SpatiallyPartitionedUMeshContent(const std::string umeshFileName,
-                                       const box3f &domain)
+                                       const box3f &domain,
+                                       bool withSurfaceMesh)
       : fileName(umeshFileName),
         fileSize(getFileSize(umeshFileName)),
-        domain(domain)
+        domain(domain),
+        withSurfaceMesh(withSurfaceMesh)
     {}
     
     void SpatiallyPartitionedUMeshContent::create(DataLoader *loader,
-                                                  const ResourceSpecifier &dataURL)
+                                                  const ResourceSpecifier &dataURL,
+                                                  bool withSurfaceMesh)
     {
       const std::string domainsFileName = dataURL.where+".domains";
       size_t domainsFileSize = getFileSize(domainsFileName.c_str());
-      int numParts = (domainsFileSize - 2*sizeof(size_t)) / (sizeof(box3f)+sizeof(range1f));
-      std::vector<box3f> domains(numParts);
-      std::vector<range1f> valueRanges(numParts);
       std::ifstream in(domainsFileName.c_str(),std::ios::binary);
-      size_t numDomains;
+      size_t numDomains = 0;
       in.read((char*)&numDomains,sizeof(numDomains));
-      if (numParts != numDomains)
+      // (files that UMeshPartContent::save() wrote have the source's
+      // stamp after the value ranges)
+      if (!in.good() ||
+          numDomains*(sizeof(box3f)+sizeof(range1f))+2*sizeof(size_t) > domainsFileSize)
         throw std::runtime_error("fishy results from reading domains");
+      int numParts = (int)numDomains;
+      std::vector<box3f> domains(numParts);
+      std::vector<range1f> valueRanges(numParts);
       std::cout << "#hs.spumesh: reading " << numParts << " domains" << std::endl;
       in.read((char*)domains.data(),domains.size()*sizeof(domains[0]));
 
@@ -100,7 +523,8 @@ namespace hs {
         char suffix[100];
         snprintf(suffix,sizeof(suffix),"_%05i",i);
         std::string partFileName = dataURL.where+suffix+".umesh";
-        loader->addContent(new SpatiallyPartitionedUMeshContent(partFileName,domains[i]));
+        loader->addContent(new SpatiallyPartitionedUMeshContent(partFileName,domains[i],
+                                                                withSurfaceMesh));
 
         // umesh::UMesh::SP mesh = umesh::UMesh::loadFrom(partFileName);
         // loader->dataRanks.unsts.push_back({mesh,domains[i]});
@@ -119,7 +543,10 @@ namespace hs {
     
     void SpatiallyPartitionedUMeshContent::executeLoad(OnePartition &dataRank) 
     {
-      dataRank.unsts.push_back({umesh::UMesh::loadFrom(fileName),domain});
+      umesh::UMesh::SP mesh = umesh::UMesh::loadFrom(fileName);
+      dataRank.unsts.push_back({mesh,domain});
+      if (withSurfaceMesh)
+        UMeshContent::addSurfaceMesh(dataRank,mesh);
     }
 
   }  
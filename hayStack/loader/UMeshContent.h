@@ -9,25 +9,94 @@
 namespace hs {
   namespace loader {
 
-    /*! a 'umesh' file of unstructured mesh data */
+    /*! a 'umesh' file of unstructured mesh data. with 'N@file.umesh'
+        this gets split into N spatial parts at load time (see
+        UMeshPartContent); and with ':cache[=base]', that split gets
+        done once (on rank 0), and written out as a '<base>.domains'
+        file plus '<base>_%05i.umesh' part files, so later runs (and
+        spumesh://<base>) can load those parts directly. */
     struct UMeshContent : public LoadableContent {
       UMeshContent(const std::string &fileName);
       static void create(DataLoader *loader,
-                         const std::string &dataURL);
+                         const ResourceSpecifier &dataURL);
       std::string toString() override;
       size_t projectedSize() override;
       void   executeLoad(OnePartition &dataGroup) override;
 
+      /*! if the mesh has surface triangles/quads, also add those to
+          the data group, as a semi-transparent mini mesh */
+      static void addSurfaceMesh(OnePartition &dataGroup,
+                                 umesh::UMesh::SP mesh);
+
+      const std::string fileName;
+      const size_t      fileSize;
+    };
+
+    /*! one of N spatial parts of a single umesh file, which gets
+        computed at load time: the cell centroids get split into N
+        regions with a kd-tree, and each part gets all the cells
+        whose bounding box overlaps its region (with vertices
+        duplicated as required), plus that region as its domain.
+
+        only rank 0 loads (and splits) the full mesh, in
+        distribute(), and sends each part to the rank(s) that load
+        it; a part that gets loaded anywhere else later on (eg,
+        after rebalancing) has to load and split the mesh itself */
+    struct UMeshPartContent : public LoadableContent {
+      /*! the parts of one umesh file, shared by all of its
+          UMeshPartContents; only ever filled on rank 0, and each
+          part gets released once it's been sent */
+      struct Source {
+        /*! whether distribute() has (tried to) split the file yet */
+        bool isSplit = false;
+        std::vector<std::pair<umesh::UMesh::SP,box3f>> parts;
+      };
+      
+      UMeshPartContent(const std::string &fileName,
+                       int thisPartID,
+                       int numParts,
+                       std::shared_ptr<Source> source);
+      std::string toString() override;
+      size_t      projectedSize() override;
+      void        executeLoad(OnePartition &dataGroup) override;
+      void        distribute(hs::mpi::Comm &workers, bool loadedHere) override;
+
+      /*! split given mesh into numParts (mesh,domain) pairs. if
+          onlyPart is >= 0, only that part's mesh gets extracted (the
+          others' are null) */
+      static std::vector<std::pair<umesh::UMesh::SP,box3f>>
+      split(umesh::UMesh::SP mesh, int numParts, int onlyPart=-1);
+
+      /*! write given parts as '<base>.domains' plus one
+          '<base>_%05i.umesh' per part, in the format that
+          SpatiallyPartitionedUMeshContent reads; the domains file
+          also gets the size and modification time of the umesh the
+          parts got split from, so a later ':cache' can tell if it's
+          still up to date */
+      static void save(const std::vector<std::pair<umesh::UMesh::SP,box3f>> &parts,
+                       const std::string &base,
+                       const std::string &sourceFileName);
+
       const std::string fileName;
       const size_t      fileSize;
+      const int         thisPartID;
+      const int         numParts;
+      std::shared_ptr<Source> source;
+      /*! this part, as received in distribute() */
+      std::pair<umesh::UMesh::SP,box3f> received;
     };
 
-    /*! a 'umesh' file of unstructured mesh data */
+    /*! a 'umesh' file of unstructured mesh data. with
+        withSurfaceMesh (as for the parts that 'N@...:cache' wrote)
+        its surface triangles/quads also get added, the same way
+        UMeshPartContent does */
     struct SpatiallyPartitionedUMeshContent : public LoadableContent {
       SpatiallyPartitionedUMeshContent(const std::string umeshFileName,
-                                       const box3f &domain);
+                                       const box3f &domain,
+                                       bool withSurfaceMesh=false);
       static void create(DataLoader *loader,
-                         const ResourceSpecifier &dataURL);
+                         const ResourceSpecifier &dataURL,
+                         bool withSurfaceMesh=false);
       std::string toString() override;
       size_t      projectedSize() override;
       void        executeLoad(OnePartition &dataGroup) override;
@@ -35,6 +104,7 @@ namespace hs {
       const std::string fileName;
       const size_t      fileSize;
       const box3f       domain;
+      const bool        withSurfaceMesh;
     };
 
   }
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+/*! checks that splitting a nanovdb grid into N parts (the way the
+    'nvdb://' loader does) actually gives per-part grids that scale
+    with 1/N: builds a synthetic fog volume (a ball with a constant
+    core - which the builder stores as tiles - and a varying shell
+    around it), splits it into 1,2,4,... parts, and fails if the
+    parts' average size is more than '--tolerance' times the full grid
+    size over N (i.e., if all parts together hold more than that many
+    full grids; the apron and leaves cut by the split planes get
+    duplicated, so that can never be exactly 1). also spot-checks that
+    each part returns the same values as the full grid within its
+    region */
+
+#include "hayStack/loader/NVDBVolumeContent.h"
+#include <cstdlib>
+
+using namespace hs;
+using namespace hs::loader;
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+  }
+}
+
+void usage(const std::string &error = "")
+{
+  if (!error.empty())
+    std::cerr << "Error: " << error << "\n\n";
+  std::cout << "Usage: ./hsCheckNVDBSplit [--res N] [--max-parts N] [--tolerance t]\n";
+  exit(error.empty() ? 0 : 1);
+}
+
+nanovdb::GridHandle<> makeSyntheticGrid(int res)
+{
+  nanovdb::tools::build::Grid<float> grid(0.f,"synthetic",nanovdb::GridClass::FogVolume);
+  const float center = .5f*res;
+  const float radius = .45f*res;
+  const float core   = .3f*res;
+  grid([&](const nanovdb::Coord &ijk) {
+    const vec3f d = vec3f(ijk[0]+.5f,ijk[1]+.5f,ijk[2]+.5f) - center;
+    const float r = length(d);
+    if (r > radius) return 0.f;
+    if (r < core) return 1.f;
+    return (radius-r)/(radius-core) * (.75f+.25f*sinf(.3f*ijk[0])*cosf(.2f*ijk[1]));
+  }, nanovdb::CoordBBox(nanovdb::Coord(0),nanovdb::Coord(res-1)));
+  return nanovdb::tools::createNanoGrid(grid);
+}
+
+int main(int ac, char **av)
+{
+  int   res       = 512;
+  int   maxParts  = 16;
+  float tolerance = 1.5f;
+  for (int i=1;i<ac;i++) {
+    const std::string arg = av[i];
+    if (arg == "--res")
+      res = std::stoi(av[++i]);
+    else if (arg == "--max-parts")
+      maxParts = std::stoi(av[++i]);
+    else if (arg == "--tolerance")
+      tolerance = std::stof(av[++i]);
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else
+      usage("unknown cmdline arg '"+arg+"'");
+  }
+
+  nanovdb::GridHandle<> full = makeSyntheticGrid(res);
+  const nanovdb::NanoGrid<float> *grid = full.grid<float>();
+  const nanovdb::CoordBBox ib = grid->indexBBox();
+  const box3i domain(vec3i(ib[0][0],ib[0][1],ib[0][2]),
+                     vec3i(ib[1][0],ib[1][1],ib[1][2]));
+  std::cout << "#hs.nvdb: synthetic " << res << "^3 grid, "
+            << prettyNumber(full.size()) << "B" << std::endl;
+
+  bool ok = true;
+  for (int numParts=1;numParts<=maxParts;numParts*=2) {
+    std::vector<box3i> regions;
+    NVDBVolumeContent::splitKDTree(regions,domain,numParts);
+    size_t maxSize = 0, sumSize = 0;
+    int numMismatches = 0;
+    for (auto region : regions) {
+      region.lower = region.lower - vec3i(1);
+      region.upper = region.upper + vec3i(1);
+      nanovdb::GridHandle<> part
+        = NVDBVolumeContent::extractSubGrid(*grid,region);
+      maxSize = std::max(maxSize,part.size());
+      sumSize += part.size();
+
+      auto fullAcc = grid->getAccessor();
+      auto partAcc = part.grid<float>()->getAccessor();
+      const vec3i size = region.size() + 1;
+      for (int i=0;i<1000;i++) {
+        const vec3i ijk = region.lower
+          + vec3i(rand()%size.x,rand()%size.y,rand()%size.z);
+        const nanovdb::Coord c(ijk.x,ijk.y,ijk.z);
+        if (fullAcc.getValue(c) != partAcc.getValue(c))
+          ++numMismatches;
+      }
+    }
+    if (numMismatches) {
+      std::cout << "#hs.nvdb: " << numParts << " parts: " << numMismatches
+                << " sampled voxels differ from the full grid  <-- FAILED"
+                << std::endl;
+      ok = false;
+    }
+    const double ratio = double(sumSize)/full.size();
+    const bool partOK = ratio <= tolerance;
+    std::cout << "#hs.nvdb: " << numParts << " parts: largest "
+              << prettyNumber(maxSize) << "B, all parts "
+              << prettyNumber(sumSize) << "B; average*N/full = "
+              << ratio << (partOK ? "" : "  <-- FAILED") << std::endl;
+    ok = ok && partOK;
+  }
+  std::cout << (ok ? "#hs.nvdb: OK" : "#hs.nvdb: per-part size does NOT scale with 1/N")
+            << std::endl;
+  return ok ? 0 : 1;
+}
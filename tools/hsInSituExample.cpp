@@ -0,0 +1,193 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+/*! example 'simulation' that renders itself in situ through
+    hm::InSituAdaptor: every rank computes one brick of a synthetic,
+    time-varying scalar field (a few gaussian blobs orbiting the
+    domain's center) plus a set of tracer particles riding along with
+    those blobs, and hands both to hayStack each time step - without
+    any file I/O. prints where each step's time went */
+
+#include "hayMaker/InSituAdaptor.h"
+#include <cmath>
+
+using namespace hs;
+using namespace hs::loader;
+
+void usage(const std::string &error = "")
+{
+  if (!error.empty())
+    std::cerr << "Error: " << error << "\n\n";
+  std::cout << "Usage: [mpirun -n N] ./hsInSituExample [-n brickSize] [--steps N] [--particles N] [-res w h] [-spp N]\n"
+            << "  every rank computes a brickSize^3 brick of a field that is numRanks bricks tall\n";
+  exit(error.empty() ? 0 : 1);
+}
+
+/*! our 'simulation': a few blobs orbiting the (global) domain's
+    center, in a grid of brickSize^2 x (numRanks*brickSize) cells */
+struct Simulation {
+  Simulation(int brickSize, int rank, int numRanks, int numParticles)
+    : brickSize(brickSize),
+      // one more voxel layer than cells in z, shared with the brick
+      // above, so bricks meet without seams
+      dims(brickSize,brickSize,brickSize+1),
+      origin(0.f,0.f,float(rank*brickSize)),
+      domainSize(float(brickSize-1),float(brickSize-1),float(numRanks*brickSize)),
+      voxels(size_t(dims.x)*dims.y*dims.z),
+      particles(numParticles),
+      seed(rank)
+  {}
+
+  vec3f blobCenter(int blobID, float t) const
+  {
+    float angle = t + blobID*2.f*float(M_PI)/numBlobs;
+    vec3f center = .5f*domainSize;
+    return center + vec3f(.3f*domainSize.x*cosf(angle),
+                          .3f*domainSize.y*sinf(angle),
+                          .35f*domainSize.z*sinf(.5f*angle+blobID));
+  }
+
+  void step(float t)
+  {
+    const float sigma = .15f*std::min(domainSize.x,domainSize.y);
+    vec3f centers[numBlobs];
+    for (int b=0;b<numBlobs;b++)
+      centers[b] = blobCenter(b,t);
+    for (int iz=0;iz<dims.z;iz++)
+      for (int iy=0;iy<dims.y;iy++)
+        for (int ix=0;ix<dims.x;ix++) {
+          vec3f pos = origin+vec3f(ix,iy,iz);
+          float value = 0.f;
+          for (int b=0;b<numBlobs;b++) {
+            vec3f d = pos - centers[b];
+            value += expf(-dot(d,d)/(2.f*sigma*sigma));
+          }
+          voxels[ix+size_t(dims.x)*(iy+size_t(dims.y)*iz)]
+            = std::min(1.f,value);
+        }
+    // tracers: scattered around 'their' blob, in this rank's brick
+    for (int i=0;i<(int)particles.size();i++) {
+      vec3f c = blobCenter(i%numBlobs,t);
+      uint32_t h = (i+1)*2654435761u ^ (seed*40503u);
+      vec3f jitter(float((h>> 0)&0x3ff)/1023.f-.5f,
+                   float((h>>10)&0x3ff)/1023.f-.5f,
+                   float((h>>20)&0x3ff)/1023.f-.5f);
+      vec3f p = c + 2.f*sigma*jitter;
+      p.z = origin.z + fmodf(fabsf(p.z),float(brickSize));
+      particles[i] = p;
+    }
+  }
+
+  static const int numBlobs = 4;
+  const int   brickSize;
+  const vec3i dims;
+  const vec3f origin;
+  const vec3f domainSize;
+  std::vector<float> voxels;
+  std::vector<vec3f> particles;
+  const int   seed;
+};
+
+int main(int ac, char **av)
+{
+  hs::mpi::init(ac,av);
+  {
+#if HS_FAKE_MPI
+    hs::mpi::Comm world;
+#else
+    hs::mpi::Comm world(MPI_COMM_WORLD);
+#endif
+    int   brickSize    = 64;
+    int   numSteps     = 100;
+    int   numParticles = 0;
+    vec2i fbSize(800,600);
+    hm::GlobalRenderSettings renderSettings;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-n")
+        brickSize = std::stoi(av[++i]);
+      else if (arg == "--steps")
+        numSteps = std::stoi(av[++i]);
+      else if (arg == "--particles")
+        numParticles = std::stoi(av[++i]);
+      else if (arg == "-res") {
+        fbSize.x = std::stoi(av[++i]);
+        fbSize.y = std::stoi(av[++i]);
+      } else if (arg == "-spp")
+        renderSettings.samplesPerPixel = std::stoi(av[++i]);
+      else if (arg == "-h" || arg == "--help")
+        usage();
+      else
+        usage("unknown cmdline arg '"+arg+"'");
+    }
+    if (brickSize < 2) usage("brick size has to be at least 2");
+
+    Simulation sim(brickSize,world.rank,world.size,numParticles);
+    hm::InSituAdaptor insitu(world,renderSettings);
+    insitu.resize(fbSize);
+
+    hs::TransferFunction xf;
+    xf.domain = { 0.f, 1.f };
+    xf.colorMap = {
+      vec4f(.1f,.2f,.8f,0.f),
+      vec4f(.2f,.8f,.6f,.2f),
+      vec4f(.9f,.8f,.2f,.6f),
+      vec4f(.9f,.2f,.1f,1.f),
+    };
+    insitu.setTransferFunction(xf);
+
+    const vec3f center = .5f*sim.domainSize;
+    double sum[4] = { 0., 0., 0., 0. };
+    for (int step=0;step<numSteps;step++) {
+      double t0 = getCurrentTime();
+      sim.step(.05f*step);
+      float simTime = world.allReduceMax(float(getCurrentTime()-t0));
+
+      insitu.clearContent();
+      insitu.add(new ExternalStructuredVolume(sim.voxels.data(),sim.dims,"float",
+                                              sim.origin,vec3f(1.f),
+                                              range1f(0.f,1.f)));
+      if (numParticles)
+        insitu.add(new ExternalParticles(sim.particles.data(),
+                                         sim.particles.size(),
+                                         .01f*brickSize));
+      insitu.update();
+
+      // slowly orbit the camera around the whole domain
+      float angle = .01f*step;
+      hs::Camera camera;
+      camera.vi   = center;
+      camera.vp   = center + 1.2f*length(sim.domainSize)
+        * vec3f(cosf(angle),sinf(angle),.4f);
+      camera.vu   = vec3f(0.f,0.f,1.f);
+      camera.fovy = 60.f;
+      insitu.render(camera);
+
+      auto &t = insitu.lastTimings;
+      if (world.rank == 0)
+        std::cout << "#hs.insitu: step " << step
+                  << ": simulate " << prettyDouble(simTime) << "s"
+                  << ", ingest "   << prettyDouble(t.ingest) << "s"
+                  << ", build "    << prettyDouble(t.build) << "s"
+                  << ", render "   << prettyDouble(t.render) << "s"
+                  << std::endl;
+      // the first step also creates the renderer; leave it out
+      if (step == 0) continue;
+      sum[0] += simTime;
+      sum[1] += t.ingest;
+      sum[2] += t.build;
+      sum[3] += t.render;
+    }
+    if (world.rank == 0 && numSteps > 1) {
+      int n = numSteps-1;
+      std::cout << "#hs.insitu: average per step (w/o first): simulate "
+                << prettyDouble(sum[0]/n) << "s, ingest "
+                << prettyDouble(sum[1]/n) << "s, build "
+                << prettyDouble(sum[2]/n) << "s, render "
+                << prettyDouble(sum[3]/n) << "s" << std::endl;
+    }
+    world.barrier();
+  }
+  hs::mpi::finalize();
+  return 0;
+}
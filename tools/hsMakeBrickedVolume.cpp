@@ -0,0 +1,311 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+/*! converts a RAW volume (anything the 'raw://' loader can read, as
+    long as it is single-channel) into hayStack's native bricked
+    '.hsbv' format (see hayStack/loader/BrickedVolumeContent.h). the
+    input gets streamed in slabs of one brick layer each; only the
+    (1/8th size) level-1 volume gets kept in memory. with '--bench' it
+    instead compares load times of RAW vs bricked file for N parts */
+
+#include "hayStack/loader/RAWVolumeContent.h"
+#include "hayStack/loader/BrickedVolumeContent.h"
+#include <functional>
+#include <cstring>
+
+using namespace hs;
+using namespace hs::loader;
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+  }
+}
+
+typedef BrickedVolumeFile::Header    Header;
+typedef BrickedVolumeFile::LevelInfo LevelInfo;
+
+void usage(const std::string &error = "")
+{
+  if (!error.empty())
+    std::cerr << "Error: " << error << "\n\n";
+  std::cout << "Usage: ./hsMakeBrickedVolume <raw-url> -o <out.hsbv> [--brick-size N] [--levels N]\n"
+            << "   or: ./hsMakeBrickedVolume --bench <raw-url> <file.hsbv> [-n numParts] [--level L]\n"
+            << "  e.g. ./hsMakeBrickedVolume raw://file.raw:format=uint8:dims=512,512,512 -o file.hsbv\n";
+  exit(error.empty() ? 0 : 1);
+}
+
+template<typename T> inline float normalized(T v);
+template<> inline float normalized(uint8_t v)  { return v*(1.f/255.f); }
+template<> inline float normalized(uint16_t v) { return v*(1.f/((1<<16)-1)); }
+template<> inline float normalized(float v)    { return v; }
+
+template<typename T> inline T average(const float sum)
+{ return T(sum*(1.f/8.f)+(std::is_integral<T>::value ? .5f : 0.f)); }
+
+template<typename T>
+struct Converter {
+  /*! returns pointer to numSlices full z-slices of the current
+      level's voxels, starting at slice z0 */
+  typedef std::function<const T *(int z0, int numSlices)> GetSlices;
+
+  Converter(std::ofstream &out,
+            const Header &header,
+            const std::vector<LevelInfo> &levels)
+    : out(out), header(header), levels(levels)
+  {}
+
+  /*! write given level's ranges and bricks; and if 'next' is
+      non-null, box-filter it down into the next level */
+  void writeLevel(int levelID, const GetSlices &getSlices, std::vector<T> *next)
+  {
+    const LevelInfo &level = levels[levelID];
+    const vec3i dims = level.dims;
+    const int B = header.brickSize;
+    const size_t brickVoxels = size_t(B+1)*(B+1)*(B+1);
+    std::vector<vec3i> order = BrickedVolumeFile::mortonOrder(level.numBricks);
+    std::vector<size_t> filePos(order.size());
+    for (size_t i=0;i<order.size();i++)
+      filePos[order[i].x+level.numBricks.x*(order[i].y+size_t(level.numBricks.y)*order[i].z)] = i;
+
+    vec3i nextDims = BrickedVolumeFile::nextLevelDims(dims);
+    if (next)
+      next->resize(nextDims.x*size_t(nextDims.y)*nextDims.z);
+
+    std::vector<range1f> ranges(order.size());
+    std::vector<T> brick(brickVoxels);
+    for (int bz=0;bz<level.numBricks.z;bz++) {
+      const int z0 = bz*B;
+      const int z1 = std::min(z0+B,dims.z-1);
+      const T *slab = getSlices(z0,z1-z0+1);
+      auto voxel = [&](int x, int y, int z) {
+        x = std::min(x,dims.x-1);
+        y = std::min(y,dims.y-1);
+        z = std::min(z,z1);
+        return slab[x+dims.x*(y+size_t(dims.y)*(z-z0))];
+      };
+      for (int by=0;by<level.numBricks.y;by++)
+        for (int bx=0;bx<level.numBricks.x;bx++) {
+          const size_t brickID
+            = bx+level.numBricks.x*(by+size_t(level.numBricks.y)*bz);
+          range1f &range = ranges[filePos[brickID]];
+          T *dst = brick.data();
+          for (int iz=0;iz<=B;iz++)
+            for (int iy=0;iy<=B;iy++)
+              for (int ix=0;ix<=B;ix++) {
+                *dst = voxel(bx*B+ix,by*B+iy,z0+iz);
+                range.extend(normalized(*dst));
+                dst++;
+              }
+          out.seekp(level.bricksOffset+filePos[brickID]*brickVoxels*sizeof(T));
+          out.write((const char *)brick.data(),brickVoxels*sizeof(T));
+        }
+      if (!next) continue;
+      // next-level slices whose (lower) input slice is in this
+      // layer; the last layer also does the ones past the end (the
+      // next level's cells round up)
+      const bool lastLayer = (bz == level.numBricks.z-1);
+      for (int nz=(z0+1)/2;nz<nextDims.z && (lastLayer || 2*nz<z0+B);nz++)
+        for (int ny=0;ny<nextDims.y;ny++)
+          for (int nx=0;nx<nextDims.x;nx++) {
+            float sum = 0.f;
+            for (int dz=0;dz<2;dz++)
+              for (int dy=0;dy<2;dy++)
+                for (int dx=0;dx<2;dx++)
+                  sum += voxel(2*nx+dx,2*ny+dy,2*nz+dz);
+            (*next)[nx+nextDims.x*(ny+size_t(nextDims.y)*nz)] = average<T>(sum);
+          }
+    }
+    out.seekp(level.rangesOffset);
+    out.write((const char *)ranges.data(),ranges.size()*sizeof(range1f));
+    std::cout << "#hs: wrote level " << levelID << ": " << dims << " voxels, "
+              << order.size() << " bricks" << std::endl;
+  }
+
+  void run(const std::string &rawFileName)
+  {
+    std::ifstream in(rawFileName.c_str(),std::ios::binary);
+    if (!in.good())
+      throw std::runtime_error("could not open '"+rawFileName+"'");
+    const vec3i dims = levels[0].dims;
+    std::vector<T> slab;
+    std::vector<T> current, next;
+    writeLevel(0,[&](int z0, int numSlices) {
+      const size_t sliceSize = dims.x*size_t(dims.y);
+      slab.resize(numSlices*sliceSize);
+      in.seekg(z0*sliceSize*sizeof(T));
+      in.read((char *)slab.data(),slab.size()*sizeof(T));
+      if (!in.good())
+        throw std::runtime_error("error reading from '"+rawFileName+"'");
+      return slab.data();
+    },levels.size() > 1 ? &next : nullptr);
+    for (int levelID=1;levelID<levels.size();levelID++) {
+      current = std::move(next);
+      const vec3i levelDims = levels[levelID].dims;
+      writeLevel(levelID,[&](int z0, int numSlices) {
+        return current.data()+z0*size_t(levelDims.x)*levelDims.y;
+      },levelID+1 < levels.size() ? &next : nullptr);
+    }
+  }
+
+  std::ofstream &out;
+  const Header &header;
+  const std::vector<LevelInfo> &levels;
+};
+
+/*! all pieces of content that given url creates, as given type */
+template<typename ContentT>
+std::vector<ContentT *> createContent(const std::string &url)
+{
+  hs::mpi::Comm comm;
+  DynamicDataLoader loader(comm);
+  loader.addContent(url);
+  std::vector<ContentT *> contents;
+  for (auto &c : loader.allContent)
+    contents.push_back(dynamic_cast<ContentT *>(std::get<2>(c)));
+  return contents;
+}
+
+void bench(const std::string &rawURL, const std::string &hsbvFileName,
+           int numParts, int level)
+{
+  auto withParts = [&](std::string url) {
+    for (auto prefix : { "raw://", "bricked://" })
+      if (startsWith(url,prefix))
+        return prefix+std::to_string(numParts)+"@"+url.substr(strlen(prefix));
+    return std::to_string(numParts)+"@"+url;
+  };
+  auto timeLoads = [&](const std::string &url) {
+    std::cout << "#hs.bench: loading " << url << std::endl;
+    double sumTime = 0.;
+    size_t sumBytes = 0;
+    for (auto content : createContent<LoadableContent>(url)) {
+      OnePartition dataGroup(0,1);
+      double t0 = getCurrentTime();
+      content->executeLoad(dataGroup);
+      sumTime  += getCurrentTime()-t0;
+      sumBytes += content->projectedSize();
+    }
+    std::cout << "#hs.bench:   " << prettyNumber(sumBytes) << "B in "
+              << prettyDouble(sumTime) << "s ("
+              << prettyNumber(size_t(sumBytes/std::max(sumTime,1e-6))) << "B/s)" << std::endl;
+    return sumTime;
+  };
+  double tRaw     = timeLoads(withParts(rawURL));
+  double tBricked = timeLoads(withParts("bricked://"+hsbvFileName));
+  std::cout << "#hs.bench: bricked vs raw, full res: "
+            << prettyDouble(tRaw/std::max(tBricked,1e-6)) << "x" << std::endl;
+  if (level > 0) {
+    double tPreview
+      = timeLoads(withParts("bricked://"+hsbvFileName+":level="+std::to_string(level)));
+    std::cout << "#hs.bench: level " << level << " preview vs raw: "
+              << prettyDouble(tRaw/std::max(tPreview,1e-6)) << "x" << std::endl;
+  }
+  std::cout << "#hs.bench: (note these are warm-cache numbers unless the page cache"
+            << " got dropped between runs)" << std::endl;
+}
+
+int main(int ac, char **av)
+{
+  std::string inURL, outFileName, benchFileName;
+  int brickSize = 32;
+  int numLevels = 0;
+  int numParts  = 1;
+  int benchLevel = 0;
+  for (int i=1;i<ac;i++) {
+    const std::string arg = av[i];
+    if (arg == "-o")
+      outFileName = av[++i];
+    else if (arg == "--brick-size")
+      brickSize = std::stoi(av[++i]);
+    else if (arg == "--levels")
+      numLevels = std::stoi(av[++i]);
+    else if (arg == "--bench") {
+      inURL = av[++i];
+      benchFileName = av[++i];
+    } else if (arg == "-n")
+      numParts = std::stoi(av[++i]);
+    else if (arg == "--level")
+      benchLevel = std::stoi(av[++i]);
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else if (arg[0] != '-')
+      inURL = arg;
+    else
+      usage("unknown cmdline arg '"+arg+"'");
+  }
+  if (inURL.empty()) usage("no input specified");
+  if (!benchFileName.empty()) {
+    hs::loader::verbose = true;
+    bench(inURL,benchFileName,numParts,benchLevel);
+    return 0;
+  }
+  if (outFileName.empty()) usage("no output file specified");
+  if (brickSize < 2 || (brickSize & 1)) usage("brick size has to be even");
+
+  // let the raw loader figure out dims and format
+  auto raw = createContent<RAWVolumeContent>(inURL);
+  if (raw.size() != 1 || !raw[0])
+    usage("'"+inURL+"' is not a (single-part) raw volume");
+  if (raw[0]->numChannels != 1)
+    usage("only single-channel volumes are supported");
+  const vec3i dims = raw[0]->fullVolumeDims;
+
+  Header header;
+  header.magic     = BrickedVolumeFile::magic;
+  header.dims      = dims;
+  header.brickSize = brickSize;
+  memset(header.texelFormat,0,sizeof(header.texelFormat));
+  strncpy(header.texelFormat,raw[0]->texelFormat.c_str(),sizeof(header.texelFormat)-1);
+
+  const size_t texelSize = sizeOf(raw[0]->texelFormat);
+  const size_t brickBytes = size_t(brickSize+1)*(brickSize+1)*(brickSize+1)*texelSize;
+  std::vector<LevelInfo> levels;
+  for (vec3i levelDims = dims;;levelDims = BrickedVolumeFile::nextLevelDims(levelDims)) {
+    LevelInfo level;
+    level.dims      = levelDims;
+    level.numBricks = max(vec3i(1),(levelDims-1+brickSize-1)/brickSize);
+    levels.push_back(level);
+    if (numLevels
+        ? (int)levels.size() == numLevels
+        : reduce_max(levelDims-1) <= brickSize)
+      break;
+    if (levelDims == BrickedVolumeFile::nextLevelDims(levelDims))
+      break;
+  }
+  header.numLevels = (int)levels.size();
+  size_t offset = sizeof(Header)+levels.size()*sizeof(LevelInfo);
+  for (auto &level : levels) {
+    const size_t numBricks
+      = level.numBricks.x*size_t(level.numBricks.y)*level.numBricks.z;
+    level.rangesOffset = offset;
+    offset += numBricks*sizeof(range1f);
+    // align bricks to 4k, for direct/aligned reads
+    offset = (offset+4095) & ~size_t(4095);
+    level.bricksOffset = offset;
+    offset += numBricks*brickBytes;
+  }
+
+  std::cout << "#hs: converting " << inURL << " (" << dims << " "
+            << header.texelFormat << ") into " << levels.size()
+            << " levels of " << brickSize << "^3-cell bricks" << std::endl;
+  std::ofstream out(outFileName.c_str(),std::ios::binary);
+  if (!out.good())
+    throw std::runtime_error("could not open '"+outFileName+"' for writing");
+  out.write((const char *)&header,sizeof(header));
+  out.write((const char *)levels.data(),levels.size()*sizeof(LevelInfo));
+
+  const std::string &format = raw[0]->texelFormat;
+  if (format == "uint8_t")
+    Converter<uint8_t>(out,header,levels).run(raw[0]->fileName);
+  else if (format == "uint16_t")
+    Converter<uint16_t>(out,header,levels).run(raw[0]->fileName);
+  else if (format == "float")
+    Converter<float>(out,header,levels).run(raw[0]->fileName);
+  else
+    usage("unsupported texel format '"+format+"'");
+  if (!out.good())
+    throw std::runtime_error("error writing '"+outFileName+"'");
+  std::cout << "#hs: done, wrote " << prettyNumber(offset) << "B" << std::endl;
+  return 0;
+}
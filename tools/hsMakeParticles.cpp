@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+/*! converts any sphere input that the hayStack loader can read
+    ('spheres://file:format=...' or '.vmdspheres') into hayStack's
+    native, chunked '.hsp' particle format (see
+    hayStack/loader/ParticlesContent.h) */
+
+#include "hayStack/loader/SpheresFromFile.h"
+#include "hayStack/loader/ParticlesContent.h"
+
+using namespace hs;
+using namespace hs::loader;
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+  }
+}
+
+void usage(const std::string &error = "")
+{
+  if (!error.empty())
+    std::cerr << "Error: " << error << "\n\n";
+  std::cout << "Usage: ./hsMakeParticles <spheres-url> -o <out.hsp> [--chunk-size N]\n"
+            << "  e.g. ./hsMakeParticles spheres://file.xyz:format=xyz:radius=.1 -o file.hsp\n"
+            << "    or ./hsMakeParticles file.vmdspheres -o file.hsp\n";
+  exit(error.empty() ? 0 : 1);
+}
+
+int main(int ac, char **av)
+{
+  hs::loader::verbose = true;
+  std::string inURL, outFileName;
+  size_t chunkSize = 1<<16;
+  for (int i=1;i<ac;i++) {
+    const std::string arg = av[i];
+    if (arg == "-o")
+      outFileName = av[++i];
+    else if (arg == "--chunk-size")
+      chunkSize = std::stoull(av[++i]);
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else if (arg[0] != '-')
+      inURL = arg;
+    else
+      usage("unknown cmdline arg '"+arg+"'");
+  }
+  if (inURL.empty())    usage("no input specified");
+  if (outFileName.empty()) usage("no output file specified");
+
+  if (endsWith(inURL,".vmdspheres") && !startsWith(inURL,"vmdspheres://"))
+    inURL = "vmdspheres://"+inURL;
+  ResourceSpecifier url(inURL);
+  if (url.numParts != 1)
+    usage("'N@' makes no sense for conversion");
+
+  LoadableContent *content = nullptr;
+  if (url.type == "spheres")
+    content = new SpheresFromFile(url,0,DataLoader::defaultRadius);
+  else if (url.type == "vmdspheres")
+    content = new VMDSpheres(url,0);
+  else
+    usage("unsupported input type '"+url.type+"'");
+
+  std::cout << "#hs: loading " << content->toString() << std::endl;
+  OnePartition dataGroup(0,1);
+  content->executeLoad(dataGroup);
+  if (dataGroup.sphereSets.size() != 1)
+    throw std::runtime_error("expected exactly one sphere set from input");
+  SphereSet::SP spheres = dataGroup.sphereSets[0];
+
+  std::cout << "#hs: writing " << prettyNumber(spheres->origins.size())
+            << " particles to " << outFileName << std::endl;
+  ParticleFile::write(outFileName,spheres,chunkSize);
+
+  ParticleFile::Header header;
+  std::vector<ParticleFile::ChunkInfo> chunks;
+  ParticleFile::readHeader(outFileName,header,chunks);
+  std::cout << "#hs: done; " << chunks.size() << " chunks"
+            << (header.flags & ParticleFile::HAS_COLORS ? ", with colors" : "")
+            << (header.flags & ParticleFile::HAS_RADII  ? ", with radii" : "")
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+/*! pre-partitions content offline: loads the given content into the
+    given number of data groups - exactly like the viewer would, but
+    without any renderer - and writes one PartitionSnapshot per data
+    group, so a later 'hsViewer ... -ndg N --snapshot-dir <dir>' can
+    start from those. runs on any number of ranks; every rank loads
+    ceil(ndg/numRanks) of the groups */
+
+#include "hayStack/loader/DataLoader.h"
+
+using namespace hs;
+using namespace hs::loader;
+
+namespace hs {
+  namespace loader {
+    extern bool verbose;
+  }
+}
+
+void usage(const std::string &error = "")
+{
+  if (!error.empty())
+    std::cerr << "Error: " << error << "\n\n";
+  std::cout << "Usage: [mpirun -n N] ./hsMakeSnapshot <content>... -ndg N -o <dir> [--default-radius r] [-v]\n"
+            << "  e.g. mpirun -n 4 ./hsMakeSnapshot lander.umesh -ndg 16 -o /scratch/snapshots\n";
+  exit(error.empty() ? 0 : 1);
+}
+
+int main(int ac, char **av)
+{
+  hs::mpi::init(ac,av);
+  {
+#if HS_FAKE_MPI
+    hs::mpi::Comm world;
+#else
+    hs::mpi::Comm world(MPI_COMM_WORLD);
+#endif
+    std::vector<std::string> content;
+    std::string outDir;
+    int numDataGroups = 0;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-o")
+        outDir = av[++i];
+      else if (arg == "-ndg")
+        numDataGroups = std::stoi(av[++i]);
+      else if (arg == "--default-radius")
+        DataLoader::defaultRadius = std::stof(av[++i]);
+      else if (arg == "-v" || arg == "--verbose")
+        hs::loader::verbose = true;
+      else if (arg == "-h" || arg == "--help")
+        usage();
+      else if (arg[0] != '-')
+        content.push_back(arg);
+      else
+        usage("unknown cmdline arg '"+arg+"'");
+    }
+    if (content.empty()) usage("no content specified");
+    if (outDir.empty()) usage("no output directory specified");
+    if (numDataGroups < 1) usage("no (valid) number of data groups specified");
+
+    DynamicDataLoader loader(world);
+    loader.snapshotDir = outDir;
+    for (auto &descriptor : content)
+      loader.addContent(descriptor);
+
+    // make sure every group is on some rank; loadData() writes the
+    // snapshots (unless they all are there already)
+    int dataPerRank = (numDataGroups+world.size-1)/world.size;
+    double t0 = getCurrentTime();
+    loader.loadData(numDataGroups,dataPerRank);
+    float seconds = world.allReduceMax(float(getCurrentTime()-t0));
+    if (world.rank == 0)
+      std::cout << "#hs: done with " << numDataGroups << " data group(s) in "
+                << prettyDouble(seconds) << "s" << std::endl;
+    world.barrier();
+  }
+  hs::mpi::finalize();
+  return 0;
+}
@@ -0,0 +1,261 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "viewer/Benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <ctime>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace hm {
+
+  /*! quote and escape given string for use as a json value */
+  static std::string jsonString(const std::string &s)
+  {
+    std::stringstream ss;
+    ss << '"';
+    for (char c : s) {
+      switch (c) {
+      case '"':  ss << "\\\""; break;
+      case '\\': ss << "\\\\"; break;
+      case '\n': ss << "\\n";  break;
+      case '\t': ss << "\\t";  break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char hex[8];
+          snprintf(hex,sizeof(hex),"\\u%04x",c);
+          ss << hex;
+        } else
+          ss << c;
+      }
+    }
+    ss << '"';
+    return ss.str();
+  }
+
+  static std::string jsonNumber(double d)
+  {
+    if (!std::isfinite(d)) return "null";
+    char s[64];
+    snprintf(s,sizeof(s),"%.9g",d);
+    return s;
+  }
+
+  static std::string jsonStats(const Benchmark::Stats &stats)
+  {
+    std::stringstream ss;
+    ss << "{ \"count\": " << stats.count
+       << ", \"min\": "    << jsonNumber(stats.min)
+       << ", \"median\": " << jsonNumber(stats.median)
+       << ", \"p95\": "    << jsonNumber(stats.p95)
+       << ", \"p99\": "    << jsonNumber(stats.p99)
+       << ", \"max\": "    << jsonNumber(stats.max)
+       << ", \"mean\": "   << jsonNumber(stats.mean)
+       << ", \"fps\": "    << jsonNumber(stats.mean > 0. ? 1./stats.mean : 0.)
+       << " }";
+    return ss.str();
+  }
+
+  static std::string jsonVec3f(const vec3f &v)
+  {
+    return "[ "+jsonNumber(v.x)+", "+jsonNumber(v.y)+", "+jsonNumber(v.z)+" ]";
+  }
+
+  Benchmark::Stats Benchmark::Stats::compute(std::vector<double> times)
+  {
+    Stats stats;
+    if (times.empty()) return stats;
+    std::sort(times.begin(),times.end());
+    // nearest-rank percentiles
+    auto percentile = [&](double p) {
+      size_t rank = (size_t)std::ceil(p/100.*times.size());
+      return times[std::min(times.size(),std::max(rank,(size_t)1))-1];
+    };
+    stats.count  = (int)times.size();
+    stats.min    = times.front();
+    stats.max    = times.back();
+    stats.median = percentile(50.);
+    stats.p95    = percentile(95.);
+    stats.p99    = percentile(99.);
+    double sum = 0.;
+    for (auto t : times) sum += t;
+    stats.mean   = sum / times.size();
+    return stats;
+  }
+
+  void Benchmark::addInfo(const std::string &key, const std::string &value)
+  {
+    info.push_back({key,jsonString(value)});
+  }
+
+  void Benchmark::addInfo(const std::string &key, double value)
+  {
+    info.push_back({key,jsonNumber(value)});
+  }
+
+  void Benchmark::addTime(const std::string &key, double seconds)
+  {
+    times.push_back({key,seconds});
+  }
+
+  void Benchmark::captureEnvironment()
+  {
+    const char *prefixes[] = {
+      "BARNEY_", "ANARI_", "AWT_", "HS_", "CUDA_VISIBLE_DEVICES", "OMP_NUM_THREADS"
+    };
+    for (char **env = environ; env && *env; env++) {
+      std::string var = *env;
+      size_t eq = var.find('=');
+      if (eq == var.npos) continue;
+      std::string name = var.substr(0,eq);
+      for (auto prefix : prefixes)
+        if (name.compare(0,strlen(prefix),prefix) == 0) {
+          environment.push_back({name,var.substr(eq+1)});
+          break;
+        }
+    }
+    std::sort(environment.begin(),environment.end());
+  }
+
+  void Benchmark::run(RenderEngineInterface *renderer,
+                      const std::vector<hs::Camera> &cameras)
+  {
+    for (auto &camera : cameras) {
+      renderer->setCamera(camera);
+      renderer->resetAccumulation();
+      for (int i=0;i<config.warmupFrames;i++)
+        renderer->renderFrame();
+
+      beginCamera(camera);
+      double t_begin = getCurrentTime();
+      while ((int)perCamera.back().frameTimes.size() < config.measureFrames) {
+        double t0 = getCurrentTime();
+        renderer->renderFrame();
+        double t1 = getCurrentTime();
+        addFrame(t1-t0,renderer->getLastFrameTimings());
+        if (t1-t_begin >= config.maxSeconds)
+          break;
+      }
+    }
+  }
+
+  void Benchmark::beginCamera(const hs::Camera &camera)
+  {
+    PerCamera pc;
+    pc.camera = camera;
+    perCamera.push_back(pc);
+  }
+  
+  void Benchmark::addFrame(double seconds, const FrameTimings &ft)
+  {
+    if (perCamera.empty())
+      beginCamera(hs::Camera());
+    PerCamera &pc = perCamera.back();
+    pc.frameTimes.push_back(seconds);
+    pc.sumTimings.render += ft.render;
+    pc.sumTimings.map    += ft.map;
+    pc.sumTimings.composite += ft.composite;
+    pc.sumTimings.copy   += ft.copy;
+  }
+
+  void Benchmark::printSummary() const
+  {
+    std::vector<double> all;
+    for (auto &pc : perCamera)
+      all.insert(all.end(),pc.frameTimes.begin(),pc.frameTimes.end());
+    Stats stats = Stats::compute(all);
+    double seconds = stats.mean * stats.count;
+    std::cout << "measure: rendered " << stats.count << " frames in " << seconds
+              << " (" << perCamera.size() << " camera(s)), that is:" << std::endl;
+    std::cout << "FPS " << (stats.mean > 0. ? 1./stats.mean : 0.) << std::endl;
+    std::cout << "frame time (ms): min " << prettyDouble(1000.*stats.min)
+              << " median " << prettyDouble(1000.*stats.median)
+              << " p95 " << prettyDouble(1000.*stats.p95)
+              << " p99 " << prettyDouble(1000.*stats.p99)
+              << " max " << prettyDouble(1000.*stats.max) << std::endl;
+  }
+
+  void Benchmark::writeJSON(const std::string &fileName) const
+  {
+    std::ofstream out(fileName.c_str());
+    if (!out.good())
+      throw std::runtime_error("could not open benchmark report file '"+fileName+"'");
+
+    char hostName[256] = { 0 };
+    gethostname(hostName,sizeof(hostName)-1);
+    char timeStamp[64] = { 0 };
+    time_t now = time(nullptr);
+    strftime(timeStamp,sizeof(timeStamp),"%Y-%m-%dT%H:%M:%S",localtime(&now));
+
+    std::vector<double> all;
+    FrameTimings sumTimings;
+    for (auto &pc : perCamera) {
+      all.insert(all.end(),pc.frameTimes.begin(),pc.frameTimes.end());
+      sumTimings.render += pc.sumTimings.render;
+      sumTimings.map    += pc.sumTimings.map;
+      sumTimings.composite += pc.sumTimings.composite;
+      sumTimings.copy   += pc.sumTimings.copy;
+    }
+    Stats stats = Stats::compute(all);
+    double numFrames = std::max(1,stats.count);
+
+    out << "{" << std::endl;
+    out << "  \"timestamp\": " << jsonString(timeStamp) << "," << std::endl;
+    out << "  \"host\": " << jsonString(hostName) << "," << std::endl;
+
+    out << "  \"config\": { \"warmupFrames\": " << config.warmupFrames
+        << ", \"measureFrames\": " << config.measureFrames
+        << ", \"maxSeconds\": " << jsonNumber(config.maxSeconds)
+        << " }," << std::endl;
+
+    out << "  \"info\": {";
+    for (size_t i=0;i<info.size();i++)
+      out << (i ? "," : "") << std::endl
+          << "    " << jsonString(info[i].first) << ": " << info[i].second;
+    out << std::endl << "  }," << std::endl;
+
+    out << "  \"environment\": {";
+    for (size_t i=0;i<environment.size();i++)
+      out << (i ? "," : "") << std::endl
+          << "    " << jsonString(environment[i].first)
+          << ": " << jsonString(environment[i].second);
+    out << std::endl << "  }," << std::endl;
+
+    out << "  \"times\": {";
+    for (size_t i=0;i<times.size();i++)
+      out << (i ? "," : "") << std::endl
+          << "    " << jsonString(times[i].first)
+          << ": " << jsonNumber(times[i].second);
+    out << std::endl << "  }," << std::endl;
+
+    out << "  \"frameTime\": " << jsonStats(stats) << "," << std::endl;
+    out << "  \"avgBreakdown\": { \"render\": " << jsonNumber(sumTimings.render/numFrames)
+        << ", \"map\": " << jsonNumber(sumTimings.map/numFrames)
+        << ", \"composite\": " << jsonNumber(sumTimings.composite/numFrames)
+        << ", \"copy\": " << jsonNumber(sumTimings.copy/numFrames)
+        << " }," << std::endl;
+
+    out << "  \"cameras\": [";
+    for (size_t i=0;i<perCamera.size();i++) {
+      auto &pc = perCamera[i];
+      out << (i ? "," : "") << std::endl;
+      out << "    { \"vp\": " << jsonVec3f(pc.camera.vp)
+          << ", \"vi\": " << jsonVec3f(pc.camera.vi)
+          << ", \"vu\": " << jsonVec3f(pc.camera.vu)
+          << ", \"fovy\": " << jsonNumber(pc.camera.fovy) << "," << std::endl;
+      out << "      \"frameTime\": " << jsonStats(Stats::compute(pc.frameTimes))
+          << "," << std::endl;
+      out << "      \"frameTimes\": [";
+      for (size_t j=0;j<pc.frameTimes.size();j++)
+        out << (j ? ", " : " ") << jsonNumber(pc.frameTimes[j]);
+      out << " ] }";
+    }
+    out << std::endl << "  ]" << std::endl;
+    out << "}" << std::endl;
+    std::cout << "#hs: benchmark report written to " << fileName << std::endl;
+  }
+
+}
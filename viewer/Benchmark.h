@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayMaker/common.h"
+#include "hayMaker/RenderEngineInterface.h"
+
+namespace hm {
+
+  /*! end-to-end benchmark run: renders a given number of warm-up and
+      measured frames for each of a set of cameras, records every
+      single frame time, and writes the results (plus the settings
+      and environment they were obtained with) as a JSON report, so
+      runs can be compared over time without scraping stdout */
+  struct Benchmark {
+    struct Config {
+      /*! frames rendered (but not recorded) after each camera change */
+      int   warmupFrames  = 2;
+      /*! max frames recorded per camera */
+      int   measureFrames = 100;
+      /*! max seconds recorded per camera */
+      float maxSeconds    = 60.f;
+      /*! where to write the json report to; empty means 'don't' */
+      std::string jsonFileName;
+    };
+
+    /*! order statistics over a set of frame times, in seconds */
+    struct Stats {
+      static Stats compute(std::vector<double> times);
+
+      int    count  = 0;
+      double min    = 0.;
+      double median = 0.;
+      double p95    = 0.;
+      double p99    = 0.;
+      double max    = 0.;
+      double mean   = 0.;
+    };
+
+    struct PerCamera {
+      hs::Camera          camera;
+      std::vector<double> frameTimes;
+      /*! sums of the renderer's own per-frame breakdown */
+      FrameTimings        sumTimings;
+    };
+
+    Benchmark(const Config &config) : config(config) {}
+
+    /*! run the benchmark on given renderer, for each of the given
+        cameras */
+    void run(RenderEngineInterface *renderer,
+             const std::vector<hs::Camera> &cameras);
+
+    /*! for apps that drive the frames themselves (eg, the
+        interactive viewer): start recording frames for given camera,
+        and record one frame that took given time, with the
+        renderer's breakdown for it */
+    void beginCamera(const hs::Camera &camera);
+    void addFrame(double seconds, const FrameTimings &timings);
+
+    /*! record a (string or numeric) property of this run, to be
+        written into the report's 'info' section */
+    void addInfo(const std::string &key, const std::string &value);
+    void addInfo(const std::string &key, double value);
+
+    /*! record given time (in seconds) in the report's 'times'
+        section, such as load or world-build time */
+    void addTime(const std::string &key, double seconds);
+
+    /*! record all env vars that can affect the result (BARNEY_*,
+        ANARI_*, AWT_*, HS_*, CUDA_VISIBLE_DEVICES) */
+    void captureEnvironment();
+
+    void printSummary() const;
+    void writeJSON(const std::string &fileName) const;
+
+    const Config config;
+    std::vector<PerCamera> perCamera;
+    /*! key/value pairs, with values already json-encoded */
+    std::vector<std::pair<std::string,std::string>> info;
+    std::vector<std::pair<std::string,double>>      times;
+    std::vector<std::pair<std::string,std::string>> environment;
+  };
+
+}
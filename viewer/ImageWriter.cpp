@@ -0,0 +1,221 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#include "viewer/ImageWriter.h"
+#include "hayStack/Tracing.h"
+#include "stb/stb_image_write.h"
+
+namespace hm {
+
+  ImageWriter::Format ImageWriter::parseFormat(const std::string &name)
+  {
+    if (name == "png") return PNG;
+    if (name == "ppm") return PPM;
+    if (name == "raw" || name == "rgba") return RAW;
+    if (name == "y4m") return Y4M;
+    throw std::runtime_error("unknown frame format '"+name+"'"
+                             " (should be png, ppm, raw, or y4m)");
+  }
+
+  ImageWriter::ImageWriter(const Config &config, const std::string &baseName)
+    : config(config),
+      baseName(baseName)
+  {
+    // frames come in bottom-up
+    stbi_flip_vertically_on_write(true);
+    if (config.format == Y4M) {
+      y4m.open(fileNameFor(0).c_str(),std::ios::binary);
+      if (!y4m.good())
+        throw std::runtime_error("could not open '"+fileNameFor(0)+"' for writing");
+    }
+    for (int i=0;i<config.numThreads;i++)
+      threads.push_back(std::thread([this](){ encoderThread(); }));
+  }
+
+  ImageWriter::~ImageWriter()
+  {
+    try {
+      finish();
+    } catch (const std::exception &e) {
+      std::cerr << MINI_TERMINAL_RED << "#hs: " << e.what()
+                << MINI_TERMINAL_DEFAULT << std::endl;
+    }
+  }
+
+  std::string ImageWriter::fileNameFor(int frameID) const
+  {
+    if (config.format == Y4M)
+      return baseName+".y4m";
+    char suffix[100];
+    snprintf(suffix,sizeof(suffix),"_frame%05i.%s",frameID,
+             config.format == PNG ? "png" : config.format == PPM ? "ppm" : "rgba");
+    return baseName+suffix;
+  }
+
+  void ImageWriter::write(int frameID, const vec2i &size, const uint32_t *pixels)
+  {
+    Job job;
+    job.frameID = frameID;
+    job.size    = size;
+    job.pixels.assign(pixels,pixels+size.x*size.y);
+
+    if (threads.empty()) {
+      job.sequenceID = nextSequenceID++;
+      encode(job);
+      stats.numFrames++;
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if ((int)queue.size() >= config.maxQueued) {
+      double t0 = getCurrentTime();
+      queueChanged.wait(lock,[&]{ return (int)queue.size() < config.maxQueued; });
+      stats.stallTime += getCurrentTime()-t0;
+    }
+    job.sequenceID = nextSequenceID++;
+    queue.push_back(std::move(job));
+    stats.numFrames++;
+    queueChanged.notify_all();
+  }
+
+  void ImageWriter::finish()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      queueChanged.notify_all();
+    }
+    for (auto &thread : threads)
+      thread.join();
+    threads.clear();
+    if (y4m.is_open())
+      y4m.close();
+    if (!error.empty()) {
+      std::string e = error;
+      error = "";
+      throw std::runtime_error(e);
+    }
+  }
+
+  void ImageWriter::encoderThread()
+  {
+    while (1) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        queueChanged.wait(lock,[&]{ return done || !queue.empty(); });
+        if (queue.empty())
+          return;
+        job = std::move(queue.front());
+        queue.pop_front();
+        queueChanged.notify_all();
+      }
+      try {
+        encode(job);
+      } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error.empty()) error = e.what();
+      }
+    }
+  }
+
+  void ImageWriter::encode(Job &job)
+  {
+    HS_TRACE_SCOPE("encode",fileNameFor(job.frameID));
+    double t0 = getCurrentTime();
+    const int sx = job.size.x;
+    const int sy = job.size.y;
+    const uint8_t *rgba = (const uint8_t *)job.pixels.data();
+    const std::string fileName = fileNameFor(job.frameID);
+    switch (config.format) {
+    case PNG: {
+      if (!stbi_write_png(fileName.c_str(),sx,sy,4,rgba,sx*sizeof(uint32_t)))
+        throw std::runtime_error("could not write '"+fileName+"'");
+    } break;
+    case PPM:
+    case RAW: {
+      const int comps = config.format == PPM ? 3 : 4;
+      std::vector<uint8_t> out(size_t(sx)*sy*comps);
+      // flip to top-row-first, as the file formats expect
+      for (int iy=0;iy<sy;iy++) {
+        const uint8_t *in = rgba + size_t(sy-1-iy)*sx*4;
+        uint8_t *line = out.data() + size_t(iy)*sx*comps;
+        if (comps == 4)
+          memcpy(line,in,sx*4);
+        else
+          for (int ix=0;ix<sx;ix++) {
+            line[3*ix+0] = in[4*ix+0];
+            line[3*ix+1] = in[4*ix+1];
+            line[3*ix+2] = in[4*ix+2];
+          }
+      }
+      std::ofstream file(fileName.c_str(),std::ios::binary);
+      if (config.format == PPM)
+        file << "P6\n" << sx << " " << sy << "\n255\n";
+      file.write((const char *)out.data(),out.size());
+      if (!file.good())
+        throw std::runtime_error("could not write '"+fileName+"'");
+    } break;
+    case Y4M: {
+      // full-range BT.601 rgb->yuv, into three full-res (444) planes
+      const size_t numPixels = size_t(sx)*sy;
+      std::vector<uint8_t> yuv(3*numPixels);
+      uint8_t *Y = yuv.data();
+      uint8_t *U = Y+numPixels;
+      uint8_t *V = U+numPixels;
+      for (int iy=0;iy<sy;iy++) {
+        const uint8_t *in = rgba + size_t(sy-1-iy)*sx*4;
+        for (int ix=0;ix<sx;ix++) {
+          const float r = in[4*ix+0], g = in[4*ix+1], b = in[4*ix+2];
+          const size_t idx = size_t(iy)*sx+ix;
+          Y[idx] = (uint8_t)std::min(255.f,std::max(0.f,
+                     .299f*r+.587f*g+.114f*b+.5f));
+          U[idx] = (uint8_t)std::min(255.f,std::max(0.f,
+                     128.f-.168736f*r-.331264f*g+.5f*b+.5f));
+          V[idx] = (uint8_t)std::min(255.f,std::max(0.f,
+                     128.f+.5f*r-.418688f*g-.081312f*b+.5f));
+        }
+      }
+      writeY4M(job,yuv);
+    } break;
+    }
+    double t1 = getCurrentTime();
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.encodeTime += t1-t0;
+  }
+
+  void ImageWriter::writeY4M(const Job &job, const std::vector<uint8_t> &yuv)
+  {
+    // frames can finish converting out of order, but have to go into
+    // the stream in order - wait for our turn. only the frame whose
+    // turn it is touches the stream, so the writing itself doesn't
+    // need the lock (which write() and the other encoders need)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      y4mTurn.wait(lock,[&]{ return y4mNextSequenceID == job.sequenceID; });
+    }
+    std::string problem;
+    if (job.sequenceID == 0) {
+      y4mSize = job.size;
+      y4m << "YUV4MPEG2 W" << y4mSize.x << " H" << y4mSize.y
+          << " F" << config.framesPerSecond << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+    }
+    if (job.size != y4mSize)
+      problem = "y4m streams cannot change frame size";
+    else {
+      y4m << "FRAME\n";
+      y4m.write((const char *)yuv.data(),yuv.size());
+      if (!y4m.good())
+        problem = "could not write to '"+fileNameFor(0)+"'";
+    }
+    // whatever happened, it's the next frame's turn now
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      y4mNextSequenceID++;
+    }
+    y4mTurn.notify_all();
+    if (!problem.empty())
+      throw std::runtime_error(problem);
+  }
+
+}
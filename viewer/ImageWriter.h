@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: Copyright (c) 2023-2026 Ingo Wald
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include "hayMaker/common.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+
+namespace hm {
+
+  /*! writes out a sequence of rendered frames (such as a camera path)
+      in the background: write() copies the frame into a bounded
+      queue and returns right away, and a small pool of threads does
+      the actual encoding and file i/o, so the next frame can already
+      render while previous ones are still being compressed. frames
+      are expected in the same (bottom-up, rgba8) layout the renderer
+      produces. */
+  struct ImageWriter {
+    typedef enum {
+      /*! one png file per frame (default; smallest, slowest) */
+      PNG,
+      /*! one binary ppm (rgb8) file per frame - no compression */
+      PPM,
+      /*! one headerless rgba8 file per frame, top row first */
+      RAW,
+      /*! all frames in a single YUV4MPEG2 (yuv444) stream, which
+          ffmpeg & co can read directly */
+      Y4M
+    } Format;
+
+    /*! parse format from its cmd-line name (png, ppm, raw, y4m) */
+    static Format parseFormat(const std::string &name);
+
+    struct Config {
+      Format format = PNG;
+      /*! num encoder threads; 0 means 'encode synchronously in
+          write()', which is what we used to do */
+      int numThreads = std::max(1,std::min(4,(int)std::thread::hardware_concurrency()));
+      /*! max num frames waiting to be encoded; once full, write()
+          blocks until an encoder frees up a slot */
+      int maxQueued  = 4;
+      /*! frame rate written into the y4m header */
+      int framesPerSecond = 30;
+    };
+
+    /*! all written files (or the one y4m stream) will be named after
+        baseName */
+    ImageWriter(const Config &config, const std::string &baseName);
+    ~ImageWriter();
+
+    /*! queue given frame for writing; the pixels get copied, so the
+        caller can re-use (or unmap) them right after this returns */
+    void write(int frameID, const vec2i &size, const uint32_t *pixels);
+
+    /*! wait for all queued frames to be written, and shut down the
+        encoder threads. throws if any frame failed to write */
+    void finish();
+
+    /*! name of the file that frame 'frameID' gets written to */
+    std::string fileNameFor(int frameID) const;
+
+    const Config config;
+    const std::string baseName;
+
+    struct {
+      int    numFrames  = 0;
+      /*! total time write() spent blocked on a full queue */
+      double stallTime  = 0.;
+      /*! total time spent encoding & writing, summed over all
+          encoder threads */
+      double encodeTime = 0.;
+    } stats;
+
+  private:
+    struct Job {
+      int                   frameID;
+      /*! position in the sequence - y4m frames have to go into the
+          stream in this order */
+      int                   sequenceID;
+      vec2i                 size;
+      std::vector<uint32_t> pixels;
+    };
+
+    void encoderThread();
+    void encode(Job &job);
+    void writeY4M(const Job &job, const std::vector<uint8_t> &yuv);
+
+    std::vector<std::thread> threads;
+    std::mutex               mutex;
+    std::condition_variable  queueChanged;
+    std::deque<Job>          queue;
+    bool                     done = false;
+    int                      nextSequenceID = 0;
+    /*! first error any encoder ran into, rethrown in finish() */
+    std::string              error;
+
+    /*! single stream that all y4m frames get appended to */
+    std::ofstream            y4m;
+    vec2i                    y4mSize { -1,-1 };
+    int                      y4mNextSequenceID = 0;
+    std::condition_variable  y4mTurn;
+  };
+
+}
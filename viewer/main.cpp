@@ -2,7 +2,15 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "hayMaker/HayMaker.h"
+#include "hayMaker/NativeRenderer.h"
 #include "hayStack/loader/DataLoader.h"
+#include "hayStack/loader/TimeSeries.h"
+#include "hayStack/loader/Rebalancer.h"
+#include "hayStack/loader/ConfigPlanner.h"
+#include "viewer/Benchmark.h"
+#include "viewer/ImageWriter.h"
+#include "hayStack/Tracing.h"
+#include "hayStack/SpatialRedistribution.h"
 #if HS_CUTEE
 # include "cutee/OWLViewer.h"
 # include "cutee/XFEditor.h"
@@ -20,6 +28,7 @@
 #if HS_MPI
 #include <unistd.h>
 #endif
+#include <functional>
 
 namespace hm {
 
@@ -54,25 +63,87 @@ namespace hm {
     int cmID = 0;
     
     bool mergeUnstructuredMeshes = false;
+    /*! after loading, move prims between data groups such that each
+        group covers a compact region of space (see
+        SpatialRedistribution.h); value is num samples per group, 0
+        means 'off' */
+    int redistributeSamples = 0;
+    /*! if > 0, build this many coarser levels for each structured
+        volume, and render from the coarsest of those while the
+        camera is moving; 0 means 'off' */
+    int interactionLevel = 0;
+    /*! seconds without camera change after which we switch back to
+        full resolution */
+    float interactionIdleDelay = .25f;
     vec4f bgColor { NAN, NAN, NAN, NAN };
     float ambientRadiance = .6f;
     std::string xfFileName = "";
     std::string outFileName = "hayStack.png";
     vec2i fbSize = { 800,600 };
     bool createHeadNode = false;
+    /*! max num commands a head node can have in flight to the
+        workers; '0' means 'use $HS_CMD_QUEUE_DEPTH or default' */
+    int  cmdQueueDepth = 0;
     int  numExtraDisplayRanks = 0;
     int  numFramesAccum = 1;
     int  spp            = 1;
     bool verbose = true;
     CmdLineCamera camera;
     std::vector<CmdLineCamera> cameraPath;
+    /*! how (and in how many threads) to write out camera path
+        frames */
+    ImageWriter::Config frameWriter;
     // struct {
     //   vec3f vp0, vp1;
     //   vec3f vi0, vi1;
     //   int numSteps = 0;
     // } cameraPath;
     bool measure = 0;
+    /*! frame counts etc for --measure; also used for the json
+        report if requested */
+    Benchmark::Config bench;
+    /*! name of anari library to load; empty means '$ANARI_LIBRARY
+        if set, else barney' */
+    std::string anariLibrary;
+    /*! composite on our side even if the anari device could */
+    bool hsCompositing = false;
+    /*! screen tiles per rank for sort-first rendering; 0 is off */
+    int sortFirstTilesPerRank = 0;
+    /*! render with the built-in cpu renderer rather than through
+        anari (single rank only) */
+    bool native = false;
     std::string envMapFileName;
+    /*! render into two frames alternately, so the next frame renders
+        while the current one gets read back; off by default, and
+        always off for benchmarks and camera paths, where every
+        image has to be the one of its own camera */
+    bool doubleBuffered = false;
+    /*! if the content is a time series (see TimeSeries.h): which
+        steps to use; count 0 means 'all that exist' */
+    struct {
+      int first = 0;
+      int count = 0;
+    } timeSteps;
+    /*! max host memory (per rank) that current plus prefetched time
+        step may use; 0 means 'whatever the system has available' */
+    size_t prefetchMemoryMB = 0;
+    /*! time steps per second to play back at; 0 means 'as fast as
+        we can' */
+    float playRate = 0.f;
+    /*! whether to move content between data groups based on
+        measured render times (see Rebalancer.h), and when */
+    bool  rebalance = false;
+    float rebalanceThreshold = 1.2f;
+    int   rebalanceWindow = 8;
+    /*! per-rank memory budget; if set, -ndg/-dpr (and content split
+        factors) get picked to fit it if not specified, and checked
+        against it otherwise (see ConfigPlanner.h) */
+    size_t memoryBudgetMB = 0;
+    /*! only print what the planner picks, don't load anything */
+    bool   planOnly = false;
+    /*! use the host memory still available (per rank on the node)
+        as this rank's capacity, see DataLoader::capacity */
+    bool   measureCapacity = false;
   };
   FromCL fromCL;
   
@@ -87,6 +158,9 @@ namespace hm {
     std::cout << "./hs{Offline,Viewer,ViewerQT} ... <args>" << std::endl;
     std::cout << "w/ args:" << std::endl;
     std::cout << "-xf file.xf   ; specify transfer function" << std::endl;
+    std::cout << "tamr://N@file.tamr ; split a TinyAMR model into N parts" << std::endl
+              << "                     (each part still reads the full model while loading," << std::endl
+              << "                     so peak load memory is that of the full model)" << std::endl;
     if (!error.empty())
       throw std::runtime_error("fatal error: " +error);
     exit(0);
@@ -179,6 +253,21 @@ namespace hm {
         break;
       }
 
+      case '>': case '<':
+        if (numTimeSteps > 1) {
+          playing = false;
+          stepTo((timeStep + (key == '>' ? 1 : numTimeSteps-1)) % numTimeSteps);
+        }
+        break;
+      case 'p':
+        if (numTimeSteps > 1) {
+          playing = !playing;
+          playback.begin = mini::common::getCurrentTime();
+          playback.numSteps = 0;
+          std::cout << "#hs.ts: playback " << (playing ? "on" : "off") << std::endl;
+        }
+        break;
+
       case 'T':
         std::cout << "(T) : dumping transfer function" << std::endl;
 #if HS_CUTEE
@@ -200,11 +289,30 @@ namespace hm {
       renderer->resize((const mini::common::vec2i&)newSize,fbPointer);
     }
 
+    void stepTo(int step)
+    {
+      renderer->setTimeStep(step);
+      timeStep = step;
+      accumDirty = true;
+    }
+
     /*! gets called whenever the viewer needs us to re-render out widget */
     void render() override
     {
       double _t0 = mini::common::getCurrentTime();
 
+      if (playing &&
+          (fromCL.playRate <= 0.f ||
+           _t0-playback.lastStep >= 1./fromCL.playRate)) {
+        stepTo((timeStep+1) % numTimeSteps);
+        playback.lastStep = _t0;
+        if (++playback.numSteps % numTimeSteps == 0)
+          std::cout << "#hs.ts: playing at "
+                    << mini::common::prettyDouble
+            (playback.numSteps/(mini::common::getCurrentTime()-playback.begin))
+                    << " steps/s" << std::endl;
+      }
+
       if (xfDirty) {
         renderer->setTransferFunction(xf);
         xfDirty = false;
@@ -219,39 +327,61 @@ namespace hm {
       }
 #endif
 
+      if (interaction.active &&
+          _t0-interaction.lastCameraChange > fromCL.interactionIdleDelay) {
+        renderer->setInteractive(false);
+        interaction.active = false;
+        accumDirty = true;
+        const double t = interaction.lastCameraChange-interaction.begin;
+        if (interaction.numFrames > 1 && t > 0.)
+          std::cout << "#hs: interaction: " << interaction.numFrames
+                    << " frames at coarse level " << fromCL.interactionLevel
+                    << ", " << mini::common::prettyDouble(interaction.numFrames/t)
+                    << "fps" << std::endl;
+      }
+
       if (accumDirty) {
         renderer->resetAccumulation();
         accumDirty = false;
       }
 
       static int numFramesRendered = 0;
-      const int measure_warmup_frames = 2;
-      const int measure_max_frames = 100;
-      const float measure_max_seconds = 60.f;
+      const int measure_warmup_frames = fromCL.bench.warmupFrames;
+      const int measure_max_frames = fromCL.bench.measureFrames;
+      const float measure_max_seconds = fromCL.bench.maxSeconds;
       
       static double measure_t0 = 0.;
       if (numFramesRendered == measure_warmup_frames)
         measure_t0 = mini::common::getCurrentTime();
 
       static double t0 = mini::common::getCurrentTime();
+      const double t_frame = mini::common::getCurrentTime();
       renderer->renderFrame();
       ++numFramesRendered;
+      if (interaction.active)
+        ++interaction.numFrames;
       double t1 = mini::common::getCurrentTime();
 
-      if (fromCL.measure) {
+      if (bench) {
         int numFramesMeasured = numFramesRendered - measure_warmup_frames;
         float numSecondsMeasured
           = (numFramesMeasured < 1)
           ? 0.f
           : float(t1 - measure_t0);
+        if (numFramesMeasured == 1)
+          bench->beginCamera(currentCamera);
+        if (numFramesMeasured >= 1)
+          bench->addFrame(t1-t_frame,renderer->getLastFrameTimings());
 
         if (numFramesMeasured >= measure_max_frames ||
             numSecondsMeasured >= measure_max_seconds) {
-          std::cout << "measure: rendered " << numFramesMeasured << " frames in " << numSecondsMeasured << ", that is:" << std::endl;
-          std::cout << "FPS " << double(numFramesMeasured/numSecondsMeasured) << std::endl;
+          bench->printSummary();
+          if (finishBenchmark)
+            finishBenchmark(*bench);
           screenShot();
           renderer->terminate();
           
+          hs::trace::finish(*world);
           world->barrier();
           hs::mpi::finalize();
           exit(0);
@@ -264,7 +394,8 @@ namespace hm {
       sum_w = 0.8f*sum_w + 1.f;
       float timePerFrame = float(sum_t / sum_w);
       float fps = 1.f/timePerFrame;
-      std::string title = "HayThere ("+mini::common::prettyDouble(fps)+"fps)";
+      std::string title = "HayThere ("+mini::common::prettyDouble(fps)+"fps"
+        +(interaction.active ? ", coarse)" : ")");
       setTitle(title.c_str());
       t0 = t1;
       double _t1 = mini::common::getCurrentTime();
@@ -281,8 +412,42 @@ namespace hm {
          camera.fovy);
       renderer->setCamera(camera);
       accumDirty = true;
+      currentCamera = camera;
+      // frames measured from here on are for a different view
+      if (bench && !bench->perCamera.empty())
+        bench->beginCamera(camera);
+      
+      if (fromCL.interactionLevel > 0) {
+        const double now = mini::common::getCurrentTime();
+        if (!interaction.active) {
+          renderer->setInteractive(true);
+          interaction.active    = true;
+          interaction.begin     = now;
+          interaction.numFrames = 0;
+        }
+        interaction.lastCameraChange = now;
+      }
     }
 
+    /*! tracks whether the user is currently moving the camera (in
+        which case we render from the coarse volume levels), and the
+        frame rate we get while doing so */
+    struct {
+      bool   active = false;
+      double begin = 0.;
+      double lastCameraChange = 0.;
+      int    numFrames = 0;
+    } interaction;
+
+    int  numTimeSteps = 1;
+    int  timeStep = 0;
+    bool playing = false;
+    struct {
+      double begin = 0.;
+      double lastStep = 0.;
+      int    numSteps = 0;
+    } playback;
+
     TransferFunction xf;
     bool xfDirty = true;
 #if HS_USE_MULTI_SCATTERING
@@ -294,6 +459,13 @@ namespace hm {
     RenderEngineInterface *const renderer;
     hs::mpi::Comm *world;
     XFEditor *xfEditor = 0;
+
+    hs::Camera currentCamera;
+    /*! for --measure: records the measured frames, and gets handed
+        to finishBenchmark() (which writes the --bench-json report)
+        once we're done measuring; null if not measuring */
+    Benchmark *bench = nullptr;
+    std::function<void(Benchmark &)> finishBenchmark;
   };
 #endif
 
@@ -339,15 +511,6 @@ namespace hm {
     return mini::common::vec3f(x,y,z);
   }
 
-  size_t computeHashFromString(const char *s)
-  {
-    size_t hash = 0;
-    size_t FNV_PRIME = 0x00000100000001b3ull;
-    for (int i=0;s[i] != 0;i++)
-      hash = hash * FNV_PRIME ^ s[i];
-    return hash;
-  }
-  
   std::vector<int> parseCommaSeparatedListOfInts(std::string s)
   {
     std::vector<std::string> tokens;
@@ -378,20 +541,12 @@ namespace hm {
     localSize = 1;
 # else
     world.barrier();
-    std::vector<char> hostName(10000);
-    gethostname(hostName.data(),hostName.size());
-    size_t hash = computeHashFromString(hostName.data());
-    std::vector<size_t> allHostNames(world.size);
-    MPI_Allgather(&hash,sizeof(hash),MPI_BYTE,
-                  allHostNames.data(),sizeof(hash),MPI_BYTE,
-                  world.comm);
-    localRank = 0;
-    localSize = 0;
-    for (int i=0;i<world.size;i++) {
-      if (allHostNames[i] != hash) continue;
-      localSize++;
-      if (i < world.rank) localRank++;
-    }
+    // (ranks on the same node, as far as MPI's shared-memory
+    // domains go - rather than by host name)
+    mpi::Comm node = world.splitShared();
+    localRank = node.rank;
+    localSize = node.size;
+    node.free();
 
     for (int i=0;i<world.size;i++) {
       world.barrier();
@@ -512,12 +667,43 @@ int main(int ac, char **av)
   }
   world.barrier();
 
-  bool hanari = true;
+  // tracing has to be set up before anything else we might want to
+  // trace (including content discovery during arg parsing), so look
+  // for it ahead of the actual arg parsing
+  std::string traceFileName
+    = getenv("HS_TRACE") ? getenv("HS_TRACE") : "";
+  for (int i=1;i<ac-1;i++)
+    if (std::string(av[i]) == "--trace")
+      traceFileName = av[i+1];
+  hs::trace::init(world,traceFileName);
+
   hs::loader::DynamicDataLoader loader(world);
+  // with snapshots, content discovery gets deferred until we know
+  // whether we need it, so this too has to be known before parsing
+  for (int i=1;i<ac-1;i++)
+    if (std::string(av[i]) == "--snapshot-dir")
+      loader.snapshotDir = av[i+1];
+  // same for which time steps to use, since content gets expanded
+  // to the first of those while parsing
+  for (int i=1;i<ac-2;i++)
+    if (std::string(av[i]) == "--time-steps") {
+      fromCL.timeSteps.first = std::stoi(av[i+1]);
+      fromCL.timeSteps.count = std::stoi(av[i+2]);
+    }
+  std::vector<std::string> contentDescriptors;
   for (int i=1;i<ac;i++) {
     const std::string arg = av[i];
     if (arg[0] != '-') {
-      loader.addContent(arg);
+      if (hs::loader::TimeSeries::isPattern(arg)) {
+        if (fromCL.timeSteps.count == 0)
+          hs::loader::TimeSeries::findSteps(arg,
+                                            fromCL.timeSteps.first,
+                                            fromCL.timeSteps.count);
+        loader.addContent(hs::loader::TimeSeries::expand
+                          (arg,fromCL.timeSteps.first));
+      } else
+        loader.addContent(arg);
+      contentDescriptors.push_back(arg);
     } else if (arg == "--no-bg") {
       fromCL.bgColor = ::mini::common::vec4f(0.f);
     } else if (arg == "--bg-color") {
@@ -549,10 +735,85 @@ int main(int ac, char **av)
       fromCL.mergeUnstructuredMeshes = true;
     } else if (arg == "--no-mum") {
       fromCL.mergeUnstructuredMeshes = false;
+    } else if (arg == "--redistribute") {
+      fromCL.redistributeSamples = 4096;
+    } else if (arg == "--redistribute-samples") {
+      fromCL.redistributeSamples = std::stoi(av[++i]);
+    } else if (arg == "--share-node-memory") {
+      loader.shareNodeMemory = true;
+    } else if (arg == "--load-once") {
+      loader.loadOnceAndBroadcast = true;
+    } else if (arg == "--replicas") {
+      std::string replicas = av[++i];
+      if (replicas == "auto")
+        loader.replicateHeavyGroups = true;
+      else
+        loader.replicasOfGroup = parseCommaSeparatedListOfInts(replicas);
+    } else if (arg == "--capacity") {
+      std::string capacity = av[++i];
+      if (capacity == "mem")
+        fromCL.measureCapacity = true;
+      else
+        loader.capacity = std::stof(capacity);
+    } else if (arg == "--report-node-memory") {
+      loader.reportNodeMemory = true;
+    } else if (arg == "--interaction-level") {
+      fromCL.interactionLevel = std::stoi(av[++i]);
+    } else if (arg == "--interaction-idle-delay") {
+      fromCL.interactionIdleDelay = std::stof(av[++i]);
     } else if (arg == "--default-radius") {
       loader.defaultRadius = std::stof(av[++i]);
     } else if (arg == "--measure") {
       fromCL.measure = true;
+    } else if (arg == "--warmup-frames") {
+      fromCL.bench.warmupFrames = std::stoi(av[++i]);
+    } else if (arg == "--measure-frames") {
+      fromCL.bench.measureFrames = std::stoi(av[++i]);
+    } else if (arg == "--measure-seconds") {
+      fromCL.bench.maxSeconds = std::stof(av[++i]);
+    } else if (arg == "--bench-json") {
+      fromCL.bench.jsonFileName = av[++i];
+      fromCL.measure = true;
+    } else if (arg == "--anari-library") {
+      fromCL.anariLibrary = av[++i];
+    } else if (arg == "--hs-compositing") {
+      fromCL.hsCompositing = true;
+    } else if (arg == "--sort-first") {
+      fromCL.sortFirstTilesPerRank = std::stoi(av[++i]);
+    } else if (arg == "-native" || arg == "--native") {
+      fromCL.native = true;
+    } else if (arg == "-anari" || arg == "--hanari") {
+      fromCL.native = false;
+    } else if (arg == "--frame-format") {
+      fromCL.frameWriter.format = ImageWriter::parseFormat(av[++i]);
+    } else if (arg == "--encode-threads") {
+      fromCL.frameWriter.numThreads = std::max(0,std::stoi(av[++i]));
+    } else if (arg == "--encode-queue") {
+      fromCL.frameWriter.maxQueued = std::max(1,std::stoi(av[++i]));
+    } else if (arg == "--y4m-fps") {
+      fromCL.frameWriter.framesPerSecond = std::stoi(av[++i]);
+    } else if (arg == "--trace" || arg == "--snapshot-dir") {
+      // already handled above
+      ++i;
+    } else if (arg == "--time-steps") {
+      // already handled above
+      i += 2;
+    } else if (arg == "--prefetch-memory") {
+      fromCL.prefetchMemoryMB = std::stoul(av[++i]);
+    } else if (arg == "--play") {
+      fromCL.playRate = std::stof(av[++i]);
+    } else if (arg == "--memory-budget") {
+      fromCL.memoryBudgetMB = std::stoul(av[++i]);
+    } else if (arg == "--plan") {
+      fromCL.planOnly = true;
+    } else if (arg == "--rebalance") {
+      fromCL.rebalance = true;
+    } else if (arg == "--rebalance-threshold") {
+      fromCL.rebalance = true;
+      fromCL.rebalanceThreshold = std::stof(av[++i]);
+    } else if (arg == "--rebalance-window") {
+      fromCL.rebalance = true;
+      fromCL.rebalanceWindow = std::stoi(av[++i]);
     } else if (arg == "-o") {
       fromCL.outFileName = av[++i];
     } else if (arg == "--dir-light") {
@@ -602,6 +863,12 @@ int main(int ac, char **av)
         : DPMODE_DATA_PARALLEL;
     } else if (arg == "-dpr") {
       fromCL.dpr = std::stoi(av[++i]);
+    } else if (arg == "--double-buffer") {
+      fromCL.doubleBuffered = true;
+    } else if (arg == "--single-buffer") {
+      fromCL.doubleBuffered = false;
+    } else if (arg == "--cmd-queue-depth") {
+      fromCL.cmdQueueDepth = std::stoi(av[++i]);
     } else if (arg == "-nhn" || arg == "--no-head-node") {
       fromCL.createHeadNode = false;
     } else if (arg == "-hn" || arg == "-chn" ||
@@ -609,10 +876,6 @@ int main(int ac, char **av)
       fromCL.createHeadNode = true;
     } else if (arg == "-h" || arg == "--help") {
       usage();
-    } else if (arg == "-anari" || arg == "--hanari") {
-      hanari = true;
-    } else if (arg == "-native" || arg == "--native") {
-      hanari = false;
     } else {
       usage("unknown cmd-line argument '"+arg+"'");
     }    
@@ -634,6 +897,55 @@ int main(int ac, char **av)
   const bool isHeadNode = fromCL.createHeadNode && (world.rank == 0);
   hs::mpi::Comm workers = world.split(!isHeadNode);
 
+  if (fromCL.measureCapacity) {
+    hs::mpi::Comm node = world.splitShared();
+    size_t available = hs::loader::availableHostMemory() / node.size;
+    node.free();
+    if (available == 0)
+      throw std::runtime_error("--capacity mem: could not determine available memory");
+    loader.capacity = float(available);
+    std::stringstream ss;
+    ss << "#hs: rank " << world.rank << " has capacity of "
+       << prettyNumber(available) << "B available host memory";
+    std::cout << ss.str() << std::endl;
+  }
+
+  if (fromCL.memoryBudgetMB > 0 || fromCL.planOnly) {
+    if (fromCL.memoryBudgetMB == 0)
+      usage("--plan needs a --memory-budget <MB>");
+    if (fromCL.timeSteps.count > 0 && fromCL.ndg == 0)
+      // (the other steps would not get the same split factors)
+      usage("with --time-steps, -ndg has to be specified; the planner can then only check it");
+    // (on all ranks, as discovery is collective across the loader's)
+    hs::loader::ConfigPlanner planner(loader,fromCL.memoryBudgetMB << 20,
+                                      fromCL.createHeadNode);
+    hs::loader::ConfigPlanner::Plan plan
+      = fromCL.ndg > 0
+      ? planner.evaluate(fromCL.ndg,fromCL.dpr)
+      : planner.plan();
+    planner.report(plan);
+    if (!plan.fits)
+      throw std::runtime_error("the data does not fit into "
+                               +std::to_string(fromCL.memoryBudgetMB)
+                               +"MB per rank with this config - not loading anything");
+    if (fromCL.planOnly) {
+      hs::trace::finish(world);
+      world.barrier();
+      hs::mpi::finalize();
+      exit(0);
+    }
+    fromCL.ndg = plan.ndg;
+    fromCL.dpr = plan.dpr;
+    fromCL.dpMode
+      = (plan.ndg == 1)
+      ? DPMODE_DATA_REPLICATED
+      : DPMODE_DATA_PARALLEL;
+  }
+
+  if (!loader.replicasOfGroup.empty() && fromCL.ndg == 0) {
+    fromCL.ndg = (int)loader.replicasOfGroup.size();
+    fromCL.dpMode = DPMODE_DATA_PARALLEL;
+  }
   if (world.size > 1 && fromCL.dpMode == DPMODE_NOT_SPECIFIED)
     throw std::runtime_error("you're running haystack in MPI mode, and with more than one rank, but didn't specify num data groups (-ndg <n>), or whether you want to run data parallel (-dp|--data-parallel) or data replicated (-dr|--data-replicated). Just to make sure we're not actually running the wrong mode I'll hereby bail out ...");
   
@@ -652,6 +964,7 @@ int main(int ac, char **av)
   //  LocalModel thisRankData;
   LocalPartitions *localPartitions = 0;
   // localPartitions->colorMapIndex = fromCL.cmID;
+  double t_load_begin = getCurrentTime();
   if (!isHeadNode) {
     localPartitions = loader.loadData(numDataGroupsGlobally,dataPerRank);
     // loader.loadData(thisRankData,numDataGroupsGlobally,dataPerRank,verbose());
@@ -661,6 +974,29 @@ int main(int ac, char **av)
     localPartitions->mergeUnstructuredMeshes();
     std::cout << "done mergine umeshes..." << std::endl;
   }
+  if (fromCL.redistributeSamples > 0 && !isHeadNode)
+    hs::redistributeSpatially(workers,*localPartitions,fromCL.redistributeSamples);
+  if (fromCL.interactionLevel > 0 && !isHeadNode) {
+    double t0 = getCurrentTime();
+    size_t fullBytes = 0, pyramidBytes = 0;
+    for (auto part : localPartitions->myPartitions)
+      for (auto vol : part->structuredVolumes) {
+        vol->buildPyramid(fromCL.interactionLevel);
+        fullBytes    += vol->voxelBytes();
+        pyramidBytes += vol->pyramidBytes();
+      }
+    float sumFull    = workers.allReduceAdd(float(fullBytes));
+    float sumPyramid = workers.allReduceAdd(float(pyramidBytes));
+    float maxTime    = workers.allReduceMax(float(getCurrentTime()-t0));
+    if (workers.rank == 0 && sumFull > 0.f)
+      std::cout << "#hs: built " << fromCL.interactionLevel
+                << " coarser volume level(s) in " << prettyDouble(maxTime) << "s; "
+                << prettyNumber(size_t(sumPyramid)) << "B on top of "
+                << prettyNumber(size_t(sumFull)) << "B full-res ("
+                << prettyDouble(100.f*sumPyramid/sumFull) << "% extra)" << std::endl;
+  }
+  // slowest rank is what determines when we can start rendering
+  float loadTime = world.allReduceMax(float(getCurrentTime()-t_load_begin));
   
   int numPartitionsLocally = localPartitions->numPartitionsOnThisRank();
   if (numPartitionsLocally == 0)
@@ -676,20 +1012,40 @@ int main(int ac, char **av)
     deviceConfigs.push_back(dc);
   }
 
+  if (fromCL.doubleBuffered && (fromCL.measure || !fromCL.cameraPath.empty())) {
+    // a double-buffered frame is the one of the previous camera
+    if (world.rank == 0)
+      std::cout << "#hs: not double buffering for benchmarks or camera paths"
+                << std::endl;
+    fromCL.doubleBuffered = false;
+  }
+  
   GlobalRenderSettings globalRenderSettings;
   globalRenderSettings.samplesPerPixel = fromCL.spp;
   globalRenderSettings.ambientRadiance = fromCL.ambientRadiance;
   globalRenderSettings.bgColor = fromCL.bgColor;
   globalRenderSettings.defaultColorMapIndex = fromCL.cmID;
+  globalRenderSettings.doubleBufferedFrames = fromCL.doubleBuffered;
+  globalRenderSettings.anariLibrary = fromCL.anariLibrary;
+  globalRenderSettings.hsCompositing = fromCL.hsCompositing;
+  globalRenderSettings.sortFirstTilesPerRank = fromCL.sortFirstTilesPerRank;
   
-  HayMaker *hayMaker
-    = new HayMaker(// mpi/peers:
-                   world,workers,
-                   globalRenderSettings,
-                   // the parition(s) we have loaded locally on this rank
-                   localPartitions,
-                   
-                   deviceConfigs);
+  double t_init_begin = getCurrentTime();
+  HayMaker       *hayMaker = nullptr;
+  NativeRenderer *native   = nullptr;
+  if (fromCL.native) {
+    if (world.size > 1)
+      throw std::runtime_error("--native only works on a single rank");
+    native = new NativeRenderer(localPartitions,globalRenderSettings);
+  } else
+    hayMaker
+      = new HayMaker(// mpi/peers:
+                     world,workers,
+                     globalRenderSettings,
+                     // the parition(s) we have loaded locally on this rank
+                     localPartitions,
+                     
+                     deviceConfigs);
                    
     // = HayMaker::createAnariImplementation(world,
     //                                       /* the workers */workers,
@@ -699,8 +1055,11 @@ int main(int ac, char **av)
     //                                       thisRankData,
     //                                       gpuIDs,verbose());
   
+  float deviceInitTime
+    = world.allReduceMax(float(getCurrentTime()-t_init_begin));
   world.barrier();
-  const BoundsData worldBounds = hayMaker->getWorldBounds();
+  const BoundsData worldBounds
+    = native ? native->getWorldBounds() : hayMaker->getWorldBounds();
   bool modelHasVolumeData = !worldBounds.scalars.empty();
   
   if (world.rank == 0)
@@ -725,31 +1084,135 @@ int main(int ac, char **av)
     std::cout << MINI_TERMINAL_CYAN
               << "#hs: building data groups"
               << MINI_TERMINAL_DEFAULT << std::endl;
-  if (!isHeadNode)
+  double t_build_begin = getCurrentTime();
+  if (native)
+    native->buildAccels();
+  else if (!isHeadNode)
     hayMaker->renderInitialAnariWorld();
+  float worldBuildTime
+    = world.allReduceMax(float(getCurrentTime()-t_build_begin));
   
+  const int numTimeSteps = std::max(1,fromCL.timeSteps.count);
+  if (numTimeSteps > 1 && !isHeadNode) {
+    if (native)
+      throw std::runtime_error("--native does not work with time series");
+    if (!loader.snapshotDir.empty())
+      throw std::runtime_error("--snapshot-dir does not work with time series");
+    if (fromCL.redistributeSamples > 0)
+      throw std::runtime_error("--redistribute does not work with time series");
+    // (node-shared windows never get freed, so every step would add
+    // another copy of its data)
+    if (loader.shareNodeMemory)
+      throw std::runtime_error("--share-node-memory does not work with time series");
+    auto timeSeries
+      = new hs::loader::TimeSeries(workers,contentDescriptors,
+                                   fromCL.timeSteps.first,numTimeSteps,
+                                   numDataGroupsGlobally,dataPerRank);
+    timeSeries->memoryCap = fromCL.prefetchMemoryMB << 20;
+    timeSeries->mergeUnstructuredMeshes = fromCL.mergeUnstructuredMeshes;
+    timeSeries->pyramidLevels = fromCL.interactionLevel;
+    timeSeries->capacity = loader.capacity;
+    timeSeries->loadOnceAndBroadcast = loader.loadOnceAndBroadcast;
+    timeSeries->replicasOfGroup = localPartitions->replicasOfGroup;
+    hayMaker->timeSeries = timeSeries;
+    timeSeries->prefetch(1,hs::loader::TimeSeries::hostBytes(*localPartitions));
+  }
+  if (fromCL.rebalance && !isHeadNode) {
+    if (numTimeSteps > 1 || fromCL.redistributeSamples > 0)
+      throw std::runtime_error("--rebalance does not work with time series, or --redistribute");
+    if (native)
+      throw std::runtime_error("--rebalance does not work with --native");
+    auto rebalancer
+      = new hs::loader::Rebalancer(workers,loader,localPartitions);
+    rebalancer->threshold = fromCL.rebalanceThreshold;
+    rebalancer->windowFrames = fromCL.rebalanceWindow;
+    rebalancer->mergeUnstructuredMeshes = fromCL.mergeUnstructuredMeshes;
+    rebalancer->pyramidLevels = fromCL.interactionLevel;
+    hayMaker->rebalancer = rebalancer;
+  }
+  if (world.rank == 0 && numTimeSteps > 1)
+    std::cout << "#hs.ts: time series of " << numTimeSteps
+              << " steps, starting at step " << fromCL.timeSteps.first << std::endl;
+
   world.barrier();
 
   RenderEngineInterface *renderer = nullptr;
-  if (world.size == 1)
+  if (native)
+    renderer = native;
+  else if (world.size == 1)
     // no MPI, render direcftly
     renderer = hayMaker;
   else if (world.rank == 0)
     // we're in MPI mode, _and_ the rank that runs the viewer
-    renderer = new MPIRenderEngine(world,hayMaker);
+    renderer = new MPIRenderEngine(world,hayMaker,fromCL.cmdQueueDepth);
   else {
     // we're in MPI mode, but one of the passive workers (ie NOT running the viewer)
     MPIRenderEngine::runWorker(world,hayMaker);
+    hs::trace::finish(world);
     world.barrier();
     hs::mpi::finalize();
 
     exit(0);
   }
 
+  /*! adds everything the --bench-json report records about this run
+      (other than the measured frames) to given benchmark, and writes
+      it out - if asked to. shared by the offline and interactive
+      paths */
+  auto writeBenchReport = [&](Benchmark &bench) {
+    if (fromCL.bench.jsonFileName.empty())
+      return;
+    std::string cmdLine;
+    for (int i=0;i<ac;i++)
+      cmdLine += (i ? " " : "") + std::string(av[i]);
+    bench.addInfo("commandLine",cmdLine);
+    bench.addInfo("numRanks",world.size);
+    bench.addInfo("ndg",numDataGroupsGlobally);
+    bench.addInfo("dpr",dataPerRank);
+    bench.addInfo("headNode",fromCL.createHeadNode ? "yes" : "no");
+    bench.addInfo("numDevicesOnMaster",deviceConfigs.size());
+    bench.addInfo("fbSize",
+                  std::to_string(fromCL.fbSize.x)+"x"+std::to_string(fromCL.fbSize.y));
+    bench.addInfo("spp",fromCL.spp);
+    bench.addInfo("doubleBuffered",fromCL.doubleBuffered ? "yes" : "no");
+    bench.addInfo("engine",native ? "native" : "anari");
+    if (native) {
+      bench.addInfo("numThreads",native->numThreads);
+    } else {
+      bench.addInfo("anariLibrary",
+                    !fromCL.anariLibrary.empty()
+                    ? fromCL.anariLibrary
+                    : (getenv("ANARI_LIBRARY") ? "environment" : "barney"));
+      if (hayMaker) {
+        bench.addInfo("compositing",
+                      hayMaker->sortFirst
+                      ? "sortFirst"
+                      : (hayMaker->ownCompositing ? "hayStack" : "device"));
+        if (hayMaker->sortFirst)
+          bench.addInfo("numTiles",hayMaker->tileScheduler->numTiles);
+      }
+    }
+    bench.addTime("load",loadTime);
+    bench.addTime("deviceInit",deviceInitTime);
+    bench.addTime("worldBuild",worldBuildTime);
+    bench.captureEnvironment();
+    bench.writeJSON(fromCL.bench.jsonFileName);
+  };
+
 #if HS_CUTEE
   // QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
   QApplication app(ac,av);
   Viewer viewer(renderer,&world);
+  Benchmark viewerBench(fromCL.bench);
+  if (fromCL.measure) {
+    viewer.bench = &viewerBench;
+    viewer.finishBenchmark = [&](Benchmark &bench) {
+      bench.addInfo("mode","interactive");
+      writeBenchReport(bench);
+    };
+  }
+  viewer.numTimeSteps = numTimeSteps;
+  viewer.playing      = numTimeSteps > 1 && fromCL.playRate > 0.f;
 
   viewer.show();
   viewer.enableFlyMode();
@@ -803,8 +1266,22 @@ int main(int ac, char **av)
 #else
 
   auto &fbSize = fromCL.fbSize;
-  std::vector<uint32_t> pixels(fbSize.x*fbSize.y);
-  renderer->resize((const mini::common::vec2i&)fbSize,pixels.data());
+  // no host framebuffer: we write out directly from the renderer's
+  // mapped frame, rather than having it copy into one first
+  renderer->resize((const mini::common::vec2i&)fbSize,nullptr);
+  /*! the pixels to write out, or null - with an error - if the
+      renderer doesn't have a frame on this rank (eg, a head node
+      that doesn't render itself); in which case we skip the write
+      rather than write out garbage */
+  auto framePixels = [&]() -> const uint32_t * {
+    const uint32_t *mapped = renderer->getMappedFrame();
+    if (!mapped)
+      std::cerr << MINI_TERMINAL_RED
+                << "#hs: renderer did not provide a frame on this rank"
+                << " - not writing any image"
+                << MINI_TERMINAL_DEFAULT << std::endl;
+    return mapped;
+  };
 
   hs::Camera camera;
   camera.vp = fromCL.camera.vp;
@@ -820,8 +1297,127 @@ int main(int ac, char **av)
     renderer->resetAccumulation();
   }
 
+  if (fromCL.measure) {
+    Benchmark bench(fromCL.bench);
+    std::vector<hs::Camera> cameras;
+    for (auto c : fromCL.cameraPath)
+      cameras.push_back({ c.vp, c.vi, c.vu, c.fovy });
+    if (cameras.empty())
+      cameras.push_back(camera);
+    // time to first image, from start of loading - which is what
+    // eg, bricked or preview-level volume files are meant to cut
+    renderer->renderFrame();
+    double firstImageTime = getCurrentTime()-t_load_begin;
+    NativeRenderer::Stats statsBefore;
+    if (native)
+      statsBefore = native->stats;
+    bench.run(renderer,cameras);
+    bench.printSummary();
+    double raysPerSecond = 0., samplesPerSecond = 0.;
+    if (native) {
+      const double time
+        = std::max(1e-6,native->stats.renderTime-statsBefore.renderTime);
+      raysPerSecond
+        = (native->stats.numRays-statsBefore.numRays)/time;
+      samplesPerSecond
+        = (native->stats.numSamples-statsBefore.numSamples)/time;
+      std::cout << "#hs.native: " << native->numThreads << " thread(s), "
+                << prettyNumber(size_t(raysPerSecond)) << " rays/s, "
+                << prettyNumber(size_t(samplesPerSecond)) << " samples/s"
+                << std::endl;
+    }
+    double interactiveFPS = 0.;
+    if (fromCL.interactionLevel > 0) {
+      // same frames again, but the way they'd get rendered while
+      // the camera is moving
+      renderer->setInteractive(true);
+      renderer->resetAccumulation();
+      for (int i=0;i<fromCL.bench.warmupFrames;i++)
+        renderer->renderFrame();
+      double t0 = getCurrentTime();
+      for (int i=0;i<fromCL.bench.measureFrames;i++)
+        renderer->renderFrame();
+      interactiveFPS
+        = fromCL.bench.measureFrames/std::max(1e-6,getCurrentTime()-t0);
+      std::cout << "#hs: interactive (coarse level " << fromCL.interactionLevel
+                << "): " << prettyDouble(interactiveFPS) << "fps" << std::endl;
+      renderer->setInteractive(false);
+      renderer->resetAccumulation();
+      renderer->renderFrame();
+    }
+    
+    if (native) {
+      bench.addInfo("raysPerSecond",raysPerSecond);
+      bench.addInfo("samplesPerSecond",samplesPerSecond);
+    }
+    bench.addTime("firstImage",firstImageTime);
+    if (fromCL.interactionLevel > 0) {
+      bench.addInfo("interactionLevel",fromCL.interactionLevel);
+      bench.addInfo("interactiveFPS",interactiveFPS);
+    }
+    writeBenchReport(bench);
+    
+    if (const uint32_t *fb = framePixels()) {
+      stbi_flip_vertically_on_write(true);
+      std::cout << "saving in " << fromCL.outFileName.c_str() << std::endl;
+      stbi_write_png(fromCL.outFileName.c_str(),fbSize.x,fbSize.y,4,
+                     fb,fbSize.x*sizeof(uint32_t));
+    }
+    
+    renderer->terminate();
+    hs::trace::finish(world);
+    world.barrier();
+    hs::mpi::finalize();
+    exit(0);
+  }
+  
+  if (numTimeSteps > 1) {
+    std::cout << "rendering time series" << std::endl;
+    ImageWriter writer(fromCL.frameWriter,fromCL.outFileName);
+    double t_series_begin = getCurrentTime();
+    double t_switching = 0., t_switching_max = 0.;
+    for (int step=0;step<numTimeSteps;step++) {
+      double t0 = getCurrentTime();
+      renderer->setTimeStep(step);
+      renderer->resetAccumulation();
+      double t1 = getCurrentTime();
+      if (step > 0) {
+        t_switching += t1-t0;
+        t_switching_max = std::max(t_switching_max,t1-t0);
+      }
+      for (int i=0;i<fromCL.numFramesAccum;i++) 
+        renderer->renderFrame();
+      if (const uint32_t *fb = framePixels())
+        writer.write(step,fbSize,fb);
+      // pace the playback if asked to; steps that take longer than
+      // that just play slower
+      if (fromCL.playRate > 0.f) {
+        double due = t_series_begin+(step+1)/fromCL.playRate;
+        double now = getCurrentTime();
+        if (now < due)
+          std::this_thread::sleep_for
+            (std::chrono::microseconds(int64_t(1e6*(due-now))));
+      }
+    }
+    writer.finish();
+    double t_series = getCurrentTime()-t_series_begin;
+    std::cout << "#hs.ts: " << numTimeSteps << " time steps in "
+              << prettyDouble(t_series) << "s, that is "
+              << prettyDouble(numTimeSteps/t_series) << " steps/s; step-to-step latency "
+              << prettyDouble(t_switching/(numTimeSteps-1)) << "s avg, "
+              << prettyDouble(t_switching_max) << "s max" << std::endl;
+    renderer->terminate();
+    hs::trace::finish(world);
+    world.barrier();
+    hs::mpi::finalize();
+    exit(0);
+  }
+
   if (!fromCL.cameraPath.empty()) {
     std::cout << "rendering camera path sequence" << std::endl;
+    ImageWriter writer(fromCL.frameWriter,fromCL.outFileName);
+    double t_path_begin = getCurrentTime();
+    double t_rendering = 0.;
     for (int frameID=0;frameID<fromCL.cameraPath.size();frameID++) {
       hs::Camera camera;
       auto c = fromCL.cameraPath[frameID];
@@ -835,72 +1431,44 @@ int main(int ac, char **av)
       //   = (1.f-f)*fromCL.cameraPath.vp0 + f*fromCL.cameraPath.vp1;
       // camera.vi
       //   = (1.f-f)*fromCL.cameraPath.vi0 + f*fromCL.cameraPath.vi1;
+      double t0 = getCurrentTime();
       renderer->setCamera(camera);
       renderer->renderFrame();
-      stbi_flip_vertically_on_write(true);
-      char suffix[100];
-      sprintf(suffix,"_frame%05i.png",frameID);
-      std::string fileName = fromCL.outFileName+std::string(suffix);
-      std::cout << " ... saving frame " << fileName << std::endl;
-      stbi_write_png(fileName.c_str(),fbSize.x,fbSize.y,4,
-                     pixels.data(),fbSize.x*sizeof(uint32_t));
+      t_rendering += getCurrentTime()-t0;
+      if (const uint32_t *fb = framePixels()) {
+        std::cout << " ... saving frame " << writer.fileNameFor(frameID) << std::endl;
+        writer.write(frameID,fbSize,fb);
+      }
     }
+    writer.finish();
+    double t_path = getCurrentTime()-t_path_begin;
+    std::cout << "camera path: " << writer.stats.numFrames << " frames in "
+              << prettyDouble(t_path) << "s (rendering "
+              << prettyDouble(t_rendering) << "s, encoding "
+              << prettyDouble(writer.stats.encodeTime) << "s on "
+              << writer.config.numThreads << " thread(s), stalled on encoder "
+              << prettyDouble(writer.stats.stallTime) << "s)" << std::endl;
     renderer->terminate();
+    hs::trace::finish(world);
     world.barrier();
     hs::mpi::finalize();
     exit(0);
   }
   
-#if 1
-  if (fromCL.measure) {
-    int numFramesRendered = 0;
-    const int measure_warmup_frames = 2;
-    const int measure_max_frames = 100;
-    const float measure_max_seconds = 60.f;
-    double measure_t0 = 0.;
-
-    while (true) {
-      if (numFramesRendered == measure_warmup_frames)
-        measure_t0 = getCurrentTime();
-      
-      double t0 = getCurrentTime();
-      renderer->renderFrame();
-      ++numFramesRendered;
-      double t1 = getCurrentTime();
-      
-      int numFramesMeasured = numFramesRendered - measure_warmup_frames;
-      float numSecondsMeasured
-        = (numFramesMeasured < 1)
-        ? 0.f
-        : float(t1 - measure_t0);
-      if (numFramesMeasured >= measure_max_frames ||
-          numSecondsMeasured >= measure_max_seconds) {
-        std::cout << "measure: rendered " << numFramesMeasured << " frames in " << numSecondsMeasured << ", that is:" << std::endl;
-        std::cout << "FPS " << double(numFramesMeasured/numSecondsMeasured) << std::endl;
-        stbi_flip_vertically_on_write(true);
-        std::cout << "saving in " << fromCL.outFileName.c_str() << std::endl;
-        stbi_write_png(fromCL.outFileName.c_str(),fbSize.x,fbSize.y,4,
-                       pixels.data(),fbSize.x*sizeof(uint32_t));
-        
-        renderer->terminate();
-        world.barrier();
-        hs::mpi::finalize();
-        exit(0);
-      }
-    }
-  }
-#endif
   for (int i=0;i<fromCL.numFramesAccum;i++) 
     renderer->renderFrame();
 
-  stbi_flip_vertically_on_write(true);
-  std::cout << "saving in " << fromCL.outFileName.c_str() << std::endl;
-  stbi_write_png(fromCL.outFileName.c_str(),fbSize.x,fbSize.y,4,
-                 pixels.data(),fbSize.x*sizeof(uint32_t));
+  if (const uint32_t *fb = framePixels()) {
+    stbi_flip_vertically_on_write(true);
+    std::cout << "saving in " << fromCL.outFileName.c_str() << std::endl;
+    stbi_write_png(fromCL.outFileName.c_str(),fbSize.x,fbSize.y,4,
+                   fb,fbSize.x*sizeof(uint32_t));
+  }
 
   renderer->terminate();
 #endif
 
+  hs::trace::finish(world);
   world.barrier();
   hs::mpi::finalize();
 